@@ -24,6 +24,7 @@
 #endif
 
 #include <winpr/crt.h>
+#include <winpr/interlocked.h>
 #include <winpr/stream.h>
 
 #include <freerdp/channels/drdynvc.h>
@@ -191,25 +192,94 @@ static const char* dvcman_get_channel_name(IWTSVirtualChannel* channel)
 	return dvc->channel_name;
 }
 
+static UINT32 dvcman_channel_id_hash(const void* key)
+{
+	const UINT32* ChannelId = (const UINT32*)key;
+	WINPR_ASSERT(ChannelId);
+	return *ChannelId;
+}
+
+static BOOL dvcman_channel_id_equals(const void* key1, const void* key2)
+{
+	const UINT32* ChannelId1 = (const UINT32*)key1;
+	const UINT32* ChannelId2 = (const UINT32*)key2;
+
+	if (!ChannelId1 || !ChannelId2)
+		return (ChannelId1 == ChannelId2);
+
+	return *ChannelId1 == *ChannelId2;
+}
+
+/**
+ * Looks up a channel by id. With bRef set a reference is taken that keeps the channel
+ * alive until dvcman_channel_unref, even if it is closed concurrently.
+ */
+static DVCMAN_CHANNEL* dvcman_get_channel_by_id(DVCMAN* dvcman, UINT32 ChannelId, BOOL bRef)
+{
+	DVCMAN_CHANNEL* channel;
+
+	WINPR_ASSERT(dvcman);
+
+	EnterCriticalSection(&dvcman->lock);
+	channel = (DVCMAN_CHANNEL*)HashTable_GetItemValue(dvcman->channels, &ChannelId);
+
+	if (channel && bRef)
+		InterlockedIncrement(&channel->refCount);
+
+	LeaveCriticalSection(&dvcman->lock);
+	return channel;
+}
+
+static void dvcman_channel_unref(DVCMAN_CHANNEL* channel)
+{
+	if (!channel)
+		return;
+
+	if (InterlockedDecrement(&channel->refCount) == 0)
+		dvcman_channel_free(channel);
+}
+
 static IWTSVirtualChannel* dvcman_find_channel_by_id(IWTSVirtualChannelManager* pChannelMgr,
                                                      UINT32 ChannelId)
+{
+	DVCMAN_CHANNEL* channel = dvcman_get_channel_by_id((DVCMAN*)pChannelMgr, ChannelId, FALSE);
+
+	if (!channel)
+		return NULL;
+
+	return &channel->iface;
+}
+
+/* Removes all channels from the manager and drops the reference the manager holds on them */
+static void dvcman_clear_channels(DVCMAN* dvcman)
 {
 	size_t index;
-	IWTSVirtualChannel* channel = NULL;
-	DVCMAN* dvcman = (DVCMAN*)pChannelMgr;
-	ArrayList_Lock(dvcman->channels);
-	for (index = 0; index < ArrayList_Count(dvcman->channels); index++)
-	{
-		DVCMAN_CHANNEL* cur = (DVCMAN_CHANNEL*)ArrayList_GetItem(dvcman->channels, index);
-		if (cur->channel_id == ChannelId)
-		{
-			channel = &cur->iface;
-			break;
-		}
-	}
+	size_t count;
+	ULONG_PTR* keys = NULL;
+	DVCMAN_CHANNEL** channels = NULL;
 
-	ArrayList_Unlock(dvcman->channels);
-	return channel;
+	WINPR_ASSERT(dvcman);
+
+	if (!dvcman->channels)
+		return;
+
+	EnterCriticalSection(&dvcman->lock);
+	count = HashTable_GetKeys(dvcman->channels, &keys);
+
+	if (count > 0)
+		channels = (DVCMAN_CHANNEL**)calloc(count, sizeof(DVCMAN_CHANNEL*));
+
+	for (index = 0; channels && (index < count); index++)
+		channels[index] = HashTable_GetItemValue(dvcman->channels, (const void*)keys[index]);
+
+	HashTable_Clear(dvcman->channels);
+	LeaveCriticalSection(&dvcman->lock);
+
+	for (index = 0; channels && (index < count); index++)
+		dvcman_channel_unref(channels[index]);
+
+	free(channels);
+	free(keys);
 }
 
 static void dvcman_plugin_terminate(void* plugin)
@@ -235,19 +305,28 @@ static IWTSVirtualChannelManager* dvcman_new(drdynvcPlugin* plugin)
 	if (!dvcman)
 		return NULL;
 
+	if (!InitializeCriticalSectionAndSpinCount(&dvcman->lock, 4000))
+	{
+		free(dvcman);
+		return NULL;
+	}
+
 	dvcman->iface.CreateListener = dvcman_create_listener;
 	dvcman->iface.DestroyListener = dvcman_destroy_listener;
 	dvcman->iface.FindChannelById = dvcman_find_channel_by_id;
 	dvcman->iface.GetChannelId = dvcman_get_channel_id;
 	dvcman->iface.GetChannelName = dvcman_get_channel_name;
 	dvcman->drdynvc = plugin;
-	dvcman->channels = ArrayList_New(TRUE);
+	dvcman->channels = HashTable_New(FALSE);
 
 	if (!dvcman->channels)
 		goto fail;
 
-	obj = ArrayList_Object(dvcman->channels);
-	obj->fnObjectFree = dvcman_channel_free;
+	if (!HashTable_SetHashFunction(dvcman->channels, dvcman_channel_id_hash))
+		goto fail;
+
+	obj = HashTable_KeyObject(dvcman->channels);
+	obj->fnObjectEquals = dvcman_channel_id_equals;
 
 	dvcman->pool = StreamPool_New(TRUE, 10);
 	if (!dvcman->pool)
@@ -311,7 +390,7 @@ static DVCMAN_CHANNEL* dvcman_channel_new(drdynvcPlugin* drdynvc,
 {
 	DVCMAN_CHANNEL* channel;
 
-	if (dvcman_find_channel_by_id(pChannelMgr, ChannelId))
+	if (dvcman_get_channel_by_id((DVCMAN*)pChannelMgr, ChannelId, FALSE))
 	{
 		WLog_Print(drdynvc->log, WLOG_ERROR,
 		           "Protocol error: Duplicated ChannelId %" PRIu32 " (%s)!", ChannelId,
@@ -326,6 +405,7 @@ static DVCMAN_CHANNEL* dvcman_channel_new(drdynvcPlugin* drdynvc,
 
 	channel->dvcman = (DVCMAN*)pChannelMgr;
 	channel->channel_id = ChannelId;
+	channel->refCount = 1;
 	channel->channel_name = _strdup(ChannelName);
 
 	if (!channel->channel_name)
@@ -391,7 +471,7 @@ static void dvcman_clear(drdynvcPlugin* drdynvc, IWTSVirtualChannelManager* pCha
 	WINPR_UNUSED(drdynvc);
 
 	ArrayList_Clear(dvcman->plugins);
-	ArrayList_Clear(dvcman->channels);
+	dvcman_clear_channels(dvcman);
 	ArrayList_Clear(dvcman->plugin_names);
 	ArrayList_Clear(dvcman->listeners);
 }
@@ -402,11 +482,13 @@ static void dvcman_free(drdynvcPlugin* drdynvc, IWTSVirtualChannelManager* pChan
 	WINPR_UNUSED(drdynvc);
 
 	ArrayList_Free(dvcman->plugins);
-	ArrayList_Free(dvcman->channels);
+	dvcman_clear_channels(dvcman);
+	HashTable_Free(dvcman->channels);
 	ArrayList_Free(dvcman->plugin_names);
 	ArrayList_Free(dvcman->listeners);
 
 	StreamPool_Free(dvcman->pool);
+	DeleteCriticalSection(&dvcman->lock);
 	free(dvcman);
 }
 
@@ -491,6 +573,7 @@ static UINT dvcman_create_channel(drdynvcPlugin* drdynvc, IWTSVirtualChannelMana
                                   UINT32 ChannelId, const char* ChannelName)
 {
 	size_t i;
+	BOOL rc;
 	BOOL bAccept;
 	DVCMAN_CHANNEL* channel;
 	DrdynvcClientContext* context;
@@ -504,8 +587,15 @@ static UINT dvcman_create_channel(drdynvcPlugin* drdynvc, IWTSVirtualChannelMana
 	}
 
 	channel->status = ERROR_NOT_CONNECTED;
-	if (!ArrayList_Append(dvcman->channels, channel))
+	EnterCriticalSection(&dvcman->lock);
+	rc = HashTable_Insert(dvcman->channels, &channel->channel_id, channel);
+	LeaveCriticalSection(&dvcman->lock);
+
+	if (!rc)
+	{
+		dvcman_channel_free(channel);
 		return ERROR_INTERNAL_ERROR;
+	}
 
 	ArrayList_Lock(dvcman->listeners);
 	for (i = 0; i < ArrayList_Count(dvcman->listeners); i++)
@@ -574,8 +664,8 @@ static UINT dvcman_open_channel(drdynvcPlugin* drdynvc, IWTSVirtualChannelManage
 {
 	DVCMAN_CHANNEL* channel;
 	IWTSVirtualChannelCallback* pCallback;
-	UINT error;
-	channel = (DVCMAN_CHANNEL*)dvcman_find_channel_by_id(pChannelMgr, ChannelId);
+	UINT error = CHANNEL_RC_OK;
+	channel = dvcman_get_channel_by_id((DVCMAN*)pChannelMgr, ChannelId, TRUE);
 
 	if (!channel)
 	{
@@ -594,14 +684,16 @@ static UINT dvcman_open_channel(drdynvcPlugin* drdynvc, IWTSVirtualChannelManage
 			{
 				WLog_Print(drdynvc->log, WLOG_ERROR, "OnOpen failed with error %" PRIu32 "!",
 				           error);
-				return error;
+				goto fail;
 			}
 		}
 
 		WLog_Print(drdynvc->log, WLOG_DEBUG, "open_channel: ChannelId %" PRIu32 "", ChannelId);
 	}
 
-	return CHANNEL_RC_OK;
+fail:
+	dvcman_channel_unref(channel);
+	return error;
 }
 
 /**
@@ -616,7 +708,8 @@ UINT dvcman_close_channel(IWTSVirtualChannelManager* pChannelMgr, UINT32 Channel
 	UINT error = CHANNEL_RC_OK;
 	DVCMAN* dvcman = (DVCMAN*)pChannelMgr;
 	drdynvcPlugin* drdynvc = dvcman->drdynvc;
-	channel = (DVCMAN_CHANNEL*)dvcman_find_channel_by_id(pChannelMgr, ChannelId);
+	BOOL removed;
+	channel = dvcman_get_channel_by_id(dvcman, ChannelId, TRUE);
 
 	if (!channel)
 	{
@@ -644,7 +737,16 @@ UINT dvcman_close_channel(IWTSVirtualChannelManager* pChannelMgr, UINT32 Channel
 		}
 	}
 
-	ArrayList_Remove(dvcman->channels, channel);
+	EnterCriticalSection(&dvcman->lock);
+	removed = HashTable_Remove(dvcman->channels, &channel->channel_id);
+	LeaveCriticalSection(&dvcman->lock);
+
+	/* Drop the reference held by the manager, the channel is freed once the receive path
+	 * is done with it */
+	if (removed)
+		dvcman_channel_unref(channel);
+
+	dvcman_channel_unref(channel);
 	return error;
 }
 
@@ -657,8 +759,9 @@ static UINT dvcman_receive_channel_data_first(drdynvcPlugin* drdynvc,
                                               IWTSVirtualChannelManager* pChannelMgr,
                                               UINT32 ChannelId, UINT32 length)
 {
+	UINT status = CHANNEL_RC_OK;
 	DVCMAN_CHANNEL* channel;
-	channel = (DVCMAN_CHANNEL*)dvcman_find_channel_by_id(pChannelMgr, ChannelId);
+	channel = dvcman_get_channel_by_id((DVCMAN*)pChannelMgr, ChannelId, TRUE);
 
 	if (!channel)
 	{
@@ -679,11 +782,13 @@ static UINT dvcman_receive_channel_data_first(drdynvcPlugin* drdynvc,
 	if (!channel->dvc_data)
 	{
 		WLog_Print(drdynvc->log, WLOG_ERROR, "StreamPool_Take failed!");
-		return CHANNEL_RC_NO_MEMORY;
+		status = CHANNEL_RC_NO_MEMORY;
 	}
+	else
+		channel->dvc_data_length = length;
 
-	channel->dvc_data_length = length;
-	return CHANNEL_RC_OK;
+	dvcman_channel_unref(channel);
+	return status;
 }
 
 /**
@@ -698,7 +803,7 @@ static UINT dvcman_receive_channel_data(drdynvcPlugin* drdynvc,
 	UINT status = CHANNEL_RC_OK;
 	DVCMAN_CHANNEL* channel;
 	size_t dataSize = Stream_GetRemainingLength(data);
-	channel = (DVCMAN_CHANNEL*)dvcman_find_channel_by_id(pChannelMgr, ChannelId);
+	channel = dvcman_get_channel_by_id((DVCMAN*)pChannelMgr, ChannelId, TRUE);
 
 	if (!channel)
 	{
@@ -716,7 +821,8 @@ static UINT dvcman_receive_channel_data(drdynvcPlugin* drdynvc,
 			WLog_Print(drdynvc->log, WLOG_ERROR, "data exceeding declared length!");
 			Stream_Release(channel->dvc_data);
 			channel->dvc_data = NULL;
-			return ERROR_INVALID_DATA;
+			status = ERROR_INVALID_DATA;
+			goto fail;
 		}
 
 		Stream_Copy(data, channel->dvc_data, dataSize);
@@ -736,6 +842,8 @@ static UINT dvcman_receive_channel_data(drdynvcPlugin* drdynvc,
 		status = channel->channel_callback->OnDataReceived(channel->channel_callback, data);
 	}
 
+fail:
+	dvcman_channel_unref(channel);
 	return status;
 }
 
@@ -1406,23 +1514,28 @@ static DWORD WINAPI drdynvc_virtual_channel_client_thread(LPVOID arg)
 		/* Disconnect remaining dynamic channels that the server did not.
 		 * This is required to properly shut down channels by calling the appropriate
 		 * event handlers. */
+		size_t index;
 		size_t count = 0;
+		UINT32* ids = NULL;
+		ULONG_PTR* keys = NULL;
 		DVCMAN* drdynvcMgr = (DVCMAN*)drdynvc->channel_mgr;
 
-		do
-		{
-			ArrayList_Lock(drdynvcMgr->channels);
-			count = ArrayList_Count(drdynvcMgr->channels);
-			if (count > 0)
-			{
-				IWTSVirtualChannel* channel =
-				    (IWTSVirtualChannel*)ArrayList_GetItem(drdynvcMgr->channels, 0);
-				const UINT32 ChannelId = drdynvc->channel_mgr->GetChannelId(channel);
-				dvcman_close_channel(drdynvc->channel_mgr, ChannelId, FALSE);
-				count--;
-			}
-			ArrayList_Unlock(drdynvcMgr->channels);
-		} while (count > 0);
+		EnterCriticalSection(&drdynvcMgr->lock);
+		count = HashTable_GetKeys(drdynvcMgr->channels, &keys);
+
+		if (count > 0)
+			ids = (UINT32*)calloc(count, sizeof(UINT32));
+
+		for (index = 0; ids && (index < count); index++)
+			ids[index] = *(const UINT32*)keys[index];
+
+		LeaveCriticalSection(&drdynvcMgr->lock);
+
+		for (index = 0; ids && (index < count); index++)
+			dvcman_close_channel(drdynvc->channel_mgr, ids[index], FALSE);
+
+		free(ids);
+		free(keys);
 	}
 
 	if (error && drdynvc->rdpcontext)
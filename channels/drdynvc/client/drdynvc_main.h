@@ -47,7 +47,10 @@ struct _DVCMAN
 	wArrayList* plugins;
 
 	wArrayList* listeners;
-	wArrayList* channels;
+	/* lock is held only to look up, insert or remove channels, the channels themselves are
+	 * kept alive by their reference count */
+	CRITICAL_SECTION lock;
+	wHashTable* channels;
 	wStreamPool* pool;
 };
 typedef struct _DVCMAN DVCMAN;
@@ -87,6 +90,7 @@ struct _DVCMAN_CHANNEL
 	wStream* dvc_data;
 	UINT32 dvc_data_length;
 	CRITICAL_SECTION lock;
+	LONG refCount;
 };
 typedef struct _DVCMAN_CHANNEL DVCMAN_CHANNEL;
 
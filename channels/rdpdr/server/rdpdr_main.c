@@ -48,18 +48,59 @@ static void rdpdr_server_irp_free(RDPDR_IRP* irp)
 	free(irp);
 }
 
+static UINT32 rdpdr_server_next_completion_id(RdpdrServerContext* context)
+{
+	UINT32 completionId;
+
+	/* Completion IDs are allocated from the API callers and the IO threads concurrently.
+	 * 0 is skipped as it can not be used as a hash table key. */
+	do
+	{
+		completionId = (UINT32)InterlockedIncrement(&context->priv->NextCompletionId);
+	} while (completionId == 0);
+
+	return completionId;
+}
+
 static BOOL rdpdr_server_enqueue_irp(RdpdrServerContext* context, RDPDR_IRP* irp)
 {
-	return ListDictionary_Add(context->priv->IrpList, (void*)(size_t)irp->CompletionId, irp);
+	BOOL rc;
+	EnterCriticalSection(&context->priv->IrpLock);
+	rc = HashTable_Insert(context->priv->IrpTable, (void*)(size_t)irp->CompletionId, irp);
+	LeaveCriticalSection(&context->priv->IrpLock);
+	return rc;
 }
 
 static RDPDR_IRP* rdpdr_server_dequeue_irp(RdpdrServerContext* context, UINT32 completionId)
 {
 	RDPDR_IRP* irp;
-	irp = (RDPDR_IRP*)ListDictionary_Remove(context->priv->IrpList, (void*)(size_t)completionId);
+	EnterCriticalSection(&context->priv->IrpLock);
+	irp = (RDPDR_IRP*)HashTable_GetItemValue(context->priv->IrpTable, (void*)(size_t)completionId);
+
+	if (irp)
+		HashTable_Remove(context->priv->IrpTable, (void*)(size_t)completionId);
+
+	LeaveCriticalSection(&context->priv->IrpLock);
 	return irp;
 }
 
+static BOOL rdpdr_server_free_irp_cb(const void* key, void* value, void* arg)
+{
+	WINPR_UNUSED(key);
+	WINPR_UNUSED(arg);
+	rdpdr_server_irp_free((RDPDR_IRP*)value);
+	return TRUE;
+}
+
+static void rdpdr_server_dump_stream(wStream* s)
+{
+	wLog* log = WLog_Get(TAG);
+
+	/* Read completions are large, do not format them unless debug logging is enabled */
+	if (WLog_IsLevelActive(log, WLOG_DEBUG))
+		winpr_HexLogDump(log, WLOG_DEBUG, Stream_Buffer(s), Stream_Length(s));
+}
+
 static UINT rdpdr_seal_send_free_request(RdpdrServerContext* context, wStream* s)
 {
 	BOOL status;
@@ -72,7 +113,7 @@ static UINT rdpdr_seal_send_free_request(RdpdrServerContext* context, wStream* s
 	Stream_SealLength(s);
 	length = Stream_Length(s);
 	WINPR_ASSERT(length <= ULONG_MAX);
-	winpr_HexDump(TAG, WLOG_DEBUG, Stream_Buffer(s), Stream_Length(s));
+	rdpdr_server_dump_stream(s);
 	status = WTSVirtualChannelWrite(context->priv->ChannelHandle, (PCHAR)Stream_Buffer(s),
 	                                (ULONG)length, &written);
 	Stream_Free(s, TRUE);
@@ -950,8 +991,9 @@ static UINT rdpdr_server_receive_device_io_completion(RdpdrServerContext* contex
 	UINT32 deviceId;
 	UINT32 completionId;
 	UINT32 ioStatus;
+	size_t index;
 	RDPDR_IRP* irp;
-	UINT error = CHANNEL_RC_OK;
+	wStream* completion;
 
 	WINPR_UNUSED(header);
 
@@ -974,13 +1016,97 @@ static UINT rdpdr_server_receive_device_io_completion(RdpdrServerContext* contex
 		return ERROR_INTERNAL_ERROR;
 	}
 
-	/* Invoke the callback. */
-	if (irp->Callback)
+	if (!irp->Callback)
 	{
-		error = (*irp->Callback)(context, s, irp, deviceId, completionId, ioStatus);
+		rdpdr_server_irp_free(irp);
+		return CHANNEL_RC_OK;
 	}
 
-	return error;
+	/* The completion is the last PDU in the channel message, hand it over to the IO
+	 * thread serving the file handle so the receive thread can go on reading. */
+	completion = Stream_New(NULL, 12 + Stream_GetRemainingLength(s));
+
+	if (!completion)
+	{
+		WLog_ERR(TAG, "Stream_New failed!");
+		rdpdr_server_irp_free(irp);
+		return CHANNEL_RC_NO_MEMORY;
+	}
+
+	Stream_Write_UINT32(completion, deviceId);
+	Stream_Write_UINT32(completion, completionId);
+	Stream_Write_UINT32(completion, ioStatus);
+	Stream_Copy(s, completion, Stream_GetRemainingLength(s));
+	Stream_SealLength(completion);
+	Stream_SetPosition(completion, 0);
+	index = (irp->DeviceId * 31 + irp->FileId) % RDPDR_SERVER_IO_WORKERS;
+
+	if (!MessageQueue_Post(context->priv->IoQueues[index], context, 0, irp, completion))
+	{
+		WLog_ERR(TAG, "MessageQueue_Post failed!");
+		Stream_Free(completion, TRUE);
+		rdpdr_server_irp_free(irp);
+		return ERROR_INTERNAL_ERROR;
+	}
+
+	return CHANNEL_RC_OK;
+}
+
+static void rdpdr_server_io_message_free(void* obj)
+{
+	wMessage* message = (wMessage*)obj;
+
+	if (!message || (message->id == WMQ_QUIT))
+		return;
+
+	rdpdr_server_irp_free((RDPDR_IRP*)message->wParam);
+	Stream_Free((wStream*)message->lParam, TRUE);
+}
+
+static DWORD WINAPI rdpdr_server_io_thread(LPVOID arg)
+{
+	wMessage message;
+	wMessageQueue* queue = (wMessageQueue*)arg;
+
+	while (MessageQueue_Wait(queue))
+	{
+		UINT error;
+		UINT32 deviceId;
+		UINT32 completionId;
+		UINT32 ioStatus;
+		RdpdrServerContext* context;
+		RDPDR_IRP* irp;
+		wStream* s;
+
+		if (!MessageQueue_Peek(queue, &message, TRUE))
+			continue;
+
+		if (message.id == WMQ_QUIT)
+			break;
+
+		context = (RdpdrServerContext*)message.context;
+		irp = (RDPDR_IRP*)message.wParam;
+		s = (wStream*)message.lParam;
+		Stream_Read_UINT32(s, deviceId);
+		Stream_Read_UINT32(s, completionId);
+		Stream_Read_UINT32(s, ioStatus);
+
+		/* The callback takes ownership of the IRP */
+		error = irp->Callback(context, s, irp, deviceId, completionId, ioStatus);
+		Stream_Free(s, TRUE);
+
+		if (error)
+		{
+			WLog_ERR(TAG, "IRP callback failed with error %" PRIu32 "!", error);
+
+			if (context->rdpcontext)
+				setChannelError(context->rdpcontext, error,
+				                "rdpdr_server_io_thread reported an error");
+		}
+	}
+
+	ExitThread(0);
+	return 0;
 }
 
 /**
@@ -1018,7 +1144,7 @@ static UINT rdpdr_server_receive_pdu(RdpdrServerContext* context, wStream* s, RD
 	UINT error = CHANNEL_RC_OK;
 	WLog_DBG(TAG, "RdpdrServerReceivePdu: Component: 0x%04" PRIX16 " PacketId: 0x%04" PRIX16 "",
 	         header->Component, header->PacketId);
-	winpr_HexDump(TAG, WLOG_DEBUG, Stream_Buffer(s), Stream_Length(s));
+	rdpdr_server_dump_stream(s);
 
 	if (header->Component == RDPDR_CTYP_CORE)
 	{
@@ -1225,6 +1351,24 @@ static DWORD WINAPI rdpdr_server_thread(LPVOID arg)
 		if (status == WAIT_OBJECT_0)
 			break;
 
+		/* Read completions carry up to a full read length, size the buffer to the message */
+		if (!WTSVirtualChannelRead(context->priv->ChannelHandle, 0, NULL, 0, &BytesReturned))
+		{
+			if (GetLastError() == ERROR_NO_DATA)
+				continue;
+
+			WLog_ERR(TAG, "WTSVirtualChannelRead failed!");
+			error = ERROR_INTERNAL_ERROR;
+			break;
+		}
+
+		if (!Stream_EnsureCapacity(s, BytesReturned))
+		{
+			WLog_ERR(TAG, "Stream_EnsureCapacity failed!");
+			error = CHANNEL_RC_NO_MEMORY;
+			break;
+		}
+
 		capacity = MIN(Stream_Capacity(s), ULONG_MAX);
 		if (!WTSVirtualChannelRead(context->priv->ChannelHandle, 0, (PCHAR)Stream_Buffer(s),
 		                           (ULONG)capacity, &BytesReturned))
@@ -1264,6 +1408,22 @@ out:
 	return error;
 }
 
+static void rdpdr_server_stop_io_threads(RdpdrServerContext* context)
+{
+	size_t x;
+
+	for (x = 0; x < RDPDR_SERVER_IO_WORKERS; x++)
+	{
+		if (!context->priv->IoThreads[x])
+			continue;
+
+		MessageQueue_PostQuit(context->priv->IoQueues[x], 0);
+		WaitForSingleObject(context->priv->IoThreads[x], INFINITE);
+		CloseHandle(context->priv->IoThreads[x]);
+		context->priv->IoThreads[x] = NULL;
+	}
+}
+
 /**
  * Function description
  *
@@ -1271,6 +1431,8 @@ out:
  */
 static UINT rdpdr_server_start(RdpdrServerContext* context)
 {
+	size_t x;
+
 	context->priv->ChannelHandle =
 	    WTSVirtualChannelOpen(context->vcm, WTS_CURRENT_SESSION, "rdpdr");
 
@@ -1286,10 +1448,24 @@ static UINT rdpdr_server_start(RdpdrServerContext* context)
 		return ERROR_INTERNAL_ERROR;
 	}
 
+	for (x = 0; x < RDPDR_SERVER_IO_WORKERS; x++)
+	{
+		if (!(context->priv->IoThreads[x] = CreateThread(
+		          NULL, 0, rdpdr_server_io_thread, (void*)context->priv->IoQueues[x], 0, NULL)))
+		{
+			WLog_ERR(TAG, "CreateThread failed!");
+			rdpdr_server_stop_io_threads(context);
+			CloseHandle(context->priv->StopEvent);
+			context->priv->StopEvent = NULL;
+			return ERROR_INTERNAL_ERROR;
+		}
+	}
+
 	if (!(context->priv->Thread =
 	          CreateThread(NULL, 0, rdpdr_server_thread, (void*)context, 0, NULL)))
 	{
 		WLog_ERR(TAG, "CreateThread failed!");
+		rdpdr_server_stop_io_threads(context);
 		CloseHandle(context->priv->StopEvent);
 		context->priv->StopEvent = NULL;
 		return ERROR_INTERNAL_ERROR;
@@ -1322,6 +1498,7 @@ static UINT rdpdr_server_stop(RdpdrServerContext* context)
 		context->priv->Thread = NULL;
 		CloseHandle(context->priv->StopEvent);
 		context->priv->StopEvent = NULL;
+		rdpdr_server_stop_io_threads(context);
 	}
 
 	return CHANNEL_RC_OK;
@@ -1683,7 +1860,7 @@ static UINT rdpdr_server_drive_create_directory_callback1(RdpdrServerContext* co
 	Stream_Read_UINT32(s, fileId);     /* FileId (4 bytes) */
 	Stream_Read_UINT8(s, information); /* Information (1 byte) */
 	/* Setup the IRP. */
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_create_directory_callback2;
 	irp->DeviceId = deviceId;
 	irp->FileId = fileId;
@@ -1716,7 +1893,7 @@ static UINT rdpdr_server_drive_create_directory(RdpdrServerContext* context, voi
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_create_directory_callback1;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -1796,7 +1973,7 @@ static UINT rdpdr_server_drive_delete_directory_callback1(RdpdrServerContext* co
 	Stream_Read_UINT32(s, fileId);     /* FileId (4 bytes) */
 	Stream_Read_UINT8(s, information); /* Information (1 byte) */
 	/* Setup the IRP. */
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_delete_directory_callback2;
 	irp->DeviceId = deviceId;
 	irp->FileId = fileId;
@@ -1829,7 +2006,7 @@ static UINT rdpdr_server_drive_delete_directory(RdpdrServerContext* context, voi
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_delete_directory_callback1;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -1905,7 +2082,7 @@ static UINT rdpdr_server_drive_query_directory_callback2(RdpdrServerContext* con
 		context->OnDriveQueryDirectoryComplete(context, irp->CallbackData, ioStatus,
 		                                       length > 0 ? &fdi : NULL);
 		/* Setup the IRP. */
-		irp->CompletionId = context->priv->NextCompletionId++;
+		irp->CompletionId = rdpdr_server_next_completion_id(context);
 		irp->Callback = rdpdr_server_drive_query_directory_callback2;
 
 		if (!rdpdr_server_enqueue_irp(context, irp))
@@ -1962,7 +2139,7 @@ static UINT rdpdr_server_drive_query_directory_callback1(RdpdrServerContext* con
 
 	Stream_Read_UINT32(s, fileId);
 	/* Setup the IRP. */
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_query_directory_callback2;
 	irp->DeviceId = deviceId;
 	irp->FileId = fileId;
@@ -1997,7 +2174,7 @@ static UINT rdpdr_server_drive_query_directory(RdpdrServerContext* context, void
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_query_directory_callback1;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -2070,7 +2247,7 @@ static UINT rdpdr_server_drive_open_file(RdpdrServerContext* context, void* call
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_open_file_callback;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -2155,7 +2332,7 @@ static UINT rdpdr_server_drive_read_file(RdpdrServerContext* context, void* call
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_read_file_callback;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -2232,7 +2409,7 @@ static UINT rdpdr_server_drive_write_file(RdpdrServerContext* context, void* cal
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_write_file_callback;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -2293,7 +2470,7 @@ static UINT rdpdr_server_drive_close_file(RdpdrServerContext* context, void* cal
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_close_file_callback;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -2370,7 +2547,7 @@ static UINT rdpdr_server_drive_delete_file_callback1(RdpdrServerContext* context
 	Stream_Read_UINT32(s, fileId);     /* FileId (4 bytes) */
 	Stream_Read_UINT8(s, information); /* Information (1 byte) */
 	/* Setup the IRP. */
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_delete_file_callback2;
 	irp->DeviceId = deviceId;
 	irp->FileId = fileId;
@@ -2403,7 +2580,7 @@ static UINT rdpdr_server_drive_delete_file(RdpdrServerContext* context, void* ca
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_delete_file_callback1;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -2474,7 +2651,7 @@ static UINT rdpdr_server_drive_rename_file_callback2(RdpdrServerContext* context
 	/* Invoke the rename file completion routine. */
 	context->OnDriveRenameFileComplete(context, irp->CallbackData, ioStatus);
 	/* Setup the IRP. */
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_rename_file_callback3;
 	irp->DeviceId = deviceId;
 
@@ -2524,7 +2701,7 @@ static UINT rdpdr_server_drive_rename_file_callback1(RdpdrServerContext* context
 	Stream_Read_UINT32(s, fileId);     /* FileId (4 bytes) */
 	Stream_Read_UINT8(s, information); /* Information (1 byte) */
 	/* Setup the IRP. */
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_rename_file_callback2;
 	irp->DeviceId = deviceId;
 	irp->FileId = fileId;
@@ -2559,7 +2736,7 @@ static UINT rdpdr_server_drive_rename_file(RdpdrServerContext* context, void* ca
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	irp->CompletionId = context->priv->NextCompletionId++;
+	irp->CompletionId = rdpdr_server_next_completion_id(context);
 	irp->Callback = rdpdr_server_drive_rename_file_callback1;
 	irp->CallbackData = callbackData;
 	irp->DeviceId = deviceId;
@@ -2583,6 +2760,7 @@ static UINT rdpdr_server_drive_rename_file(RdpdrServerContext* context, void* ca
 
 RdpdrServerContext* rdpdr_server_context_new(HANDLE vcm)
 {
+	size_t x;
 	RdpdrServerContext* context;
 	context = (RdpdrServerContext*)calloc(1, sizeof(RdpdrServerContext));
 
@@ -2613,15 +2791,27 @@ RdpdrServerContext* rdpdr_server_context_new(HANDLE vcm)
 		context->priv->VersionMinor = RDPDR_VERSION_MINOR_RDP6X;
 		context->priv->ClientId = g_ClientId++;
 		context->priv->UserLoggedOnPdu = TRUE;
-		context->priv->NextCompletionId = 1;
-		context->priv->IrpList = ListDictionary_New(TRUE);
+		context->priv->NextCompletionId = 0;
+		InitializeCriticalSection(&context->priv->IrpLock);
+		context->priv->IrpTable = HashTable_New(FALSE);
 
-		if (!context->priv->IrpList)
+		if (!context->priv->IrpTable)
 		{
-			WLog_ERR(TAG, "ListDictionary_New failed!");
-			free(context->priv);
-			free(context);
-			return NULL;
+			WLog_ERR(TAG, "HashTable_New failed!");
+			goto fail;
+		}
+
+		for (x = 0; x < RDPDR_SERVER_IO_WORKERS; x++)
+		{
+			wObject obj = { 0 };
+			obj.fnObjectFree = rdpdr_server_io_message_free;
+			context->priv->IoQueues[x] = MessageQueue_New(&obj);
+
+			if (!context->priv->IoQueues[x])
+			{
+				WLog_ERR(TAG, "MessageQueue_New failed!");
+				goto fail;
+			}
 		}
 	}
 	else
@@ -2630,15 +2820,29 @@ RdpdrServerContext* rdpdr_server_context_new(HANDLE vcm)
 	}
 
 	return context;
+fail:
+	rdpdr_server_context_free(context);
+	return NULL;
 }
 
 void rdpdr_server_context_free(RdpdrServerContext* context)
 {
+	size_t x;
+
 	if (context)
 	{
 		if (context->priv)
 		{
-			ListDictionary_Free(context->priv->IrpList);
+			for (x = 0; x < RDPDR_SERVER_IO_WORKERS; x++)
+				MessageQueue_Free(context->priv->IoQueues[x]);
+
+			if (context->priv->IrpTable)
+			{
+				HashTable_Foreach(context->priv->IrpTable, rdpdr_server_free_irp_cb, NULL);
+				HashTable_Free(context->priv->IrpTable);
+			}
+
+			DeleteCriticalSection(&context->priv->IrpLock);
 			free(context->priv);
 		}
 
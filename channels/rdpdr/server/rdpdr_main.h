@@ -31,6 +31,9 @@
 #include <freerdp/settings.h>
 #include <freerdp/server/rdpdr.h>
 
+/* Number of threads completing IRPs, a file handle is always served by the same thread */
+#define RDPDR_SERVER_IO_WORKERS 4
+
 struct _rdpdr_server_private
 {
 	HANDLE Thread;
@@ -44,8 +47,12 @@ struct _rdpdr_server_private
 
 	BOOL UserLoggedOnPdu;
 
-	wListDictionary* IrpList;
-	UINT32 NextCompletionId;
+	CRITICAL_SECTION IrpLock;
+	wHashTable* IrpTable;
+	LONG NextCompletionId;
+
+	HANDLE IoThreads[RDPDR_SERVER_IO_WORKERS];
+	wMessageQueue* IoQueues[RDPDR_SERVER_IO_WORKERS];
 };
 
 #define RDPDR_HEADER_LENGTH 4
@@ -65,6 +65,9 @@
 #define MAX_CONTACTS 64
 #define MAX_PEN_CONTACTS 4
 
+/* Active contacts that did not change are repeated at this interval (ms) */
+#define RDPEI_REPEAT_INTERVAL 20
+
 struct _RDPEI_CHANNEL_CALLBACK
 {
 	IWTSVirtualChannelCallback iface;
@@ -111,6 +114,10 @@ struct _RDPEI_PLUGIN
 	BOOL initialized;
 	HANDLE thread;
 	HANDLE event;
+
+	UINT64 pendingSince; /* time of the oldest contact change not sent yet */
+	UINT64 lastUpdate;   /* time the last frame was sent */
+	RDPEI_INPUT_STATS stats;
 };
 typedef struct _RDPEI_PLUGIN RDPEI_PLUGIN;
 
@@ -179,6 +186,7 @@ static RDPINPUT_CONTACT_POINT* rdpei_contact(RDPEI_PLUGIN* rdpei, INT32 external
 static UINT rdpei_add_frame(RdpeiClientContext* context)
 {
 	UINT16 i;
+	UINT32 changes = 0;
 	RDPEI_PLUGIN* rdpei;
 	RDPINPUT_TOUCH_FRAME frame = { 0 };
 	RDPINPUT_CONTACT_DATA contacts[MAX_CONTACTS] = { 0 };
@@ -199,6 +207,7 @@ static UINT rdpei_add_frame(RdpeiClientContext* context)
 			contacts[frame.contactCount] = *contact;
 			rdpei->contactPoints[i].dirty = FALSE;
 			frame.contactCount++;
+			changes++;
 		}
 		else if (contactPoint->active)
 		{
@@ -228,6 +237,12 @@ static UINT rdpei_add_frame(RdpeiClientContext* context)
 			WLog_ERR(TAG, "rdpei_send_frame failed with error %" PRIu32 "!", error);
 			return error;
 		}
+
+		rdpei->stats.frames++;
+		rdpei->stats.changes += changes;
+
+		if (changes == 0)
+			rdpei->stats.repeats++;
 	}
 	return CHANNEL_RC_OK;
 }
@@ -398,6 +413,8 @@ static UINT rdpei_send_pen_frame(RdpeiClientContext* context, RDPINPUT_PEN_FRAME
 static UINT rdpei_add_pen_frame(RdpeiClientContext* context)
 {
 	UINT16 i;
+	UINT32 changes = 0;
+	UINT error;
 	RDPEI_PLUGIN* rdpei;
 	RDPINPUT_PEN_FRAME penFrame = { 0 };
 	RDPINPUT_PEN_CONTACT penContacts[MAX_PEN_CONTACTS] = { 0 };
@@ -417,6 +434,7 @@ static UINT rdpei_add_pen_frame(RdpeiClientContext* context)
 		{
 			penContacts[penFrame.contactCount++] = contact->data;
 			contact->dirty = FALSE;
+			changes++;
 		}
 		else if (contact->active)
 		{
@@ -436,21 +454,110 @@ static UINT rdpei_add_pen_frame(RdpeiClientContext* context)
 		}
 	}
 
-	if (penFrame.contactCount > 0)
-		return rdpei_send_pen_frame(context, &penFrame);
+	if (penFrame.contactCount == 0)
+		return CHANNEL_RC_OK;
+
+	if ((error = rdpei_send_pen_frame(context, &penFrame)))
+		return error;
+
+	rdpei->stats.frames++;
+	rdpei->stats.changes += changes;
+
+	if (changes == 0)
+		rdpei->stats.repeats++;
+
 	return CHANNEL_RC_OK;
 }
 
+static BOOL rdpei_is_connected(const RDPEI_PLUGIN* rdpei)
+{
+	return rdpei->listener_callback && rdpei->listener_callback->channel_callback;
+}
+
+/**
+ * Sends all changed contacts in one touch and one pen frame, called with the lock held.
+ * While the channel is closed the changes stay queued, they are sent once it is connected.
+ */
 static UINT rdpei_update(RdpeiClientContext* context)
 {
-	UINT error = rdpei_add_frame(context);
+	RDPEI_PLUGIN* rdpei = (RDPEI_PLUGIN*)context->handle;
+	const UINT64 now = GetTickCount64();
+	UINT error;
+
+	if (!rdpei_is_connected(rdpei))
+		return CHANNEL_RC_OK;
+
+	error = rdpei_add_frame(context);
 	if (error != CHANNEL_RC_OK)
 	{
 		WLog_ERR(TAG, "rdpei_add_frame failed with error %" PRIu32 "!", error);
 		return error;
 	}
 
-	return rdpei_add_pen_frame(context);
+	if ((error = rdpei_add_pen_frame(context)))
+		return error;
+
+	if (rdpei->pendingSince)
+	{
+		const UINT64 latency = now - rdpei->pendingSince;
+		rdpei->stats.totalLatency += latency;
+
+		if (latency > rdpei->stats.maxLatency)
+			rdpei->stats.maxLatency = latency;
+
+		rdpei->pendingSince = 0;
+	}
+
+	rdpei->lastUpdate = now;
+	return CHANNEL_RC_OK;
+}
+
+/* Contacts remaining active are repeated, without any the thread sleeps until the next change */
+static DWORD rdpei_update_timeout(RDPEI_PLUGIN* rdpei)
+{
+	size_t x;
+	BOOL active = FALSE;
+	UINT64 now;
+
+	if (!rdpei_is_connected(rdpei))
+		return INFINITE;
+
+	for (x = 0; x < rdpei->maxTouchContacts; x++)
+		active |= rdpei->contactPoints[x].active;
+
+	for (x = 0; x < rdpei->maxPenContacts; x++)
+		active |= rdpei->penContactPoints[x].active;
+
+	if (!active)
+		return INFINITE;
+
+	now = GetTickCount64();
+
+	if (now - rdpei->lastUpdate >= RDPEI_REPEAT_INTERVAL)
+		return 0;
+
+	return (DWORD)(rdpei->lastUpdate + RDPEI_REPEAT_INTERVAL - now);
+}
+
+/**
+ * Marks a contact changed, a pending down or up transition is sent before it is replaced.
+ * While the channel is closed only the newest state is queued and CHANNEL_RC_OK returned.
+ */
+static UINT rdpei_contact_changed(RdpeiClientContext* context, BOOL* dirty, UINT32 pendingFlags)
+{
+	UINT error = CHANNEL_RC_OK;
+	RDPEI_PLUGIN* rdpei = (RDPEI_PLUGIN*)context->handle;
+
+	if (*dirty &&
+	    (pendingFlags & (RDPINPUT_CONTACT_FLAG_DOWN | RDPINPUT_CONTACT_FLAG_UP)))
+		error = rdpei_update(context);
+
+	if (!rdpei->pendingSince)
+		rdpei->pendingSince = GetTickCount64();
+
+	*dirty = TRUE;
+	SetEvent(rdpei->event);
+	return error;
 }
 
 static DWORD WINAPI rdpei_periodic_update(LPVOID arg)
@@ -476,7 +583,13 @@ static DWORD WINAPI rdpei_periodic_update(LPVOID arg)
 
 	while (rdpei->initialized)
 	{
-		status = WaitForSingleObject(rdpei->event, 20);
+		DWORD timeout;
+
+		EnterCriticalSection(&rdpei->lock);
+		timeout = rdpei_update_timeout(rdpei);
+		LeaveCriticalSection(&rdpei->lock);
+
+		status = WaitForSingleObject(rdpei->event, timeout);
 
 		if (status == WAIT_FAILED)
 		{
@@ -487,19 +600,27 @@ static DWORD WINAPI rdpei_periodic_update(LPVOID arg)
 
 		EnterCriticalSection(&rdpei->lock);
 
+		/* Changes made from now on signal the event again */
+		if (status == WAIT_OBJECT_0)
+			ResetEvent(rdpei->event);
+
+		rdpei->stats.wakeups++;
 		error = rdpei_update(context);
+		LeaveCriticalSection(&rdpei->lock);
+
 		if (error != CHANNEL_RC_OK)
 		{
 			WLog_ERR(TAG, "rdpei_add_frame failed with error %" PRIu32 "!", error);
 			break;
 		}
-
-		if (status == WAIT_OBJECT_0)
-			ResetEvent(rdpei->event);
-
-		LeaveCriticalSection(&rdpei->lock);
 	}
 
+	WLog_DBG(TAG,
+	         "%" PRIu64 " wakeups, %" PRIu64 " frames (%" PRIu64 " repeats), %" PRIu64
+	         " contact changes, latency max %" PRIu64 "ms total %" PRIu64 "ms",
+	         rdpei->stats.wakeups, rdpei->stats.frames, rdpei->stats.repeats,
+	         rdpei->stats.changes, rdpei->stats.maxLatency, rdpei->stats.totalLatency);
+
 out:
 
 	if (error && rdpei && rdpei->rdpcontext)
@@ -668,7 +789,7 @@ static UINT rdpei_send_touch_event_pdu(RDPEI_CHANNEL_CALLBACK* callback,
 	UINT status;
 	wStream* s;
 	UINT32 pduLength;
-	RDPEI_PLUGIN* rdpei = (RDPEI_PLUGIN*)callback->plugin->pInterface;
+	RDPEI_PLUGIN* rdpei = (RDPEI_PLUGIN*)callback->plugin;
 	if (!rdpei || !rdpei->rdpcontext)
 		return ERROR_INTERNAL_ERROR;
 	if (freerdp_settings_get_bool(rdpei->rdpcontext->settings, FreeRDP_SuspendInput))
@@ -892,8 +1013,10 @@ static UINT rdpei_on_close(IWTSVirtualChannelCallback* pChannelCallback)
 		RDPEI_PLUGIN* rdpei = (RDPEI_PLUGIN*)callback->plugin;
 		if (rdpei && rdpei->listener_callback)
 		{
+			EnterCriticalSection(&rdpei->lock);
 			if (rdpei->listener_callback->channel_callback == callback)
 				rdpei->listener_callback->channel_callback = NULL;
+			LeaveCriticalSection(&rdpei->lock);
 		}
 	}
 	free(callback);
@@ -909,6 +1032,7 @@ static UINT rdpei_on_new_channel_connection(IWTSListenerCallback* pListenerCallb
                                             IWTSVirtualChannel* pChannel, BYTE* Data,
                                             BOOL* pbAccept, IWTSVirtualChannelCallback** ppCallback)
 {
+	RDPEI_PLUGIN* rdpei;
 	RDPEI_CHANNEL_CALLBACK* callback;
 	RDPEI_LISTENER_CALLBACK* listener_callback = (RDPEI_LISTENER_CALLBACK*)pListenerCallback;
 	if (!listener_callback)
@@ -929,7 +1053,13 @@ static UINT rdpei_on_new_channel_connection(IWTSListenerCallback* pListenerCallb
 	callback->plugin = listener_callback->plugin;
 	callback->channel_mgr = listener_callback->channel_mgr;
 	callback->channel = pChannel;
+	rdpei = (RDPEI_PLUGIN*)listener_callback->plugin;
+
+	/* Contact changes queued while the channel was closed are sent now */
+	EnterCriticalSection(&rdpei->lock);
 	listener_callback->channel_callback = callback;
+	SetEvent(rdpei->event);
+	LeaveCriticalSection(&rdpei->lock);
 	*ppCallback = (IWTSVirtualChannelCallback*)callback;
 	return CHANNEL_RC_OK;
 }
@@ -1047,6 +1177,21 @@ static UINT32 rdpei_get_features(RdpeiClientContext* context)
 	return rdpei->features;
 }
 
+static UINT rdpei_get_stats(RdpeiClientContext* context, RDPEI_INPUT_STATS* stats)
+{
+	RDPEI_PLUGIN* rdpei;
+	if (!context || !context->handle || !stats)
+		return ERROR_INVALID_PARAMETER;
+	rdpei = (RDPEI_PLUGIN*)context->handle;
+	if (!rdpei->initialized)
+		return ERROR_INVALID_STATE;
+
+	EnterCriticalSection(&rdpei->lock);
+	*stats = rdpei->stats;
+	LeaveCriticalSection(&rdpei->lock);
+	return CHANNEL_RC_OK;
+}
+
 /**
  * Function description
  *
@@ -1095,6 +1240,7 @@ static UINT rdpei_add_contact(RdpeiClientContext* context, const RDPINPUT_CONTAC
 {
 	RDPINPUT_CONTACT_POINT* contactPoint;
 	RDPEI_PLUGIN* rdpei;
+	UINT error;
 	if (!context || !contact || !context->handle)
 		return ERROR_INTERNAL_ERROR;
 
@@ -1102,12 +1248,12 @@ static UINT rdpei_add_contact(RdpeiClientContext* context, const RDPINPUT_CONTAC
 
 	EnterCriticalSection(&rdpei->lock);
 	contactPoint = &rdpei->contactPoints[contact->contactId];
+	error =
+	    rdpei_contact_changed(context, &contactPoint->dirty, contactPoint->data.contactFlags);
 	contactPoint->data = *contact;
-	contactPoint->dirty = TRUE;
-	SetEvent(rdpei->event);
 	LeaveCriticalSection(&rdpei->lock);
 
-	return CHANNEL_RC_OK;
+	return error;
 }
 
 static UINT rdpei_touch_process(RdpeiClientContext* context, INT32 externalId, UINT32 contactFlags,
@@ -1299,6 +1445,7 @@ static UINT rdpei_add_pen(RdpeiClientContext* context, INT32 externalId,
 {
 	RDPEI_PLUGIN* rdpei;
 	RDPINPUT_PEN_CONTACT_POINT* contactPoint;
+	UINT error = CHANNEL_RC_OK;
 
 	if (!context || !contact || !context->handle)
 		return ERROR_INTERNAL_ERROR;
@@ -1309,13 +1456,13 @@ static UINT rdpei_add_pen(RdpeiClientContext* context, INT32 externalId,
 	contactPoint = rdpei_pen_contact(rdpei, externalId, TRUE);
 	if (contactPoint)
 	{
+		error =
+		    rdpei_contact_changed(context, &contactPoint->dirty, contactPoint->data.contactFlags);
 		contactPoint->data = *contact;
-		contactPoint->dirty = TRUE;
-		SetEvent(rdpei->event);
 	}
 	LeaveCriticalSection(&rdpei->lock);
 
-	return CHANNEL_RC_OK;
+	return error;
 }
 
 static UINT rdpei_pen_process(RdpeiClientContext* context, INT32 externalId, UINT32 contactFlags,
@@ -1521,6 +1668,7 @@ UINT DVCPluginEntry(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
 		context->PenEnd = rdpei_pen_end;
 		context->PenCancel = rdpei_pen_cancel;
 		context->PenRawEvent = rdpei_pen_raw_event;
+		context->GetStats = rdpei_get_stats;
 
 		rdpei->context = context;
 		rdpei->iface.pInterface = (void*)context;
@@ -0,0 +1,357 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/dvc.h>
+#include <freerdp/client/rdpei.h>
+
+#include "rdpei_common.h"
+
+#ifdef BUILTIN_CHANNELS
+#define TEST_RDPEI_ENTRY rdpei_DVCPluginEntry
+#else
+#define TEST_RDPEI_ENTRY DVCPluginEntry
+#endif
+
+UINT TEST_RDPEI_ENTRY(IDRDYNVC_ENTRY_POINTS* pEntryPoints);
+
+#define TEST_MAX_EVENTS 1024
+
+typedef struct
+{
+	UINT32 contactFlags;
+	INT32 x;
+	INT32 y;
+} test_event;
+
+/* Contacts of the touch frames written to the channel, in order */
+static CRITICAL_SECTION g_Lock;
+static test_event g_Events[TEST_MAX_EVENTS];
+static size_t g_EventCount = 0;
+static size_t g_Frames = 0;
+
+static IWTSPlugin* g_Plugin = NULL;
+static rdpSettings* g_Settings = NULL;
+static IWTSListenerCallback* g_ListenerCallback = NULL;
+static IWTSListener g_Listener = { 0 };
+
+static UINT test_RegisterPlugin(IDRDYNVC_ENTRY_POINTS* pEntryPoints, const char* name,
+                                IWTSPlugin* pPlugin)
+{
+	WINPR_UNUSED(pEntryPoints);
+	WINPR_UNUSED(name);
+	g_Plugin = pPlugin;
+	return CHANNEL_RC_OK;
+}
+
+static IWTSPlugin* test_GetPlugin(IDRDYNVC_ENTRY_POINTS* pEntryPoints, const char* name)
+{
+	WINPR_UNUSED(pEntryPoints);
+	WINPR_UNUSED(name);
+	return g_Plugin;
+}
+
+static const ADDIN_ARGV* test_GetPluginData(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	WINPR_UNUSED(pEntryPoints);
+	return NULL;
+}
+
+static void* test_GetRdpSettings(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	WINPR_UNUSED(pEntryPoints);
+	return g_Settings;
+}
+
+static UINT test_CreateListener(IWTSVirtualChannelManager* pChannelMgr, const char* pszChannelName,
+                                ULONG ulFlags, IWTSListenerCallback* pListenerCallback,
+                                IWTSListener** ppListener)
+{
+	WINPR_UNUSED(pChannelMgr);
+	WINPR_UNUSED(pszChannelName);
+	WINPR_UNUSED(ulFlags);
+	g_ListenerCallback = pListenerCallback;
+	*ppListener = &g_Listener;
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_DestroyListener(IWTSVirtualChannelManager* pChannelMgr, IWTSListener* pListener)
+{
+	WINPR_UNUSED(pChannelMgr);
+	WINPR_UNUSED(pListener);
+	return CHANNEL_RC_OK;
+}
+
+/* Records the first contact of every touch frame */
+static UINT test_Write(IWTSVirtualChannel* pChannel, ULONG cbSize, const BYTE* pBuffer,
+                       void* pReserved)
+{
+	wStream sbuffer = { 0 };
+	wStream* s = &sbuffer;
+	UINT16 eventId;
+	UINT16 frameCount;
+	UINT16 contactCount;
+	UINT16 fieldsPresent;
+	UINT32 encodeTime;
+	UINT64 frameOffset;
+	test_event event = { 0 };
+	WINPR_UNUSED(pChannel);
+	WINPR_UNUSED(pReserved);
+
+	Stream_StaticInit(s, (BYTE*)pBuffer, cbSize);
+
+	if (Stream_GetRemainingLength(s) < 6)
+		return ERROR_INVALID_DATA;
+
+	Stream_Read_UINT16(s, eventId);
+	Stream_Seek_UINT32(s); /* pduLength */
+
+	if (eventId != EVENTID_TOUCH)
+		return CHANNEL_RC_OK;
+
+	if (!rdpei_read_4byte_unsigned(s, &encodeTime) || !rdpei_read_2byte_unsigned(s, &frameCount) ||
+	    (frameCount != 1) || !rdpei_read_2byte_unsigned(s, &contactCount) ||
+	    !rdpei_read_8byte_unsigned(s, &frameOffset) || (contactCount < 1) ||
+	    (Stream_GetRemainingLength(s) < 1))
+		return ERROR_INVALID_DATA;
+
+	Stream_Seek_UINT8(s); /* contactId */
+
+	if (!rdpei_read_2byte_unsigned(s, &fieldsPresent) || !rdpei_read_4byte_signed(s, &event.x) ||
+	    !rdpei_read_4byte_signed(s, &event.y) ||
+	    !rdpei_read_4byte_unsigned(s, &event.contactFlags))
+		return ERROR_INVALID_DATA;
+
+	EnterCriticalSection(&g_Lock);
+	g_Frames++;
+
+	if (g_EventCount < TEST_MAX_EVENTS)
+		g_Events[g_EventCount++] = event;
+
+	LeaveCriticalSection(&g_Lock);
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_Close(IWTSVirtualChannel* pChannel)
+{
+	WINPR_UNUSED(pChannel);
+	return CHANNEL_RC_OK;
+}
+
+/* The input thread sends asynchronously, give it up to 5 seconds */
+static BOOL test_wait_changes(RdpeiClientContext* context, UINT64 changes)
+{
+	RDPEI_INPUT_STATS stats = { 0 };
+	const UINT64 end = GetTickCount64() + 5000;
+
+	do
+	{
+		if (context->GetStats(context, &stats) != CHANNEL_RC_OK)
+			return FALSE;
+
+		if (stats.changes >= changes)
+			return TRUE;
+
+		Sleep(1);
+	} while (GetTickCount64() < end);
+
+	fprintf(stderr, "%" PRIu64 " contact changes sent, expected %" PRIu64 "\n", stats.changes,
+	        changes);
+	return FALSE;
+}
+
+/* Index of the first recorded event at or after start with the flag at x, y */
+static size_t test_find(size_t start, UINT32 flag, INT32 x, INT32 y)
+{
+	size_t index;
+	size_t found = SIZE_MAX;
+
+	EnterCriticalSection(&g_Lock);
+
+	for (index = start; index < g_EventCount; index++)
+	{
+		const test_event* event = &g_Events[index];
+
+		if ((event->contactFlags & flag) && (event->x == x) && (event->y == y))
+		{
+			found = index;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&g_Lock);
+	return found;
+}
+
+static size_t test_event_count(void)
+{
+	size_t count;
+	EnterCriticalSection(&g_Lock);
+	count = g_EventCount;
+	LeaveCriticalSection(&g_Lock);
+	return count;
+}
+
+/* Each transition reaches the channel in order, the up event last */
+static BOOL test_flush_order(RdpeiClientContext* context, UINT64 changes)
+{
+	INT32 contactId;
+	size_t down, move, up;
+	const size_t start = test_event_count();
+
+	if ((context->TouchBegin(context, 2, 10, 10, &contactId) != CHANNEL_RC_OK) ||
+	    !test_wait_changes(context, changes + 1))
+		return FALSE;
+
+	if ((context->TouchUpdate(context, 2, 20, 20, &contactId) != CHANNEL_RC_OK) ||
+	    !test_wait_changes(context, changes + 2))
+		return FALSE;
+
+	if ((context->TouchEnd(context, 2, 30, 30, &contactId) != CHANNEL_RC_OK) ||
+	    !test_wait_changes(context, changes + 3))
+		return FALSE;
+
+	down = test_find(start, RDPINPUT_CONTACT_FLAG_DOWN, 10, 10);
+	move = test_find(start, RDPINPUT_CONTACT_FLAG_UPDATE, 20, 20);
+	up = test_find(start, RDPINPUT_CONTACT_FLAG_UP, 30, 30);
+
+	if ((down == SIZE_MAX) || (move == SIZE_MAX) || (up == SIZE_MAX) || (down > move) ||
+	    (move > up) || (up != test_event_count() - 1))
+	{
+		fprintf(stderr, "down at %" PRIuz ", move at %" PRIuz ", up at %" PRIuz " of %" PRIuz "\n",
+		        down, move, up, test_event_count());
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* A tap ending before the input thread runs still sends its down event first */
+static BOOL test_fast_tap(RdpeiClientContext* context, UINT64 changes)
+{
+	INT32 contactId;
+	size_t down, up;
+	const size_t start = test_event_count();
+
+	if ((context->TouchBegin(context, 3, 40, 40, &contactId) != CHANNEL_RC_OK) ||
+	    (context->TouchEnd(context, 3, 50, 50, &contactId) != CHANNEL_RC_OK) ||
+	    !test_wait_changes(context, changes + 2))
+		return FALSE;
+
+	down = test_find(start, RDPINPUT_CONTACT_FLAG_DOWN, 40, 40);
+	up = test_find(start, RDPINPUT_CONTACT_FLAG_UP, 50, 50);
+	return (down != SIZE_MAX) && (up != SIZE_MAX) && (down < up);
+}
+
+int TestRdpeiContacts(int argc, char* argv[])
+{
+	int rc = -1;
+	INT32 contactId;
+	BOOL accept = TRUE;
+	freerdp instance = { 0 };
+	rdpContext rdpcontext = { 0 };
+	RDPEI_INPUT_STATS stats = { 0 };
+	IDRDYNVC_ENTRY_POINTS entryPoints = { 0 };
+	IWTSVirtualChannelManager channelMgr = { 0 };
+	IWTSVirtualChannel channel = { 0 };
+	IWTSVirtualChannelCallback* channelCallback = NULL;
+	RdpeiClientContext* context;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	InitializeCriticalSection(&g_Lock);
+	g_Settings = freerdp_settings_new(0);
+
+	if (!g_Settings)
+		goto out;
+
+	g_Settings->instance = &instance;
+	instance.context = &rdpcontext;
+	rdpcontext.settings = g_Settings;
+	entryPoints.RegisterPlugin = test_RegisterPlugin;
+	entryPoints.GetPlugin = test_GetPlugin;
+	entryPoints.GetPluginData = test_GetPluginData;
+	entryPoints.GetRdpSettings = test_GetRdpSettings;
+	channelMgr.CreateListener = test_CreateListener;
+	channelMgr.DestroyListener = test_DestroyListener;
+	channel.Write = test_Write;
+	channel.Close = test_Close;
+
+	if ((TEST_RDPEI_ENTRY(&entryPoints) != CHANNEL_RC_OK) || !g_Plugin)
+		goto out;
+
+	if ((g_Plugin->Initialize(g_Plugin, &channelMgr) != CHANNEL_RC_OK) || !g_ListenerCallback)
+		goto fail;
+
+	context = (RdpeiClientContext*)g_Plugin->pInterface;
+
+	/* While the channel is closed changes are queued, a pending down is replaced */
+	if ((context->TouchBegin(context, 1, 5, 5, &contactId) != CHANNEL_RC_OK) ||
+	    (context->TouchEnd(context, 1, 6, 6, &contactId) != CHANNEL_RC_OK))
+		goto fail;
+
+	if ((context->GetStats(context, &stats) != CHANNEL_RC_OK) || (stats.frames != 0))
+		goto fail;
+
+	/* The queued change is sent once the channel is connected */
+	if ((g_ListenerCallback->OnNewChannelConnection(g_ListenerCallback, &channel, NULL, &accept,
+	                                                &channelCallback) != CHANNEL_RC_OK) ||
+	    !channelCallback)
+		goto fail;
+
+	if (!test_wait_changes(context, 1) ||
+	    (test_find(0, RDPINPUT_CONTACT_FLAG_UP, 6, 6) == SIZE_MAX))
+		goto fail;
+
+	if (!test_flush_order(context, 1))
+		goto fail;
+
+	if (!test_fast_tap(context, 4))
+		goto fail;
+
+	/* Every frame written is counted, repeats are frames without a change */
+	if (context->GetStats(context, &stats) != CHANNEL_RC_OK)
+		goto fail;
+
+	EnterCriticalSection(&g_Lock);
+
+	if ((stats.changes != 6) || (stats.frames != g_Frames) || (stats.repeats > stats.frames) ||
+	    (stats.frames - stats.repeats > stats.changes) || (stats.wakeups == 0) ||
+	    (stats.maxLatency > stats.totalLatency))
+	{
+		fprintf(stderr,
+		        "%" PRIu64 " frames (%" PRIuz " written), %" PRIu64 " repeats, %" PRIu64
+		        " changes, %" PRIu64 " wakeups, latency max %" PRIu64 " total %" PRIu64 "\n",
+		        stats.frames, g_Frames, stats.repeats, stats.changes, stats.wakeups,
+		        stats.maxLatency, stats.totalLatency);
+		LeaveCriticalSection(&g_Lock);
+		goto fail;
+	}
+
+	LeaveCriticalSection(&g_Lock);
+
+	/* Closing the channel queues changes again */
+	channelCallback->OnClose(channelCallback);
+
+	if (context->TouchBegin(context, 4, 60, 60, &contactId) != CHANNEL_RC_OK)
+		goto fail;
+
+	rc = 0;
+fail:
+	g_Plugin->Terminated(g_Plugin);
+out:
+	if (rc != 0)
+		fprintf(stderr, "%s failed\n", __FUNCTION__);
+
+	freerdp_settings_free(g_Settings);
+	DeleteCriticalSection(&g_Lock);
+	return rc;
+}
@@ -87,39 +87,41 @@ static INLINE BOOL rdpgfx_server_packet_complete_header(wStream* s, size_t start
 
 /**
  * Function description
- * Send the stream for rdpgfx server packet.
- * The packet would be compressed according to [MS-RDPEGFX].
+ * Compress a buffer holding one or more rdpgfx PDUs and write it to the
+ * channel. The packet would be compressed according to [MS-RDPEGFX].
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT rdpgfx_server_packet_send(RdpgfxServerContext* context, wStream* s)
+static UINT rdpgfx_server_write_pdus(RdpgfxServerContext* context, const BYTE* pSrcData,
+                                     UINT32 SrcSize)
 {
 	UINT error;
 	UINT32 flags = 0;
 	ULONG written;
-	BYTE* pSrcData = Stream_Buffer(s);
-	UINT32 SrcSize = Stream_GetPosition(s);
 	wStream* fs;
-	/* Allocate new stream with enough capacity. Additional overhead is
+	RdpgfxServerPrivate* priv = context->priv;
+	/* Take a stream with enough capacity. Additional overhead is
 	 * descriptor (1 bytes) + segmentCount (2 bytes) + uncompressedSize (4 bytes)
 	 * + segmentCount * size (4 bytes) */
-	fs = Stream_New(NULL, SrcSize + 7 + (SrcSize / ZGFX_SEGMENTED_MAXSIZE + 1) * 4);
+	fs = StreamPool_Take(priv->pool, SrcSize + 7 + (SrcSize / ZGFX_SEGMENTED_MAXSIZE + 1) * 4);
 
 	if (!fs)
 	{
-		WLog_ERR(TAG, "Stream_New failed!");
-		error = CHANNEL_RC_NO_MEMORY;
-		goto out;
+		WLog_ERR(TAG, "StreamPool_Take failed!");
+		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	if (zgfx_compress_to_stream(context->priv->zgfx, fs, pSrcData, SrcSize, &flags) < 0)
+	/* The compression history is shared, packets go out in the order they are compressed */
+	EnterCriticalSection(&priv->batchLock);
+
+	if (zgfx_compress_to_stream(priv->zgfx, fs, pSrcData, SrcSize, &flags) < 0)
 	{
 		WLog_ERR(TAG, "zgfx_compress_to_stream failed!");
 		error = ERROR_INTERNAL_ERROR;
 		goto out;
 	}
 
-	if (!WTSVirtualChannelWrite(context->priv->rdpgfx_channel, (PCHAR)Stream_Buffer(fs),
+	if (!WTSVirtualChannelWrite(priv->rdpgfx_channel, (PCHAR)Stream_Buffer(fs),
 	                            Stream_GetPosition(fs), &written))
 	{
 		WLog_ERR(TAG, "WTSVirtualChannelWrite failed!");
@@ -135,28 +137,92 @@ static UINT rdpgfx_server_packet_send(RdpgfxServerContext* context, wStream* s)
 
 	error = CHANNEL_RC_OK;
 out:
-	Stream_Free(fs, TRUE);
+	LeaveCriticalSection(&priv->batchLock);
+	Stream_Release(fs);
+	return error;
+}
+
+/**
+ * Function description
+ * Send the stream for rdpgfx server packet.
+ * The packet would be compressed according to [MS-RDPEGFX].
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpgfx_server_packet_send(RdpgfxServerContext* context, wStream* s)
+{
+	const UINT error =
+	    rdpgfx_server_write_pdus(context, Stream_Buffer(s), Stream_GetPosition(s));
 	Stream_Free(s, TRUE);
 	return error;
 }
 
+/**
+ * Function description
+ * Get the frame batch PDUs of the calling thread are added to. Only the
+ * thread that began the batch collects into it, PDUs of other threads are
+ * sent directly.
+ *
+ * @return the batch stream of the calling thread or NULL
+ */
+static wStream* rdpgfx_server_get_batch(RdpgfxServerPrivate* priv)
+{
+	wStream* batch = NULL;
+
+	EnterCriticalSection(&priv->batchLock);
+
+	if (priv->batchOwner == GetCurrentThreadId())
+		batch = priv->batch;
+
+	LeaveCriticalSection(&priv->batchLock);
+	return batch;
+}
+
 /**
  * Function description
  * Create new stream for single rdpgfx packet. The new stream length
  * would be required data length + header. The header will be written
  * to the stream before return, but the pduLength field might be
  * changed in rdpgfx_server_single_packet_send.
+ * While a frame batch is active the packet is written to the batch
+ * stream directly, which avoids a per PDU allocation.
  *
  * @param cmdId
  * @param dataLen estimated data length without header
  *
  * @return new stream
  */
-static wStream* rdpgfx_server_single_packet_new(UINT16 cmdId, UINT32 dataLen)
+static wStream* rdpgfx_server_single_packet_new(RdpgfxServerContext* context, UINT16 cmdId,
+                                                UINT32 dataLen)
 {
 	UINT error;
 	wStream* s;
+	RdpgfxServerPrivate* priv = context->priv;
 	UINT32 pduLength = rdpgfx_pdu_length(dataLen);
+	wStream* batch = rdpgfx_server_get_batch(priv);
+
+	if (batch)
+	{
+		s = batch;
+
+		if (!Stream_EnsureRemainingCapacity(s, pduLength))
+		{
+			WLog_ERR(TAG, "Stream_EnsureRemainingCapacity failed!");
+			return NULL;
+		}
+
+		priv->batchPduStart = Stream_GetPosition(s);
+
+		if ((error = rdpgfx_server_packet_init_header(s, cmdId, pduLength)))
+		{
+			WLog_ERR(TAG, "Failed to init header with error %" PRIu32 "!", error);
+			Stream_SetPosition(s, priv->batchPduStart);
+			return NULL;
+		}
+
+		return s;
+	}
+
 	s = Stream_New(NULL, pduLength);
 
 	if (!s)
@@ -177,6 +243,21 @@ error:
 	return NULL;
 }
 
+/**
+ * Function description
+ * Drop a packet created with rdpgfx_server_single_packet_new that
+ * could not be completed.
+ */
+static void rdpgfx_server_single_packet_free(RdpgfxServerContext* context, wStream* s)
+{
+	RdpgfxServerPrivate* priv = context->priv;
+
+	if (s && (s == rdpgfx_server_get_batch(priv)))
+		Stream_SetPosition(s, priv->batchPduStart);
+	else
+		Stream_Free(s, TRUE);
+}
+
 /**
  * Function description
  * Send the stream for single rdpgfx packet.
@@ -187,11 +268,341 @@ error:
  */
 static INLINE UINT rdpgfx_server_single_packet_send(RdpgfxServerContext* context, wStream* s)
 {
+	RdpgfxServerPrivate* priv = context->priv;
+
+	if (s == rdpgfx_server_get_batch(priv))
+	{
+		if (!rdpgfx_server_packet_complete_header(s, priv->batchPduStart))
+		{
+			Stream_SetPosition(s, priv->batchPduStart);
+			return ERROR_INTERNAL_ERROR;
+		}
+
+		return CHANNEL_RC_OK;
+	}
+
 	/* Fill actual length */
 	rdpgfx_server_packet_complete_header(s, 0);
 	return rdpgfx_server_packet_send(context, s);
 }
 
+/**
+ * Function description
+ * Start collecting PDUs for a frame. Every PDU sent until
+ * rdpgfx_server_submit_frame_batch is called is appended to one pooled
+ * buffer.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpgfx_server_begin_frame_batch(RdpgfxServerContext* context)
+{
+	UINT error = CHANNEL_RC_OK;
+	RdpgfxServerPrivate* priv;
+
+	WINPR_ASSERT(context);
+	priv = context->priv;
+	WINPR_ASSERT(priv);
+
+	EnterCriticalSection(&priv->batchLock);
+
+	if (priv->batch)
+	{
+		WLog_ERR(TAG, "Frame batch already active!");
+		error = ERROR_INVALID_STATE;
+		goto out;
+	}
+
+	priv->batch = StreamPool_Take(priv->pool, 0);
+
+	if (!priv->batch)
+	{
+		WLog_ERR(TAG, "StreamPool_Take failed!");
+		error = CHANNEL_RC_NO_MEMORY;
+		goto out;
+	}
+
+	priv->batchOwner = GetCurrentThreadId();
+	priv->batchPduStart = 0;
+out:
+	LeaveCriticalSection(&priv->batchLock);
+	return error;
+}
+
+/**
+ * Function description
+ * Send all PDUs collected since rdpgfx_server_begin_frame_batch as a single
+ * ZGFX segmented packet with one channel write.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpgfx_server_submit_frame_batch(RdpgfxServerContext* context)
+{
+	UINT error = CHANNEL_RC_OK;
+	wStream* s;
+	RdpgfxServerPrivate* priv;
+
+	WINPR_ASSERT(context);
+	priv = context->priv;
+	WINPR_ASSERT(priv);
+
+	EnterCriticalSection(&priv->batchLock);
+	s = priv->batch;
+
+	if (!s || (priv->batchOwner != GetCurrentThreadId()))
+	{
+		WLog_ERR(TAG, "No frame batch active!");
+		LeaveCriticalSection(&priv->batchLock);
+		return ERROR_INVALID_STATE;
+	}
+
+	priv->batch = NULL;
+	priv->batchOwner = 0;
+	LeaveCriticalSection(&priv->batchLock);
+
+	if (Stream_GetPosition(s) > 0)
+		error = rdpgfx_server_write_pdus(context, Stream_Buffer(s), Stream_GetPosition(s));
+
+	Stream_Release(s);
+	return error;
+}
+
+static UINT32 rdpgfx_server_cache_key_hash(const void* key)
+{
+	const UINT64 cacheKey = *((const UINT64*)key);
+	return (UINT32)(cacheKey ^ (cacheKey >> 32));
+}
+
+static BOOL rdpgfx_server_cache_key_compare(const void* key1, const void* key2)
+{
+	return *((const UINT64*)key1) == *((const UINT64*)key2);
+}
+
+static void* rdpgfx_server_cache_key_clone(const void* key)
+{
+	UINT64* clone = malloc(sizeof(UINT64));
+
+	if (clone)
+		*clone = *((const UINT64*)key);
+
+	return clone;
+}
+
+/**
+ * Function description
+ * Reset the table of client cache slots for a cache with maxCacheSlots entries.
+ * [MS-RDPEGFX] 3.3.1.4: the cache holds 25600 slots (100 MB), or 4096
+ * slots (16 MB) if the client advertised RDPGFX_CAPS_FLAG_SMALL_CACHE.
+ *
+ * @return TRUE on success, FALSE otherwise
+ */
+static BOOL rdpgfx_server_cache_reset(RdpgfxServerPrivate* priv, UINT16 maxCacheSlots,
+                                      UINT32 maxCacheSize)
+{
+	BOOL rc = TRUE;
+
+	EnterCriticalSection(&priv->cacheLock);
+	HashTable_Clear(priv->cacheIndex);
+	free(priv->cacheSlots);
+	priv->cacheSlots = NULL;
+	priv->maxCacheSlots = 0;
+	priv->maxCacheSize = 0;
+	priv->cacheSize = 0;
+	priv->usedCacheSlots = 0;
+	priv->nextCacheSlot = 1;
+
+	if (maxCacheSlots > 0)
+	{
+		priv->cacheSlots = calloc(maxCacheSlots, sizeof(RDPGFX_SERVER_CACHE_SLOT));
+
+		if (priv->cacheSlots)
+		{
+			priv->maxCacheSlots = maxCacheSlots;
+			priv->maxCacheSize = maxCacheSize;
+		}
+		else
+			rc = FALSE;
+	}
+
+	LeaveCriticalSection(&priv->cacheLock);
+	return rc;
+}
+
+/* Must be called with cacheLock held */
+static void rdpgfx_server_cache_evict_slot(RdpgfxServerPrivate* priv, UINT16 cacheSlot)
+{
+	RDPGFX_SERVER_CACHE_SLOT* slot;
+
+	if ((cacheSlot == 0) || (cacheSlot > priv->maxCacheSlots))
+		return;
+
+	slot = &priv->cacheSlots[cacheSlot - 1];
+
+	if (!slot->used)
+		return;
+
+	/* Only drop the key if it still refers to this slot */
+	if ((UINT16)(size_t)HashTable_GetItemValue(priv->cacheIndex, &slot->cacheKey) == cacheSlot)
+		HashTable_Remove(priv->cacheIndex, &slot->cacheKey);
+
+	priv->cacheSize -= slot->size;
+	priv->usedCacheSlots--;
+	slot->used = FALSE;
+	slot->cacheKey = 0;
+	slot->size = 0;
+}
+
+/* Must be called with cacheLock held */
+static BOOL rdpgfx_server_cache_set_slot(RdpgfxServerPrivate* priv, UINT16 cacheSlot,
+                                         UINT64 cacheKey, UINT32 size)
+{
+	RDPGFX_SERVER_CACHE_SLOT* slot;
+
+	if ((cacheSlot == 0) || (cacheSlot > priv->maxCacheSlots))
+		return FALSE;
+
+	rdpgfx_server_cache_evict_slot(priv, cacheSlot);
+	slot = &priv->cacheSlots[cacheSlot - 1];
+	slot->used = TRUE;
+	slot->cacheKey = cacheKey;
+	slot->size = size;
+	priv->cacheSize += size;
+	priv->usedCacheSlots++;
+	return HashTable_SetItemValue(priv->cacheIndex, &cacheKey, (void*)(size_t)cacheSlot) ||
+	       HashTable_Insert(priv->cacheIndex, &cacheKey, (void*)(size_t)cacheSlot);
+}
+
+/**
+ * Function description
+ * Import the entries offered by the client into free cache slots and
+ * answer with a RDPGFX_CACHE_IMPORT_REPLY_PDU. The cacheSlots of the reply
+ * match the order of the offer, a slot of 0 means the entry was not imported.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpgfx_server_cache_import(RdpgfxServerContext* context,
+                                       const RDPGFX_CACHE_IMPORT_OFFER_PDU* offer)
+{
+	UINT16 index;
+	UINT16 nextSlot = 1;
+	UINT16 imported = 0;
+	UINT error = CHANNEL_RC_OK;
+	RDPGFX_CACHE_IMPORT_REPLY_PDU reply = { 0 };
+	RdpgfxServerPrivate* priv = context->priv;
+
+	if (offer->cacheEntriesCount > 0)
+	{
+		reply.cacheSlots = calloc(offer->cacheEntriesCount, sizeof(UINT16));
+
+		if (!reply.cacheSlots)
+			return CHANNEL_RC_NO_MEMORY;
+	}
+
+	reply.importedEntriesCount = offer->cacheEntriesCount;
+	EnterCriticalSection(&priv->cacheLock);
+
+	for (index = 0; index < offer->cacheEntriesCount; index++)
+	{
+		const RDPGFX_CACHE_ENTRY_METADATA* entry = &offer->cacheEntries[index];
+
+		/* Slots filled earlier, by imports or SurfaceToCache, count against the limit */
+		if (priv->cacheSize + entry->bitmapLength > priv->maxCacheSize)
+			continue;
+
+		while ((nextSlot <= priv->maxCacheSlots) && priv->cacheSlots[nextSlot - 1].used)
+			nextSlot++;
+
+		if (nextSlot > priv->maxCacheSlots)
+			break;
+
+		if (!rdpgfx_server_cache_set_slot(priv, nextSlot, entry->cacheKey, entry->bitmapLength))
+			continue;
+
+		reply.cacheSlots[index] = nextSlot;
+		imported++;
+	}
+
+	LeaveCriticalSection(&priv->cacheLock);
+	WLog_DBG(TAG, "Imported %" PRIu16 " of %" PRIu16 " offered cache entries", imported,
+	         offer->cacheEntriesCount);
+	IFCALLRET(context->CacheImportReply, error, context, &reply);
+	free(reply.cacheSlots);
+	return error;
+}
+
+/**
+ * Function description
+ * Look up the cache slot holding the bitmap with the given cacheKey on the
+ * client, either imported from the client's persistent cache or stored
+ * with a SurfaceToCache PDU during this connection.
+ *
+ * @return TRUE if found, FALSE otherwise
+ */
+BOOL rdpgfx_server_cache_lookup(RdpgfxServerContext* context, UINT64 cacheKey, UINT16* cacheSlot)
+{
+	size_t slot;
+	RdpgfxServerPrivate* priv;
+
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(cacheSlot);
+	priv = context->priv;
+	WINPR_ASSERT(priv);
+
+	EnterCriticalSection(&priv->cacheLock);
+	slot = (size_t)HashTable_GetItemValue(priv->cacheIndex, &cacheKey);
+	LeaveCriticalSection(&priv->cacheLock);
+
+	if (slot == 0)
+		return FALSE;
+
+	*cacheSlot = (UINT16)slot;
+	return TRUE;
+}
+
+/**
+ * Function description
+ * Pick the cache slot for the next SurfaceToCache PDU with a bitmap of size
+ * bytes. Free slots are used while the client cache has room. Once it is
+ * full, used slots are overwritten in turn, as long as the cache stays within
+ * its size limit.
+ *
+ * @return TRUE if a slot was found, FALSE otherwise
+ */
+BOOL rdpgfx_server_cache_alloc_slot(RdpgfxServerContext* context, UINT32 size,
+                                    UINT16* cacheSlot)
+{
+	UINT16 count;
+	BOOL full;
+	BOOL found = FALSE;
+	RdpgfxServerPrivate* priv;
+
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(cacheSlot);
+	priv = context->priv;
+	WINPR_ASSERT(priv);
+
+	EnterCriticalSection(&priv->cacheLock);
+	full = (priv->usedCacheSlots == priv->maxCacheSlots) ||
+	       (priv->cacheSize + size > priv->maxCacheSize);
+
+	for (count = 0; count < priv->maxCacheSlots; count++)
+	{
+		const UINT16 index = priv->nextCacheSlot;
+		const RDPGFX_SERVER_CACHE_SLOT* slot = &priv->cacheSlots[index - 1];
+		priv->nextCacheSlot = (index < priv->maxCacheSlots) ? index + 1 : 1;
+
+		if ((!slot->used && !full) ||
+		    (slot->used && full && (priv->cacheSize - slot->size + size <= priv->maxCacheSize)))
+		{
+			*cacheSlot = index;
+			found = TRUE;
+			break;
+		}
+	}
+
+	LeaveCriticalSection(&priv->cacheLock);
+	return found;
+}
+
 /**
  * Function description
  *
@@ -200,6 +611,7 @@ static INLINE UINT rdpgfx_server_single_packet_send(RdpgfxServerContext* context
 static UINT rdpgfx_send_caps_confirm_pdu(RdpgfxServerContext* context,
                                          const RDPGFX_CAPS_CONFIRM_PDU* capsConfirm)
 {
+	BOOL rc;
 	wStream* s;
 	RDPGFX_CAPSET* capsSet;
 
@@ -209,7 +621,7 @@ static UINT rdpgfx_send_caps_confirm_pdu(RdpgfxServerContext* context,
 	capsSet = capsConfirm->capsSet;
 	WINPR_ASSERT(capsSet);
 
-	s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_CAPSCONFIRM,
+	s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_CAPSCONFIRM,
 	                                    RDPGFX_CAPSET_BASE_SIZE + capsSet->length);
 
 	if (!s)
@@ -231,6 +643,18 @@ static UINT rdpgfx_send_caps_confirm_pdu(RdpgfxServerContext* context,
 	else
 		Stream_Zero(s, capsSet->length);
 
+	if (capsSet->flags & RDPGFX_CAPS_FLAG_SMALL_CACHE)
+		rc = rdpgfx_server_cache_reset(context->priv, 4096, 16 * 1024 * 1024);
+	else
+		rc = rdpgfx_server_cache_reset(context->priv, 25600, 100 * 1024 * 1024);
+
+	if (!rc)
+	{
+		WLog_ERR(TAG, "rdpgfx_server_cache_reset failed!");
+		rdpgfx_server_single_packet_free(context, s);
+		return CHANNEL_RC_NO_MEMORY;
+	}
+
 	return rdpgfx_server_single_packet_send(context, s);
 }
 
@@ -253,7 +677,7 @@ static UINT rdpgfx_send_reset_graphics_pdu(RdpgfxServerContext* context,
 		return ERROR_INVALID_DATA;
 	}
 
-	s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_RESETGRAPHICS,
+	s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_RESETGRAPHICS,
 	                                    RDPGFX_RESET_GRAPHICS_PDU_SIZE - RDPGFX_HEADER_SIZE);
 
 	if (!s)
@@ -289,7 +713,7 @@ static UINT rdpgfx_send_reset_graphics_pdu(RdpgfxServerContext* context,
 static UINT rdpgfx_send_evict_cache_entry_pdu(RdpgfxServerContext* context,
                                               const RDPGFX_EVICT_CACHE_ENTRY_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_EVICTCACHEENTRY, 2);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_EVICTCACHEENTRY, 2);
 
 	if (!s)
 	{
@@ -298,6 +722,9 @@ static UINT rdpgfx_send_evict_cache_entry_pdu(RdpgfxServerContext* context,
 	}
 
 	Stream_Write_UINT16(s, pdu->cacheSlot); /* cacheSlot (2 bytes) */
+	EnterCriticalSection(&context->priv->cacheLock);
+	rdpgfx_server_cache_evict_slot(context->priv, pdu->cacheSlot);
+	LeaveCriticalSection(&context->priv->cacheLock);
 	return rdpgfx_server_single_packet_send(context, s);
 }
 
@@ -310,7 +737,7 @@ static UINT rdpgfx_send_cache_import_reply_pdu(RdpgfxServerContext* context,
                                                const RDPGFX_CACHE_IMPORT_REPLY_PDU* pdu)
 {
 	UINT16 index;
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_CACHEIMPORTREPLY,
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_CACHEIMPORTREPLY,
 	                                             2 + 2 * pdu->importedEntriesCount);
 
 	if (!s)
@@ -338,7 +765,7 @@ static UINT rdpgfx_send_cache_import_reply_pdu(RdpgfxServerContext* context,
 static UINT rdpgfx_send_create_surface_pdu(RdpgfxServerContext* context,
                                            const RDPGFX_CREATE_SURFACE_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_CREATESURFACE, 7);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_CREATESURFACE, 7);
 
 	WINPR_ASSERT(context);
 	WINPR_ASSERT(pdu);
@@ -366,7 +793,7 @@ static UINT rdpgfx_send_create_surface_pdu(RdpgfxServerContext* context,
 static UINT rdpgfx_send_delete_surface_pdu(RdpgfxServerContext* context,
                                            const RDPGFX_DELETE_SURFACE_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_DELETESURFACE, 2);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_DELETESURFACE, 2);
 
 	if (!s)
 	{
@@ -403,8 +830,8 @@ static INLINE BOOL rdpgfx_write_end_frame_pdu(wStream* s, const RDPGFX_END_FRAME
 static UINT rdpgfx_send_start_frame_pdu(RdpgfxServerContext* context,
                                         const RDPGFX_START_FRAME_PDU* pdu)
 {
-	wStream* s =
-	    rdpgfx_server_single_packet_new(RDPGFX_CMDID_STARTFRAME, RDPGFX_START_FRAME_PDU_SIZE);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_STARTFRAME,
+	                                             RDPGFX_START_FRAME_PDU_SIZE);
 
 	if (!s)
 	{
@@ -423,7 +850,8 @@ static UINT rdpgfx_send_start_frame_pdu(RdpgfxServerContext* context,
  */
 static UINT rdpgfx_send_end_frame_pdu(RdpgfxServerContext* context, const RDPGFX_END_FRAME_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_ENDFRAME, RDPGFX_END_FRAME_PDU_SIZE);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_ENDFRAME,
+	                                             RDPGFX_END_FRAME_PDU_SIZE);
 
 	if (!s)
 	{
@@ -708,7 +1136,7 @@ static UINT rdpgfx_send_surface_command(RdpgfxServerContext* context,
 {
 	UINT error = CHANNEL_RC_OK;
 	wStream* s;
-	s = rdpgfx_server_single_packet_new(rdpgfx_surface_command_cmdid(cmd),
+	s = rdpgfx_server_single_packet_new(context, rdpgfx_surface_command_cmdid(cmd),
 	                                    rdpgfx_estimate_surface_command(cmd));
 
 	if (!s)
@@ -727,7 +1155,7 @@ static UINT rdpgfx_send_surface_command(RdpgfxServerContext* context,
 
 	return rdpgfx_server_single_packet_send(context, s);
 error:
-	Stream_Free(s, TRUE);
+	rdpgfx_server_single_packet_free(context, s);
 	return error;
 }
 
@@ -748,6 +1176,9 @@ static UINT rdpgfx_send_surface_frame_command(RdpgfxServerContext* context,
 	UINT error = CHANNEL_RC_OK;
 	wStream* s;
 	UINT32 position = 0;
+	size_t batchStart = 0;
+	BOOL batched = FALSE;
+	RdpgfxServerPrivate* priv = context->priv;
 	UINT32 size = rdpgfx_pdu_length(rdpgfx_estimate_surface_command(cmd));
 
 	if (startFrame)
@@ -760,12 +1191,26 @@ static UINT rdpgfx_send_surface_frame_command(RdpgfxServerContext* context,
 		size += rdpgfx_pdu_length(RDPGFX_END_FRAME_PDU_SIZE);
 	}
 
-	s = Stream_New(NULL, size);
+	if ((s = rdpgfx_server_get_batch(priv)))
+	{
+		batched = TRUE;
+		batchStart = Stream_GetPosition(s);
 
-	if (!s)
+		if (!Stream_EnsureRemainingCapacity(s, size))
+		{
+			WLog_ERR(TAG, "Stream_EnsureRemainingCapacity failed!");
+			return CHANNEL_RC_NO_MEMORY;
+		}
+	}
+	else
 	{
-		WLog_ERR(TAG, "Stream_New failed!");
-		return CHANNEL_RC_NO_MEMORY;
+		s = Stream_New(NULL, size);
+
+		if (!s)
+		{
+			WLog_ERR(TAG, "Stream_New failed!");
+			return CHANNEL_RC_NO_MEMORY;
+		}
 	}
 
 	/* Write start frame if exists */
@@ -824,9 +1269,16 @@ static UINT rdpgfx_send_surface_frame_command(RdpgfxServerContext* context,
 			goto error;
 	}
 
+	if (batched)
+		return CHANNEL_RC_OK;
+
 	return rdpgfx_server_packet_send(context, s);
 error:
-	Stream_Free(s, TRUE);
+	if (batched)
+		Stream_SetPosition(s, batchStart);
+	else
+		Stream_Free(s, TRUE);
+
 	return error;
 }
 
@@ -838,7 +1290,7 @@ error:
 static UINT rdpgfx_send_delete_encoding_context_pdu(RdpgfxServerContext* context,
                                                     const RDPGFX_DELETE_ENCODING_CONTEXT_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_DELETEENCODINGCONTEXT, 6);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_DELETEENCODINGCONTEXT, 6);
 
 	if (!s)
 	{
@@ -862,8 +1314,8 @@ static UINT rdpgfx_send_solid_fill_pdu(RdpgfxServerContext* context,
 	UINT error = CHANNEL_RC_OK;
 	UINT16 index;
 	RECTANGLE_16* fillRect;
-	wStream* s =
-	    rdpgfx_server_single_packet_new(RDPGFX_CMDID_SOLIDFILL, 8 + 8 * pdu->fillRectCount);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_SOLIDFILL,
+	                                             8 + 8 * pdu->fillRectCount);
 
 	if (!s)
 	{
@@ -895,7 +1347,7 @@ static UINT rdpgfx_send_solid_fill_pdu(RdpgfxServerContext* context,
 
 	return rdpgfx_server_single_packet_send(context, s);
 error:
-	Stream_Free(s, TRUE);
+	rdpgfx_server_single_packet_free(context, s);
 	return error;
 }
 
@@ -910,8 +1362,8 @@ static UINT rdpgfx_send_surface_to_surface_pdu(RdpgfxServerContext* context,
 	UINT error = CHANNEL_RC_OK;
 	UINT16 index;
 	RDPGFX_POINT16* destPt;
-	wStream* s =
-	    rdpgfx_server_single_packet_new(RDPGFX_CMDID_SURFACETOSURFACE, 14 + 4 * pdu->destPtsCount);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_SURFACETOSURFACE,
+	                                             14 + 4 * pdu->destPtsCount);
 
 	if (!s)
 	{
@@ -944,7 +1396,7 @@ static UINT rdpgfx_send_surface_to_surface_pdu(RdpgfxServerContext* context,
 
 	return rdpgfx_server_single_packet_send(context, s);
 error:
-	Stream_Free(s, TRUE);
+	rdpgfx_server_single_packet_free(context, s);
 	return error;
 }
 
@@ -957,7 +1409,7 @@ static UINT rdpgfx_send_surface_to_cache_pdu(RdpgfxServerContext* context,
                                              const RDPGFX_SURFACE_TO_CACHE_PDU* pdu)
 {
 	UINT error = CHANNEL_RC_OK;
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_SURFACETOCACHE, 20);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_SURFACETOCACHE, 20);
 
 	if (!s)
 	{
@@ -976,9 +1428,15 @@ static UINT rdpgfx_send_surface_to_cache_pdu(RdpgfxServerContext* context,
 		goto error;
 	}
 
+	/* The client stores the rectangle as 32bpp bitmap */
+	EnterCriticalSection(&context->priv->cacheLock);
+	rdpgfx_server_cache_set_slot(context->priv, pdu->cacheSlot, pdu->cacheKey,
+	                             4U * (pdu->rectSrc.right - pdu->rectSrc.left) *
+	                                 (pdu->rectSrc.bottom - pdu->rectSrc.top));
+	LeaveCriticalSection(&context->priv->cacheLock);
 	return rdpgfx_server_single_packet_send(context, s);
 error:
-	Stream_Free(s, TRUE);
+	rdpgfx_server_single_packet_free(context, s);
 	return error;
 }
 
@@ -993,8 +1451,8 @@ static UINT rdpgfx_send_cache_to_surface_pdu(RdpgfxServerContext* context,
 	UINT error = CHANNEL_RC_OK;
 	UINT16 index;
 	RDPGFX_POINT16* destPt;
-	wStream* s =
-	    rdpgfx_server_single_packet_new(RDPGFX_CMDID_CACHETOSURFACE, 6 + 4 * pdu->destPtsCount);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_CACHETOSURFACE,
+	                                             6 + 4 * pdu->destPtsCount);
 
 	if (!s)
 	{
@@ -1019,7 +1477,7 @@ static UINT rdpgfx_send_cache_to_surface_pdu(RdpgfxServerContext* context,
 
 	return rdpgfx_server_single_packet_send(context, s);
 error:
-	Stream_Free(s, TRUE);
+	rdpgfx_server_single_packet_free(context, s);
 	return error;
 }
 
@@ -1031,7 +1489,7 @@ error:
 static UINT rdpgfx_send_map_surface_to_output_pdu(RdpgfxServerContext* context,
                                                   const RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_MAPSURFACETOOUTPUT, 12);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_MAPSURFACETOOUTPUT, 12);
 
 	if (!s)
 	{
@@ -1054,7 +1512,7 @@ static UINT rdpgfx_send_map_surface_to_output_pdu(RdpgfxServerContext* context,
 static UINT rdpgfx_send_map_surface_to_window_pdu(RdpgfxServerContext* context,
                                                   const RDPGFX_MAP_SURFACE_TO_WINDOW_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_MAPSURFACETOWINDOW, 18);
+	wStream* s = rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_MAPSURFACETOWINDOW, 18);
 
 	if (!s)
 	{
@@ -1073,7 +1531,8 @@ static UINT
 rdpgfx_send_map_surface_to_scaled_window_pdu(RdpgfxServerContext* context,
                                              const RDPGFX_MAP_SURFACE_TO_SCALED_WINDOW_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_MAPSURFACETOSCALEDWINDOW, 26);
+	wStream* s =
+	    rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_MAPSURFACETOSCALEDWINDOW, 26);
 
 	if (!s)
 	{
@@ -1180,6 +1639,8 @@ static UINT rdpgfx_recv_cache_import_offer_pdu(RdpgfxServerContext* context, wSt
 
 		if (error)
 			WLog_ERR(TAG, "context->CacheImportOffer failed with error %" PRIu32 "", error);
+		else if (context->autoCacheImport && (error = rdpgfx_server_cache_import(context, &pdu)))
+			WLog_ERR(TAG, "rdpgfx_server_cache_import failed with error %" PRIu32 "", error);
 	}
 
 	free(pdu.cacheEntries);
@@ -1286,7 +1747,8 @@ static UINT
 rdpgfx_send_map_surface_to_scaled_output_pdu(RdpgfxServerContext* context,
                                              const RDPGFX_MAP_SURFACE_TO_SCALED_OUTPUT_PDU* pdu)
 {
-	wStream* s = rdpgfx_server_single_packet_new(RDPGFX_CMDID_MAPSURFACETOSCALEDOUTPUT, 20);
+	wStream* s =
+	    rdpgfx_server_single_packet_new(context, RDPGFX_CMDID_MAPSURFACETOSCALEDOUTPUT, 20);
 
 	if (!s)
 	{
@@ -1542,8 +2004,20 @@ static BOOL rdpgfx_server_close(RdpgfxServerContext* context)
 		priv->stopEvent = NULL;
 	}
 
+	EnterCriticalSection(&priv->batchLock);
+
+	if (priv->batch)
+	{
+		Stream_Release(priv->batch);
+		priv->batch = NULL;
+		priv->batchOwner = 0;
+	}
+
+	LeaveCriticalSection(&priv->batchLock);
+
 	zgfx_context_free(priv->zgfx);
 	priv->zgfx = NULL;
+	rdpgfx_server_cache_reset(priv, 0, 0);
 
 	if (priv->rdpgfx_channel)
 	{
@@ -1595,6 +2069,8 @@ RdpgfxServerContext* rdpgfx_server_context_new(HANDLE vcm)
 	context->CapsConfirm = rdpgfx_send_caps_confirm_pdu;
 	context->FrameAcknowledge = NULL;
 	context->QoeFrameAcknowledge = NULL;
+	context->BeginFrameBatch = rdpgfx_server_begin_frame_batch;
+	context->SubmitFrameBatch = rdpgfx_server_submit_frame_batch;
 	context->priv = priv = (RdpgfxServerPrivate*)calloc(1, sizeof(RdpgfxServerPrivate));
 
 	if (!priv)
@@ -1612,10 +2088,41 @@ RdpgfxServerContext* rdpgfx_server_context_new(HANDLE vcm)
 		goto out_free_priv;
 	}
 
+	/* Index of the bitmaps held in the client cache */
+	priv->cacheIndex = HashTable_New(FALSE);
+
+	if (!priv->cacheIndex)
+	{
+		WLog_ERR(TAG, "HashTable_New failed!");
+		goto out_free_stream;
+	}
+
+	HashTable_SetHashFunction(priv->cacheIndex, rdpgfx_server_cache_key_hash);
+	HashTable_KeyObject(priv->cacheIndex)->fnObjectEquals = rdpgfx_server_cache_key_compare;
+	HashTable_KeyObject(priv->cacheIndex)->fnObjectNew = rdpgfx_server_cache_key_clone;
+	HashTable_KeyObject(priv->cacheIndex)->fnObjectFree = free;
+	InitializeCriticalSection(&priv->cacheLock);
+	InitializeCriticalSection(&priv->batchLock);
+
+	/* Pool for outgoing frame batches and compressed packets */
+	priv->pool = StreamPool_New(TRUE, 4096);
+
+	if (!priv->pool)
+	{
+		WLog_ERR(TAG, "StreamPool_New failed!");
+		goto out_free_cache;
+	}
+
 	priv->isOpened = FALSE;
 	priv->isReady = FALSE;
 	priv->ownThread = TRUE;
 	return (RdpgfxServerContext*)context;
+out_free_cache:
+	DeleteCriticalSection(&priv->batchLock);
+	DeleteCriticalSection(&priv->cacheLock);
+	HashTable_Free(priv->cacheIndex);
+out_free_stream:
+	Stream_Free(priv->input_stream, TRUE);
 out_free_priv:
 	free(context->priv);
 out_free:
@@ -1628,7 +2135,14 @@ void rdpgfx_server_context_free(RdpgfxServerContext* context)
 	rdpgfx_server_close(context);
 
 	if (context->priv)
+	{
 		Stream_Free(context->priv->input_stream, TRUE);
+		StreamPool_Free(context->priv->pool);
+		HashTable_Free(context->priv->cacheIndex);
+		free(context->priv->cacheSlots);
+		DeleteCriticalSection(&context->priv->batchLock);
+		DeleteCriticalSection(&context->priv->cacheLock);
+	}
 
 	free(context->priv);
 	free(context);
@@ -20,9 +20,19 @@
 #ifndef FREERDP_CHANNEL_RDPGFX_SERVER_MAIN_H
 #define FREERDP_CHANNEL_RDPGFX_SERVER_MAIN_H
 
+#include <winpr/collections.h>
+
 #include <freerdp/server/rdpgfx.h>
 #include <freerdp/codec/zgfx.h>
 
+struct _RDPGFX_SERVER_CACHE_SLOT
+{
+	BOOL used;
+	UINT64 cacheKey;
+	UINT32 size; /* Bytes of the bitmap in the client cache */
+};
+typedef struct _RDPGFX_SERVER_CACHE_SLOT RDPGFX_SERVER_CACHE_SLOT;
+
 struct _rdpgfx_server_private
 {
 	ZGFX_CONTEXT* zgfx;
@@ -35,6 +45,23 @@ struct _rdpgfx_server_private
 	wStream* input_stream;
 	BOOL isOpened;
 	BOOL isReady;
+	wStreamPool* pool;
+
+	/* Protects batch and batchOwner, and keeps the ZGFX compression and the channel write of
+	 * a packet together. Only held for short sections, never across API calls. */
+	CRITICAL_SECTION batchLock;
+	wStream* batch;
+	DWORD batchOwner; /* Thread collecting the batch */
+	size_t batchPduStart;
+
+	CRITICAL_SECTION cacheLock;
+	wHashTable* cacheIndex; /* cacheKey to cache slot */
+	RDPGFX_SERVER_CACHE_SLOT* cacheSlots;
+	UINT16 maxCacheSlots;
+	UINT32 maxCacheSize;
+	UINT64 cacheSize;     /* Bytes held by all used slots */
+	UINT16 usedCacheSlots;
+	UINT16 nextCacheSlot; /* Where rdpgfx_server_cache_alloc_slot continues */
 };
 
 #endif /* FREERDP_CHANNEL_RDPGFX_SERVER_MAIN_H */
@@ -28,6 +28,7 @@
 #include <string.h>
 
 #include <winpr/crt.h>
+#include <winpr/interlocked.h>
 #include <winpr/print.h>
 #include <winpr/stream.h>
 
@@ -36,6 +37,9 @@
 #include "rdpsnd_common.h"
 #include "rdpsnd_main.h"
 
+static RdpsndServerSource* rdpsnd_server_context_get_source(RdpsndServerContext* context);
+static void rdpsnd_server_source_release(RdpsndServerSource* source);
+
 /**
  * Function description
  *
@@ -101,6 +105,9 @@ static UINT rdpsnd_server_recv_waveconfirm(RdpsndServerContext* context, wStream
 	Stream_Read_UINT16(s, timestamp);
 	Stream_Read_UINT8(s, confirmBlockNum);
 	Stream_Seek_UINT8(s);
+	EnterCriticalSection(&context->priv->lock);
+	context->priv->confirmed_block_no = confirmBlockNum + 1;
+	LeaveCriticalSection(&context->priv->lock);
 	IFCALLRET(context->ConfirmBlock, error, context, confirmBlockNum, timestamp);
 
 	if (error)
@@ -285,6 +292,57 @@ static UINT rdpsnd_server_initialize(RdpsndServerContext* context, BOOL ownThrea
 	return context->Start(context);
 }
 
+/**
+ * Function description
+ * Number of source frames encoded into one wave PDU for the given
+ * client format and latency.
+ */
+static int rdpsnd_server_block_frames(const AUDIO_FORMAT* src_format, const AUDIO_FORMAT* format,
+                                      int latency)
+{
+	int bs;
+	int frames = src_format->nSamplesPerSec * latency / 1000;
+
+	if (frames < 1)
+		frames = 1;
+
+	switch (format->wFormatTag)
+	{
+		case WAVE_FORMAT_DVI_ADPCM:
+			bs = (format->nBlockAlign - 4 * format->nChannels) * 4;
+			frames -= frames % bs;
+
+			if (frames < bs)
+				frames = bs;
+
+			break;
+
+		case WAVE_FORMAT_ADPCM:
+			bs = (format->nBlockAlign - 7 * format->nChannels) * 2 / format->nChannels + 2;
+			frames -= frames % bs;
+
+			if (frames < bs)
+				frames = bs;
+
+			break;
+	}
+
+	return frames;
+}
+
+static BOOL rdpsnd_server_format_equal(const AUDIO_FORMAT* a, const AUDIO_FORMAT* b)
+{
+	if ((a->wFormatTag != b->wFormatTag) || (a->nChannels != b->nChannels) ||
+	    (a->nSamplesPerSec != b->nSamplesPerSec) || (a->nBlockAlign != b->nBlockAlign) ||
+	    (a->wBitsPerSample != b->wBitsPerSample) || (a->cbSize != b->cbSize))
+		return FALSE;
+
+	if (a->cbSize > 0)
+		return memcmp(a->data, b->data, a->cbSize) == 0;
+
+	return TRUE;
+}
+
 /**
  * Function description
  *
@@ -292,9 +350,10 @@ static UINT rdpsnd_server_initialize(RdpsndServerContext* context, BOOL ownThrea
  */
 static UINT rdpsnd_server_select_format(RdpsndServerContext* context, UINT16 client_format_index)
 {
-	int bs;
 	int out_buffer_size;
 	AUDIO_FORMAT* format;
+	RdpsndServerSource* source;
+	BOOL changed = TRUE;
 	UINT error = CHANNEL_RC_OK;
 
 	if ((client_format_index >= context->num_client_formats) || (!context->src_format))
@@ -307,9 +366,14 @@ static UINT rdpsnd_server_select_format(RdpsndServerContext* context, UINT16 cli
 	context->priv->src_bytes_per_sample = context->src_format->wBitsPerSample / 8;
 	context->priv->src_bytes_per_frame =
 	    context->priv->src_bytes_per_sample * context->src_format->nChannels;
-	context->selected_client_format = client_format_index;
 	format = &context->client_formats[client_format_index];
 
+	if (context->selected_client_format < context->num_client_formats)
+		changed = !rdpsnd_server_format_equal(
+		    &context->client_formats[context->selected_client_format], format);
+
+	context->selected_client_format = client_format_index;
+
 	if (format->nSamplesPerSec == 0)
 	{
 		WLog_ERR(TAG, "invalid Client Sound Format!!");
@@ -320,32 +384,8 @@ static UINT rdpsnd_server_select_format(RdpsndServerContext* context, UINT16 cli
 	if (context->latency <= 0)
 		context->latency = 50;
 
-	context->priv->out_frames = context->src_format->nSamplesPerSec * context->latency / 1000;
-
-	if (context->priv->out_frames < 1)
-		context->priv->out_frames = 1;
-
-	switch (format->wFormatTag)
-	{
-		case WAVE_FORMAT_DVI_ADPCM:
-			bs = (format->nBlockAlign - 4 * format->nChannels) * 4;
-			context->priv->out_frames -= context->priv->out_frames % bs;
-
-			if (context->priv->out_frames < bs)
-				context->priv->out_frames = bs;
-
-			break;
-
-		case WAVE_FORMAT_ADPCM:
-			bs = (format->nBlockAlign - 7 * format->nChannels) * 2 / format->nChannels + 2;
-			context->priv->out_frames -= context->priv->out_frames % bs;
-
-			if (context->priv->out_frames < bs)
-				context->priv->out_frames = bs;
-
-			break;
-	}
-
+	context->priv->out_frames =
+	    rdpsnd_server_block_frames(context->src_format, format, context->latency);
 	context->priv->out_pending_frames = 0;
 	out_buffer_size = context->priv->out_frames * context->priv->src_bytes_per_frame;
 
@@ -368,6 +408,17 @@ static UINT rdpsnd_server_select_format(RdpsndServerContext* context, UINT16 cli
 	freerdp_dsp_context_reset(context->priv->dsp_context, format, 0u);
 out:
 	LeaveCriticalSection(&context->priv->lock);
+	source = rdpsnd_server_context_get_source(context);
+
+	/* Move a shared source subscription to the encoder of the new format. Done without the
+	 * context lock, the source sends to its contexts with its own lock held. */
+	if (!error && changed && source && !rdpsnd_server_source_add_context(source, context))
+	{
+		WLog_ERR(TAG, "rdpsnd_server_source_add_context failed!");
+		error = CHANNEL_RC_NO_MEMORY;
+	}
+
+	rdpsnd_server_source_release(source);
 	return error;
 }
 
@@ -391,17 +442,44 @@ static BOOL rdpsnd_server_align_wave_pdu(wStream* s, UINT32 alignment)
 	return TRUE;
 }
 
+/**
+ * Function description
+ * Append the audio data of a wave PDU. If encoded is NULL the pending
+ * frames of the context are encoded, otherwise the already encoded block
+ * is copied.
+ *
+ * @return TRUE on success, FALSE otherwise
+ */
+static BOOL rdpsnd_server_write_wave_data(RdpsndServerContext* context, wStream* s,
+                                          const BYTE* encoded, size_t encodedLength)
+{
+	size_t length;
+	const BYTE* src;
+
+	if (encoded)
+	{
+		if (!Stream_EnsureRemainingCapacity(s, encodedLength))
+			return FALSE;
+
+		Stream_Write(s, encoded, encodedLength);
+		return TRUE;
+	}
+
+	src = context->priv->out_buffer;
+	length = context->priv->out_pending_frames * context->priv->src_bytes_per_frame * 1ULL;
+	return freerdp_dsp_encode(context->priv->dsp_context, context->src_format, src, length, s);
+}
+
 /**
  * Function description
  * context->priv->lock should be obtained before calling this function
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT rdpsnd_server_send_wave_pdu(RdpsndServerContext* context, UINT16 wTimestamp)
+static UINT rdpsnd_server_send_wave_pdu(RdpsndServerContext* context, UINT16 wTimestamp,
+                                        const BYTE* encoded, size_t encodedLength)
 {
-	size_t length;
 	size_t start, end = 0;
-	const BYTE* src;
 	AUDIO_FORMAT* format;
 	ULONG written;
 	wStream* s = context->priv->rdpsnd_pdu;
@@ -421,10 +499,8 @@ static UINT rdpsnd_server_send_wave_pdu(RdpsndServerContext* context, UINT16 wTi
 	Stream_Write_UINT8(s, context->block_no);                /* cBlockNo */
 	Stream_Seek(s, 3);                                       /* bPad */
 	start = Stream_GetPosition(s);
-	src = context->priv->out_buffer;
-	length = context->priv->out_pending_frames * context->priv->src_bytes_per_frame * 1ULL;
 
-	if (!freerdp_dsp_encode(context->priv->dsp_context, context->src_format, src, length, s))
+	if (!rdpsnd_server_write_wave_data(context, s, encoded, encodedLength))
 		return ERROR_INTERNAL_ERROR;
 	else
 	{
@@ -466,7 +542,6 @@ static UINT rdpsnd_server_send_wave_pdu(RdpsndServerContext* context, UINT16 wTi
 
 out:
 	Stream_SetPosition(s, 0);
-	context->priv->out_pending_frames = 0;
 	return error;
 }
 
@@ -476,11 +551,10 @@ out:
  *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT rdpsnd_server_send_wave2_pdu(RdpsndServerContext* context, UINT16 wTimestamp)
+static UINT rdpsnd_server_send_wave2_pdu(RdpsndServerContext* context, UINT16 wTimestamp,
+                                         const BYTE* encoded, size_t encodedLength)
 {
-	size_t length;
 	size_t end = 0;
-	const BYTE* src;
 	AUDIO_FORMAT* format;
 	ULONG written;
 	wStream* s = context->priv->rdpsnd_pdu;
@@ -500,10 +574,8 @@ static UINT rdpsnd_server_send_wave2_pdu(RdpsndServerContext* context, UINT16 wT
 	Stream_Write_UINT8(s, context->block_no);                /* cBlockNo */
 	Stream_Seek(s, 3);                                       /* bPad */
 	Stream_Write_UINT32(s, wTimestamp);                      /* dwAudioTimeStamp */
-	src = context->priv->out_buffer;
-	length = context->priv->out_pending_frames * context->priv->src_bytes_per_frame;
 
-	if (!freerdp_dsp_encode(context->priv->dsp_context, context->src_format, src, length, s))
+	if (!rdpsnd_server_write_wave_data(context, s, encoded, encodedLength))
 		error = ERROR_INTERNAL_ERROR;
 	else
 	{
@@ -530,17 +602,47 @@ static UINT rdpsnd_server_send_wave2_pdu(RdpsndServerContext* context, UINT16 wT
 	}
 
 	Stream_SetPosition(s, 0);
-	context->priv->out_pending_frames = 0;
 	return error;
 }
 
 /* Wrapper function to send WAVE or WAVE2 PDU depending on client connected */
 static UINT rdpsnd_server_send_audio_pdu(RdpsndServerContext* context, UINT16 wTimestamp)
 {
+	UINT error;
+
 	if (context->clientVersion >= CHANNEL_VERSION_WIN_8)
-		return rdpsnd_server_send_wave2_pdu(context, wTimestamp);
+		error = rdpsnd_server_send_wave2_pdu(context, wTimestamp, NULL, 0);
 	else
-		return rdpsnd_server_send_wave_pdu(context, wTimestamp);
+		error = rdpsnd_server_send_wave_pdu(context, wTimestamp, NULL, 0);
+
+	/* The pending frames are gone even if sending failed */
+	context->priv->out_pending_frames = 0;
+	return error;
+}
+
+/**
+ * Send an audio block encoded by a shared RdpsndServerSource. The block is
+ * dropped if maxPending (0 for no limit) blocks are already unconfirmed.
+ */
+static UINT rdpsnd_server_send_encoded_pdu(RdpsndServerContext* context, UINT16 wTimestamp,
+                                           const BYTE* encoded, size_t encodedLength,
+                                           UINT32 maxPending)
+{
+	UINT8 pending;
+	UINT error = CHANNEL_RC_OK;
+	EnterCriticalSection(&context->priv->lock);
+	pending = context->block_no - context->priv->confirmed_block_no;
+
+	/* Drop the block for clients lagging behind instead of queueing it */
+	if ((maxPending > 0) && (pending >= maxPending))
+		WLog_DBG(TAG, "Dropping audio block, %" PRIu8 " blocks not confirmed", pending);
+	else if (context->clientVersion >= CHANNEL_VERSION_WIN_8)
+		error = rdpsnd_server_send_wave2_pdu(context, wTimestamp, encoded, encodedLength);
+	else
+		error = rdpsnd_server_send_wave_pdu(context, wTimestamp, encoded, encodedLength);
+
+	LeaveCriticalSection(&context->priv->lock);
+	return error;
 }
 
 /**
@@ -857,6 +959,14 @@ void rdpsnd_server_context_reset(RdpsndServerContext* context)
 
 void rdpsnd_server_context_free(RdpsndServerContext* context)
 {
+	RdpsndServerSource* source = rdpsnd_server_context_get_source(context);
+
+	if (source)
+	{
+		rdpsnd_server_source_remove_context(source, context);
+		rdpsnd_server_source_release(source);
+	}
+
 	if (context->priv->ChannelHandle)
 		WTSVirtualChannelClose(context->priv->ChannelHandle);
 
@@ -980,3 +1090,375 @@ UINT rdpsnd_server_handle_messages(RdpsndServerContext* context)
 	Stream_SetPosition(s, 0);
 	return ret;
 }
+
+static void rdpsnd_server_encoder_free(RdpsndServerEncoder* encoder)
+{
+	if (!encoder)
+		return;
+
+	ArrayList_Free(encoder->contexts);
+	Stream_Free(encoder->encoded, TRUE);
+	free(encoder->buffer);
+	freerdp_dsp_context_free(encoder->dsp_context);
+	audio_format_free(&encoder->format);
+	free(encoder);
+}
+
+static RdpsndServerEncoder* rdpsnd_server_encoder_new(const RdpsndServerSource* source,
+                                                      const AUDIO_FORMAT* format)
+{
+	RdpsndServerEncoder* encoder = (RdpsndServerEncoder*)calloc(1, sizeof(RdpsndServerEncoder));
+
+	if (!encoder)
+		return NULL;
+
+	if (!audio_format_copy(format, &encoder->format))
+		goto fail;
+
+	encoder->dsp_context = freerdp_dsp_context_new(TRUE);
+
+	if (!encoder->dsp_context || !freerdp_dsp_context_reset(encoder->dsp_context, format, 0u))
+		goto fail;
+
+	encoder->frames = rdpsnd_server_block_frames(&source->src_format, format, source->latency);
+	encoder->buffer = (BYTE*)calloc(encoder->frames, source->src_bytes_per_frame);
+	encoder->encoded = Stream_New(NULL, 4096);
+	encoder->contexts = ArrayList_New(FALSE);
+
+	if (!encoder->buffer || !encoder->encoded || !encoder->contexts)
+		goto fail;
+
+	return encoder;
+fail:
+	WLog_ERR(TAG, "Failed to create encoder for format %s",
+	         audio_format_get_tag_string(format->wFormatTag));
+	rdpsnd_server_encoder_free(encoder);
+	return NULL;
+}
+
+/**
+ * Function description
+ * Encode the pending frames of an encoder once and send the block to
+ * every context subscribed to it.
+ * source->lock should be obtained before calling this function
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpsnd_server_encoder_flush(const RdpsndServerSource* source,
+                                        RdpsndServerEncoder* encoder, UINT16 wTimestamp)
+{
+	size_t index;
+	BOOL rc;
+	UINT error = CHANNEL_RC_OK;
+	wStream* s = encoder->encoded;
+
+	Stream_SetPosition(s, 0);
+	rc = freerdp_dsp_encode(encoder->dsp_context, &source->src_format, encoder->buffer,
+	                        encoder->pending_frames * source->src_bytes_per_frame, s);
+	encoder->pending_frames = 0;
+
+	if (!rc)
+	{
+		WLog_ERR(TAG, "freerdp_dsp_encode failed!");
+		return ERROR_INTERNAL_ERROR;
+	}
+
+	for (index = 0; index < ArrayList_Count(encoder->contexts); index++)
+	{
+		RdpsndServerContext* context = ArrayList_GetItem(encoder->contexts, index);
+		const UINT status =
+		    rdpsnd_server_send_encoded_pdu(context, wTimestamp, Stream_Buffer(s),
+		                                   Stream_GetPosition(s), source->max_pending_blocks);
+
+		if (status != CHANNEL_RC_OK)
+		{
+			WLog_WARN(TAG, "rdpsnd_server_send_encoded_pdu failed with error %" PRIu32 "",
+			          status);
+			error = status;
+		}
+	}
+
+	return error;
+}
+
+RdpsndServerSource* rdpsnd_server_source_new(const AUDIO_FORMAT* src_format, int latency)
+{
+	RdpsndServerSource* source;
+
+	if (!src_format || (src_format->wFormatTag != WAVE_FORMAT_PCM) ||
+	    (src_format->wBitsPerSample < 8) || (src_format->nChannels == 0))
+	{
+		WLog_ERR(TAG, "Source format must be PCM");
+		return NULL;
+	}
+
+	source = (RdpsndServerSource*)calloc(1, sizeof(RdpsndServerSource));
+
+	if (!source)
+	{
+		WLog_ERR(TAG, "calloc failed!");
+		return NULL;
+	}
+
+	if (!audio_format_copy(src_format, &source->src_format))
+		goto fail;
+
+	source->src_bytes_per_frame = src_format->wBitsPerSample / 8 * src_format->nChannels;
+	source->latency = (latency > 0) ? latency : 50;
+	source->encoders = ArrayList_New(FALSE);
+
+	if (!source->encoders)
+		goto fail;
+
+	ArrayList_Object(source->encoders)->fnObjectFree =
+	    (OBJECT_FREE_FN)rdpsnd_server_encoder_free;
+
+	if (!InitializeCriticalSectionAndSpinCount(&source->lock, 4000))
+		goto fail;
+
+	source->refs = 1;
+	return source;
+fail:
+	ArrayList_Free(source->encoders);
+	audio_format_free(&source->src_format);
+	free(source);
+	return NULL;
+}
+
+static void rdpsnd_server_source_release(RdpsndServerSource* source)
+{
+	if (!source || (InterlockedDecrement(&source->refs) > 0))
+		return;
+
+	ArrayList_Free(source->encoders);
+	DeleteCriticalSection(&source->lock);
+	audio_format_free(&source->src_format);
+	free(source);
+}
+
+/**
+ * Function description
+ * The source a context is subscribed to, with a reference the caller releases. Taken under
+ * the context lock, the source drops the reference of a context only after detaching it
+ * there.
+ *
+ * @return the source or NULL if the context is not subscribed
+ */
+static RdpsndServerSource* rdpsnd_server_context_get_source(RdpsndServerContext* context)
+{
+	RdpsndServerSource* source;
+
+	EnterCriticalSection(&context->priv->lock);
+	source = context->priv->source;
+
+	if (source)
+		InterlockedIncrement(&source->refs);
+
+	LeaveCriticalSection(&context->priv->lock);
+	return source;
+}
+
+/* source->lock must be held */
+static void rdpsnd_server_context_set_source(RdpsndServerContext* context,
+                                             RdpsndServerSource* source)
+{
+	EnterCriticalSection(&context->priv->lock);
+	context->priv->source = source;
+	LeaveCriticalSection(&context->priv->lock);
+}
+
+void rdpsnd_server_source_free(RdpsndServerSource* source)
+{
+	size_t x, y;
+
+	if (!source)
+		return;
+
+	EnterCriticalSection(&source->lock);
+
+	for (x = 0; x < ArrayList_Count(source->encoders); x++)
+	{
+		RdpsndServerEncoder* encoder = ArrayList_GetItem(source->encoders, x);
+
+		for (y = 0; y < ArrayList_Count(encoder->contexts); y++)
+		{
+			RdpsndServerContext* context = ArrayList_GetItem(encoder->contexts, y);
+			rdpsnd_server_context_set_source(context, NULL);
+			InterlockedDecrement(&source->refs);
+		}
+	}
+
+	ArrayList_Clear(source->encoders);
+	LeaveCriticalSection(&source->lock);
+
+	/* Contexts being freed meanwhile still hold a reference */
+	rdpsnd_server_source_release(source);
+}
+
+void rdpsnd_server_source_set_max_pending_blocks(RdpsndServerSource* source, UINT32 count)
+{
+	if (!source)
+		return;
+
+	EnterCriticalSection(&source->lock);
+	source->max_pending_blocks = count;
+	LeaveCriticalSection(&source->lock);
+}
+
+/**
+ * Function description
+ * Subscribe a context to the source. The context must have selected a
+ * client format, samples are then encoded once for all contexts sharing
+ * that format.
+ *
+ * @return TRUE on success, FALSE otherwise
+ */
+BOOL rdpsnd_server_source_add_context(RdpsndServerSource* source, RdpsndServerContext* context)
+{
+	size_t index;
+	BOOL rc = FALSE;
+	const AUDIO_FORMAT* format;
+	RdpsndServerSource* previous;
+	RdpsndServerEncoder* encoder = NULL;
+
+	if (!source || !context)
+		return FALSE;
+
+	if (context->selected_client_format >= context->num_client_formats)
+	{
+		WLog_ERR(TAG, "No client format selected");
+		return FALSE;
+	}
+
+	previous = rdpsnd_server_context_get_source(context);
+
+	if (previous)
+	{
+		rdpsnd_server_source_remove_context(previous, context);
+		rdpsnd_server_source_release(previous);
+	}
+
+	format = &context->client_formats[context->selected_client_format];
+	EnterCriticalSection(&source->lock);
+
+	for (index = 0; index < ArrayList_Count(source->encoders); index++)
+	{
+		RdpsndServerEncoder* cur = ArrayList_GetItem(source->encoders, index);
+
+		if (rdpsnd_server_format_equal(&cur->format, format))
+		{
+			encoder = cur;
+			break;
+		}
+	}
+
+	if (!encoder)
+	{
+		encoder = rdpsnd_server_encoder_new(source, format);
+
+		if (!encoder)
+			goto out;
+
+		if (!ArrayList_Append(source->encoders, encoder))
+		{
+			rdpsnd_server_encoder_free(encoder);
+			goto out;
+		}
+	}
+
+	if (!ArrayList_Append(encoder->contexts, context))
+		goto out;
+
+	InterlockedIncrement(&source->refs);
+	rdpsnd_server_context_set_source(context, source);
+	rc = TRUE;
+out:
+	LeaveCriticalSection(&source->lock);
+	return rc;
+}
+
+BOOL rdpsnd_server_source_remove_context(RdpsndServerSource* source, RdpsndServerContext* context)
+{
+	size_t index;
+	BOOL rc = FALSE;
+
+	if (!source || !context)
+		return FALSE;
+
+	EnterCriticalSection(&source->lock);
+
+	for (index = 0; index < ArrayList_Count(source->encoders); index++)
+	{
+		RdpsndServerEncoder* encoder = ArrayList_GetItem(source->encoders, index);
+
+		if (!ArrayList_Contains(encoder->contexts, context))
+			continue;
+
+		ArrayList_Remove(encoder->contexts, context);
+
+		/* Drop the encoder with its last subscriber */
+		if (ArrayList_Count(encoder->contexts) == 0)
+			ArrayList_RemoveAt(source->encoders, index);
+
+		rdpsnd_server_context_set_source(context, NULL);
+		rc = TRUE;
+		break;
+	}
+
+	LeaveCriticalSection(&source->lock);
+
+	/* The caller holds a reference of its own, this never frees the source */
+	if (rc)
+		InterlockedDecrement(&source->refs);
+
+	return rc;
+}
+
+/**
+ * Function description
+ * Send audio samples to all contexts subscribed to the source. Actually
+ * bytes in the buffer must be:
+ * nframes * src_format.nBitsPerSample * src_format.nChannels / 8
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+UINT rdpsnd_server_source_send_samples(RdpsndServerSource* source, const void* buf, int nframes,
+                                       UINT16 wTimestamp)
+{
+	size_t index;
+	UINT error = CHANNEL_RC_OK;
+
+	if (!source || !buf || (nframes < 0))
+		return ERROR_INVALID_PARAMETER;
+
+	EnterCriticalSection(&source->lock);
+
+	for (index = 0; index < ArrayList_Count(source->encoders); index++)
+	{
+		RdpsndServerEncoder* encoder = ArrayList_GetItem(source->encoders, index);
+		const BYTE* src = (const BYTE*)buf;
+		size_t remaining = (size_t)nframes;
+
+		while (remaining > 0)
+		{
+			const size_t cframes = MIN(remaining, encoder->frames - encoder->pending_frames);
+			const size_t cframesize = cframes * source->src_bytes_per_frame;
+			CopyMemory(encoder->buffer + (encoder->pending_frames * source->src_bytes_per_frame),
+			           src, cframesize);
+			src += cframesize;
+			remaining -= cframes;
+			encoder->pending_frames += cframes;
+
+			if (encoder->pending_frames >= encoder->frames)
+			{
+				const UINT status = rdpsnd_server_encoder_flush(source, encoder, wTimestamp);
+
+				if (status != CHANNEL_RC_OK)
+					error = status;
+			}
+		}
+	}
+
+	LeaveCriticalSection(&source->lock);
+	return error;
+}
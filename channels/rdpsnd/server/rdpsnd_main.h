@@ -24,6 +24,7 @@
 #include <winpr/crt.h>
 #include <winpr/synch.h>
 #include <winpr/thread.h>
+#include <winpr/collections.h>
 
 #include <freerdp/codec/dsp.h>
 #include <freerdp/channels/wtsvc.h>
@@ -53,6 +54,32 @@ struct _rdpsnd_server_private
 	UINT32 src_bytes_per_frame;
 	FREERDP_DSP_CONTEXT* dsp_context;
 	CRITICAL_SECTION lock; /* Protect out_buffer and related parameters */
+	RdpsndServerSource* source; /* Protected by lock, holds a reference of the source */
+	UINT8 confirmed_block_no; /* Block following the last confirmed one, protected by lock */
+};
+
+/* One encoder per client format of a shared source */
+struct _rdpsnd_server_encoder
+{
+	AUDIO_FORMAT format;
+	FREERDP_DSP_CONTEXT* dsp_context;
+	BYTE* buffer;
+	size_t frames;
+	size_t pending_frames;
+	wStream* encoded;
+	wArrayList* contexts;
+};
+typedef struct _rdpsnd_server_encoder RdpsndServerEncoder;
+
+struct _rdpsnd_server_source
+{
+	AUDIO_FORMAT src_format;
+	UINT32 src_bytes_per_frame;
+	int latency;
+	UINT32 max_pending_blocks;
+	CRITICAL_SECTION lock; /* Protect encoders and their subscribed contexts */
+	wArrayList* encoders;
+	LONG refs; /* One for the owner and one per subscribed context */
 };
 
 #endif /* FREERDP_CHANNEL_RDPSND_SERVER_MAIN_H */
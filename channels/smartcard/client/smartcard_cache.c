@@ -0,0 +1,805 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Smartcard Device Service Virtual Channel
+ * Reader State Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/wlog.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/collections.h>
+
+#include <freerdp/types.h>
+#include <freerdp/channels/log.h>
+
+#include "smartcard_cache.h"
+
+#define TAG CHANNELS_TAG("smartcard.client")
+
+static const char SMARTCARD_CACHE_PNP_NOTIFICATION[] = "\\\\?PnP?\\Notification";
+
+typedef struct
+{
+	char* name;
+	DWORD dwEventState;
+	DWORD cbAtr;
+	BYTE rgbAtr[36];
+} SMARTCARD_CACHED_READER;
+
+typedef struct
+{
+	SCARDCONTEXT hContext;
+	HANDLE event;
+	BOOL cancelled;
+} SMARTCARD_CACHE_WAITER;
+
+struct _SMARTCARD_READER_CACHE
+{
+	SCardApiFunctionTable defaultApi;
+	const SCardApiFunctionTable* api;
+
+	CRITICAL_SECTION lock;
+	BOOL started;
+	BOOL valid;
+	SMARTCARD_CACHED_READER* readers; /* includes the PnP notification entry */
+	DWORD count;
+	LPSTR mszReaders;
+	DWORD cchReaders;
+	wArrayList* waiters;
+
+	SCARDCONTEXT hContext;
+	HANDLE thread;
+	HANDLE stopEvent;
+};
+
+static void smartcard_cache_free_readers(SMARTCARD_CACHED_READER* readers, DWORD count)
+{
+	DWORD index;
+
+	if (!readers)
+		return;
+
+	for (index = 0; index < count; index++)
+		free(readers[index].name);
+
+	free(readers);
+}
+
+static void smartcard_cache_free_states(SCARD_READERSTATEA* states, DWORD count)
+{
+	DWORD index;
+
+	if (!states)
+		return;
+
+	for (index = 0; index < count; index++)
+		free((char*)states[index].szReader);
+
+	free(states);
+}
+
+/* Must be called with the cache locked */
+static void smartcard_cache_wake_waiters(SMARTCARD_READER_CACHE* cache)
+{
+	size_t index;
+	const size_t count = ArrayList_Count(cache->waiters);
+
+	for (index = 0; index < count; index++)
+	{
+		SMARTCARD_CACHE_WAITER* waiter = ArrayList_GetItem(cache->waiters, index);
+		SetEvent(waiter->event);
+	}
+}
+
+static void smartcard_cache_invalidate(SMARTCARD_READER_CACHE* cache)
+{
+	EnterCriticalSection(&cache->lock);
+	cache->valid = FALSE;
+	smartcard_cache_wake_waiters(cache);
+	LeaveCriticalSection(&cache->lock);
+}
+
+static BOOL smartcard_cache_publish(SMARTCARD_READER_CACHE* cache, const SCARD_READERSTATEA* states,
+                                    DWORD count)
+{
+	DWORD index;
+	SMARTCARD_CACHED_READER* readers = calloc(MAX(count, 1), sizeof(SMARTCARD_CACHED_READER));
+
+	if (!readers)
+		return FALSE;
+
+	for (index = 0; index < count; index++)
+	{
+		readers[index].name = _strdup(states[index].szReader);
+
+		if (!readers[index].name)
+		{
+			smartcard_cache_free_readers(readers, count);
+			return FALSE;
+		}
+
+		readers[index].dwEventState = states[index].dwEventState & ~SCARD_STATE_CHANGED;
+		readers[index].cbAtr = MIN(states[index].cbAtr, sizeof(readers[index].rgbAtr));
+		CopyMemory(readers[index].rgbAtr, states[index].rgbAtr, readers[index].cbAtr);
+	}
+
+	EnterCriticalSection(&cache->lock);
+	smartcard_cache_free_readers(cache->readers, cache->count);
+	cache->readers = readers;
+	cache->count = count;
+	cache->valid = TRUE;
+	smartcard_cache_wake_waiters(cache);
+	LeaveCriticalSection(&cache->lock);
+	return TRUE;
+}
+
+static DWORD smartcard_cache_known_state(const SCARD_READERSTATEA* states, DWORD count,
+                                         const char* name)
+{
+	DWORD index;
+
+	for (index = 0; index < count; index++)
+	{
+		if (strcmp(states[index].szReader, name) == 0)
+			return states[index].dwCurrentState;
+	}
+
+	return SCARD_STATE_UNAWARE;
+}
+
+/**
+ * Lists the readers of PC/SC and builds the reader states the monitor waits on, readers
+ * already known keep their state, new readers start unaware. The PnP notification entry is
+ * last if PC/SC supports it.
+ */
+static LONG smartcard_cache_list(SMARTCARD_READER_CACHE* cache, BOOL pnp,
+                                 SCARD_READERSTATEA** pStates, DWORD* pCount)
+{
+	LONG status;
+	DWORD index = 0;
+	DWORD readers = 0;
+	DWORD count;
+	const char* name;
+	LPSTR mszReaders = NULL;
+	LPSTR copy = NULL;
+	DWORD cchReaders = SCARD_AUTOALLOCATE;
+	SCARD_READERSTATEA* states;
+
+	status =
+	    cache->api->pfnSCardListReadersA(cache->hContext, NULL, (LPSTR)&mszReaders, &cchReaders);
+
+	if (status == SCARD_E_NO_READERS_AVAILABLE)
+	{
+		mszReaders = NULL;
+		cchReaders = 0;
+	}
+	else if (status != SCARD_S_SUCCESS)
+		return status;
+
+	for (name = mszReaders; name && (name < mszReaders + cchReaders) && *name;
+	     name += strlen(name) + 1)
+		readers++;
+
+	count = pnp ? readers + 1 : readers;
+	states = calloc(MAX(count, 1), sizeof(SCARD_READERSTATEA));
+
+	if (cchReaders > 0)
+		copy = malloc(cchReaders);
+
+	if (!states || ((cchReaders > 0) && !copy))
+		goto fail;
+
+	for (name = mszReaders; index < readers; name += strlen(name) + 1)
+	{
+		states[index].szReader = _strdup(name);
+		states[index].dwCurrentState = smartcard_cache_known_state(*pStates, *pCount, name);
+
+		if (!states[index++].szReader)
+			goto fail;
+	}
+
+	if (pnp)
+	{
+		states[index].szReader = _strdup(SMARTCARD_CACHE_PNP_NOTIFICATION);
+		states[index].dwCurrentState =
+		    smartcard_cache_known_state(*pStates, *pCount, SMARTCARD_CACHE_PNP_NOTIFICATION);
+
+		if (!states[index].szReader)
+			goto fail;
+	}
+
+	if (copy)
+		CopyMemory(copy, mszReaders, cchReaders);
+
+	EnterCriticalSection(&cache->lock);
+	free(cache->mszReaders);
+	cache->mszReaders = copy;
+	cache->cchReaders = cchReaders;
+	LeaveCriticalSection(&cache->lock);
+
+	if (mszReaders)
+		cache->api->pfnSCardFreeMemory(cache->hContext, mszReaders);
+
+	smartcard_cache_free_states(*pStates, *pCount);
+	*pStates = states;
+	*pCount = count;
+	return SCARD_S_SUCCESS;
+fail:
+	if (mszReaders)
+		cache->api->pfnSCardFreeMemory(cache->hContext, mszReaders);
+
+	smartcard_cache_free_states(states, count);
+	free(copy);
+	return SCARD_E_NO_MEMORY;
+}
+
+static BOOL smartcard_cache_establish(SMARTCARD_READER_CACHE* cache)
+{
+	SCARDCONTEXT hContext = 0;
+	const LONG status =
+	    cache->api->pfnSCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &hContext);
+
+	if (status != SCARD_S_SUCCESS)
+	{
+		WLog_DBG(TAG, "reader cache: SCardEstablishContext failed with %s",
+		         SCardGetErrorString(status));
+		return FALSE;
+	}
+
+	EnterCriticalSection(&cache->lock);
+	cache->hContext = hContext;
+	LeaveCriticalSection(&cache->lock);
+	return TRUE;
+}
+
+/**
+ * PC/SC stacks without reader change notifications reject the PnP notification entry or
+ * report it as unknown, the monitor then polls the reader list instead.
+ */
+static BOOL smartcard_cache_probe_pnp(SMARTCARD_READER_CACHE* cache)
+{
+	LONG status;
+	SCARD_READERSTATEA state = { 0 };
+	state.szReader = (LPSTR)SMARTCARD_CACHE_PNP_NOTIFICATION;
+	state.dwCurrentState = SCARD_STATE_UNAWARE;
+	status = cache->api->pfnSCardGetStatusChangeA(cache->hContext, 0, &state, 1);
+
+	if (((status != SCARD_S_SUCCESS) && (status != SCARD_E_TIMEOUT)) ||
+	    ((status == SCARD_S_SUCCESS) &&
+	     (state.dwEventState & (SCARD_STATE_UNKNOWN | SCARD_STATE_IGNORE))))
+	{
+		WLog_DBG(TAG, "reader cache: no PnP notifications (%s), polling the reader list",
+		         SCardGetErrorString(status));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static DWORD WINAPI smartcard_cache_monitor_thread(LPVOID arg)
+{
+	DWORD index;
+	DWORD count = 0;
+	BOOL pnp = FALSE;
+	BOOL relist = TRUE;
+	SCARD_READERSTATEA* states = NULL;
+	SMARTCARD_READER_CACHE* cache = (SMARTCARD_READER_CACHE*)arg;
+
+	while (WaitForSingleObject(cache->stopEvent, 0) == WAIT_TIMEOUT)
+	{
+		LONG status;
+
+		if (!cache->hContext)
+		{
+			if (!smartcard_cache_establish(cache))
+			{
+				WaitForSingleObject(cache->stopEvent, 1000);
+				continue;
+			}
+
+			pnp = smartcard_cache_probe_pnp(cache);
+			relist = TRUE;
+		}
+
+		if (relist)
+		{
+			status = smartcard_cache_list(cache, pnp, &states, &count);
+
+			if (status != SCARD_S_SUCCESS)
+			{
+				WLog_DBG(TAG, "reader cache: SCardListReadersA failed with %s",
+				         SCardGetErrorString(status));
+				smartcard_cache_invalidate(cache);
+				WaitForSingleObject(cache->stopEvent, 1000);
+				continue;
+			}
+
+			relist = FALSE;
+		}
+
+		/* Nothing to wait on without readers and PnP notifications */
+		if (count == 0)
+		{
+			if (!smartcard_cache_publish(cache, states, count))
+				smartcard_cache_invalidate(cache);
+
+			WaitForSingleObject(cache->stopEvent, SMARTCARD_CACHE_REFRESH_INTERVAL);
+			relist = TRUE;
+			continue;
+		}
+
+		status = cache->api->pfnSCardGetStatusChangeA(
+		    cache->hContext, SMARTCARD_CACHE_REFRESH_INTERVAL, states, count);
+
+		switch (status)
+		{
+			case SCARD_S_SUCCESS:
+				/* Readers were added or removed */
+				relist = pnp && (states[count - 1].dwEventState & SCARD_STATE_CHANGED);
+
+				for (index = 0; index < count; index++)
+					states[index].dwCurrentState =
+					    states[index].dwEventState & ~SCARD_STATE_CHANGED;
+
+				if (!smartcard_cache_publish(cache, states, count))
+					smartcard_cache_invalidate(cache);
+
+				break;
+
+			case SCARD_E_TIMEOUT:
+				/* PC/SC implementations without PnP notifications are polled */
+				relist = !pnp;
+				break;
+
+			case SCARD_E_CANCELLED:
+				break;
+
+			case SCARD_E_UNKNOWN_READER:
+				relist = TRUE;
+				break;
+
+			default:
+				WLog_DBG(TAG, "reader cache: SCardGetStatusChangeA failed with %s",
+				         SCardGetErrorString(status));
+				smartcard_cache_invalidate(cache);
+				relist = TRUE;
+
+				if ((status == SCARD_E_NO_SERVICE) || (status == SCARD_E_SERVICE_STOPPED) ||
+				    (status == SCARD_E_INVALID_HANDLE))
+				{
+					EnterCriticalSection(&cache->lock);
+					cache->api->pfnSCardReleaseContext(cache->hContext);
+					cache->hContext = 0;
+					LeaveCriticalSection(&cache->lock);
+				}
+
+				WaitForSingleObject(cache->stopEvent, 1000);
+				break;
+		}
+	}
+
+	smartcard_cache_free_states(states, count);
+	EnterCriticalSection(&cache->lock);
+
+	if (cache->hContext)
+		cache->api->pfnSCardReleaseContext(cache->hContext);
+
+	cache->hContext = 0;
+	LeaveCriticalSection(&cache->lock);
+	ExitThread(0);
+	return 0;
+}
+
+/* Must be called with the cache locked */
+static void smartcard_cache_start(SMARTCARD_READER_CACHE* cache)
+{
+	if (cache->started)
+		return;
+
+	cache->started = TRUE;
+	cache->thread = CreateThread(NULL, 0, smartcard_cache_monitor_thread, cache, 0, NULL);
+
+	if (!cache->thread)
+		WLog_ERR(TAG, "reader cache: CreateThread failed!");
+}
+
+SMARTCARD_READER_CACHE* smartcard_cache_new(const SCardApiFunctionTable* api)
+{
+	SMARTCARD_READER_CACHE* cache = calloc(1, sizeof(SMARTCARD_READER_CACHE));
+
+	if (!cache)
+		return NULL;
+
+	if (!api)
+	{
+		cache->defaultApi.pfnSCardEstablishContext = SCardEstablishContext;
+		cache->defaultApi.pfnSCardReleaseContext = SCardReleaseContext;
+		cache->defaultApi.pfnSCardListReadersA = SCardListReadersA;
+		cache->defaultApi.pfnSCardGetStatusChangeA = SCardGetStatusChangeA;
+		cache->defaultApi.pfnSCardCancel = SCardCancel;
+		cache->defaultApi.pfnSCardFreeMemory = SCardFreeMemory;
+		api = &cache->defaultApi;
+	}
+
+	cache->api = api;
+	cache->waiters = ArrayList_New(FALSE);
+	cache->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!cache->waiters || !cache->stopEvent ||
+	    !InitializeCriticalSectionAndSpinCount(&cache->lock, 4000))
+	{
+		ArrayList_Free(cache->waiters);
+
+		if (cache->stopEvent)
+			CloseHandle(cache->stopEvent);
+
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+void smartcard_cache_free(SMARTCARD_READER_CACHE* cache)
+{
+	if (!cache)
+		return;
+
+	if (cache->thread)
+	{
+		SetEvent(cache->stopEvent);
+
+		/* The monitor blocks in SCardGetStatusChange, cancel until it noticed the stop */
+		while (WaitForSingleObject(cache->thread, 50) == WAIT_TIMEOUT)
+		{
+			EnterCriticalSection(&cache->lock);
+
+			if (cache->hContext)
+				cache->api->pfnSCardCancel(cache->hContext);
+
+			LeaveCriticalSection(&cache->lock);
+		}
+
+		CloseHandle(cache->thread);
+	}
+
+	smartcard_cache_free_readers(cache->readers, cache->count);
+	free(cache->mszReaders);
+	ArrayList_Free(cache->waiters);
+	CloseHandle(cache->stopEvent);
+	DeleteCriticalSection(&cache->lock);
+	free(cache);
+}
+
+BOOL smartcard_cache_list_readers_a(SMARTCARD_READER_CACHE* cache, LPSTR* mszReaders,
+                                    LPDWORD pcchReaders, LONG* status)
+{
+	BOOL handled = FALSE;
+
+	if (!cache || !mszReaders || !pcchReaders || !status)
+		return FALSE;
+
+	EnterCriticalSection(&cache->lock);
+	smartcard_cache_start(cache);
+
+	if (cache->valid)
+	{
+		handled = TRUE;
+		*mszReaders = NULL;
+		*pcchReaders = 0;
+		*status = SCARD_E_NO_READERS_AVAILABLE;
+
+		if (cache->cchReaders > 0)
+		{
+			*mszReaders = malloc(cache->cchReaders);
+			*status = SCARD_E_NO_MEMORY;
+
+			if (*mszReaders)
+			{
+				CopyMemory(*mszReaders, cache->mszReaders, cache->cchReaders);
+				*pcchReaders = cache->cchReaders;
+				*status = SCARD_S_SUCCESS;
+			}
+		}
+	}
+
+	LeaveCriticalSection(&cache->lock);
+	return handled;
+}
+
+BOOL smartcard_cache_list_readers_w(SMARTCARD_READER_CACHE* cache, LPWSTR* mszReaders,
+                                    LPDWORD pcchReaders, LONG* status)
+{
+	int length;
+	LPSTR mszReadersA = NULL;
+	DWORD cchReadersA = 0;
+
+	if (!mszReaders || !pcchReaders || !status)
+		return FALSE;
+
+	if (!smartcard_cache_list_readers_a(cache, &mszReadersA, &cchReadersA, status))
+		return FALSE;
+
+	*mszReaders = NULL;
+	*pcchReaders = 0;
+
+	if (*status == SCARD_S_SUCCESS)
+	{
+		length = ConvertToUnicode(CP_UTF8, 0, mszReadersA, (int)cchReadersA, mszReaders, 0);
+
+		if (length <= 0)
+			*status = SCARD_E_NO_MEMORY;
+		else
+			*pcchReaders = (DWORD)length;
+	}
+
+	free(mszReadersA);
+	return TRUE;
+}
+
+static const SMARTCARD_CACHED_READER* smartcard_cache_find(const SMARTCARD_READER_CACHE* cache,
+                                                           const char* name)
+{
+	DWORD index;
+
+	for (index = 0; index < cache->count; index++)
+	{
+		if (strcmp(cache->readers[index].name, name) == 0)
+			return &cache->readers[index];
+	}
+
+	return NULL;
+}
+
+static BOOL smartcard_cache_state_changed(const char* name, DWORD cached, DWORD current)
+{
+	current &= ~SCARD_STATE_CHANGED;
+
+	/* The PnP entry carries the reader count in the high word, compare all of it */
+	if (strcmp(name, SMARTCARD_CACHE_PNP_NOTIFICATION) == 0)
+		return cached != current;
+
+	if (current == SCARD_STATE_UNAWARE)
+		return TRUE;
+
+	if ((cached & 0xFFFF) != (current & 0xFFFF))
+		return TRUE;
+
+	/* The high word counts card events, only compared if the caller tracks it */
+	return ((current >> 16) != 0) && ((cached >> 16) != (current >> 16));
+}
+
+/* Must be called with the cache locked, returns TRUE if any reader state changed */
+static BOOL smartcard_cache_evaluate(const SMARTCARD_READER_CACHE* cache,
+                                     LPSCARD_READERSTATEA rgReaderStates, DWORD cReaders)
+{
+	DWORD index;
+	BOOL changed = FALSE;
+
+	for (index = 0; index < cReaders; index++)
+	{
+		LPSCARD_READERSTATEA state = &rgReaderStates[index];
+		const SMARTCARD_CACHED_READER* reader = smartcard_cache_find(cache, state->szReader);
+
+		if (!reader)
+		{
+			/* The reader was removed while waiting */
+			state->dwEventState = SCARD_STATE_UNKNOWN | SCARD_STATE_CHANGED | SCARD_STATE_IGNORE;
+			state->cbAtr = 0;
+			changed = TRUE;
+			continue;
+		}
+
+		state->dwEventState = reader->dwEventState;
+		state->cbAtr = reader->cbAtr;
+		CopyMemory(state->rgbAtr, reader->rgbAtr, reader->cbAtr);
+
+		if (smartcard_cache_state_changed(reader->name, reader->dwEventState,
+		                                  state->dwCurrentState))
+		{
+			state->dwEventState |= SCARD_STATE_CHANGED;
+			changed = TRUE;
+		}
+	}
+
+	return changed;
+}
+
+/* Must be called with the cache locked */
+static BOOL smartcard_cache_can_answer(const SMARTCARD_READER_CACHE* cache,
+                                       LPSCARD_READERSTATEA rgReaderStates, DWORD cReaders)
+{
+	DWORD index;
+
+	if (!cache->valid || (cReaders == 0))
+		return FALSE;
+
+	for (index = 0; index < cReaders; index++)
+	{
+		if (!rgReaderStates[index].szReader ||
+		    (rgReaderStates[index].dwCurrentState & SCARD_STATE_IGNORE))
+			return FALSE;
+
+		if (!smartcard_cache_find(cache, rgReaderStates[index].szReader))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+BOOL smartcard_cache_get_status_change_a(SMARTCARD_READER_CACHE* cache, SCARDCONTEXT hContext,
+                                         DWORD dwTimeout, LPSCARD_READERSTATEA rgReaderStates,
+                                         DWORD cReaders, LONG* status)
+{
+	BOOL handled = TRUE;
+	const UINT64 start = GetTickCount64();
+	SMARTCARD_CACHE_WAITER waiter = { 0 };
+
+	if (!cache || !rgReaderStates || !status)
+		return FALSE;
+
+	EnterCriticalSection(&cache->lock);
+	smartcard_cache_start(cache);
+
+	if (!smartcard_cache_can_answer(cache, rgReaderStates, cReaders))
+	{
+		LeaveCriticalSection(&cache->lock);
+		return FALSE;
+	}
+
+	waiter.hContext = hContext;
+
+	while (!smartcard_cache_evaluate(cache, rgReaderStates, cReaders))
+	{
+		DWORD timeout = INFINITE;
+
+		if (dwTimeout != INFINITE)
+		{
+			const UINT64 elapsed = GetTickCount64() - start;
+
+			if (elapsed >= dwTimeout)
+			{
+				*status = SCARD_E_TIMEOUT;
+				goto out;
+			}
+
+			timeout = (DWORD)(dwTimeout - elapsed);
+		}
+
+		if (!waiter.event)
+		{
+			waiter.event = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+			if (!waiter.event)
+			{
+				handled = FALSE;
+				goto out;
+			}
+		}
+
+		ResetEvent(waiter.event);
+
+		if (!ArrayList_Append(cache->waiters, &waiter))
+		{
+			handled = FALSE;
+			goto out;
+		}
+
+		LeaveCriticalSection(&cache->lock);
+		WaitForSingleObject(waiter.event, timeout);
+		EnterCriticalSection(&cache->lock);
+		ArrayList_Remove(cache->waiters, &waiter);
+
+		if (waiter.cancelled)
+		{
+			*status = SCARD_E_CANCELLED;
+			goto out;
+		}
+
+		/* The monitor lost PC/SC, let the caller ask PC/SC directly */
+		if (!cache->valid)
+		{
+			handled = FALSE;
+			goto out;
+		}
+	}
+
+	*status = SCARD_S_SUCCESS;
+out:
+	LeaveCriticalSection(&cache->lock);
+
+	if (waiter.event)
+		CloseHandle(waiter.event);
+
+	return handled;
+}
+
+BOOL smartcard_cache_get_status_change_w(SMARTCARD_READER_CACHE* cache, SCARDCONTEXT hContext,
+                                         DWORD dwTimeout, LPSCARD_READERSTATEW rgReaderStates,
+                                         DWORD cReaders, LONG* status)
+{
+	DWORD index;
+	BOOL handled = FALSE;
+	SCARD_READERSTATEA* states;
+
+	if (!cache || !rgReaderStates || !status || (cReaders == 0))
+		return FALSE;
+
+	states = calloc(cReaders, sizeof(SCARD_READERSTATEA));
+
+	if (!states)
+		return FALSE;
+
+	for (index = 0; index < cReaders; index++)
+	{
+		LPSTR name = NULL;
+
+		if (!rgReaderStates[index].szReader ||
+		    (ConvertFromUnicode(CP_UTF8, 0, rgReaderStates[index].szReader, -1, &name, 0, NULL,
+		                        NULL) <= 0))
+			goto fail;
+
+		states[index].szReader = name;
+		states[index].dwCurrentState = rgReaderStates[index].dwCurrentState;
+	}
+
+	handled = smartcard_cache_get_status_change_a(cache, hContext, dwTimeout, states, cReaders,
+	                                              status);
+
+	if (handled)
+	{
+		for (index = 0; index < cReaders; index++)
+		{
+			rgReaderStates[index].dwEventState = states[index].dwEventState;
+			rgReaderStates[index].cbAtr = states[index].cbAtr;
+			CopyMemory(rgReaderStates[index].rgbAtr, states[index].rgbAtr, states[index].cbAtr);
+		}
+	}
+
+fail:
+	smartcard_cache_free_states(states, cReaders);
+	return handled;
+}
+
+void smartcard_cache_cancel(SMARTCARD_READER_CACHE* cache, SCARDCONTEXT hContext)
+{
+	size_t index;
+	size_t count;
+
+	if (!cache)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+	count = ArrayList_Count(cache->waiters);
+
+	for (index = 0; index < count; index++)
+	{
+		SMARTCARD_CACHE_WAITER* waiter = ArrayList_GetItem(cache->waiters, index);
+
+		if (waiter->hContext == hContext)
+		{
+			waiter->cancelled = TRUE;
+			SetEvent(waiter->event);
+		}
+	}
+
+	LeaveCriticalSection(&cache->lock);
+}
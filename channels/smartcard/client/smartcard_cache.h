@@ -0,0 +1,58 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Smartcard Device Service Virtual Channel
+ * Reader State Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_SMARTCARD_CLIENT_CACHE_H
+#define FREERDP_CHANNEL_SMARTCARD_CLIENT_CACHE_H
+
+#include <winpr/crt.h>
+#include <winpr/smartcard.h>
+
+/* Interval at which the monitor lists readers again, for PC/SC without PnP notifications */
+#define SMARTCARD_CACHE_REFRESH_INTERVAL 2000
+
+typedef struct _SMARTCARD_READER_CACHE SMARTCARD_READER_CACHE;
+
+/**
+ * The reader cache mirrors the reader list and reader states of PC/SC. A single monitor
+ * thread blocks in SCardGetStatusChange and refreshes the cache, repeated SCardListReaders
+ * and SCardGetStatusChange calls from the server are answered from the cache.
+ *
+ * The query functions return FALSE if the cache cannot answer a call (monitor not ready,
+ * unknown reader, unsupported flags), the caller must then forward the call to PC/SC.
+ *
+ * api is the PC/SC provider used by the monitor, NULL selects the WinPR SCard API.
+ */
+SMARTCARD_READER_CACHE* smartcard_cache_new(const SCardApiFunctionTable* api);
+void smartcard_cache_free(SMARTCARD_READER_CACHE* cache);
+
+BOOL smartcard_cache_list_readers_a(SMARTCARD_READER_CACHE* cache, LPSTR* mszReaders,
+                                    LPDWORD pcchReaders, LONG* status);
+BOOL smartcard_cache_list_readers_w(SMARTCARD_READER_CACHE* cache, LPWSTR* mszReaders,
+                                    LPDWORD pcchReaders, LONG* status);
+
+BOOL smartcard_cache_get_status_change_a(SMARTCARD_READER_CACHE* cache, SCARDCONTEXT hContext,
+                                         DWORD dwTimeout, LPSCARD_READERSTATEA rgReaderStates,
+                                         DWORD cReaders, LONG* status);
+BOOL smartcard_cache_get_status_change_w(SMARTCARD_READER_CACHE* cache, SCARDCONTEXT hContext,
+                                         DWORD dwTimeout, LPSCARD_READERSTATEW rgReaderStates,
+                                         DWORD cReaders, LONG* status);
+
+/* Wakes GetStatusChange calls of hContext waiting on the cache with SCARD_E_CANCELLED */
+void smartcard_cache_cancel(SMARTCARD_READER_CACHE* cache, SCARDCONTEXT hContext);
+
+#endif /* FREERDP_CHANNEL_SMARTCARD_CLIENT_CACHE_H */
@@ -179,6 +179,9 @@ void smartcard_context_free(void* pCtx)
 		return;
 
 	/* cancel blocking calls like SCardGetStatusChange */
+	if (pContext->smartcard)
+		smartcard_cache_cancel(pContext->smartcard->cache, pContext->hContext);
+
 	SCardCancel(pContext->hContext);
 	SCardReleaseContext(pContext->hContext);
 
@@ -225,6 +228,7 @@ static void smartcard_release_all_contexts(SMARTCARD_DEVICE* smartcard)
 				continue;
 
 			hContext = pContext->hContext;
+			smartcard_cache_cancel(smartcard->cache, hContext);
 
 			if (SCardIsValidContext(hContext) == SCARD_S_SUCCESS)
 			{
@@ -276,6 +280,7 @@ static UINT smartcard_free_(SMARTCARD_DEVICE* smartcard)
 	ListDictionary_Free(smartcard->rgSCardContextList);
 	ListDictionary_Free(smartcard->rgOutstandingMessages);
 	Queue_Free(smartcard->CompletedIrpQueue);
+	smartcard_cache_free(smartcard->cache);
 
 	if (smartcard->StartedEvent)
 		SCardReleaseStartedEvent();
@@ -780,6 +785,14 @@ UINT DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints)
 			goto fail;
 		}
 
+		smartcard->cache = smartcard_cache_new(NULL);
+
+		if (!smartcard->cache)
+		{
+			WLog_ERR(TAG, "smartcard_cache_new failed!");
+			goto fail;
+		}
+
 		if ((error = pEntryPoints->RegisterDevice(pEntryPoints->devman, &smartcard->device)))
 		{
 			WLog_ERR(TAG, "RegisterDevice failed!");
@@ -33,6 +33,7 @@
 #include <winpr/collections.h>
 
 #include "smartcard_operations.h"
+#include "smartcard_cache.h"
 
 #define TAG CHANNELS_TAG("smartcard.client")
 
@@ -59,6 +60,7 @@ struct _SMARTCARD_DEVICE
 	wListDictionary* rgOutstandingMessages;
 	rdpContext* rdpcontext;
 	wLinkedList* names;
+	SMARTCARD_READER_CACHE* cache;
 };
 
 SMARTCARD_CONTEXT* smartcard_context_new(SMARTCARD_DEVICE* smartcard, SCARDCONTEXT hContext);
@@ -467,6 +467,38 @@ static BOOL filter_match(wLinkedList* list, LPCSTR reader, size_t readerLen)
 	return FALSE;
 }
 
+/* The reader cache holds all readers, PC/SC groups other than the all readers group need PC/SC */
+static BOOL smartcard_all_readers_group_a(LPCSTR mszGroups)
+{
+	if (!mszGroups || (mszGroups[0] == '\0'))
+		return TRUE;
+
+	if (mszGroups[strlen(mszGroups) + 1] != '\0')
+		return FALSE;
+
+	return (strcmp(mszGroups, "SCard$AllReaders") == 0) ||
+	       (strcmp(mszGroups, "SCard$DefaultReaders") == 0);
+}
+
+static BOOL smartcard_all_readers_group_w(LPCWSTR mszGroups)
+{
+	BOOL rc;
+	LPSTR group = NULL;
+
+	if (!mszGroups || (mszGroups[0] == 0))
+		return TRUE;
+
+	if (mszGroups[_wcslen(mszGroups) + 1] != 0)
+		return FALSE;
+
+	if (ConvertFromUnicode(CP_UTF8, 0, mszGroups, -1, &group, 0, NULL, NULL) <= 0)
+		return FALSE;
+
+	rc = (strcmp(group, "SCard$AllReaders") == 0) || (strcmp(group, "SCard$DefaultReaders") == 0);
+	free(group);
+	return rc;
+}
+
 static DWORD filter_device_by_name_a(wLinkedList* list, LPSTR* mszReaders, DWORD cchReaders)
 {
 	size_t rpos = 0, wpos = 0;
@@ -554,11 +586,22 @@ static LONG smartcard_ListReadersA_Call(SMARTCARD_DEVICE* smartcard, SMARTCARD_O
 	ListReaders_Return ret = { 0 };
 	LPSTR mszReaders = NULL;
 	DWORD cchReaders = 0;
+	BOOL cached = FALSE;
 	IRP* irp = operation->irp;
 	ListReaders_Call* call = &operation->call.listReaders;
-	cchReaders = SCARD_AUTOALLOCATE;
-	status = ret.ReturnCode = SCardListReadersA(operation->hContext, (LPCSTR)call->mszGroups,
-	                                            (LPSTR)&mszReaders, &cchReaders);
+
+	if (smartcard_all_readers_group_a((LPCSTR)call->mszGroups))
+		cached = smartcard_cache_list_readers_a(smartcard->cache, &mszReaders, &cchReaders,
+		                                        &ret.ReturnCode);
+
+	if (!cached)
+	{
+		cchReaders = SCARD_AUTOALLOCATE;
+		ret.ReturnCode = SCardListReadersA(operation->hContext, (LPCSTR)call->mszGroups,
+		                                   (LPSTR)&mszReaders, &cchReaders);
+	}
+
+	status = ret.ReturnCode;
 
 	if (call->mszGroups)
 	{
@@ -576,14 +619,17 @@ static LONG smartcard_ListReadersA_Call(SMARTCARD_DEVICE* smartcard, SMARTCARD_O
 	ret.cBytes = cchReaders;
 
 	status = smartcard_pack_list_readers_return(smartcard, irp->output, &ret, FALSE);
+
+	if (cached)
+		free(mszReaders);
+	else if (mszReaders)
+		SCardFreeMemory(operation->hContext, mszReaders);
+
 	if (status != SCARD_S_SUCCESS)
 	{
 		return log_status_error(TAG, "smartcard_pack_list_readers_return", status);
 	}
 
-	if (mszReaders)
-		SCardFreeMemory(operation->hContext, mszReaders);
-
 	if (status != SCARD_S_SUCCESS)
 		return status;
 
@@ -700,6 +746,7 @@ static LONG smartcard_ListReadersW_Call(SMARTCARD_DEVICE* smartcard, SMARTCARD_O
 	LONG status;
 	ListReaders_Return ret = { 0 };
 	DWORD cchReaders = 0;
+	BOOL cached = FALSE;
 	IRP* irp = operation->irp;
 	ListReaders_Call* call = &operation->call.listReaders;
 	union
@@ -717,9 +764,20 @@ static LONG smartcard_ListReadersW_Call(SMARTCARD_DEVICE* smartcard, SMARTCARD_O
 	} mszReaders;
 
 	string.bp = call->mszGroups;
-	cchReaders = SCARD_AUTOALLOCATE;
-	status = ret.ReturnCode =
-	    SCardListReadersW(operation->hContext, string.wz, (LPWSTR)&mszReaders.pw, &cchReaders);
+	mszReaders.pw = NULL;
+
+	if (smartcard_all_readers_group_w(string.wz))
+		cached = smartcard_cache_list_readers_w(smartcard->cache, &mszReaders.pw, &cchReaders,
+		                                        &ret.ReturnCode);
+
+	if (!cached)
+	{
+		cchReaders = SCARD_AUTOALLOCATE;
+		ret.ReturnCode = SCardListReadersW(operation->hContext, string.wz,
+		                                   (LPWSTR)&mszReaders.pw, &cchReaders);
+	}
+
+	status = ret.ReturnCode;
 
 	if (call->mszGroups)
 	{
@@ -735,7 +793,9 @@ static LONG smartcard_ListReadersW_Call(SMARTCARD_DEVICE* smartcard, SMARTCARD_O
 	ret.cBytes = cchReaders;
 	status = smartcard_pack_list_readers_return(smartcard, irp->output, &ret, TRUE);
 
-	if (mszReaders.pb)
+	if (cached)
+		free(mszReaders.pb);
+	else if (mszReaders.pb)
 		SCardFreeMemory(operation->hContext, mszReaders.pb);
 
 	if (status != SCARD_S_SUCCESS)
@@ -1222,8 +1282,13 @@ static LONG smartcard_GetStatusChangeA_Call(SMARTCARD_DEVICE* smartcard,
 	LPSCARD_READERSTATEA rgReaderState = NULL;
 	IRP* irp = operation->irp;
 	GetStatusChangeA_Call* call = &operation->call.getStatusChangeA;
-	ret.ReturnCode = SCardGetStatusChangeA(operation->hContext, call->dwTimeOut,
-	                                       call->rgReaderStates, call->cReaders);
+
+	if (!smartcard_cache_get_status_change_a(smartcard->cache, operation->hContext,
+	                                         call->dwTimeOut, call->rgReaderStates,
+	                                         call->cReaders, &ret.ReturnCode))
+		ret.ReturnCode = SCardGetStatusChangeA(operation->hContext, call->dwTimeOut,
+		                                       call->rgReaderStates, call->cReaders);
+
 	log_status_error(TAG, "SCardGetStatusChangeA", ret.ReturnCode);
 	ret.cReaders = call->cReaders;
 	ret.rgReaderStates = NULL;
@@ -1286,8 +1351,13 @@ static LONG smartcard_GetStatusChangeW_Call(SMARTCARD_DEVICE* smartcard,
 	LPSCARD_READERSTATEW rgReaderState = NULL;
 	IRP* irp = operation->irp;
 	GetStatusChangeW_Call* call = &operation->call.getStatusChangeW;
-	ret.ReturnCode = SCardGetStatusChangeW(operation->hContext, call->dwTimeOut,
-	                                       call->rgReaderStates, call->cReaders);
+
+	if (!smartcard_cache_get_status_change_w(smartcard->cache, operation->hContext,
+	                                         call->dwTimeOut, call->rgReaderStates,
+	                                         call->cReaders, &ret.ReturnCode))
+		ret.ReturnCode = SCardGetStatusChangeW(operation->hContext, call->dwTimeOut,
+		                                       call->rgReaderStates, call->cReaders);
+
 	log_status_error(TAG, "SCardGetStatusChangeW", ret.ReturnCode);
 	ret.cReaders = call->cReaders;
 	ret.rgReaderStates = NULL;
@@ -1346,6 +1416,7 @@ static LONG smartcard_Cancel_Call(SMARTCARD_DEVICE* smartcard, SMARTCARD_OPERATI
 {
 	Long_Return ret = { 0 };
 
+	smartcard_cache_cancel(smartcard->cache, operation->hContext);
 	ret.ReturnCode = SCardCancel(operation->hContext);
 	log_status_error(TAG, "SCardCancel", ret.ReturnCode);
 	smartcard_trace_long_return(smartcard, &ret, "Cancel");
@@ -0,0 +1,490 @@
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+#include <winpr/smartcard.h>
+
+#include "../smartcard_cache.h"
+
+#define TEST_PNP_NOTIFICATION "\\\\?PnP?\\Notification"
+#define TEST_MAX_READERS 4
+#define TEST_WAITERS 4
+#define TEST_QUERIES 1000
+
+/* A PC/SC provider whose SCardGetStatusChange blocks until a reader changes or is cancelled */
+struct test_pcsc
+{
+	CRITICAL_SECTION lock;
+	HANDLE changed;
+	BOOL cancelled;
+	char names[TEST_MAX_READERS][32];
+	DWORD states[TEST_MAX_READERS];
+	DWORD count;
+	BOOL noPnp; /* Rejects the PnP notification entry like PC/SC without PnP support */
+	LONG listCalls;
+	LONG statusCalls;
+};
+
+static struct test_pcsc g_Pcsc = { 0 };
+
+static LONG WINAPI test_establish_context(DWORD dwScope, LPCVOID pvReserved1, LPCVOID pvReserved2,
+                                          LPSCARDCONTEXT phContext)
+{
+	WINPR_UNUSED(dwScope);
+	WINPR_UNUSED(pvReserved1);
+	WINPR_UNUSED(pvReserved2);
+	*phContext = 0x1000;
+	return SCARD_S_SUCCESS;
+}
+
+static LONG WINAPI test_release_context(SCARDCONTEXT hContext)
+{
+	WINPR_UNUSED(hContext);
+	return SCARD_S_SUCCESS;
+}
+
+static LONG WINAPI test_list_readers(SCARDCONTEXT hContext, LPCSTR mszGroups, LPSTR mszReaders,
+                                     LPDWORD pcchReaders)
+{
+	DWORD index;
+	size_t length = 1;
+	char* msz;
+	char* cur;
+	WINPR_UNUSED(hContext);
+	WINPR_UNUSED(mszGroups);
+
+	EnterCriticalSection(&g_Pcsc.lock);
+	g_Pcsc.listCalls++;
+
+	if (g_Pcsc.count == 0)
+	{
+		LeaveCriticalSection(&g_Pcsc.lock);
+		return SCARD_E_NO_READERS_AVAILABLE;
+	}
+
+	for (index = 0; index < g_Pcsc.count; index++)
+		length += strlen(g_Pcsc.names[index]) + 1;
+
+	cur = msz = calloc(length, sizeof(char));
+
+	if (!msz)
+	{
+		LeaveCriticalSection(&g_Pcsc.lock);
+		return SCARD_E_NO_MEMORY;
+	}
+
+	for (index = 0; index < g_Pcsc.count; index++)
+	{
+		strcpy(cur, g_Pcsc.names[index]);
+		cur += strlen(cur) + 1;
+	}
+
+	LeaveCriticalSection(&g_Pcsc.lock);
+	*(LPSTR*)mszReaders = msz;
+	*pcchReaders = (DWORD)length;
+	return SCARD_S_SUCCESS;
+}
+
+static LONG WINAPI test_free_memory(SCARDCONTEXT hContext, LPVOID pvMem)
+{
+	WINPR_UNUSED(hContext);
+	free(pvMem);
+	return SCARD_S_SUCCESS;
+}
+
+static DWORD test_actual_state(const char* name)
+{
+	DWORD index;
+
+	if (strcmp(name, TEST_PNP_NOTIFICATION) == 0)
+		return g_Pcsc.count << 16;
+
+	for (index = 0; index < g_Pcsc.count; index++)
+	{
+		if (strcmp(name, g_Pcsc.names[index]) == 0)
+			return g_Pcsc.states[index];
+	}
+
+	return SCARD_STATE_UNKNOWN;
+}
+
+static LONG WINAPI test_get_status_change(SCARDCONTEXT hContext, DWORD dwTimeout,
+                                          LPSCARD_READERSTATEA rgReaderStates, DWORD cReaders)
+{
+	WINPR_UNUSED(hContext);
+	InterlockedIncrement(&g_Pcsc.statusCalls);
+
+	for (;;)
+	{
+		DWORD index;
+		BOOL changed = FALSE;
+
+		EnterCriticalSection(&g_Pcsc.lock);
+		ResetEvent(g_Pcsc.changed);
+
+		for (index = 0; index < cReaders; index++)
+		{
+			if (g_Pcsc.noPnp &&
+			    (strcmp(rgReaderStates[index].szReader, TEST_PNP_NOTIFICATION) == 0))
+			{
+				LeaveCriticalSection(&g_Pcsc.lock);
+				return SCARD_E_UNKNOWN_READER;
+			}
+		}
+
+		for (index = 0; index < cReaders; index++)
+		{
+			const DWORD actual = test_actual_state(rgReaderStates[index].szReader);
+			rgReaderStates[index].dwEventState = actual;
+			rgReaderStates[index].cbAtr = 0;
+
+			if (actual & SCARD_STATE_PRESENT)
+			{
+				rgReaderStates[index].cbAtr = 2;
+				rgReaderStates[index].rgbAtr[0] = 0x3B;
+				rgReaderStates[index].rgbAtr[1] = (BYTE)(actual >> 16);
+			}
+
+			if (actual != (rgReaderStates[index].dwCurrentState & ~SCARD_STATE_CHANGED))
+			{
+				rgReaderStates[index].dwEventState |= SCARD_STATE_CHANGED;
+				changed = TRUE;
+			}
+		}
+
+		if (g_Pcsc.cancelled)
+		{
+			g_Pcsc.cancelled = FALSE;
+			LeaveCriticalSection(&g_Pcsc.lock);
+			return SCARD_E_CANCELLED;
+		}
+
+		LeaveCriticalSection(&g_Pcsc.lock);
+
+		if (changed)
+			return SCARD_S_SUCCESS;
+
+		if (WaitForSingleObject(g_Pcsc.changed, dwTimeout) == WAIT_TIMEOUT)
+			return SCARD_E_TIMEOUT;
+	}
+}
+
+static LONG WINAPI test_cancel(SCARDCONTEXT hContext)
+{
+	WINPR_UNUSED(hContext);
+	EnterCriticalSection(&g_Pcsc.lock);
+	g_Pcsc.cancelled = TRUE;
+	SetEvent(g_Pcsc.changed);
+	LeaveCriticalSection(&g_Pcsc.lock);
+	return SCARD_S_SUCCESS;
+}
+
+static void test_insert_card(DWORD index)
+{
+	EnterCriticalSection(&g_Pcsc.lock);
+	g_Pcsc.states[index] = (g_Pcsc.states[index] & 0xFFFF0000) + 0x10000;
+	g_Pcsc.states[index] |= SCARD_STATE_PRESENT;
+	SetEvent(g_Pcsc.changed);
+	LeaveCriticalSection(&g_Pcsc.lock);
+}
+
+static void test_add_reader(const char* name)
+{
+	EnterCriticalSection(&g_Pcsc.lock);
+	sprintf_s(g_Pcsc.names[g_Pcsc.count], sizeof(g_Pcsc.names[g_Pcsc.count]), "%s", name);
+	g_Pcsc.states[g_Pcsc.count++] = SCARD_STATE_EMPTY;
+	SetEvent(g_Pcsc.changed);
+	LeaveCriticalSection(&g_Pcsc.lock);
+}
+
+static BOOL test_list_contains(SMARTCARD_READER_CACHE* cache, const char* name)
+{
+	LONG status;
+	BOOL found = FALSE;
+	LPSTR mszReaders = NULL;
+	DWORD cchReaders = 0;
+	const char* cur;
+
+	if (!smartcard_cache_list_readers_a(cache, &mszReaders, &cchReaders, &status))
+		return FALSE;
+
+	for (cur = mszReaders; cur && *cur; cur += strlen(cur) + 1)
+	{
+		if (strcmp(cur, name) == 0)
+			found = TRUE;
+	}
+
+	free(mszReaders);
+	return found;
+}
+
+/* The monitor fills the cache in the background, wait until it answers for name */
+static BOOL test_wait_for_reader(SMARTCARD_READER_CACHE* cache, const char* name)
+{
+	const UINT64 start = GetTickCount64();
+
+	while (GetTickCount64() - start < 5000)
+	{
+		LONG status;
+		SCARD_READERSTATEA state = { 0 };
+		state.szReader = (LPSTR)name;
+
+		if (test_list_contains(cache, name) &&
+		    smartcard_cache_get_status_change_a(cache, 1, 0, &state, 1, &status))
+			return TRUE;
+
+		Sleep(10);
+	}
+
+	return FALSE;
+}
+
+struct test_waiter
+{
+	SMARTCARD_READER_CACHE* cache;
+	SCARDCONTEXT hContext;
+	DWORD dwTimeout;
+	SCARD_READERSTATEA state;
+	BOOL handled;
+	LONG status;
+};
+
+static DWORD WINAPI test_waiter_thread(LPVOID arg)
+{
+	struct test_waiter* waiter = (struct test_waiter*)arg;
+	waiter->handled = smartcard_cache_get_status_change_a(
+	    waiter->cache, waiter->hContext, waiter->dwTimeout, &waiter->state, 1, &waiter->status);
+	return 0;
+}
+
+/* All waiters are woken by a single change seen by the monitor */
+static BOOL test_fan_out(SMARTCARD_READER_CACHE* cache, DWORD currentState)
+{
+	size_t x;
+	BOOL rc = TRUE;
+	HANDLE threads[TEST_WAITERS] = { 0 };
+	struct test_waiter waiters[TEST_WAITERS] = { 0 };
+	const LONG statusCalls = InterlockedCompareExchange(&g_Pcsc.statusCalls, 0, 0);
+
+	for (x = 0; x < TEST_WAITERS; x++)
+	{
+		waiters[x].cache = cache;
+		waiters[x].hContext = x + 1;
+		waiters[x].dwTimeout = INFINITE;
+		waiters[x].state.szReader = "Reader 0";
+		waiters[x].state.dwCurrentState = currentState;
+		threads[x] = CreateThread(NULL, 0, test_waiter_thread, &waiters[x], 0, NULL);
+
+		if (!threads[x])
+			return FALSE;
+	}
+
+	Sleep(100);
+	test_insert_card(0);
+
+	for (x = 0; x < TEST_WAITERS; x++)
+	{
+		WaitForSingleObject(threads[x], INFINITE);
+		CloseHandle(threads[x]);
+
+		if (!waiters[x].handled || (waiters[x].status != SCARD_S_SUCCESS) ||
+		    !(waiters[x].state.dwEventState & SCARD_STATE_PRESENT) ||
+		    !(waiters[x].state.dwEventState & SCARD_STATE_CHANGED) ||
+		    (waiters[x].state.cbAtr != 2) || (waiters[x].state.rgbAtr[0] != 0x3B))
+			rc = FALSE;
+	}
+
+	printf("%d waiters woken, %" PRId32 " SCardGetStatusChange calls to PC/SC\n", TEST_WAITERS,
+	       InterlockedCompareExchange(&g_Pcsc.statusCalls, 0, 0) - statusCalls);
+	return rc;
+}
+
+static BOOL test_cancel_waiter(SMARTCARD_READER_CACHE* cache, DWORD currentState)
+{
+	HANDLE thread;
+	struct test_waiter waiter = { 0 };
+
+	waiter.cache = cache;
+	waiter.hContext = 42;
+	waiter.dwTimeout = INFINITE;
+	waiter.state.szReader = "Reader 0";
+	waiter.state.dwCurrentState = currentState;
+	thread = CreateThread(NULL, 0, test_waiter_thread, &waiter, 0, NULL);
+
+	if (!thread)
+		return FALSE;
+
+	/* Only waiting calls are cancelled, repeat until the waiter went to sleep */
+	while (WaitForSingleObject(thread, 10) == WAIT_TIMEOUT)
+		smartcard_cache_cancel(cache, 42);
+
+	CloseHandle(thread);
+	return waiter.handled && (waiter.status == SCARD_E_CANCELLED);
+}
+
+static LONG test_list_calls(void)
+{
+	return InterlockedCompareExchange(&g_Pcsc.listCalls, 0, 0);
+}
+
+/* With PnP notifications the reader list is not polled */
+static BOOL test_no_polling(void)
+{
+	const LONG listCalls = test_list_calls();
+	Sleep(SMARTCARD_CACHE_REFRESH_INTERVAL + 500);
+
+	if (test_list_calls() != listCalls)
+	{
+		fprintf(stderr, "the reader list was polled despite PnP notifications\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Without PnP notifications added readers are found by polling the reader list */
+static BOOL test_polling(const SCardApiFunctionTable* api)
+{
+	BOOL rc = FALSE;
+	SMARTCARD_READER_CACHE* cache;
+
+	EnterCriticalSection(&g_Pcsc.lock);
+	g_Pcsc.noPnp = TRUE;
+	LeaveCriticalSection(&g_Pcsc.lock);
+	cache = smartcard_cache_new(api);
+
+	if (!cache || !test_wait_for_reader(cache, "Reader 1"))
+		goto fail;
+
+	test_add_reader("Reader 2");
+
+	if (!test_wait_for_reader(cache, "Reader 2"))
+	{
+		fprintf(stderr, "an added reader was not found without PnP notifications\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	smartcard_cache_free(cache);
+	return rc;
+}
+
+int TestSmartCardCache(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t x;
+	LONG status;
+	UINT64 start;
+	LONG listCalls;
+	DWORD currentState;
+	SCARD_READERSTATEA state = { 0 };
+	SCardApiFunctionTable api = { 0 };
+	SMARTCARD_READER_CACHE* cache = NULL;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	api.pfnSCardEstablishContext = test_establish_context;
+	api.pfnSCardReleaseContext = test_release_context;
+	api.pfnSCardListReadersA = test_list_readers;
+	api.pfnSCardGetStatusChangeA = test_get_status_change;
+	api.pfnSCardCancel = test_cancel;
+	api.pfnSCardFreeMemory = test_free_memory;
+
+	InitializeCriticalSection(&g_Pcsc.lock);
+	g_Pcsc.changed = CreateEvent(NULL, TRUE, FALSE, NULL);
+	test_add_reader("Reader 0");
+	cache = smartcard_cache_new(&api);
+
+	if (!g_Pcsc.changed || !cache)
+		goto fail;
+
+	if (!test_wait_for_reader(cache, "Reader 0"))
+		goto fail;
+
+	/* Repeated queries are answered without PC/SC */
+	listCalls = InterlockedCompareExchange(&g_Pcsc.listCalls, 0, 0);
+
+	for (x = 0; x < TEST_QUERIES; x++)
+	{
+		if (!test_list_contains(cache, "Reader 0"))
+			goto fail;
+	}
+
+	if (InterlockedCompareExchange(&g_Pcsc.listCalls, 0, 0) - listCalls > 2)
+	{
+		fprintf(stderr, "SCardListReaders was not answered from the cache\n");
+		goto fail;
+	}
+
+	state.szReader = "Reader 0";
+	state.dwCurrentState = SCARD_STATE_UNAWARE;
+
+	if (!smartcard_cache_get_status_change_a(cache, 1, INFINITE, &state, 1, &status) ||
+	    (status != SCARD_S_SUCCESS) || !(state.dwEventState & SCARD_STATE_EMPTY))
+		goto fail;
+
+	currentState = state.dwEventState & ~SCARD_STATE_CHANGED;
+
+	if (!test_fan_out(cache, currentState))
+	{
+		fprintf(stderr, "waiters were not woken by a card insertion\n");
+		goto fail;
+	}
+
+	state.dwCurrentState = SCARD_STATE_UNAWARE;
+
+	if (!smartcard_cache_get_status_change_a(cache, 1, 0, &state, 1, &status) ||
+	    (status != SCARD_S_SUCCESS))
+		goto fail;
+
+	currentState = state.dwEventState & ~SCARD_STATE_CHANGED;
+
+	if (!test_cancel_waiter(cache, currentState))
+	{
+		fprintf(stderr, "a cancelled wait did not return SCARD_E_CANCELLED\n");
+		goto fail;
+	}
+
+	state.dwCurrentState = currentState;
+	start = GetTickCount64();
+
+	if (!smartcard_cache_get_status_change_a(cache, 1, 50, &state, 1, &status) ||
+	    (status != SCARD_E_TIMEOUT) || (GetTickCount64() - start < 40))
+	{
+		fprintf(stderr, "a wait without changes did not time out\n");
+		goto fail;
+	}
+
+	/* Unknown readers are left to PC/SC */
+	state.szReader = "Reader 1";
+
+	if (smartcard_cache_get_status_change_a(cache, 1, 0, &state, 1, &status))
+		goto fail;
+
+	test_add_reader("Reader 1");
+
+	if (!test_wait_for_reader(cache, "Reader 1"))
+	{
+		fprintf(stderr, "an added reader did not appear in the cache\n");
+		goto fail;
+	}
+
+	if (!test_no_polling() || !test_polling(&api))
+		goto fail;
+
+	rc = 0;
+fail:
+	start = GetTickCount64();
+	smartcard_cache_free(cache);
+
+	if (GetTickCount64() - start > SMARTCARD_CACHE_REFRESH_INTERVAL)
+		rc = -1;
+
+	if (g_Pcsc.changed)
+		CloseHandle(g_Pcsc.changed);
+
+	DeleteCriticalSection(&g_Pcsc.lock);
+	return rc;
+}
@@ -0,0 +1,187 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/collections.h>
+
+#include "../xf_rail_grid.h"
+
+#define TEST_DESKTOP_WIDTH 1024
+#define TEST_DESKTOP_HEIGHT 768
+
+static xfAppWindow* test_window_new(wHashTable* windows, UINT64 id, INT32 x, INT32 y,
+                                    UINT32 width, UINT32 height)
+{
+	xfAppWindow* appWindow = (xfAppWindow*)calloc(1, sizeof(xfAppWindow));
+
+	if (!appWindow)
+		return NULL;
+
+	appWindow->windowId = id;
+	appWindow->x = x;
+	appWindow->y = y;
+	appWindow->width = width;
+	appWindow->height = height;
+	region16_init(&appWindow->damage);
+
+	if (!HashTable_Insert(windows, &appWindow->windowId, appWindow))
+	{
+		region16_uninit(&appWindow->damage);
+		free(appWindow);
+		return NULL;
+	}
+
+	return appWindow;
+}
+
+static void test_window_free(xfAppWindow* appWindow)
+{
+	if (!appWindow)
+		return;
+
+	region16_uninit(&appWindow->damage);
+	free(appWindow);
+}
+
+static BOOL test_invalidate(xfRailGrid* grid, wHashTable* windows, UINT16 left, UINT16 top,
+                            UINT16 right, UINT16 bottom)
+{
+	const RECTANGLE_16 rect = { left, top, right, bottom };
+	return xf_rail_grid_invalidate(grid, windows, TEST_DESKTOP_WIDTH, TEST_DESKTOP_HEIGHT, &rect);
+}
+
+static BOOL test_damaged(xfRailGrid* grid, const xfAppWindow* appWindow)
+{
+	size_t x;
+	size_t count = 0;
+	xfAppWindow** damaged = xf_rail_grid_get_damaged(grid, &count);
+
+	for (x = 0; x < count; x++)
+	{
+		if (damaged[x] == appWindow)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static size_t test_damaged_count(xfRailGrid* grid)
+{
+	size_t count = 0;
+	xf_rail_grid_get_damaged(grid, &count);
+	return count;
+}
+
+static BOOL test_extents(const xfAppWindow* appWindow, UINT16 left, UINT16 top, UINT16 right,
+                         UINT16 bottom)
+{
+	const RECTANGLE_16* extents = region16_extents(&appWindow->damage);
+
+	if ((extents->left != left) || (extents->top != top) || (extents->right != right) ||
+	    (extents->bottom != bottom))
+	{
+		fprintf(stderr,
+		        "window %" PRIu64 " damage %" PRIu16 "x%" PRIu16 "-%" PRIu16 "x%" PRIu16
+		        ", expected %" PRIu16 "x%" PRIu16 "-%" PRIu16 "x%" PRIu16 "\n",
+		        appWindow->windowId, extents->left, extents->top, extents->right,
+		        extents->bottom, left, top, right, bottom);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int TestClientX11RailGrid(int argc, char* argv[])
+{
+	int rc = -1;
+	xfRailGrid* grid = NULL;
+	wHashTable* windows = NULL;
+	xfAppWindow* a = NULL;
+	xfAppWindow* b = NULL;
+	xfAppWindow* c = NULL;
+	xfAppWindow* d = NULL;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!(grid = xf_rail_grid_new()) || !(windows = HashTable_New(FALSE)))
+		goto fail;
+
+	/* a in a single cell, b across 4x3 cells, c near the bottom right corner */
+	if (!(a = test_window_new(windows, 1, 10, 10, 100, 100)) ||
+	    !(b = test_window_new(windows, 2, 100, 100, 400, 300)) ||
+	    !(c = test_window_new(windows, 3, 900, 600, 50, 50)))
+		goto fail;
+
+	/* Invalidate: only overlapped windows get the overlap as damage */
+	if (!test_invalidate(grid, windows, 0, 0, 50, 50))
+		goto fail;
+
+	if ((test_damaged_count(grid) != 1) || !test_damaged(grid, a) ||
+	    !test_extents(a, 10, 10, 50, 50))
+		goto fail;
+
+	/* Damage coalescing: a window is listed once, its damage is the union */
+	if (!test_invalidate(grid, windows, 40, 40, 200, 200) ||
+	    !test_invalidate(grid, windows, 150, 150, 300, 300))
+		goto fail;
+
+	if ((test_damaged_count(grid) != 2) || !test_damaged(grid, b) ||
+	    !test_extents(a, 10, 10, 110, 110) || !test_extents(b, 100, 100, 300, 300))
+		goto fail;
+
+	xf_rail_grid_clear_damage(grid);
+
+	if ((test_damaged_count(grid) != 0) || !region16_is_empty(&a->damage) ||
+	    !region16_is_empty(&b->damage))
+		goto fail;
+
+	/* Add: a new window is found once the grid is marked dirty */
+	if (!(d = test_window_new(windows, 4, 600, 0, 100, 100)))
+		goto fail;
+
+	xf_rail_grid_set_dirty(grid);
+
+	if (!test_invalidate(grid, windows, 0, 0, TEST_DESKTOP_WIDTH, TEST_DESKTOP_HEIGHT))
+		goto fail;
+
+	if ((test_damaged_count(grid) != 4) || !test_extents(d, 600, 0, 700, 100) ||
+	    !test_extents(c, 900, 600, 950, 650))
+		goto fail;
+
+	/* Remove: a removed window is dropped from the pending damage and the grid */
+	xf_rail_grid_remove(grid, c);
+	HashTable_Remove(windows, &c->windowId);
+	test_window_free(c);
+	c = NULL;
+
+	if (test_damaged_count(grid) != 3)
+		goto fail;
+
+	xf_rail_grid_clear_damage(grid);
+
+	if (!test_invalidate(grid, windows, 900, 600, 950, 650) || (test_damaged_count(grid) != 0))
+		goto fail;
+
+	/* Move: the window is found at its new position only */
+	a->x = 700;
+	xf_rail_grid_set_dirty(grid);
+
+	if (!test_invalidate(grid, windows, 10, 10, 50, 50) || (test_damaged_count(grid) != 0))
+		goto fail;
+
+	if (!test_invalidate(grid, windows, 700, 10, 720, 20) || (test_damaged_count(grid) != 1) ||
+	    !test_damaged(grid, a) || !test_extents(a, 700, 10, 720, 20))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (rc != 0)
+		fprintf(stderr, "%s failed\n", __FUNCTION__);
+
+	xf_rail_grid_free(grid);
+	HashTable_Free(windows);
+	test_window_free(a);
+	test_window_free(b);
+	test_window_free(c);
+	test_window_free(d);
+	return rc;
+}
@@ -79,6 +79,7 @@
 
 #include <freerdp/client/file.h>
 #include <freerdp/client/cmdline.h>
+#include <freerdp/client/present.h>
 
 #include <winpr/crt.h>
 #include <winpr/synch.h>
@@ -109,6 +110,15 @@
 
 #define MIN_PIXEL_DIFF 0.001
 
+/* Desktop updates are presented at most once per display refresh at 60Hz */
+#define XF_PRESENT_INTERVAL 16
+
+/* Step interval of the floatbar slide animation */
+#define XF_FLOATBAR_STEP_INTERVAL 20
+
+/* Interval of the main loop wakeup statistics in the debug log */
+#define XF_WAKEUP_REPORT_INTERVAL 10000
+
 static int (*_def_error_handler)(Display*, XErrorEvent*);
 static int _xf_error_handler(Display* d, XErrorEvent* ev);
 static void xf_check_extensions(xfContext* context);
@@ -226,12 +236,16 @@ BOOL xf_picture_transform_required(xfContext* xfc)
 void xf_draw_screen_(xfContext* xfc, int x, int y, int w, int h, const char* fkt, const char* file,
                      int line)
 {
+	const rdpSettings* settings;
+
 	if (!xfc)
 	{
 		WLog_DBG(TAG, "[%s] called from [%s] xfc=%p", __FUNCTION__, fkt, xfc);
 		return;
 	}
 
+	settings = xfc->context.settings;
+
 	if (w == 0 || h == 0)
 	{
 		WLog_WARN(TAG, "invalid width and/or height specified: w=%d h=%d", w, h);
@@ -247,6 +261,30 @@ void xf_draw_screen_(xfContext* xfc, int x, int y, int w, int h, const char* fkt
 	}
 
 #endif
+	/* The primary pixmap may be larger than the desktop. Until the server confirms a new size,
+	 * the desktop is cropped to the window and window areas beyond it are blacked out */
+	if ((x + w > (int)settings->DesktopWidth) || (y + h > (int)settings->DesktopHeight))
+	{
+		const int right = MAX(x, (int)settings->DesktopWidth);
+		const int bottom = MAX(y, (int)settings->DesktopHeight);
+		XSetFunction(xfc->display, xfc->gc, GXcopy);
+		XSetFillStyle(xfc->display, xfc->gc, FillSolid);
+		XSetForeground(xfc->display, xfc->gc, 0);
+
+		if (x + w > right)
+			XFillRectangle(xfc->display, xfc->window->handle, xfc->gc, right, y, x + w - right, h);
+
+		if (y + h > bottom)
+			XFillRectangle(xfc->display, xfc->window->handle, xfc->gc, x, bottom, w,
+			               y + h - bottom);
+
+		w = MIN(w, right - x);
+		h = MIN(h, bottom - y);
+
+		if ((w <= 0) || (h <= 0))
+			return;
+	}
+
 	XCopyArea(xfc->display, xfc->primary, xfc->window->handle, xfc->gc, x, y, w, h, x, y);
 }
 
@@ -255,15 +293,36 @@ static BOOL xf_desktop_resize(rdpContext* context)
 	rdpSettings* settings;
 	xfContext* xfc = (xfContext*)context;
 	settings = context->settings;
+	/* The RAIL window grid covers the desktop */
+	xf_rail_window_geometry_changed(xfc);
+	/* The whole desktop is redrawn, pending damage may be outside of the new size */
+	present_scheduler_clear(xfc->present);
+
+	/* The primary pixmap only grows, intermediate sizes of a window drag reuse it */
+	if (xfc->primary && (((int)settings->DesktopWidth > xfc->primaryWidth) ||
+	                     ((int)settings->DesktopHeight > xfc->primaryHeight)))
+	{
+		Pixmap primary;
+		const BOOL same = (xfc->primary == xfc->drawing) ? TRUE : FALSE;
+		const int width =
+		    MAX(xfc->primaryWidth, (int)(settings->DesktopWidth + settings->DesktopWidth / 8));
+		const int height =
+		    MAX(xfc->primaryHeight, (int)(settings->DesktopHeight + settings->DesktopHeight / 8));
+
+		if (!(primary = XCreatePixmap(xfc->display, xfc->drawable, width, height, xfc->depth)))
+			return FALSE;
 
-	if (xfc->primary)
-	{
-		BOOL same = (xfc->primary == xfc->drawing) ? TRUE : FALSE;
+		/* Keep showing the current contents until the server repaints */
+		XSetFunction(xfc->display, xfc->gc, GXcopy);
+		XSetFillStyle(xfc->display, xfc->gc, FillSolid);
+		XSetForeground(xfc->display, xfc->gc, 0);
+		XFillRectangle(xfc->display, primary, xfc->gc, 0, 0, width, height);
+		XCopyArea(xfc->display, xfc->primary, primary, xfc->gc, 0, 0, xfc->primaryWidth,
+		          xfc->primaryHeight, 0, 0);
 		XFreePixmap(xfc->display, xfc->primary);
-
-		if (!(xfc->primary = XCreatePixmap(xfc->display, xfc->drawable, settings->DesktopWidth,
-		                                   settings->DesktopHeight, xfc->depth)))
-			return FALSE;
+		xfc->primary = primary;
+		xfc->primaryWidth = width;
+		xfc->primaryHeight = height;
 
 		if (same)
 			xfc->drawing = xfc->primary;
@@ -306,6 +365,31 @@ static BOOL xf_desktop_resize(rdpContext* context)
 	return TRUE;
 }
 
+/* Draws the frames paced by xfc->present */
+static BOOL xf_present(void* custom, const RECTANGLE_16* rects, UINT32 nrects)
+{
+	UINT32 i;
+	xfContext* xfc = (xfContext*)custom;
+	xf_lock_x11(xfc);
+
+	for (i = 0; i < nrects; i++)
+	{
+		const int x = rects[i].left;
+		const int y = rects[i].top;
+		const int w = rects[i].right - rects[i].left;
+		const int h = rects[i].bottom - rects[i].top;
+
+		if (xfc->context.settings->SoftwareGdi)
+			XPutImage(xfc->display, xfc->primary, xfc->gc, xfc->image, x, y, x, y, w, h);
+
+		xf_draw_screen(xfc, x, y, w, h);
+	}
+
+	XFlush(xfc->display);
+	xf_unlock_x11(xfc);
+	return TRUE;
+}
+
 static BOOL xf_sw_end_paint(rdpContext* context)
 {
 	int i;
@@ -333,31 +417,20 @@ static BOOL xf_sw_end_paint(rdpContext* context)
 			if (gdi->primary->hdc->hwnd->invalid->null)
 				return TRUE;
 
-			xf_lock_x11(xfc);
-			XPutImage(xfc->display, xfc->primary, xfc->gc, xfc->image, x, y, x, y, w, h);
-			xf_draw_screen(xfc, x, y, w, h);
-			xf_unlock_x11(xfc);
+			present_scheduler_invalidate(xfc->present, x, y, w, h);
 		}
 		else
 		{
 			if (gdi->primary->hdc->hwnd->ninvalid < 1)
 				return TRUE;
 
-			xf_lock_x11(xfc);
-
 			for (i = 0; i < ninvalid; i++)
-			{
-				x = cinvalid[i].x;
-				y = cinvalid[i].y;
-				w = cinvalid[i].w;
-				h = cinvalid[i].h;
-				XPutImage(xfc->display, xfc->primary, xfc->gc, xfc->image, x, y, x, y, w, h);
-				xf_draw_screen(xfc, x, y, w, h);
-			}
-
-			XFlush(xfc->display);
-			xf_unlock_x11(xfc);
+				present_scheduler_invalidate(xfc->present, cinvalid[i].x, cinvalid[i].y,
+				                             cinvalid[i].w, cinvalid[i].h);
 		}
+
+		if (!present_scheduler_end_frame(xfc->present))
+			WLog_WARN(TAG, "failed to present the frame");
 	}
 	else
 	{
@@ -365,7 +438,17 @@ static BOOL xf_sw_end_paint(rdpContext* context)
 			return TRUE;
 
 		xf_lock_x11(xfc);
-		xf_rail_paint(xfc, x, y, x + w, y + h);
+
+		for (i = 0; i < ninvalid; i++)
+		{
+			x = cinvalid[i].x;
+			y = cinvalid[i].y;
+			w = cinvalid[i].w;
+			h = cinvalid[i].h;
+			xf_rail_invalidate(xfc, x, y, x + w, y + h);
+		}
+
+		xf_rail_paint(xfc);
 		xf_unlock_x11(xfc);
 	}
 
@@ -408,8 +491,11 @@ out:
 
 static BOOL xf_hw_end_paint(rdpContext* context)
 {
+	int i;
 	INT32 x, y;
 	UINT32 w, h;
+	int ninvalid;
+	HGDI_RGN cinvalid;
 	xfContext* xfc = (xfContext*)context;
 
 	if (xfc->context.gdi->suppressOutput)
@@ -426,47 +512,43 @@ static BOOL xf_hw_end_paint(rdpContext* context)
 			y = xfc->hdc->hwnd->invalid->y;
 			w = xfc->hdc->hwnd->invalid->w;
 			h = xfc->hdc->hwnd->invalid->h;
-			xf_lock_x11(xfc);
-			xf_draw_screen(xfc, x, y, w, h);
-			xf_unlock_x11(xfc);
+			present_scheduler_invalidate(xfc->present, x, y, w, h);
 		}
 		else
 		{
-			int i;
-			int ninvalid;
-			HGDI_RGN cinvalid;
-
 			if (xfc->hdc->hwnd->ninvalid < 1)
 				return TRUE;
 
 			ninvalid = xfc->hdc->hwnd->ninvalid;
 			cinvalid = xfc->hdc->hwnd->cinvalid;
-			xf_lock_x11(xfc);
 
 			for (i = 0; i < ninvalid; i++)
-			{
-				x = cinvalid[i].x;
-				y = cinvalid[i].y;
-				w = cinvalid[i].w;
-				h = cinvalid[i].h;
-				xf_draw_screen(xfc, x, y, w, h);
-			}
-
-			XFlush(xfc->display);
-			xf_unlock_x11(xfc);
+				present_scheduler_invalidate(xfc->present, cinvalid[i].x, cinvalid[i].y,
+				                             cinvalid[i].w, cinvalid[i].h);
 		}
+
+		if (!present_scheduler_end_frame(xfc->present))
+			WLog_WARN(TAG, "failed to present the frame");
 	}
 	else
 	{
 		if (xfc->hdc->hwnd->invalid->null)
 			return TRUE;
 
-		x = xfc->hdc->hwnd->invalid->x;
-		y = xfc->hdc->hwnd->invalid->y;
-		w = xfc->hdc->hwnd->invalid->w;
-		h = xfc->hdc->hwnd->invalid->h;
+		ninvalid = xfc->hdc->hwnd->ninvalid;
+		cinvalid = xfc->hdc->hwnd->cinvalid;
 		xf_lock_x11(xfc);
-		xf_rail_paint(xfc, x, y, x + w, y + h);
+
+		for (i = 0; i < ninvalid; i++)
+		{
+			x = cinvalid[i].x;
+			y = cinvalid[i].y;
+			w = cinvalid[i].w;
+			h = cinvalid[i].h;
+			xf_rail_invalidate(xfc, x, y, x + w, y + h);
+		}
+
+		xf_rail_paint(xfc);
 		xf_unlock_x11(xfc);
 	}
 
@@ -629,8 +711,12 @@ BOOL xf_create_window(xfContext* xfc)
 		xfc->gc = XCreateGC(xfc->display, xfc->drawable, GCGraphicsExposures, &gcv);
 
 	if (!xfc->primary)
+	{
 		xfc->primary = XCreatePixmap(xfc->display, xfc->drawable, settings->DesktopWidth,
 		                             settings->DesktopHeight, xfc->depth);
+		xfc->primaryWidth = settings->DesktopWidth;
+		xfc->primaryHeight = settings->DesktopHeight;
+	}
 
 	xfc->drawing = xfc->primary;
 
@@ -705,6 +791,8 @@ static void xf_window_free(xfContext* xfc)
 	{
 		XFreePixmap(xfc->display, xfc->primary);
 		xfc->primary = 0;
+		xfc->primaryWidth = 0;
+		xfc->primaryHeight = 0;
 	}
 
 	if (xfc->gc)
@@ -1174,6 +1262,14 @@ static BOOL xf_pre_connect(freerdp* instance)
 	channels = context->channels;
 	settings->OsMajorType = OSMAJORTYPE_UNIX;
 	settings->OsMinorType = OSMINORTYPE_NATIVE_XSERVER;
+
+	if (!settings->SoftwareGdi)
+	{
+		/* The X11 drawing backend has no ellipse orders */
+		settings->OrderSupport[NEG_ELLIPSE_SC_INDEX] = FALSE;
+		settings->OrderSupport[NEG_ELLIPSE_CB_INDEX] = FALSE;
+	}
+
 	PubSub_SubscribeChannelConnected(instance->context->pubSub, xf_OnChannelConnectedEventHandler);
 	PubSub_SubscribeChannelDisconnected(instance->context->pubSub,
 	                                    xf_OnChannelDisconnectedEventHandler);
@@ -1317,6 +1413,9 @@ static BOOL xf_post_connect(freerdp* instance)
 		return FALSE;
 	}
 
+	if (!(xfc->present = present_scheduler_new(XF_PRESENT_INTERVAL, xf_present, xfc)))
+		return FALSE;
+
 	if (settings->SoftwareGdi)
 	{
 		update->EndPaint = xf_sw_end_paint;
@@ -1363,6 +1462,8 @@ static void xf_post_disconnect(freerdp* instance)
 	PubSub_UnsubscribeChannelDisconnected(instance->context->pubSub,
 	                                      xf_OnChannelDisconnectedEventHandler);
 	gdi_free(instance);
+	present_scheduler_free(xfc->present);
+	xfc->present = NULL;
 
 	if (xfc->clipboard)
 	{
@@ -1476,6 +1577,57 @@ static BOOL handle_window_events(freerdp* instance)
 	return TRUE;
 }
 
+/**
+ * The main loop sleeps until a handle is signaled or the nearest deadline: a deferred
+ * present, a timer subscriber (see TimerEventArgs) or the next floatbar animation step.
+ */
+static DWORD xf_client_timeout(xfContext* xfc, UINT64 timerDue)
+{
+	DWORD timeout = present_scheduler_timeout(xfc->present);
+
+	if (timerDue)
+	{
+		const UINT64 now = GetTickCount64();
+		const UINT64 delay = (timerDue > now) ? timerDue - now : 0;
+
+		if (delay < timeout)
+			timeout = (DWORD)delay;
+	}
+
+	if (xfc->window && xf_floatbar_is_sliding(xfc->window->floatbar) &&
+	    (timeout > XF_FLOATBAR_STEP_INTERVAL))
+		timeout = XF_FLOATBAR_STEP_INTERVAL;
+
+	/* Events Xlib already read from the connection do not signal the socket again */
+	if (!xfc->context.settings->AsyncInput)
+	{
+		xf_lock_x11(xfc);
+
+		if (XEventsQueued(xfc->display, QueuedAlready) > 0)
+			timeout = 0;
+
+		xf_unlock_x11(xfc);
+	}
+
+	return timeout;
+}
+
+static void xf_client_report_wakeups(UINT64* start, UINT32* wakeups, BOOL final)
+{
+	const UINT64 now = GetTickCount64();
+	const UINT64 elapsed = now - *start;
+
+	if (!final && (elapsed < XF_WAKEUP_REPORT_INTERVAL))
+		return;
+
+	if (elapsed > 0)
+		WLog_DBG(TAG, "main loop: %" PRIu32 " wakeups in %" PRIu64 "ms (%.1f/s)", *wakeups,
+		         elapsed, *wakeups * 1000.0 / elapsed);
+
+	*start = now;
+	*wakeups = 0;
+}
+
 /** Main loop for the rdp connection.
  *  It will be run from the thread's entry point (thread_func()).
  *  It initiates the connection, and will continue to run until the session ends,
@@ -1495,8 +1647,10 @@ static DWORD WINAPI xf_client_thread(LPVOID param)
 	rdpContext* context;
 	HANDLE inputEvent = NULL;
 	HANDLE inputThread = NULL;
-	HANDLE timer = NULL;
-	LARGE_INTEGER due;
+	WINPR_WAIT_SET* waitSet = NULL;
+	UINT64 timerDue = 0;
+	UINT64 wakeupStart = 0;
+	UINT32 wakeups = 0;
 	rdpSettings* settings;
 	TimerEventArgs timerEvent;
 	EventArgsInit(&timerEvent, "xfreerdp");
@@ -1548,18 +1702,11 @@ static DWORD WINAPI xf_client_thread(LPVOID param)
 	}
 
 	settings = context->settings;
-	timer = CreateWaitableTimerA(NULL, FALSE, "mainloop-periodic-timer");
+	waitSet = winpr_WaitSet_New();
 
-	if (!timer)
-	{
-		WLog_ERR(TAG, "failed to create timer");
-		goto disconnect;
-	}
-
-	due.QuadPart = 0;
-
-	if (!SetWaitableTimer(timer, &due, 20, NULL, NULL, FALSE))
+	if (!waitSet)
 	{
+		WLog_ERR(TAG, "failed to create wait set");
 		goto disconnect;
 	}
 
@@ -1577,10 +1724,11 @@ static DWORD WINAPI xf_client_thread(LPVOID param)
 		}
 	}
 
+	wakeupStart = GetTickCount64();
+
 	while (!freerdp_shall_disconnect(instance))
 	{
 		nCount = 0;
-		handles[nCount++] = timer;
 
 		if (!settings->AsyncInput)
 			handles[nCount++] = inputEvent;
@@ -1612,11 +1760,23 @@ static DWORD WINAPI xf_client_thread(LPVOID param)
 		if (xfc->window)
 			xf_floatbar_hide_and_show(xfc->window->floatbar);
 
-		waitStatus = WaitForMultipleObjects(nCount, handles, FALSE, INFINITE);
+		if (!winpr_WaitSet_Update(waitSet, handles, nCount))
+		{
+			WLog_ERR(TAG, "failed to update the wait set");
+			break;
+		}
+
+		waitStatus = winpr_WaitSet_Wait(waitSet, xf_client_timeout(xfc, timerDue));
 
 		if (waitStatus == WAIT_FAILED)
 			break;
 
+		wakeups++;
+		xf_client_report_wakeups(&wakeupStart, &wakeups, FALSE);
+
+		if (!present_scheduler_poll(xfc->present))
+			WLog_WARN(TAG, "failed to present the frame");
+
 		{
 			if (!freerdp_check_event_handles(context))
 			{
@@ -1642,13 +1802,15 @@ static DWORD WINAPI xf_client_thread(LPVOID param)
 		if (!handle_window_events(instance))
 			break;
 
-		if ((waitStatus != WAIT_TIMEOUT) && (waitStatus == WAIT_OBJECT_0))
-		{
-			timerEvent.now = GetTickCount64();
-			PubSub_OnTimer(context->pubSub, context, &timerEvent);
-		}
+		/* Anything handled above may have armed a timer, subscribers report their deadline */
+		timerEvent.now = GetTickCount64();
+		timerEvent.due = 0;
+		PubSub_OnTimer(context->pubSub, context, &timerEvent);
+		timerDue = timerEvent.due;
 	}
 
+	xf_client_report_wakeups(&wakeupStart, &wakeups, TRUE);
+
 	if (settings->AsyncInput)
 	{
 		WaitForSingleObject(inputThread, INFINITE);
@@ -1670,10 +1832,7 @@ static DWORD WINAPI xf_client_thread(LPVOID param)
 	}
 
 disconnect:
-
-	if (timer)
-		CloseHandle(timer);
-
+	winpr_WaitSet_Free(waitSet);
 	freerdp_disconnect(instance);
 end:
 	ExitThread(exit_code);
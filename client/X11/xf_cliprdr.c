@@ -145,8 +145,9 @@ struct xf_clipboard
 
 	int requestedFormatId;
 
-	BYTE* data;
-	BYTE* data_raw;
+	/* References to the WinPR clipboard data, see ClipboardGetDataRef */
+	const BYTE* data;
+	const BYTE* data_raw;
 	BOOL data_raw_format;
 	UINT32 data_format_id;
 	const char* data_format_name;
@@ -705,7 +706,7 @@ static void xf_cliprdr_process_requested_data(xfClipboard* clipboard, BOOL hasDa
 	UINT32 DstSize;
 	UINT32 srcFormatId;
 	UINT32 dstFormatId;
-	BYTE* pDstData = NULL;
+	const BYTE* pDstData = NULL;
 	const xfCliprdrFormat* format;
 
 	if (clipboard->incr_starts && hasData)
@@ -758,7 +759,7 @@ static void xf_cliprdr_process_requested_data(xfClipboard* clipboard, BOOL hasDa
 	if (bSuccess)
 	{
 		DstSize = 0;
-		pDstData = (BYTE*)ClipboardGetData(clipboard->system, dstFormatId, &DstSize);
+		pDstData = (const BYTE*)ClipboardGetDataRef(clipboard->system, dstFormatId, &DstSize);
 	}
 
 	if (!pDstData)
@@ -778,21 +779,26 @@ static void xf_cliprdr_process_requested_data(xfClipboard* clipboard, BOOL hasDa
 	    (dstFormatId == ClipboardGetFormatId(clipboard->system, "FileGroupDescriptorW")))
 	{
 		UINT error = NO_ERROR;
-		FILEDESCRIPTORW* file_array = (FILEDESCRIPTORW*)pDstData;
+		BYTE* pFileList = NULL;
+		const FILEDESCRIPTORW* file_array = (const FILEDESCRIPTORW*)pDstData;
 		UINT32 file_count = DstSize / sizeof(FILEDESCRIPTORW);
-		pDstData = NULL;
 		DstSize = 0;
 		error = cliprdr_serialize_file_list_ex(clipboard->file_capability_flags, file_array,
-		                                       file_count, &pDstData, &DstSize);
+		                                       file_count, &pFileList, &DstSize);
 
 		if (error)
 			WLog_ERR(TAG, "failed to serialize CLIPRDR_FILELIST: 0x%08X", error);
 
-		free(file_array);
+		xf_cliprdr_send_data_response(clipboard, pFileList, DstSize);
+		free(pFileList);
+	}
+	else
+	{
+		/* Sent straight from the WinPR conversion cache */
+		xf_cliprdr_send_data_response(clipboard, pDstData, DstSize);
 	}
 
-	xf_cliprdr_send_data_response(clipboard, pDstData, DstSize);
-	free(pDstData);
+	ClipboardReleaseData(pDstData);
 }
 
 static BOOL xf_cliprdr_get_requested_data(xfClipboard* clipboard, Atom target)
@@ -968,19 +974,11 @@ static BOOL xf_cliprdr_process_selection_notify(xfClipboard* clipboard,
 
 static void xf_cliprdr_clear_cached_data(xfClipboard* clipboard)
 {
-	if (clipboard->data)
-	{
-		free(clipboard->data);
-		clipboard->data = NULL;
-	}
-
+	ClipboardReleaseData(clipboard->data);
+	clipboard->data = NULL;
 	clipboard->data_length = 0;
-
-	if (clipboard->data_raw)
-	{
-		free(clipboard->data_raw);
-		clipboard->data_raw = NULL;
-	}
+	ClipboardReleaseData(clipboard->data_raw);
+	clipboard->data_raw = NULL;
 
 	clipboard->data_raw_length = 0;
 #ifdef WITH_FUSE
@@ -1979,7 +1977,7 @@ xf_cliprdr_server_format_data_response(CliprdrClientContext* context,
                                        const CLIPRDR_FORMAT_DATA_RESPONSE* formatDataResponse)
 {
 	BOOL bSuccess;
-	BYTE* pDstData;
+	const BYTE* pDstData;
 	UINT32 DstSize;
 	UINT32 SrcSize;
 	UINT32 srcFormatId;
@@ -2106,7 +2104,7 @@ xf_cliprdr_server_format_data_response(CliprdrClientContext* context,
 			return CHANNEL_RC_OK;
 		}
 
-		pDstData = (BYTE*)ClipboardGetData(clipboard->system, dstFormatId, &DstSize);
+		pDstData = (const BYTE*)ClipboardGetDataRef(clipboard->system, dstFormatId, &DstSize);
 
 		if (!pDstData)
 		{
@@ -2117,29 +2115,26 @@ xf_cliprdr_server_format_data_response(CliprdrClientContext* context,
 
 		if (nullTerminated && pDstData)
 		{
-			BYTE* nullTerminator = memchr(pDstData, '\0', DstSize);
+			const BYTE* nullTerminator = memchr(pDstData, '\0', DstSize);
 			if (nullTerminator)
 				DstSize = nullTerminator - pDstData;
 		}
 	}
 
-	/* Cache converted and original data to avoid doing a possibly costly
-	 * conversion again on subsequent requests */
+	/* Keep references to the converted and original data to avoid doing a possibly costly
+	 * conversion again on subsequent requests. Both stay valid after the clipboard->system
+	 * content changes, a failure here is not fatal as this is only a cached value. */
 	clipboard->data = pDstData;
 	clipboard->data_length = DstSize;
-	/* We have to copy the original data again, as pSrcData is now owned
-	 * by clipboard->system. Memory allocation failure is not fatal here
-	 * as this is only a cached value. */
-	clipboard->data_raw = (BYTE*)malloc(size);
+	if (bSuccess)
+		clipboard->data_raw = (const BYTE*)ClipboardGetDataRef(clipboard->system, srcFormatId,
+		                                                        &SrcSize);
 
 	if (clipboard->data_raw)
-	{
-		CopyMemory(clipboard->data_raw, data, size);
-		clipboard->data_raw_length = size;
-	}
+		clipboard->data_raw_length = (int)SrcSize;
 	else
 	{
-		WLog_WARN(TAG, "failed to allocate %" PRIu32 " bytes for a copy of raw clipboard data",
+		WLog_WARN(TAG, "failed to keep a reference to %" PRIu32 " bytes of raw clipboard data",
 		          size);
 	}
 
@@ -3013,8 +3008,8 @@ void xf_clipboard_free(xfClipboard* clipboard)
 
 	ClipboardDestroy(clipboard->system);
 	xf_clipboard_formats_free(clipboard);
-	free(clipboard->data);
-	free(clipboard->data_raw);
+	ClipboardReleaseData(clipboard->data);
+	ClipboardReleaseData(clipboard->data_raw);
 	free(clipboard->respond);
 	free(clipboard->incr_data);
 	free(clipboard);
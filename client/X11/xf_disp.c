@@ -233,12 +233,11 @@ static void xf_disp_OnGraphicsReset(void* context, GraphicsResetEventArgs* e)
 
 static void xf_disp_OnTimer(void* context, TimerEventArgs* e)
 {
+	UINT64 due;
 	xfContext* xfc;
 	xfDispContext* xfDisp;
 	rdpSettings* settings;
 
-	WINPR_UNUSED(e);
-
 	if (!xf_disp_check_context(context, &xfc, &xfDisp, &settings))
 		return;
 
@@ -246,6 +245,18 @@ static void xf_disp_OnTimer(void* context, TimerEventArgs* e)
 		return;
 
 	xf_disp_sendResize(xfDisp);
+
+	if (!xf_disp_settings_changed(xfDisp))
+		return;
+
+	/* The resize was held back by RESIZE_MIN_DELAY or the channel is not ready yet */
+	due = xfDisp->lastSentDate + RESIZE_MIN_DELAY;
+
+	if (due <= e->now)
+		due = e->now + RESIZE_MIN_DELAY;
+
+	if (!e->due || (due < e->due))
+		e->due = due;
 }
 
 xfDispContext* xf_disp_new(xfContext* xfc)
@@ -730,6 +730,7 @@ static BOOL xf_event_ConfigureNotify(xfContext* xfc, const XConfigureEvent* even
 		                      0, &appWindow->x, &appWindow->y, &childWindow);
 		appWindow->width = event->width;
 		appWindow->height = event->height;
+		xf_rail_window_geometry_changed(xfc);
 
 		/*
 		 * Additional checks for not in a local move and not ignoring configure to send
@@ -1026,6 +1027,20 @@ BOOL xf_event_process(freerdp* instance, const XEvent* event)
 		          (unsigned long)event->xany.window);
 	}
 
+	switch (event->type)
+	{
+		case ButtonPress:
+		case ButtonRelease:
+		case KeyPress:
+		case KeyRelease:
+			/* Present the echo of local input without pacing */
+			present_scheduler_input(xfc->present);
+			break;
+
+		default:
+			break;
+	}
+
 	switch (event->type)
 	{
 		case Expose:
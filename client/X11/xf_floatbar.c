@@ -142,8 +142,24 @@ BOOL xf_floatbar_set_root_y(xfFloatbar* floatbar, int y)
 	return TRUE;
 }
 
+static int xf_floatbar_slide_step(const xfFloatbar* floatbar)
+{
+	if (floatbar->locked)
+		return 0;
+
+	if ((floatbar->mode == XF_FLOATBAR_MODE_NONE) && (floatbar->last_motion_y_root > 10) &&
+	    (floatbar->y > (FLOATBAR_HEIGHT * -1)))
+		return -1;
+
+	if (floatbar->y < 0 && (floatbar->last_motion_y_root < 10))
+		return 1;
+
+	return 0;
+}
+
 BOOL xf_floatbar_hide_and_show(xfFloatbar* floatbar)
 {
+	int step;
 	xfContext* xfc;
 
 	if (!floatbar || !floatbar->xfc)
@@ -153,25 +169,25 @@ BOOL xf_floatbar_hide_and_show(xfFloatbar* floatbar)
 		return TRUE;
 
 	xfc = floatbar->xfc;
+	step = xf_floatbar_slide_step(floatbar);
 
-	if (!floatbar->locked)
+	if (step != 0)
 	{
-		if ((floatbar->mode == XF_FLOATBAR_MODE_NONE) && (floatbar->last_motion_y_root > 10) &&
-		    (floatbar->y > (FLOATBAR_HEIGHT * -1)))
-		{
-			floatbar->y = floatbar->y - 1;
-			XMoveWindow(xfc->display, floatbar->handle, floatbar->x, floatbar->y);
-		}
-		else if (floatbar->y < 0 && (floatbar->last_motion_y_root < 10))
-		{
-			floatbar->y = floatbar->y + 1;
-			XMoveWindow(xfc->display, floatbar->handle, floatbar->x, floatbar->y);
-		}
+		floatbar->y = floatbar->y + step;
+		XMoveWindow(xfc->display, floatbar->handle, floatbar->x, floatbar->y);
 	}
 
 	return TRUE;
 }
 
+BOOL xf_floatbar_is_sliding(xfFloatbar* floatbar)
+{
+	if (!floatbar || !floatbar->created)
+		return FALSE;
+
+	return xf_floatbar_slide_step(floatbar) != 0;
+}
+
 static BOOL create_floatbar(xfFloatbar* floatbar)
 {
 	xfContext* xfc;
@@ -29,6 +29,7 @@ BOOL xf_floatbar_event_process(xfFloatbar* floatbar, const XEvent* event);
 BOOL xf_floatbar_check_event(xfFloatbar* floatbar, const XEvent* event);
 BOOL xf_floatbar_toggle_fullscreen(xfFloatbar* floatbar, bool visible);
 BOOL xf_floatbar_hide_and_show(xfFloatbar* floatbar);
+BOOL xf_floatbar_is_sliding(xfFloatbar* floatbar);
 BOOL xf_floatbar_set_root_y(xfFloatbar* floatbar, int y);
 
 #endif /* FREERDP_CLIENT_X11_FLOATBAR_H */
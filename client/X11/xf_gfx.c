@@ -58,6 +58,10 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 	if (!(rects = region16_rects(&surface->gdi.invalidRegion, &nbRects)))
 		return CHANNEL_RC_OK;
 
+	/* The RAIL window grid and damage are shared with the window handling */
+	if (xfc->remote_app)
+		xf_lock_x11(xfc);
+
 	for (x = 0; x < nbRects; x++)
 	{
 		const UINT32 nXSrc = rects[x].left;
@@ -81,9 +85,7 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 		{
 			XPutImage(xfc->display, xfc->primary, xfc->gc, surface->image, nXSrc, nYSrc, nXDst,
 			          nYDst, dwidth, dheight);
-			xf_lock_x11(xfc);
-			xf_rail_paint(xfc, nXDst, nYDst, nXDst + dwidth, nYDst + dheight);
-			xf_unlock_x11(xfc);
+			xf_rail_invalidate(xfc, nXDst, nYDst, nXDst + dwidth, nYDst + dheight);
 		}
 		else
 #ifdef WITH_XRENDER
@@ -101,8 +103,14 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 		}
 	}
 
+	if (xfc->remote_app)
+		xf_rail_paint(xfc);
+
 	rc = CHANNEL_RC_OK;
 fail:
+	if (xfc->remote_app)
+		xf_unlock_x11(xfc);
+
 	region16_clear(&surface->gdi.invalidRegion);
 	XSetClipMask(xfc->display, xfc->gc, None);
 	XSync(xfc->display, False);
@@ -30,6 +30,7 @@
 
 #include "xf_window.h"
 #include "xf_rail.h"
+#include "xf_rail_grid.h"
 
 #define TAG CLIENT_TAG("x11")
 
@@ -195,63 +196,65 @@ void xf_rail_end_local_move(xfContext* xfc, xfAppWindow* appWindow)
 	appWindow->local_move.state = LMS_TERMINATING;
 }
 
-static void xf_rail_invalidate_region(xfContext* xfc, REGION16* invalidRegion)
+/**
+ * Adds a damaged desktop rectangle to the windows it overlaps, the windows are repainted by
+ * xf_rail_paint. The caller holds the X11 lock.
+ */
+void xf_rail_invalidate(xfContext* xfc, INT32 left, INT32 top, INT32 right, INT32 bottom)
 {
-	int index;
-	int count = 0;
-	RECTANGLE_16 updateRect;
-	RECTANGLE_16 windowRect;
-	ULONG_PTR* pKeys = NULL;
-	xfAppWindow* appWindow;
-	const RECTANGLE_16* extents;
-	REGION16 windowInvalidRegion;
-	region16_init(&windowInvalidRegion);
-	if (xfc->railWindows)
-		count = HashTable_GetKeys(xfc->railWindows, &pKeys);
+	RECTANGLE_16 invalidRect;
+	const rdpSettings* settings = xfc->context.settings;
+
+	if ((left >= right) || (top >= bottom) || (right <= 0) || (bottom <= 0))
+		return;
+
+	invalidRect.left = (UINT16)MIN(MAX(left, 0), UINT16_MAX);
+	invalidRect.top = (UINT16)MIN(MAX(top, 0), UINT16_MAX);
+	invalidRect.right = (UINT16)MIN(right, UINT16_MAX);
+	invalidRect.bottom = (UINT16)MIN(bottom, UINT16_MAX);
+
+	if (!xf_rail_grid_invalidate(xfc->railGrid, xfc->railWindows, settings->DesktopWidth,
+	                             settings->DesktopHeight, &invalidRect))
+		WLog_ERR(TAG, "failed to invalidate the RAIL windows");
+}
+
+/**
+ * Repaints the damage collected by xf_rail_invalidate, window by window, with a single flush.
+ * The caller holds the X11 lock.
+ */
+void xf_rail_paint(xfContext* xfc)
+{
+	size_t index;
+	size_t count = 0;
+	xfAppWindow** damaged = xf_rail_grid_get_damaged(xfc->railGrid, &count);
+
+	if (count == 0)
+		return;
 
 	for (index = 0; index < count; index++)
 	{
-		appWindow = xf_rail_get_window(xfc, *(UINT64*)pKeys[index]);
+		UINT32 x;
+		UINT32 nbRects = 0;
+		xfAppWindow* appWindow = damaged[index];
+		const RECTANGLE_16* rects = region16_rects(&appWindow->damage, &nbRects);
 
-		if (appWindow)
+		for (x = 0; x < nbRects; x++)
 		{
-			windowRect.left = MAX(appWindow->x, 0);
-			windowRect.top = MAX(appWindow->y, 0);
-			windowRect.right = MAX(appWindow->x + appWindow->width, 0);
-			windowRect.bottom = MAX(appWindow->y + appWindow->height, 0);
-			region16_clear(&windowInvalidRegion);
-			region16_intersect_rect(&windowInvalidRegion, invalidRegion, &windowRect);
-
-			if (!region16_is_empty(&windowInvalidRegion))
-			{
-				extents = region16_extents(&windowInvalidRegion);
-				updateRect.left = extents->left - appWindow->x;
-				updateRect.top = extents->top - appWindow->y;
-				updateRect.right = extents->right - appWindow->x;
-				updateRect.bottom = extents->bottom - appWindow->y;
-				xf_UpdateWindowArea(xfc, appWindow, updateRect.left, updateRect.top,
-				                    updateRect.right - updateRect.left,
-				                    updateRect.bottom - updateRect.top);
-			}
+			xf_PutWindowArea(xfc, appWindow, rects[x].left - appWindow->x,
+			                 rects[x].top - appWindow->y, rects[x].right - rects[x].left,
+			                 rects[x].bottom - rects[x].top);
 		}
 	}
 
-	free(pKeys);
-	region16_uninit(&windowInvalidRegion);
+	xf_rail_grid_clear_damage(xfc->railGrid);
+	XFlush(xfc->display);
 }
 
-void xf_rail_paint(xfContext* xfc, INT32 uleft, INT32 utop, UINT32 uright, UINT32 ubottom)
+/* Called whenever a window is added, removed, moved or resized */
+void xf_rail_window_geometry_changed(xfContext* xfc)
 {
-	REGION16 invalidRegion;
-	RECTANGLE_16 invalidRect;
-	invalidRect.left = uleft;
-	invalidRect.top = utop;
-	invalidRect.right = uright;
-	invalidRect.bottom = ubottom;
-	region16_init(&invalidRegion);
-	region16_union_rect(&invalidRegion, &invalidRegion, &invalidRect);
-	xf_rail_invalidate_region(xfc, &invalidRegion);
-	region16_uninit(&invalidRegion);
+	if (xfc)
+		xf_rail_grid_set_dirty(xfc->railGrid);
 }
 
 /* RemoteApp Core Protocol Extension */
@@ -1075,6 +1078,9 @@ static void rail_window_free(void* value)
 	if (!appWindow)
 		return;
 
+	xf_rail_grid_remove(appWindow->xfc->railGrid, appWindow);
+
+	region16_uninit(&appWindow->damage);
 	xf_DestroyWindow(appWindow->xfc, appWindow);
 }
 
@@ -1111,6 +1117,11 @@ int xf_rail_init(xfContext* xfc, RailClientContext* rail)
 		wObject* obj = HashTable_ValueObject(xfc->railWindows);
 		obj->fnObjectFree = rail_window_free;
 	}
+	xfc->railGrid = xf_rail_grid_new();
+
+	if (!xfc->railGrid)
+		goto fail;
+
 	xfc->railIconCache = RailIconCache_New(xfc->context.settings);
 
 	if (!xfc->railIconCache)
@@ -1120,6 +1131,7 @@ int xf_rail_init(xfContext* xfc, RailClientContext* rail)
 	return 1;
 fail:
 	HashTable_Free(xfc->railWindows);
+	xfc->railWindows = NULL;
 	return 0;
 }
 
@@ -1139,6 +1151,9 @@ int xf_rail_uninit(xfContext* xfc, RailClientContext* rail)
 		xfc->railWindows = NULL;
 	}
 
+	xf_rail_grid_free(xfc->railGrid);
+	xfc->railGrid = NULL;
+
 	if (xfc->railIconCache)
 	{
 		RailIconCache_Free(xfc->railIconCache);
@@ -1168,12 +1183,14 @@ xfAppWindow* xf_rail_add_window(xfContext* xfc, UINT64 id, UINT32 x, UINT32 y, U
 	appWindow->y = y;
 	appWindow->width = width;
 	appWindow->height = height;
+	region16_init(&appWindow->damage);
 	xf_AppWindowCreate(xfc, appWindow);
 	if (!HashTable_Insert(xfc->railWindows, &appWindow->windowId, (void*)appWindow))
 	{
 		rail_window_free(appWindow);
 		return NULL;
 	}
+	xf_rail_window_geometry_changed(xfc);
 	return appWindow;
 }
 
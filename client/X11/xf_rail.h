@@ -25,7 +25,9 @@
 
 #include <freerdp/client/rail.h>
 
-void xf_rail_paint(xfContext* xfc, INT32 uleft, INT32 utop, UINT32 uright, UINT32 ubottom);
+void xf_rail_invalidate(xfContext* xfc, INT32 left, INT32 top, INT32 right, INT32 bottom);
+void xf_rail_paint(xfContext* xfc);
+void xf_rail_window_geometry_changed(xfContext* xfc);
 void xf_rail_send_client_system_command(xfContext* xfc, UINT32 windowId, UINT16 command);
 void xf_rail_send_activate(xfContext* xfc, Window xwindow, BOOL enabled);
 void xf_rail_adjust_position(xfContext* xfc, xfAppWindow* appWindow);
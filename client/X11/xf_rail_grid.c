@@ -0,0 +1,299 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 RAIL Window Grid
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+
+#include <freerdp/log.h>
+
+#include "xf_rail_grid.h"
+
+#define TAG CLIENT_TAG("x11")
+
+struct xf_rail_grid
+{
+	/* Windows overlapping cell c are windows[first[c]] to windows[first[c + 1] - 1] */
+	UINT32 columns;
+	UINT32 rows;
+	UINT32* first;
+	xfAppWindow** windows;
+	UINT32 capacity;
+	BOOL dirty;
+	UINT32 sequence;
+
+	/* Windows with pending damage, repainted by xf_rail_paint */
+	xfAppWindow** damaged;
+	size_t ndamaged;
+	size_t damagedSize;
+};
+
+static void xf_rail_window_rect(const xfAppWindow* appWindow, RECTANGLE_16* rect)
+{
+	rect->left = (UINT16)MIN(MAX(appWindow->x, 0), UINT16_MAX);
+	rect->top = (UINT16)MIN(MAX(appWindow->y, 0), UINT16_MAX);
+	rect->right = (UINT16)MIN(MAX(appWindow->x + appWindow->width, 0), UINT16_MAX);
+	rect->bottom = (UINT16)MIN(MAX(appWindow->y + appWindow->height, 0), UINT16_MAX);
+}
+
+/* Windows beyond the desktop are kept in the outermost cells */
+static BOOL xf_rail_grid_cells(const xfRailGrid* grid, const xfAppWindow* appWindow, UINT32* x1,
+                               UINT32* y1, UINT32* x2, UINT32* y2)
+{
+	RECTANGLE_16 rect;
+	xf_rail_window_rect(appWindow, &rect);
+
+	if ((rect.left >= rect.right) || (rect.top >= rect.bottom))
+		return FALSE;
+
+	*x1 = MIN(rect.left / XF_RAIL_GRID_CELL, grid->columns - 1);
+	*y1 = MIN(rect.top / XF_RAIL_GRID_CELL, grid->rows - 1);
+	*x2 = MIN((rect.right - 1U) / XF_RAIL_GRID_CELL, grid->columns - 1);
+	*y2 = MIN((rect.bottom - 1U) / XF_RAIL_GRID_CELL, grid->rows - 1);
+	return TRUE;
+}
+
+static BOOL xf_rail_grid_rebuild(xfRailGrid* grid, wHashTable* table, UINT32 desktopWidth,
+                                 UINT32 desktopHeight)
+{
+	int index;
+	int count = 0;
+	UINT32 cell;
+	UINT32 total;
+	ULONG_PTR* pKeys = NULL;
+	const UINT32 columns = MAX(1, (desktopWidth + XF_RAIL_GRID_CELL - 1) / XF_RAIL_GRID_CELL);
+	const UINT32 rows = MAX(1, (desktopHeight + XF_RAIL_GRID_CELL - 1) / XF_RAIL_GRID_CELL);
+
+	if (columns * rows != grid->columns * grid->rows)
+	{
+		UINT32* first = realloc(grid->first, (columns * rows + 1ULL) * sizeof(UINT32));
+
+		if (!first)
+			return FALSE;
+
+		grid->first = first;
+	}
+
+	grid->columns = columns;
+	grid->rows = rows;
+	ZeroMemory(grid->first, (columns * rows + 1ULL) * sizeof(UINT32));
+
+	if (table)
+		count = HashTable_GetKeys(table, &pKeys);
+
+	/* Count the windows per cell, then store them cell by cell */
+	for (index = 0; index < count; index++)
+	{
+		UINT32 x, y, x1, y1, x2, y2;
+		xfAppWindow* appWindow = HashTable_GetItemValue(table, (void*)pKeys[index]);
+
+		if (!appWindow || !xf_rail_grid_cells(grid, appWindow, &x1, &y1, &x2, &y2))
+			continue;
+
+		for (y = y1; y <= y2; y++)
+			for (x = x1; x <= x2; x++)
+				grid->first[y * columns + x + 1]++;
+	}
+
+	for (cell = 0; cell < columns * rows; cell++)
+		grid->first[cell + 1] += grid->first[cell];
+
+	total = grid->first[columns * rows];
+
+	if (total > grid->capacity)
+	{
+		xfAppWindow** windows = realloc(grid->windows, total * sizeof(xfAppWindow*));
+
+		if (!windows)
+		{
+			free(pKeys);
+			return FALSE;
+		}
+
+		grid->windows = windows;
+		grid->capacity = total;
+	}
+
+	for (index = 0; index < count; index++)
+	{
+		UINT32 x, y, x1, y1, x2, y2;
+		xfAppWindow* appWindow = HashTable_GetItemValue(table, (void*)pKeys[index]);
+
+		if (!appWindow || !xf_rail_grid_cells(grid, appWindow, &x1, &y1, &x2, &y2))
+			continue;
+
+		for (y = y1; y <= y2; y++)
+			for (x = x1; x <= x2; x++)
+				grid->windows[grid->first[y * columns + x]++] = appWindow;
+	}
+
+	/* The fill pass advanced every cell start to the next cell, shift them back */
+	for (cell = columns * rows; cell > 0; cell--)
+		grid->first[cell] = grid->first[cell - 1];
+
+	grid->first[0] = 0;
+	grid->dirty = FALSE;
+	free(pKeys);
+	return TRUE;
+}
+
+BOOL xf_rail_grid_invalidate(xfRailGrid* grid, wHashTable* windows, UINT32 desktopWidth,
+                             UINT32 desktopHeight, const RECTANGLE_16* rect)
+{
+	UINT32 x, y, x1, y1, x2, y2;
+
+	if (!grid || !rect || (rect->left >= rect->right) || (rect->top >= rect->bottom))
+		return TRUE;
+
+	if (grid->dirty && !xf_rail_grid_rebuild(grid, windows, desktopWidth, desktopHeight))
+		return FALSE;
+
+	x1 = MIN(rect->left / XF_RAIL_GRID_CELL, grid->columns - 1);
+	y1 = MIN(rect->top / XF_RAIL_GRID_CELL, grid->rows - 1);
+	x2 = MIN((rect->right - 1) / XF_RAIL_GRID_CELL, grid->columns - 1);
+	y2 = MIN((rect->bottom - 1) / XF_RAIL_GRID_CELL, grid->rows - 1);
+	grid->sequence++;
+
+	for (y = y1; y <= y2; y++)
+	{
+		for (x = x1; x <= x2; x++)
+		{
+			UINT32 index;
+			const UINT32 cell = y * grid->columns + x;
+
+			for (index = grid->first[cell]; index < grid->first[cell + 1]; index++)
+			{
+				RECTANGLE_16 windowRect;
+				RECTANGLE_16 damageRect;
+				xfAppWindow* appWindow = grid->windows[index];
+
+				/* Windows spanning several cells are visited once per rectangle */
+				if (appWindow->damageSequence == grid->sequence)
+					continue;
+
+				appWindow->damageSequence = grid->sequence;
+				xf_rail_window_rect(appWindow, &windowRect);
+
+				if (!rectangles_intersection(rect, &windowRect, &damageRect))
+					continue;
+
+				if (region16_is_empty(&appWindow->damage))
+				{
+					if (grid->ndamaged == grid->damagedSize)
+					{
+						const size_t size = MAX(16, grid->damagedSize * 2);
+						xfAppWindow** damaged =
+						    realloc(grid->damaged, size * sizeof(xfAppWindow*));
+
+						if (!damaged)
+						{
+							WLog_ERR(TAG, "failed to grow the damaged RAIL window list");
+							return FALSE;
+						}
+
+						grid->damaged = damaged;
+						grid->damagedSize = size;
+					}
+
+					grid->damaged[grid->ndamaged++] = appWindow;
+				}
+
+				if (!region16_union_rect(&appWindow->damage, &appWindow->damage, &damageRect))
+				{
+					WLog_ERR(TAG, "failed to add RAIL window damage");
+					return FALSE;
+				}
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+xfAppWindow** xf_rail_grid_get_damaged(xfRailGrid* grid, size_t* count)
+{
+	if (!grid)
+	{
+		*count = 0;
+		return NULL;
+	}
+
+	*count = grid->ndamaged;
+	return grid->damaged;
+}
+
+void xf_rail_grid_clear_damage(xfRailGrid* grid)
+{
+	size_t index;
+
+	if (!grid)
+		return;
+
+	for (index = 0; index < grid->ndamaged; index++)
+		region16_clear(&grid->damaged[index]->damage);
+
+	grid->ndamaged = 0;
+}
+
+void xf_rail_grid_set_dirty(xfRailGrid* grid)
+{
+	if (grid)
+		grid->dirty = TRUE;
+}
+
+void xf_rail_grid_remove(xfRailGrid* grid, const xfAppWindow* appWindow)
+{
+	size_t index;
+
+	if (!grid)
+		return;
+
+	for (index = 0; index < grid->ndamaged; index++)
+	{
+		if (grid->damaged[index] == appWindow)
+		{
+			grid->damaged[index] = grid->damaged[--grid->ndamaged];
+			break;
+		}
+	}
+
+	grid->dirty = TRUE;
+}
+
+xfRailGrid* xf_rail_grid_new(void)
+{
+	xfRailGrid* grid = (xfRailGrid*)calloc(1, sizeof(xfRailGrid));
+
+	if (!grid)
+		return NULL;
+
+	grid->dirty = TRUE;
+	return grid;
+}
+
+void xf_rail_grid_free(xfRailGrid* grid)
+{
+	if (!grid)
+		return;
+
+	free(grid->first);
+	free(grid->windows);
+	free(grid->damaged);
+	free(grid);
+}
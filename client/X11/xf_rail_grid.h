@@ -0,0 +1,50 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 RAIL Window Grid
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CLIENT_X11_RAIL_GRID_H
+#define FREERDP_CLIENT_X11_RAIL_GRID_H
+
+#include <winpr/collections.h>
+
+#include <freerdp/types.h>
+
+#include "xfreerdp.h"
+#include "xf_window.h"
+
+/* Edge length of the square grid cells indexing the RAIL windows, in pixels */
+#define XF_RAIL_GRID_CELL 128
+
+xfRailGrid* xf_rail_grid_new(void);
+void xf_rail_grid_free(xfRailGrid* grid);
+
+/* The windows are indexed again on the next invalidate */
+void xf_rail_grid_set_dirty(xfRailGrid* grid);
+void xf_rail_grid_remove(xfRailGrid* grid, const xfAppWindow* appWindow);
+
+/**
+ * Adds a damaged desktop rectangle to the windows of the table it overlaps. Only windows in
+ * the grid cells covered by the rectangle are visited. Returns FALSE if the damage could not
+ * be recorded.
+ */
+BOOL xf_rail_grid_invalidate(xfRailGrid* grid, wHashTable* windows, UINT32 desktopWidth,
+                             UINT32 desktopHeight, const RECTANGLE_16* rect);
+
+/* Windows with pending damage, until xf_rail_grid_clear_damage */
+xfAppWindow** xf_rail_grid_get_damaged(xfRailGrid* grid, size_t* count);
+void xf_rail_grid_clear_damage(xfRailGrid* grid);
+
+#endif /* FREERDP_CLIENT_X11_RAIL_GRID_H */
@@ -927,6 +927,7 @@ void xf_MoveWindow(xfContext* xfc, xfAppWindow* appWindow, int x, int y, int wid
 	appWindow->y = y;
 	appWindow->width = width;
 	appWindow->height = height;
+	xf_rail_window_geometry_changed(xfc);
 
 	if (resize)
 		XMoveResizeWindow(xfc->display, appWindow->handle, x, y, width, height);
@@ -1048,8 +1049,8 @@ void xf_SetWindowVisibilityRects(xfContext* xfc, xfAppWindow* appWindow, UINT32
 #endif
 }
 
-void xf_UpdateWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, int width,
-                         int height)
+/* Copies a window area from the desktop without flushing, the caller holds the X11 lock */
+void xf_PutWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, int width, int height)
 {
 	int ax, ay;
 
@@ -1068,8 +1069,6 @@ void xf_UpdateWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, i
 	if (ay + height > appWindow->windowOffsetY + appWindow->height)
 		height = (appWindow->windowOffsetY + appWindow->height - 1) - ay;
 
-	xf_lock_x11(xfc);
-
 	if (xfc->context.settings->SoftwareGdi)
 	{
 		XPutImage(xfc->display, xfc->primary, appWindow->gc, xfc->image, ax, ay, ax, ay, width,
@@ -1078,6 +1077,19 @@ void xf_UpdateWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, i
 
 	XCopyArea(xfc->display, xfc->primary, appWindow->handle, appWindow->gc, ax, ay, width, height,
 	          x, y);
+}
+
+void xf_UpdateWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, int width,
+                         int height)
+{
+	if (appWindow == NULL)
+		return;
+
+	if (appWindow->surfaceId < UINT16_MAX)
+		return;
+
+	xf_lock_x11(xfc);
+	xf_PutWindowArea(xfc, appWindow, x, y, width, height);
 	XFlush(xfc->display);
 	xf_unlock_x11(xfc);
 }
@@ -23,6 +23,7 @@
 #include <X11/Xlib.h>
 
 #include <freerdp/freerdp.h>
+#include <freerdp/codec/region.h>
 
 typedef struct xf_app_window xfAppWindow;
 
@@ -138,6 +139,10 @@ struct xf_app_window
 	xfLocalMove local_move;
 	BYTE rail_state;
 	BOOL rail_ignore_configure;
+
+	/* Desktop area still to be copied to the window, see xf_rail_invalidate */
+	REGION16 damage;
+	UINT32 damageSequence;
 };
 
 void xf_ewmhints_init(xfContext* xfc);
@@ -173,6 +178,7 @@ void xf_SetWindowVisibilityRects(xfContext* xfc, xfAppWindow* appWindow, UINT32
 void xf_SetWindowStyle(xfContext* xfc, xfAppWindow* appWindow, UINT32 style, UINT32 ex_style);
 void xf_UpdateWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, int width,
                          int height);
+void xf_PutWindowArea(xfContext* xfc, xfAppWindow* appWindow, int x, int y, int width, int height);
 void xf_DestroyWindow(xfContext* xfc, xfAppWindow* appWindow);
 void xf_SetWindowMinMaxInfo(xfContext* xfc, xfAppWindow* appWindow, int maxWidth, int maxHeight,
                             int maxPosX, int maxPosY, int minTrackWidth, int minTrackHeight,
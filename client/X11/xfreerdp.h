@@ -51,6 +51,7 @@ typedef struct xf_context xfContext;
 #include <freerdp/codec/h264.h>
 #include <freerdp/codec/progressive.h>
 #include <freerdp/codec/region.h>
+#include <freerdp/client/present.h>
 
 #if !defined(XcursorUInt)
 typedef unsigned int XcursorUInt;
@@ -110,6 +111,7 @@ typedef struct xf_clipboard xfClipboard;
 typedef struct _xfDispContext xfDispContext;
 typedef struct _xfVideoContext xfVideoContext;
 typedef struct xf_rail_icon_cache xfRailIconCache;
+typedef struct xf_rail_grid xfRailGrid;
 
 /* Number of buttons that are mapped from X11 to RDP button events. */
 #define NUM_BUTTONS_MAPPED 11
@@ -134,6 +136,8 @@ struct xf_context
 	Screen* screen;
 	XImage* image;
 	Pixmap primary;
+	int primaryWidth;  /* size of primary, it only grows and may exceed the desktop */
+	int primaryHeight;
 	Pixmap drawing;
 	Visual* visual;
 	Display* display;
@@ -256,9 +260,11 @@ struct xf_context
 	RdpeiClientContext* rdpei;
 	EncomspClientContext* encomsp;
 	xfDispContext* xfDisp;
+	rdpPresentScheduler* present;
 
 	RailClientContext* rail;
 	wHashTable* railWindows;
+	xfRailGrid* railGrid;
 	xfRailIconCache* railIconCache;
 
 	BOOL xkbAvailable;
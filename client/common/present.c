@@ -0,0 +1,301 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Client Present Scheduler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+#include <freerdp/client/present.h>
+
+#define TAG CLIENT_TAG("common.present")
+
+struct rdp_present_scheduler
+{
+	CRITICAL_SECTION lock;
+	UINT32 interval;
+	pPresentSchedulerPresent present;
+	pPresentSchedulerClock clock;
+	void* custom;
+
+	REGION16 pending;
+	BOOL framePending;
+	UINT64 pendingSince;
+	BOOL presented;
+	UINT64 inputUntil;
+	PRESENT_SCHEDULER_STATS stats;
+};
+
+static UINT64 present_scheduler_now(rdpPresentScheduler* scheduler)
+{
+	if (scheduler->clock)
+		return scheduler->clock(scheduler->custom);
+
+	return GetTickCount64();
+}
+
+/* Called with the lock held, returns with the lock released */
+static BOOL present_scheduler_present_locked(rdpPresentScheduler* scheduler, UINT64 now)
+{
+	BOOL rc;
+	UINT32 nrects = 0;
+	REGION16 region;
+	const RECTANGLE_16* rects;
+
+	if (scheduler->framePending)
+	{
+		const UINT64 latency = now - scheduler->pendingSince;
+		scheduler->stats.totalLatency += latency;
+		scheduler->stats.maxLatency = MAX(scheduler->stats.maxLatency, latency);
+	}
+
+	/* Present outside of the lock, the callback takes the locks of the client backend */
+	region16_init(&region);
+	rc = region16_copy(&region, &scheduler->pending);
+	region16_clear(&scheduler->pending);
+	scheduler->framePending = FALSE;
+	scheduler->presented = TRUE;
+	scheduler->stats.presents++;
+	scheduler->stats.lastPresent = now;
+	LeaveCriticalSection(&scheduler->lock);
+
+	if (!rc)
+	{
+		WLog_ERR(TAG, "failed to copy the invalid region");
+		region16_uninit(&region);
+		return FALSE;
+	}
+
+	rects = region16_rects(&region, &nrects);
+
+	if (nrects > 0)
+		rc = scheduler->present(scheduler->custom, rects, nrects);
+
+	region16_uninit(&region);
+	return rc;
+}
+
+rdpPresentScheduler* present_scheduler_new(UINT32 interval, pPresentSchedulerPresent present,
+                                           void* custom)
+{
+	rdpPresentScheduler* scheduler;
+
+	if (!present)
+		return NULL;
+
+	scheduler = (rdpPresentScheduler*)calloc(1, sizeof(rdpPresentScheduler));
+
+	if (!scheduler)
+		return NULL;
+
+	if (!InitializeCriticalSectionAndSpinCount(&scheduler->lock, 4000))
+	{
+		free(scheduler);
+		return NULL;
+	}
+
+	scheduler->interval = interval;
+	scheduler->present = present;
+	scheduler->custom = custom;
+	region16_init(&scheduler->pending);
+	return scheduler;
+}
+
+void present_scheduler_free(rdpPresentScheduler* scheduler)
+{
+	if (!scheduler)
+		return;
+
+	region16_uninit(&scheduler->pending);
+	DeleteCriticalSection(&scheduler->lock);
+	free(scheduler);
+}
+
+void present_scheduler_set_clock(rdpPresentScheduler* scheduler, pPresentSchedulerClock clock)
+{
+	if (!scheduler)
+		return;
+
+	EnterCriticalSection(&scheduler->lock);
+	scheduler->clock = clock;
+	LeaveCriticalSection(&scheduler->lock);
+}
+
+BOOL present_scheduler_invalidate(rdpPresentScheduler* scheduler, INT32 x, INT32 y, INT32 width,
+                                  INT32 height)
+{
+	BOOL rc;
+	RECTANGLE_16 rect;
+
+	if (!scheduler)
+		return FALSE;
+
+	if ((width <= 0) || (height <= 0))
+		return TRUE;
+
+	rect.left = (UINT16)MIN(MAX(x, 0), UINT16_MAX);
+	rect.top = (UINT16)MIN(MAX(y, 0), UINT16_MAX);
+	rect.right = (UINT16)MIN(MAX((INT64)x + width, 0), UINT16_MAX);
+	rect.bottom = (UINT16)MIN(MAX((INT64)y + height, 0), UINT16_MAX);
+
+	if ((rect.left >= rect.right) || (rect.top >= rect.bottom))
+		return TRUE;
+
+	EnterCriticalSection(&scheduler->lock);
+	rc = region16_union_rect(&scheduler->pending, &scheduler->pending, &rect);
+	LeaveCriticalSection(&scheduler->lock);
+	return rc;
+}
+
+/**
+ * Ends a frame: the invalid region is presented now if the interval since the last present
+ * has passed or local input is being echoed, otherwise it is kept for present_scheduler_poll.
+ */
+BOOL present_scheduler_end_frame(rdpPresentScheduler* scheduler)
+{
+	UINT64 now;
+
+	if (!scheduler)
+		return FALSE;
+
+	EnterCriticalSection(&scheduler->lock);
+	now = present_scheduler_now(scheduler);
+
+	if (region16_is_empty(&scheduler->pending))
+	{
+		LeaveCriticalSection(&scheduler->lock);
+		return TRUE;
+	}
+
+	scheduler->stats.frames++;
+
+	if (now < scheduler->inputUntil)
+	{
+		scheduler->stats.immediate++;
+		return present_scheduler_present_locked(scheduler, now);
+	}
+
+	if (!scheduler->presented || (now - scheduler->stats.lastPresent >= scheduler->interval))
+		return present_scheduler_present_locked(scheduler, now);
+
+	scheduler->stats.deferred++;
+
+	if (!scheduler->framePending)
+	{
+		scheduler->framePending = TRUE;
+		scheduler->pendingSince = now;
+	}
+
+	LeaveCriticalSection(&scheduler->lock);
+	return TRUE;
+}
+
+/* Local input was sent, present the frames echoing it without delay */
+void present_scheduler_input(rdpPresentScheduler* scheduler)
+{
+	if (!scheduler)
+		return;
+
+	EnterCriticalSection(&scheduler->lock);
+	scheduler->inputUntil = present_scheduler_now(scheduler) + PRESENT_SCHEDULER_INPUT_ECHO;
+	LeaveCriticalSection(&scheduler->lock);
+}
+
+/* Milliseconds until a deferred frame is due, INFINITE if there is none */
+DWORD present_scheduler_timeout(rdpPresentScheduler* scheduler)
+{
+	DWORD timeout = INFINITE;
+
+	if (!scheduler)
+		return INFINITE;
+
+	EnterCriticalSection(&scheduler->lock);
+
+	if (scheduler->framePending)
+	{
+		const UINT64 now = present_scheduler_now(scheduler);
+		const UINT64 due = scheduler->stats.lastPresent + scheduler->interval;
+		timeout = (now >= due) ? 0 : (DWORD)(due - now);
+	}
+
+	LeaveCriticalSection(&scheduler->lock);
+	return timeout;
+}
+
+/* Presents a deferred frame once it is due */
+BOOL present_scheduler_poll(rdpPresentScheduler* scheduler)
+{
+	UINT64 now;
+
+	if (!scheduler)
+		return FALSE;
+
+	EnterCriticalSection(&scheduler->lock);
+	now = present_scheduler_now(scheduler);
+
+	if (!scheduler->framePending || (now - scheduler->stats.lastPresent < scheduler->interval))
+	{
+		LeaveCriticalSection(&scheduler->lock);
+		return TRUE;
+	}
+
+	return present_scheduler_present_locked(scheduler, now);
+}
+
+/* Presents a deferred frame now */
+BOOL present_scheduler_flush(rdpPresentScheduler* scheduler)
+{
+	if (!scheduler)
+		return FALSE;
+
+	EnterCriticalSection(&scheduler->lock);
+
+	if (!scheduler->framePending)
+	{
+		LeaveCriticalSection(&scheduler->lock);
+		return TRUE;
+	}
+
+	return present_scheduler_present_locked(scheduler, present_scheduler_now(scheduler));
+}
+
+/* Drops the invalid region, e.g. when the desktop is resized and redrawn as a whole */
+void present_scheduler_clear(rdpPresentScheduler* scheduler)
+{
+	if (!scheduler)
+		return;
+
+	EnterCriticalSection(&scheduler->lock);
+	region16_clear(&scheduler->pending);
+	scheduler->framePending = FALSE;
+	LeaveCriticalSection(&scheduler->lock);
+}
+
+BOOL present_scheduler_get_stats(rdpPresentScheduler* scheduler, PRESENT_SCHEDULER_STATS* stats)
+{
+	if (!scheduler || !stats)
+		return FALSE;
+
+	EnterCriticalSection(&scheduler->lock);
+	*stats = scheduler->stats;
+	LeaveCriticalSection(&scheduler->lock);
+	return TRUE;
+}
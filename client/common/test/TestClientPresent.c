@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <winpr/crt.h>
+
+#include <freerdp/client/present.h>
+
+/* Null output backend, records what would have been drawn */
+typedef struct
+{
+	UINT64 now;
+	UINT32 presents;
+	UINT32 rects;
+	RECTANGLE_16 extents;
+	BOOL fail;
+} TEST_BACKEND;
+
+static UINT64 test_clock(void* custom)
+{
+	const TEST_BACKEND* backend = (const TEST_BACKEND*)custom;
+	return backend->now;
+}
+
+static BOOL test_present(void* custom, const RECTANGLE_16* rects, UINT32 nrects)
+{
+	UINT32 x;
+	TEST_BACKEND* backend = (TEST_BACKEND*)custom;
+	backend->presents++;
+	backend->rects += nrects;
+	backend->extents = rects[0];
+
+	for (x = 1; x < nrects; x++)
+	{
+		backend->extents.left = MIN(backend->extents.left, rects[x].left);
+		backend->extents.top = MIN(backend->extents.top, rects[x].top);
+		backend->extents.right = MAX(backend->extents.right, rects[x].right);
+		backend->extents.bottom = MAX(backend->extents.bottom, rects[x].bottom);
+	}
+
+	return !backend->fail;
+}
+
+static BOOL test_frame(rdpPresentScheduler* scheduler, INT32 x, INT32 y, INT32 w, INT32 h)
+{
+	return present_scheduler_invalidate(scheduler, x, y, w, h) &&
+	       present_scheduler_end_frame(scheduler);
+}
+
+static BOOL test_burst(void)
+{
+	UINT32 i;
+	BOOL rc = FALSE;
+	PRESENT_SCHEDULER_STATS stats = { 0 };
+	TEST_BACKEND backend = { 0 };
+	rdpPresentScheduler* scheduler = present_scheduler_new(16, test_present, &backend);
+
+	if (!scheduler)
+		return FALSE;
+
+	present_scheduler_set_clock(scheduler, test_clock);
+	backend.now = 1000;
+
+	/* An idle scheduler presents the first frame right away */
+	if (!test_frame(scheduler, 0, 0, 10, 10) || (backend.presents != 1))
+		goto fail;
+
+	if (present_scheduler_timeout(scheduler) != INFINITE)
+		goto fail;
+
+	/* A burst of 50 small updates within 10ms ends up in a single present */
+	for (i = 0; i < 50; i++)
+	{
+		backend.now = 1001 + i / 5;
+
+		if (!test_frame(scheduler, (INT32)i * 8, 100, 4, 4))
+			goto fail;
+	}
+
+	if ((backend.presents != 1) || (present_scheduler_timeout(scheduler) != 6))
+		goto fail;
+
+	if (!present_scheduler_poll(scheduler) || (backend.presents != 1))
+		goto fail;
+
+	backend.now = 1016;
+
+	if ((present_scheduler_timeout(scheduler) != 0) || !present_scheduler_poll(scheduler))
+		goto fail;
+
+	if ((backend.presents != 2) || (backend.rects != 1 + 50) || (backend.extents.left != 0) ||
+	    (backend.extents.right != 49 * 8 + 4) || (backend.extents.top != 100))
+		goto fail;
+
+	if (!present_scheduler_get_stats(scheduler, &stats))
+		goto fail;
+
+	if ((stats.frames != 51) || (stats.presents != 2) || (stats.deferred != 50) ||
+	    (stats.immediate != 0) || (stats.lastPresent != 1016) || (stats.maxLatency != 15) ||
+	    (stats.totalLatency != 15))
+		goto fail;
+
+	/* Nothing left to present */
+	if ((present_scheduler_timeout(scheduler) != INFINITE) || !present_scheduler_flush(scheduler) ||
+	    (backend.presents != 2))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (!rc)
+		fprintf(stderr, "%s failed: %" PRIu32 " presents, %" PRIu32 " rects\n", __FUNCTION__,
+		        backend.presents, backend.rects);
+
+	present_scheduler_free(scheduler);
+	return rc;
+}
+
+static BOOL test_input_echo(void)
+{
+	BOOL rc = FALSE;
+	PRESENT_SCHEDULER_STATS stats = { 0 };
+	TEST_BACKEND backend = { 0 };
+	rdpPresentScheduler* scheduler = present_scheduler_new(16, test_present, &backend);
+
+	if (!scheduler)
+		return FALSE;
+
+	present_scheduler_set_clock(scheduler, test_clock);
+	backend.now = 5000;
+
+	if (!test_frame(scheduler, 0, 0, 8, 8) || !test_frame(scheduler, 8, 0, 8, 8))
+		goto fail;
+
+	if (backend.presents != 1)
+		goto fail;
+
+	/* A key press, the deferred frame and the echo of the key are presented at once */
+	backend.now = 5002;
+	present_scheduler_input(scheduler);
+
+	if (!test_frame(scheduler, 100, 100, 8, 16) || (backend.presents != 2) ||
+	    (backend.extents.left != 8) || (backend.extents.bottom != 116))
+		goto fail;
+
+	backend.now = 5003;
+
+	if (!test_frame(scheduler, 100, 100, 8, 16) || (backend.presents != 3))
+		goto fail;
+
+	/* The echo period ends, frames are paced again */
+	backend.now = 5000 + 2 + PRESENT_SCHEDULER_INPUT_ECHO;
+
+	if (!test_frame(scheduler, 0, 0, 8, 8) || (backend.presents != 4))
+		goto fail;
+
+	backend.now++;
+
+	if (!test_frame(scheduler, 0, 0, 8, 8) || (backend.presents != 4))
+		goto fail;
+
+	/* A resize drops the damage, the desktop is redrawn as a whole */
+	present_scheduler_clear(scheduler);
+	backend.now += 100;
+
+	if ((present_scheduler_timeout(scheduler) != INFINITE) || !present_scheduler_poll(scheduler) ||
+	    (backend.presents != 4))
+		goto fail;
+
+	/* Invalid rectangles are ignored, frames without damage are not counted */
+	if (!present_scheduler_invalidate(scheduler, 10, 10, 0, 5) ||
+	    !present_scheduler_invalidate(scheduler, -20, -20, 10, 10) ||
+	    !present_scheduler_end_frame(scheduler) || (backend.presents != 4))
+		goto fail;
+
+	/* Backend failures are reported to the caller */
+	backend.fail = TRUE;
+
+	if (test_frame(scheduler, 0, 0, 8, 8) || (backend.presents != 5))
+		goto fail;
+
+	if (!present_scheduler_get_stats(scheduler, &stats))
+		goto fail;
+
+	if ((stats.frames != 7) || (stats.presents != 5) || (stats.immediate != 2) ||
+	    (stats.deferred != 2))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (!rc)
+		fprintf(stderr, "%s failed: %" PRIu32 " presents, %" PRIu32 " rects\n", __FUNCTION__,
+		        backend.presents, backend.rects);
+
+	present_scheduler_free(scheduler);
+	return rc;
+}
+
+int TestClientPresent(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_burst())
+		return -1;
+
+	if (!test_input_echo())
+		return -1;
+
+	return 0;
+}
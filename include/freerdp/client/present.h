@@ -0,0 +1,83 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Client Present Scheduler
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CLIENT_PRESENT_H
+#define FREERDP_CLIENT_PRESENT_H
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/codec/region.h>
+
+/**
+ * The present scheduler collects the areas invalidated by EndPaint and hands them to the
+ * client backend at most once per interval, bursts of small updates are merged into a single
+ * present. Frames following local input are presented right away to keep the input echo
+ * responsive. The client event loop waits at most present_scheduler_timeout() milliseconds
+ * and calls present_scheduler_poll() to present deferred frames.
+ */
+typedef struct rdp_present_scheduler rdpPresentScheduler;
+
+/* Draws the given desktop rectangles to the screen */
+typedef BOOL (*pPresentSchedulerPresent)(void* custom, const RECTANGLE_16* rects, UINT32 nrects);
+/* Returns the current time in milliseconds, GetTickCount64() by default */
+typedef UINT64 (*pPresentSchedulerClock)(void* custom);
+
+typedef struct
+{
+	UINT64 frames;       /* frames ended with present_scheduler_end_frame */
+	UINT64 presents;     /* calls to the present callback */
+	UINT64 deferred;     /* frames merged into a later present */
+	UINT64 immediate;    /* presents made immediately because of recent input */
+	UINT64 lastPresent;  /* time of the last present */
+	UINT64 totalLatency; /* sum of the time deferred damage waited for its present */
+	UINT64 maxLatency;   /* longest time deferred damage waited for its present */
+} PRESENT_SCHEDULER_STATS;
+
+/* Frames ending up to this many milliseconds after local input are presented immediately */
+#define PRESENT_SCHEDULER_INPUT_ECHO 250
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	FREERDP_API rdpPresentScheduler* present_scheduler_new(UINT32 interval,
+	                                                       pPresentSchedulerPresent present,
+	                                                       void* custom);
+	FREERDP_API void present_scheduler_free(rdpPresentScheduler* scheduler);
+
+	FREERDP_API void present_scheduler_set_clock(rdpPresentScheduler* scheduler,
+	                                             pPresentSchedulerClock clock);
+
+	FREERDP_API BOOL present_scheduler_invalidate(rdpPresentScheduler* scheduler, INT32 x, INT32 y,
+	                                              INT32 width, INT32 height);
+	FREERDP_API BOOL present_scheduler_end_frame(rdpPresentScheduler* scheduler);
+	FREERDP_API void present_scheduler_input(rdpPresentScheduler* scheduler);
+
+	FREERDP_API DWORD present_scheduler_timeout(rdpPresentScheduler* scheduler);
+	FREERDP_API BOOL present_scheduler_poll(rdpPresentScheduler* scheduler);
+	FREERDP_API BOOL present_scheduler_flush(rdpPresentScheduler* scheduler);
+	FREERDP_API void present_scheduler_clear(rdpPresentScheduler* scheduler);
+
+	FREERDP_API BOOL present_scheduler_get_stats(rdpPresentScheduler* scheduler,
+	                                             PRESENT_SCHEDULER_STATS* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_CLIENT_PRESENT_H */
@@ -30,6 +30,16 @@
 
 typedef struct _rdpei_client_context RdpeiClientContext;
 
+typedef struct
+{
+	UINT64 frames;       /* touch and pen frames sent */
+	UINT64 changes;      /* contact changes sent */
+	UINT64 repeats;      /* frames only repeating unchanged active contacts */
+	UINT64 wakeups;      /* wakeups of the input thread */
+	UINT64 totalLatency; /* sum of the time contact changes waited for their frame */
+	UINT64 maxLatency;   /* longest time a contact change waited for its frame */
+} RDPEI_INPUT_STATS;
+
 typedef UINT32 (*pcRdpeiGetVersion)(RdpeiClientContext* context);
 typedef UINT32 (*pcRdpeiGetFeatures)(RdpeiClientContext* context);
 
@@ -53,6 +63,8 @@ typedef UINT (*pcRdpeiPenRawEvent)(RdpeiClientContext* context, INT32 externalId
 typedef UINT (*pcRdpeiSuspendTouch)(RdpeiClientContext* context);
 typedef UINT (*pcRdpeiResumeTouch)(RdpeiClientContext* context);
 
+typedef UINT (*pcRdpeiGetStats)(RdpeiClientContext* context, RDPEI_INPUT_STATS* stats);
+
 struct _rdpei_client_context
 {
 	void* handle;
@@ -83,6 +95,8 @@ struct _rdpei_client_context
 	pcRdpeiPenRawEvent PenRawEvent;
 
 	UINT32 clientFeaturesMask;
+
+	pcRdpeiGetStats GetStats;
 };
 
 #endif /* FREERDP_CHANNEL_RDPEI_CLIENT_RDPEI_H */
@@ -0,0 +1,63 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Drawing Order Encoder
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CODEC_ORDER_ENCODER_H
+#define FREERDP_CODEC_ORDER_ENCODER_H
+
+typedef struct _ORDER_ENCODER_CONTEXT ORDER_ENCODER_CONTEXT;
+
+#include <freerdp/api.h>
+#include <freerdp/types.h>
+#include <freerdp/settings.h>
+
+#include <freerdp/codec/color.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	/**
+	 * The order encoder translates screen content into drawing orders for clients without
+	 * bitmap codecs: solid areas are sent as OpaqueRect/MultiOpaqueRect, vertically scrolled
+	 * areas as ScrBlt and all other content as 64x64 tiles in the bitmap cache, drawn with
+	 * MemBlt. It keeps a copy of the content the client has, unchanged tiles are skipped and
+	 * tiles already in the client bitmap cache are not sent again.
+	 */
+	FREERDP_API BOOL order_encoder_supported(const rdpSettings* settings);
+
+	/**
+	 * Sends the changed parts of rect in pSrcData (a 32bpp frame of the size passed to
+	 * order_encoder_context_reset) as drawing orders with context->update.
+	 */
+	FREERDP_API BOOL order_encoder_compose(ORDER_ENCODER_CONTEXT* encoder, rdpContext* context,
+	                                       const BYTE* pSrcData, UINT32 SrcFormat,
+	                                       UINT32 nSrcStep, const RECTANGLE_16* rect);
+
+	/* Forgets the client state, required after reactivation or a desktop resize */
+	FREERDP_API BOOL order_encoder_context_reset(ORDER_ENCODER_CONTEXT* encoder,
+	                                             const rdpSettings* settings, UINT32 width,
+	                                             UINT32 height);
+
+	FREERDP_API ORDER_ENCODER_CONTEXT* order_encoder_context_new(void);
+	FREERDP_API void order_encoder_context_free(ORDER_ENCODER_CONTEXT* encoder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_CODEC_ORDER_ENCODER_H */
@@ -31,6 +31,7 @@
 #include <freerdp/codec/planar.h>
 #include <freerdp/codec/interleaved.h>
 #include <freerdp/codec/progressive.h>
+#include <freerdp/codec/order_encoder.h>
 
 #define FREERDP_CODEC_INTERLEAVED 0x00000001
 #define FREERDP_CODEC_PLANAR 0x00000002
@@ -41,6 +42,7 @@
 #define FREERDP_CODEC_PROGRESSIVE 0x00000040
 #define FREERDP_CODEC_AVC420 0x00000080
 #define FREERDP_CODEC_AVC444 0x00000100
+#define FREERDP_CODEC_DRAWING_ORDERS 0x00000200
 #define FREERDP_CODEC_ALL 0xFFFFFFFF
 
 struct rdp_codecs
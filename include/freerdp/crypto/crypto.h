@@ -46,6 +46,9 @@ struct crypto_cert_struct
 	STACK_OF(X509) * px509chain;
 };
 
+#define CRYPTO_BASE64_ENCODED_SIZE(length) ((((length) + 2) / 3) * 4 + 1)
+#define CRYPTO_BASE64_DECODED_SIZE(length) (((length) / 4) * 3)
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -108,6 +111,14 @@ extern "C"
 	FREERDP_API void crypto_base64_decode(const char* enc_data, size_t length, BYTE** dec_data,
 	                                      size_t* res_length);
 
+	/* Encodes into buffer, which takes CRYPTO_BASE64_ENCODED_SIZE(length) bytes including the
+	 * terminating NUL. Returns the number of characters written, 0 on error. */
+	FREERDP_API size_t crypto_base64_encode_buffer(const BYTE* data, size_t length, char* buffer,
+	                                               size_t size);
+	/* Decodes into buffer, which takes at most CRYPTO_BASE64_DECODED_SIZE(length) bytes */
+	FREERDP_API BOOL crypto_base64_decode_buffer(const char* enc_data, size_t length,
+	                                             BYTE* buffer, size_t size, size_t* res_length);
+
 #ifdef __cplusplus
 }
 #endif
@@ -116,8 +116,10 @@ extern "C"
 	UINT16 y;
 	DEFINE_EVENT_END(MouseEventEx)
 
+	/* Subscribers that need to be called again lower due to that tick count, 0 for none */
 	DEFINE_EVENT_BEGIN(Timer)
 	UINT64 now;
+	UINT64 due;
 	DEFINE_EVENT_END(Timer)
 
 	DEFINE_EVENT_BEGIN(GraphicsReset)
@@ -471,6 +471,7 @@ struct _GDI_DC
 	HGDI_WND hwnd;
 	INT32 drawMode;
 	INT32 bkMode;
+	INT32 polyFillMode;
 };
 typedef struct _GDI_DC GDI_DC;
 typedef GDI_DC* HGDI_DC;
@@ -526,6 +527,7 @@ struct rdp_gdi
 	GeometryClientContext* geometry;
 
 	wLog* log;
+	size_t primary_size; /* bytes allocated for an internal primary buffer, 0 if external */
 };
 
 #ifdef __cplusplus
@@ -140,6 +140,10 @@ struct _rdpdr_server_context
 	psRdpdrDriveRenameFile DriveRenameFile;
 
 	/*** Drive callbacks registered by the server. ***/
+	/**
+	 * The completion callbacks are called from the channel IO threads. Completions for the
+	 * same device and file handle are delivered in order, others may run concurrently.
+	 */
 	psRdpdrOnDriveCreate OnDriveCreate;
 	psRdpdrOnDriveDelete OnDriveDelete;
 	psRdpdrOnDriveCreateDirectoryComplete OnDriveCreateDirectoryComplete;
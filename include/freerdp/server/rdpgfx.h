@@ -77,6 +77,8 @@ typedef UINT (*psRdpgfxFrameAcknowledge)(RdpgfxServerContext* context,
                                          const RDPGFX_FRAME_ACKNOWLEDGE_PDU* frameAcknowledge);
 typedef UINT (*psRdpgfxQoeFrameAcknowledge)(
     RdpgfxServerContext* context, const RDPGFX_QOE_FRAME_ACKNOWLEDGE_PDU* qoeFrameAcknowledge);
+typedef UINT (*psRdpgfxBeginFrameBatch)(RdpgfxServerContext* context);
+typedef UINT (*psRdpgfxSubmitFrameBatch)(RdpgfxServerContext* context);
 
 struct _rdpgfx_server_context
 {
@@ -112,6 +114,23 @@ struct _rdpgfx_server_context
 
 	RdpgfxServerPrivate* priv;
 	rdpContext* rdpcontext;
+
+	/**
+	 * Frame batching: between BeginFrameBatch and SubmitFrameBatch all PDUs
+	 * the calling thread sends through this context are collected in a single
+	 * buffer and emitted as one ZGFX segmented packet with a single channel
+	 * write. PDUs of other threads are sent directly.
+	 */
+	psRdpgfxBeginFrameBatch BeginFrameBatch;
+	psRdpgfxSubmitFrameBatch SubmitFrameBatch;
+
+	/**
+	 * Answer cache import offers from the client with a CacheImportReply
+	 * that imports the offered entries into free cache slots. Off by default,
+	 * the CacheImportOffer callback is then expected to reply. If both are
+	 * used the callback is invoked first and can refuse the import.
+	 */
+	BOOL autoCacheImport;
 };
 
 #ifdef __cplusplus
@@ -123,6 +142,10 @@ extern "C"
 	FREERDP_API void rdpgfx_server_context_free(RdpgfxServerContext* context);
 	FREERDP_API HANDLE rdpgfx_server_get_event_handle(RdpgfxServerContext* context);
 	FREERDP_API UINT rdpgfx_server_handle_messages(RdpgfxServerContext* context);
+	FREERDP_API BOOL rdpgfx_server_cache_lookup(RdpgfxServerContext* context, UINT64 cacheKey,
+	                                            UINT16* cacheSlot);
+	FREERDP_API BOOL rdpgfx_server_cache_alloc_slot(RdpgfxServerContext* context, UINT32 size,
+	                                                UINT16* cacheSlot);
 
 #ifdef __cplusplus
 }
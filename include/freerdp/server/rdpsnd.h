@@ -28,6 +28,7 @@
 typedef struct _rdpsnd_server_context RdpsndServerContext;
 typedef struct _rdpsnd_server_context rdpsnd_server_context;
 typedef struct _rdpsnd_server_private RdpsndServerPrivate;
+typedef struct _rdpsnd_server_source RdpsndServerSource;
 
 typedef UINT (*psRdpsndStart)(RdpsndServerContext* context);
 typedef UINT (*psRdpsndStop)(RdpsndServerContext* context);
@@ -132,6 +133,29 @@ extern "C"
 	FREERDP_API HANDLE rdpsnd_server_get_event_handle(RdpsndServerContext* context);
 	FREERDP_API UINT rdpsnd_server_handle_messages(RdpsndServerContext* context);
 
+	/**
+	 * A source shares the audio encoding between all contexts subscribed to it.
+	 * Samples are encoded once per distinct client format and the encoded
+	 * blocks are sent to every context that selected that format.
+	 */
+	FREERDP_API RdpsndServerSource* rdpsnd_server_source_new(const AUDIO_FORMAT* src_format,
+	                                                         int latency);
+	FREERDP_API void rdpsnd_server_source_free(RdpsndServerSource* source);
+	/**
+	 * Limit the number of blocks a context may have sent but not yet had
+	 * confirmed by the client. Blocks beyond the limit are dropped for that
+	 * context. 0 (the default) disables the limit.
+	 */
+	FREERDP_API void rdpsnd_server_source_set_max_pending_blocks(RdpsndServerSource* source,
+	                                                             UINT32 count);
+	FREERDP_API BOOL rdpsnd_server_source_add_context(RdpsndServerSource* source,
+	                                                  RdpsndServerContext* context);
+	FREERDP_API BOOL rdpsnd_server_source_remove_context(RdpsndServerSource* source,
+	                                                     RdpsndServerContext* context);
+	FREERDP_API UINT rdpsnd_server_source_send_samples(RdpsndServerSource* source,
+	                                                   const void* buf, int nframes,
+	                                                   UINT16 wTimestamp);
+
 #ifdef __cplusplus
 }
 #endif
@@ -43,6 +43,8 @@
 #include <winpr/collections.h>
 #include <winpr/cmdline.h>
 
+#define SHADOW_POINTER_CACHE_SIZE 32
+
 typedef struct rdp_shadow_client rdpShadowClient;
 typedef struct rdp_shadow_server rdpShadowServer;
 typedef struct rdp_shadow_screen rdpShadowScreen;
@@ -116,6 +118,13 @@ struct rdp_shadow_client
 	RdpsndServerContext* rdpsnd;
 	audin_server_context* audin;
 	RdpgfxServerContext* rdpgfx;
+
+	BOOL pointerPending;
+	UINT32 pendingPointerX;
+	UINT32 pendingPointerY;
+	UINT64 pointerCache[SHADOW_POINTER_CACHE_SIZE];
+	UINT32 pointerCacheNext;
+	UINT32 pointerCacheIndex;
 };
 
 struct rdp_shadow_server
@@ -221,6 +230,9 @@ struct rdp_shadow_subsystem
 	pfnShadowClientCapabilities ClientCapabilities;
 
 	rdpShadowServer* server;
+
+	/* Desktop audio, clients subscribe to it once their format is selected */
+	RdpsndServerSource* rdpsndSource;
 };
 
 /* Definition of message between subsystem and clients */
@@ -322,6 +334,12 @@ extern "C"
 	FREERDP_API int shadow_client_boardcast_msg(rdpShadowServer* server, void* context, UINT32 type,
 	                                            SHADOW_MSG_OUT* msg, void* lParam);
 	FREERDP_API int shadow_client_boardcast_quit(rdpShadowServer* server, int nExitCode);
+	/**
+	 * Set the pointer position to send to a client. Updates posted before the client
+	 * thread gets to them are coalesced, only the latest position is sent.
+	 */
+	FREERDP_API BOOL shadow_client_post_pointer_position(rdpShadowClient* client, UINT32 x,
+	                                                     UINT32 y);
 
 	FREERDP_API UINT32 shadow_encoder_preferred_fps(rdpShadowEncoder* encoder);
 	FREERDP_API UINT32 shadow_encoder_inflight_frames(rdpShadowEncoder* encoder);
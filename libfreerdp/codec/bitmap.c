@@ -182,7 +182,7 @@ static INLINE UINT16 out_copy_count_3(UINT16 in_count, wStream* in_s, wStream* i
 			Stream_Write_UINT16(in_s, in_count);
 		}
 
-		Stream_Write(in_s, Stream_Pointer(in_data), in_count * 3);
+		Stream_Write(in_s, Stream_Buffer(in_data), in_count * 3);
 	}
 
 	Stream_SetPosition(in_data, 0);
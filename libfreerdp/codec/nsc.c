@@ -230,6 +230,15 @@ static BOOL nsc_stream_initialize(NSC_CONTEXT* context, wStream* s)
 	Stream_Read_UINT8(s, context->ColorLossLevel);         /* ColorLossLevel (1 byte) */
 	Stream_Read_UINT8(s, context->ChromaSubsamplingLevel); /* ChromaSubsamplingLevel (1 byte) */
 	Stream_Seek(s, 2);                                     /* Reserved (2 bytes) */
+
+	/* Checked here so every decoder sees the same valid range */
+	if ((context->ColorLossLevel < 1) || (context->ColorLossLevel > 7))
+	{
+		WLog_Print(context->priv->log, WLOG_ERROR,
+		           "invalid ColorLossLevel %" PRIu32 ", expected 1..7", context->ColorLossLevel);
+		return FALSE;
+	}
+
 	context->Planes = Stream_Pointer(s);
 	return TRUE;
 }
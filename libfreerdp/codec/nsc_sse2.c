@@ -380,11 +380,117 @@ static BOOL nsc_encode_sse2(NSC_CONTEXT* context, const BYTE* data, UINT32 scanl
 	return TRUE;
 }
 
+static INLINE __m128i nsc_decode_chroma_sse2(const BYTE* plane, BOOL subsampled, __m128i shift)
+{
+	__m128i val;
+
+	if (subsampled)
+	{
+		/* 4 samples cover 8 pixels, duplicate each of them */
+		val = _mm_cvtsi32_si128(*(const int*)plane);
+		val = _mm_unpacklo_epi8(val, val);
+	}
+	else
+		val = _mm_loadl_epi64((const __m128i*)plane);
+
+	/* Colorloss recovery, the shifted value is truncated to a signed byte */
+	val = _mm_unpacklo_epi8(val, _mm_setzero_si128());
+	val = _mm_sll_epi16(val, shift);
+	return _mm_srai_epi16(val, 8);
+}
+
+static BOOL nsc_decode_sse2(NSC_CONTEXT* context)
+{
+	UINT16 y;
+	UINT16 rw;
+	BYTE shift;
+	BOOL subsampled;
+	__m128i sshift;
+	BYTE* bmpdata;
+
+	if (!context)
+		return FALSE;
+
+	rw = ROUND_UP_TO(context->width, 8);
+	shift = context->ColorLossLevel - 1; /* colorloss recovery + YCoCg shift */
+	sshift = _mm_cvtsi32_si128(shift + 8);
+	subsampled = context->ChromaSubsamplingLevel ? TRUE : FALSE;
+	bmpdata = context->BitmapData;
+
+	if (!bmpdata)
+		return FALSE;
+
+	if (1ull * context->width * context->height * 4 > context->BitmapDataLength)
+		return FALSE;
+
+	for (y = 0; y < context->height; y++)
+	{
+		UINT16 x;
+		const BYTE* yplane;
+		const BYTE* coplane;
+		const BYTE* cgplane;
+		const BYTE* aplane = context->priv->PlaneBuffers[3] + y * context->width; /* A */
+
+		if (subsampled)
+		{
+			yplane = context->priv->PlaneBuffers[0] + y * rw;                /* Y */
+			coplane = context->priv->PlaneBuffers[1] + (y >> 1) * (rw >> 1); /* Co, supersampled */
+			cgplane = context->priv->PlaneBuffers[2] + (y >> 1) * (rw >> 1); /* Cg, supersampled */
+		}
+		else
+		{
+			yplane = context->priv->PlaneBuffers[0] + y * context->width;  /* Y */
+			coplane = context->priv->PlaneBuffers[1] + y * context->width; /* Co */
+			cgplane = context->priv->PlaneBuffers[2] + y * context->width; /* Cg */
+		}
+
+		for (x = 0; x + 8 <= context->width; x += 8)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i y_val =
+			    _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&yplane[x]), zero);
+			const __m128i co_val =
+			    nsc_decode_chroma_sse2(&coplane[subsampled ? x >> 1 : x], subsampled, sshift);
+			const __m128i cg_val =
+			    nsc_decode_chroma_sse2(&cgplane[subsampled ? x >> 1 : x], subsampled, sshift);
+			const __m128i a_val = _mm_loadl_epi64((const __m128i*)&aplane[x]);
+			const __m128i t = _mm_sub_epi16(y_val, cg_val);
+			/* Pack with unsigned saturation clamps to [0, 255] */
+			const __m128i r_val = _mm_packus_epi16(_mm_add_epi16(t, co_val), zero);
+			const __m128i g_val = _mm_packus_epi16(_mm_add_epi16(y_val, cg_val), zero);
+			const __m128i b_val = _mm_packus_epi16(_mm_sub_epi16(t, co_val), zero);
+			const __m128i bg = _mm_unpacklo_epi8(b_val, g_val);
+			const __m128i ra = _mm_unpacklo_epi8(r_val, a_val);
+			_mm_storeu_si128((__m128i*)bmpdata, _mm_unpacklo_epi16(bg, ra));
+			_mm_storeu_si128((__m128i*)(bmpdata + 16), _mm_unpackhi_epi16(bg, ra));
+			bmpdata += 32;
+		}
+
+		for (; x < context->width; x++)
+		{
+			const INT16 y_val = (INT16)yplane[x];
+			const INT16 co_val = (INT16)(INT8)(coplane[subsampled ? x >> 1 : x] << shift);
+			const INT16 cg_val = (INT16)(INT8)(cgplane[subsampled ? x >> 1 : x] << shift);
+			const INT16 r_val = y_val + co_val - cg_val;
+			const INT16 g_val = y_val + cg_val;
+			const INT16 b_val = y_val - co_val - cg_val;
+			*bmpdata++ = MINMAX(b_val, 0, 0xFF);
+			*bmpdata++ = MINMAX(g_val, 0, 0xFF);
+			*bmpdata++ = MINMAX(r_val, 0, 0xFF);
+			*bmpdata++ = aplane[x];
+		}
+	}
+
+	return TRUE;
+}
+
 void nsc_init_sse2(NSC_CONTEXT* context)
 {
 	if (!IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE))
 		return;
 
 	PROFILER_RENAME(context->priv->prof_nsc_encode, "nsc_encode_sse2")
+	PROFILER_RENAME(context->priv->prof_nsc_decode, "nsc_decode_sse2")
 	context->encode = nsc_encode_sse2;
+	context->decode = nsc_decode_sse2;
 }
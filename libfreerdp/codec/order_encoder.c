@@ -0,0 +1,774 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Drawing Order Encoder
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/collections.h>
+
+#include <freerdp/log.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/planar.h>
+#include <freerdp/codec/interleaved.h>
+#include <freerdp/codec/order_encoder.h>
+
+#include "../core/update.h"
+
+#define TAG FREERDP_TAG("codec.orders")
+
+/* Tiles are kept in the 64x64 cell of the client bitmap cache v2 */
+#define ORDER_ENCODER_CACHE_ID 2
+#define ORDER_ENCODER_TILE_SIZE 64
+/* A copy of every cached tile is kept, this bounds it to 16MB per client */
+#define ORDER_ENCODER_MAX_CACHE_ENTRIES 1024
+#define ORDER_ENCODER_MAX_RECTANGLES 45
+#define ORDER_ENCODER_SCROLL_SAMPLES 8
+#define ORDER_ENCODER_SCROLL_CANDIDATES 16
+
+typedef struct
+{
+	UINT32 color;
+	RECTANGLE_16 rect;
+} ORDER_ENCODER_FILL;
+
+struct _ORDER_ENCODER_CONTEXT
+{
+	UINT32 width;
+	UINT32 height;
+	UINT32 ColorDepth;
+	UINT32 SrcFormat;
+	BOOL scrBlt;
+	BOOL multiOpaqueRect;
+
+	/* Content as last sent to the client, tiles never sent are not valid */
+	BYTE* frame;
+	UINT32 frameStep;
+	BYTE* tileValid;
+	UINT32 gridWidth;
+	UINT32 gridHeight;
+	UINT64* rowHashes;
+
+	/* Content hashes and pixels of the tiles in the client bitmap cache, by cache index */
+	wHashTable* cache;
+	UINT64* cacheKeys;
+	BYTE* cacheTiles;
+	UINT32 cacheEntries;
+	UINT32 cacheUsed;
+	UINT32 cacheNext;
+
+	BITMAP_PLANAR_CONTEXT* planar;
+	BITMAP_INTERLEAVED_CONTEXT* interleaved;
+	BYTE* tile;
+	BYTE* bitmapData;
+	UINT32 bitmapDataSize;
+
+	ORDER_ENCODER_FILL* fills;
+	size_t numFills;
+};
+
+static UINT64 order_encoder_hash(const BYTE* data, size_t length)
+{
+	size_t x;
+	UINT64 hash = 0xCBF29CE484222325ULL;
+
+	for (x = 0; x + 8 <= length; x += 8)
+	{
+		UINT64 value;
+		memcpy(&value, &data[x], sizeof(value));
+		hash = (hash ^ value) * 0x100000001B3ULL;
+		hash ^= hash >> 29;
+	}
+
+	for (; x < length; x++)
+		hash = (hash ^ data[x]) * 0x100000001B3ULL;
+
+	return hash;
+}
+
+static UINT32 order_encoder_key_hash(const void* key)
+{
+	const UINT64 value = *(const UINT64*)key;
+	return (UINT32)(value ^ (value >> 32));
+}
+
+static BOOL order_encoder_key_compare(const void* key1, const void* key2)
+{
+	return *(const UINT64*)key1 == *(const UINT64*)key2;
+}
+
+static void order_encoder_invalidate(ORDER_ENCODER_CONTEXT* encoder)
+{
+	if (encoder->tileValid)
+		ZeroMemory(encoder->tileValid, 1ull * encoder->gridWidth * encoder->gridHeight);
+
+	if (encoder->cache)
+		HashTable_Clear(encoder->cache);
+
+	encoder->cacheUsed = 0;
+	encoder->cacheNext = 0;
+}
+
+BOOL order_encoder_supported(const rdpSettings* settings)
+{
+	const BITMAP_CACHE_V2_CELL_INFO* cell;
+
+	if (!settings || !settings->BitmapCacheV2CellInfo)
+		return FALSE;
+
+	/* Cache bitmap v2 orders have no 15bpp format */
+	switch (settings->ColorDepth)
+	{
+		case 16:
+		case 24:
+		case 32:
+			break;
+
+		default:
+			return FALSE;
+	}
+
+	if (settings->BitmapCacheV2NumCells <= ORDER_ENCODER_CACHE_ID)
+		return FALSE;
+
+	cell = &settings->BitmapCacheV2CellInfo[ORDER_ENCODER_CACHE_ID];
+
+	if (cell->numEntries == 0)
+		return FALSE;
+
+	return settings->OrderSupport[NEG_MEMBLT_INDEX] &&
+	       settings->OrderSupport[NEG_OPAQUE_RECT_INDEX];
+}
+
+static BOOL order_encoder_tile_changed(ORDER_ENCODER_CONTEXT* encoder, const BYTE* pSrcData,
+                                       UINT32 nSrcStep, UINT32 x, UINT32 y, UINT32 w, UINT32 h)
+{
+	UINT32 i;
+
+	for (i = 0; i < h; i++)
+	{
+		const BYTE* src = &pSrcData[(y + i) * nSrcStep + x * 4];
+		const BYTE* dst = &encoder->frame[(y + i) * encoder->frameStep + x * 4];
+
+		if (memcmp(src, dst, w * 4ull) != 0)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void order_encoder_copy(BYTE* pDstData, UINT32 nDstStep, UINT32 nXDst, UINT32 nYDst,
+                               const BYTE* pSrcData, UINT32 nSrcStep, UINT32 nXSrc, UINT32 nYSrc,
+                               UINT32 w, UINT32 h)
+{
+	UINT32 i;
+
+	for (i = 0; i < h; i++)
+		memcpy(&pDstData[(nYDst + i) * nDstStep + nXDst * 4],
+		       &pSrcData[(nYSrc + i) * nSrcStep + nXSrc * 4], w * 4ull);
+}
+
+static BOOL order_encoder_tile_solid(const BYTE* pSrcData, UINT32 nSrcStep, UINT32 x, UINT32 y,
+                                     UINT32 w, UINT32 h, UINT32* pixel)
+{
+	UINT32 i, j;
+	const UINT32 value = *(const UINT32*)&pSrcData[y * nSrcStep + x * 4];
+
+	for (i = 0; i < h; i++)
+	{
+		const UINT32* row = (const UINT32*)&pSrcData[(y + i) * nSrcStep + x * 4];
+
+		for (j = 0; j < w; j++)
+		{
+			if (row[j] != value)
+				return FALSE;
+		}
+	}
+
+	*pixel = value;
+	return TRUE;
+}
+
+static UINT32 order_encoder_order_color(ORDER_ENCODER_CONTEXT* encoder, const BYTE* pixel)
+{
+	UINT32 format;
+	const UINT32 color = ReadColor(pixel, encoder->SrcFormat);
+
+	if (encoder->ColorDepth == 16)
+		format = PIXEL_FORMAT_RGB16;
+	else
+		format = PIXEL_FORMAT_BGR24;
+
+	return FreeRDPConvertColor(color, encoder->SrcFormat, format, NULL);
+}
+
+/**
+ * Vertical scrolling: rows of the area that moved by the same offset are copied on the client
+ * with a ScrBlt. Only areas completely known to the client qualify.
+ */
+static BOOL order_encoder_scroll(ORDER_ENCODER_CONTEXT* encoder, rdpContext* context,
+                                 const BYTE* pSrcData, UINT32 nSrcStep, const RECTANGLE_16* area)
+{
+	UINT32 x, y, i;
+	INT32 dy = 0;
+	UINT32 top = 0;
+	UINT32 bottom = 0;
+	SCRBLT_ORDER scrblt = { 0 };
+	const UINT32 T = ORDER_ENCODER_TILE_SIZE;
+	const UINT32 height = area->bottom - area->top;
+	const size_t rowSize = (area->right - area->left) * 4ull;
+	UINT64* newHashes = encoder->rowHashes;
+	UINT64* oldHashes = &encoder->rowHashes[encoder->height];
+
+	if (height < 2 * T)
+		return TRUE;
+
+	for (y = area->top / T; y * T < area->bottom; y++)
+	{
+		for (x = area->left / T; x * T < area->right; x++)
+		{
+			if (!encoder->tileValid[y * encoder->gridWidth + x])
+				return TRUE;
+		}
+	}
+
+	for (y = area->top; y < area->bottom; y++)
+	{
+		newHashes[y] = order_encoder_hash(&pSrcData[y * nSrcStep + area->left * 4], rowSize);
+		oldHashes[y] =
+		    order_encoder_hash(&encoder->frame[y * encoder->frameStep + area->left * 4], rowSize);
+	}
+
+	/* Every old position of a few changed rows is a candidate offset, repetitive content
+	 * matches at several offsets, the one moving the longest run of rows wins. */
+	for (i = 1; i < ORDER_ENCODER_SCROLL_SAMPLES; i++)
+	{
+		UINT32 d;
+		UINT32 candidates = 0;
+		const UINT32 sample = area->top + height * i / ORDER_ENCODER_SCROLL_SAMPLES;
+
+		if (newHashes[sample] == oldHashes[sample])
+			continue;
+
+		for (d = 1; (d < height) && (candidates < ORDER_ENCODER_SCROLL_CANDIDATES); d++)
+		{
+			size_t j;
+			const INT32 offsets[] = { (INT32)d, -(INT32)d };
+
+			for (j = 0; j < ARRAYSIZE(offsets); j++)
+			{
+				UINT32 y0, y1;
+				const INT64 from = (INT64)sample - offsets[j];
+
+				if ((from < area->top) || (from >= area->bottom) ||
+				    (oldHashes[from] != newHashes[sample]))
+					continue;
+
+				candidates++;
+				y0 = sample;
+				y1 = sample + 1;
+
+				while ((y0 > area->top) && ((INT64)y0 - 1 - offsets[j] >= area->top) &&
+				       ((INT64)y0 - 1 - offsets[j] < area->bottom) &&
+				       (newHashes[y0 - 1] == oldHashes[y0 - 1 - offsets[j]]))
+					y0--;
+
+				while ((y1 < area->bottom) && ((INT64)y1 - offsets[j] >= area->top) &&
+				       ((INT64)y1 - offsets[j] < area->bottom) &&
+				       (newHashes[y1] == oldHashes[y1 - offsets[j]]))
+					y1++;
+
+				if (y1 - y0 > bottom - top)
+				{
+					top = y0;
+					bottom = y1;
+					dy = offsets[j];
+				}
+			}
+		}
+	}
+
+	if (bottom - top < T)
+		return TRUE;
+
+	for (y = top; y < bottom; y++)
+	{
+		const BYTE* src = &pSrcData[y * nSrcStep + area->left * 4];
+		const BYTE* old = &encoder->frame[(y - dy) * encoder->frameStep + area->left * 4];
+
+		if (memcmp(src, old, rowSize) != 0)
+			return TRUE;
+	}
+
+	scrblt.nLeftRect = area->left;
+	scrblt.nTopRect = (INT32)top;
+	scrblt.nWidth = area->right - area->left;
+	scrblt.nHeight = (INT32)(bottom - top);
+	scrblt.bRop = 0xCC; /* SRCCOPY */
+	scrblt.nXSrc = area->left;
+	scrblt.nYSrc = (INT32)top - dy;
+
+	if (!IFCALLRESULT(FALSE, context->update->primary->ScrBlt, context, &scrblt))
+		return FALSE;
+
+	order_encoder_copy(encoder->frame, encoder->frameStep, area->left, top, pSrcData, nSrcStep,
+	                   area->left, top, area->right - area->left, bottom - top);
+	return TRUE;
+}
+
+static BOOL order_encoder_add_fill(ORDER_ENCODER_CONTEXT* encoder, UINT32 color, UINT32 x,
+                                   UINT32 y, UINT32 w, UINT32 h)
+{
+	ORDER_ENCODER_FILL* fill;
+
+	/* Tiles are visited row by row, extend the run of the previous tile */
+	if (encoder->numFills > 0)
+	{
+		fill = &encoder->fills[encoder->numFills - 1];
+
+		if ((fill->color == color) && (fill->rect.right == x) && (fill->rect.top == y) &&
+		    (fill->rect.bottom == y + h))
+		{
+			fill->rect.right = (UINT16)(x + w);
+			return TRUE;
+		}
+	}
+
+	if (encoder->numFills >= 1ull * encoder->gridWidth * encoder->gridHeight)
+		return FALSE;
+
+	fill = &encoder->fills[encoder->numFills++];
+	fill->color = color;
+	fill->rect.left = (UINT16)x;
+	fill->rect.top = (UINT16)y;
+	fill->rect.right = (UINT16)(x + w);
+	fill->rect.bottom = (UINT16)(y + h);
+	return TRUE;
+}
+
+static int order_encoder_compare_fills(const void* a, const void* b)
+{
+	const ORDER_ENCODER_FILL* fill1 = (const ORDER_ENCODER_FILL*)a;
+	const ORDER_ENCODER_FILL* fill2 = (const ORDER_ENCODER_FILL*)b;
+
+	if (fill1->color != fill2->color)
+		return (fill1->color < fill2->color) ? -1 : 1;
+
+	if (fill1->rect.top != fill2->rect.top)
+		return (fill1->rect.top < fill2->rect.top) ? -1 : 1;
+
+	return (fill1->rect.left < fill2->rect.left) ? -1 : (fill1->rect.left > fill2->rect.left);
+}
+
+static BOOL order_encoder_send_fills(ORDER_ENCODER_CONTEXT* encoder, rdpContext* context)
+{
+	size_t x, i;
+	rdpPrimaryUpdate* primary = context->update->primary;
+
+	qsort(encoder->fills, encoder->numFills, sizeof(ORDER_ENCODER_FILL),
+	      order_encoder_compare_fills);
+
+	for (x = 0; x < encoder->numFills;)
+	{
+		size_t count = 1;
+		const ORDER_ENCODER_FILL* fills = &encoder->fills[x];
+
+		while ((x + count < encoder->numFills) && (fills[count].color == fills[0].color) &&
+		       (count < ORDER_ENCODER_MAX_RECTANGLES))
+			count++;
+
+		if ((count > 1) && encoder->multiOpaqueRect)
+		{
+			MULTI_OPAQUE_RECT_ORDER multi_opaque_rect = { 0 };
+			RECTANGLE_16 bounds = fills[0].rect;
+
+			for (i = 0; i < count; i++)
+			{
+				DELTA_RECT* rectangle = &multi_opaque_rect.rectangles[i];
+				const RECTANGLE_16* rect = &fills[i].rect;
+				bounds.left = MIN(bounds.left, rect->left);
+				bounds.top = MIN(bounds.top, rect->top);
+				bounds.right = MAX(bounds.right, rect->right);
+				bounds.bottom = MAX(bounds.bottom, rect->bottom);
+				rectangle->left = rect->left;
+				rectangle->top = rect->top;
+				rectangle->width = rect->right - rect->left;
+				rectangle->height = rect->bottom - rect->top;
+			}
+
+			multi_opaque_rect.nLeftRect = bounds.left;
+			multi_opaque_rect.nTopRect = bounds.top;
+			multi_opaque_rect.nWidth = bounds.right - bounds.left;
+			multi_opaque_rect.nHeight = bounds.bottom - bounds.top;
+			multi_opaque_rect.color = fills[0].color;
+			multi_opaque_rect.numRectangles = (UINT32)count;
+
+			if (!IFCALLRESULT(FALSE, primary->MultiOpaqueRect, context, &multi_opaque_rect))
+				return FALSE;
+		}
+		else
+		{
+			for (i = 0; i < count; i++)
+			{
+				OPAQUE_RECT_ORDER opaque_rect = { 0 };
+				const RECTANGLE_16* rect = &fills[i].rect;
+				opaque_rect.nLeftRect = rect->left;
+				opaque_rect.nTopRect = rect->top;
+				opaque_rect.nWidth = rect->right - rect->left;
+				opaque_rect.nHeight = rect->bottom - rect->top;
+				opaque_rect.color = fills[i].color;
+
+				if (!IFCALLRESULT(FALSE, primary->OpaqueRect, context, &opaque_rect))
+					return FALSE;
+			}
+		}
+
+		x += count;
+	}
+
+	encoder->numFills = 0;
+	return TRUE;
+}
+
+static BOOL order_encoder_cache_tile(ORDER_ENCODER_CONTEXT* encoder, rdpContext* context,
+                                     UINT32 cacheIndex)
+{
+	UINT32 size = encoder->bitmapDataSize;
+	CACHE_BITMAP_V2_ORDER cache_bitmap_v2 = { 0 };
+	const UINT32 T = ORDER_ENCODER_TILE_SIZE;
+
+	if (encoder->ColorDepth == 32)
+	{
+		if (!freerdp_bitmap_compress_planar(encoder->planar, encoder->tile, encoder->SrcFormat, T,
+		                                    T, T * 4, encoder->bitmapData, &size))
+		{
+			WLog_ERR(TAG, "freerdp_bitmap_compress_planar failed");
+			return FALSE;
+		}
+	}
+	else if (!interleaved_compress(encoder->interleaved, encoder->bitmapData, &size, T, T,
+	                               encoder->tile, encoder->SrcFormat, T * 4, 0, 0, NULL,
+	                               encoder->ColorDepth))
+	{
+		WLog_ERR(TAG, "interleaved_compress failed");
+		return FALSE;
+	}
+
+	cache_bitmap_v2.cacheId = ORDER_ENCODER_CACHE_ID;
+	cache_bitmap_v2.flags = CBR2_HEIGHT_SAME_AS_WIDTH;
+	cache_bitmap_v2.bitmapBpp = encoder->ColorDepth;
+	cache_bitmap_v2.bitmapWidth = T;
+	cache_bitmap_v2.bitmapHeight = T;
+	cache_bitmap_v2.bitmapLength = size;
+	cache_bitmap_v2.cacheIndex = cacheIndex;
+	cache_bitmap_v2.compressed = TRUE;
+	cache_bitmap_v2.cbCompMainBodySize = size;
+	cache_bitmap_v2.cbScanWidth = T * ((encoder->ColorDepth + 7) / 8);
+	cache_bitmap_v2.cbUncompressedSize = cache_bitmap_v2.cbScanWidth * T;
+	cache_bitmap_v2.bitmapDataStream = encoder->bitmapData;
+	return IFCALLRESULT(FALSE, context->update->secondary->CacheBitmapV2, context,
+	                    &cache_bitmap_v2);
+}
+
+static BOOL order_encoder_send_tile(ORDER_ENCODER_CONTEXT* encoder, rdpContext* context,
+                                    const BYTE* pSrcData, UINT32 nSrcStep, UINT32 x, UINT32 y,
+                                    UINT32 w, UINT32 h)
+{
+	UINT64 key;
+	UINT32 cacheIndex;
+	void* value;
+	BYTE* cached;
+	MEMBLT_ORDER memblt = { 0 };
+	const UINT32 T = ORDER_ENCODER_TILE_SIZE;
+
+	/* Edge tiles are padded, the cache cell only holds full sized bitmaps */
+	if ((w < T) || (h < T))
+		ZeroMemory(encoder->tile, T * T * 4ull);
+
+	order_encoder_copy(encoder->tile, T * 4, 0, 0, pSrcData, nSrcStep, x, y, w, h);
+	key = order_encoder_hash(encoder->tile, T * T * 4ull);
+	value = HashTable_GetItemValue(encoder->cache, &key);
+
+	if (value)
+	{
+		cacheIndex = (UINT32)(size_t)value - 1;
+		cached = &encoder->cacheTiles[T * T * 4ull * cacheIndex];
+
+		/* A different tile with the same hash replaces the cached one in place */
+		if (memcmp(cached, encoder->tile, T * T * 4ull) != 0)
+		{
+			if (!order_encoder_cache_tile(encoder, context, cacheIndex))
+				return FALSE;
+
+			CopyMemory(cached, encoder->tile, T * T * 4ull);
+		}
+	}
+	else
+	{
+		cacheIndex = encoder->cacheNext;
+		encoder->cacheNext = (cacheIndex + 1) % encoder->cacheEntries;
+
+		if (encoder->cacheUsed == encoder->cacheEntries)
+			HashTable_Remove(encoder->cache, &encoder->cacheKeys[cacheIndex]);
+		else
+			encoder->cacheUsed++;
+
+		encoder->cacheKeys[cacheIndex] = key;
+
+		if (!order_encoder_cache_tile(encoder, context, cacheIndex))
+			return FALSE;
+
+		CopyMemory(&encoder->cacheTiles[T * T * 4ull * cacheIndex], encoder->tile, T * T * 4ull);
+
+		if (!HashTable_Insert(encoder->cache, &encoder->cacheKeys[cacheIndex],
+		                      (void*)(size_t)(cacheIndex + 1)))
+			return FALSE;
+	}
+
+	memblt.cacheId = ORDER_ENCODER_CACHE_ID;
+	memblt.nLeftRect = (INT32)x;
+	memblt.nTopRect = (INT32)y;
+	memblt.nWidth = (INT32)w;
+	memblt.nHeight = (INT32)h;
+	memblt.bRop = 0xCC; /* SRCCOPY */
+	memblt.cacheIndex = cacheIndex;
+	return IFCALLRESULT(FALSE, context->update->primary->MemBlt, context, &memblt);
+}
+
+static BOOL order_encoder_encode_tile(ORDER_ENCODER_CONTEXT* encoder, rdpContext* context,
+                                      const BYTE* pSrcData, UINT32 nSrcStep, UINT32 tx, UINT32 ty)
+{
+	UINT32 pixel;
+	const UINT32 x = tx * ORDER_ENCODER_TILE_SIZE;
+	const UINT32 y = ty * ORDER_ENCODER_TILE_SIZE;
+	const UINT32 w = MIN(ORDER_ENCODER_TILE_SIZE, encoder->width - x);
+	const UINT32 h = MIN(ORDER_ENCODER_TILE_SIZE, encoder->height - y);
+	BYTE* valid = &encoder->tileValid[ty * encoder->gridWidth + tx];
+
+	if (*valid && !order_encoder_tile_changed(encoder, pSrcData, nSrcStep, x, y, w, h))
+		return TRUE;
+
+	order_encoder_copy(encoder->frame, encoder->frameStep, x, y, pSrcData, nSrcStep, x, y, w, h);
+	*valid = TRUE;
+
+	if (order_encoder_tile_solid(pSrcData, nSrcStep, x, y, w, h, &pixel))
+		return order_encoder_add_fill(encoder, order_encoder_order_color(encoder, (BYTE*)&pixel),
+		                              x, y, w, h);
+
+	return order_encoder_send_tile(encoder, context, pSrcData, nSrcStep, x, y, w, h);
+}
+
+BOOL order_encoder_compose(ORDER_ENCODER_CONTEXT* encoder, rdpContext* context,
+                           const BYTE* pSrcData, UINT32 SrcFormat, UINT32 nSrcStep,
+                           const RECTANGLE_16* rect)
+{
+	BOOL rc = FALSE;
+	UINT32 tx, ty;
+	RECTANGLE_16 area;
+	rdpUpdate* update;
+
+	if (!encoder || !context || !context->update || !pSrcData || !rect || !encoder->frame)
+		return FALSE;
+
+	update = context->update;
+
+	if (GetBytesPerPixel(SrcFormat) != 4)
+	{
+		WLog_ERR(TAG, "unsupported source format %s", FreeRDPGetColorFormatName(SrcFormat));
+		return FALSE;
+	}
+
+	if (SrcFormat != encoder->SrcFormat)
+	{
+		order_encoder_invalidate(encoder);
+		encoder->SrcFormat = SrcFormat;
+	}
+
+	area.left = (UINT16)MIN(rect->left, encoder->width);
+	area.top = (UINT16)MIN(rect->top, encoder->height);
+	area.right = (UINT16)MIN(rect->right, encoder->width);
+	area.bottom = (UINT16)MIN(rect->bottom, encoder->height);
+
+	if ((area.left >= area.right) || (area.top >= area.bottom))
+		return TRUE;
+
+	encoder->numFills = 0;
+
+	if (!update_begin_paint(update))
+		goto fail;
+
+	if (encoder->scrBlt && !order_encoder_scroll(encoder, context, pSrcData, nSrcStep, &area))
+		goto fail;
+
+	for (ty = area.top / ORDER_ENCODER_TILE_SIZE; ty * ORDER_ENCODER_TILE_SIZE < area.bottom;
+	     ty++)
+	{
+		for (tx = area.left / ORDER_ENCODER_TILE_SIZE; tx * ORDER_ENCODER_TILE_SIZE < area.right;
+		     tx++)
+		{
+			if (!order_encoder_encode_tile(encoder, context, pSrcData, nSrcStep, tx, ty))
+				goto fail;
+		}
+	}
+
+	rc = order_encoder_send_fills(encoder, context);
+fail:
+	if (!update_end_paint(update))
+		rc = FALSE;
+
+	/* The client state is unknown after a failure, start over */
+	if (!rc)
+		order_encoder_invalidate(encoder);
+
+	return rc;
+}
+
+BOOL order_encoder_context_reset(ORDER_ENCODER_CONTEXT* encoder, const rdpSettings* settings,
+                                 UINT32 width, UINT32 height)
+{
+	DWORD planarFlags = PLANAR_FORMAT_HEADER_RLE;
+	const UINT32 T = ORDER_ENCODER_TILE_SIZE;
+
+	if (!encoder || !order_encoder_supported(settings) || (width == 0) || (height == 0) ||
+	    (width > UINT16_MAX) || (height > UINT16_MAX))
+		return FALSE;
+
+	if (settings->DrawAllowSkipAlpha)
+		planarFlags |= PLANAR_FORMAT_HEADER_NA;
+
+	encoder->ColorDepth = settings->ColorDepth;
+	encoder->scrBlt = settings->OrderSupport[NEG_SCRBLT_INDEX];
+	encoder->multiOpaqueRect = settings->OrderSupport[NEG_MULTIOPAQUERECT_INDEX];
+	encoder->cacheEntries = MIN(settings->BitmapCacheV2CellInfo[ORDER_ENCODER_CACHE_ID].numEntries,
+	                            ORDER_ENCODER_MAX_CACHE_ENTRIES);
+
+	if ((width != encoder->width) || (height != encoder->height))
+	{
+		BYTE* frame;
+		BYTE* tileValid;
+		UINT64* rowHashes;
+		ORDER_ENCODER_FILL* fills;
+		const UINT32 gridWidth = (width + T - 1) / T;
+		const UINT32 gridHeight = (height + T - 1) / T;
+
+		/* The content is sent again after a reset, nothing to preserve */
+		_aligned_free(encoder->frame);
+		encoder->width = encoder->height = 0;
+		encoder->frame = frame = _aligned_malloc(1ull * height * width * 4, 16);
+		if (!frame)
+			return FALSE;
+
+		tileValid = realloc(encoder->tileValid, 1ull * gridWidth * gridHeight);
+		if (!tileValid)
+			return FALSE;
+		encoder->tileValid = tileValid;
+
+		rowHashes = realloc(encoder->rowHashes, 2ull * height * sizeof(UINT64));
+		if (!rowHashes)
+			return FALSE;
+		encoder->rowHashes = rowHashes;
+
+		fills = realloc(encoder->fills, 1ull * gridWidth * gridHeight * sizeof(ORDER_ENCODER_FILL));
+		if (!fills)
+			return FALSE;
+		encoder->fills = fills;
+
+		encoder->width = width;
+		encoder->height = height;
+		encoder->frameStep = width * 4;
+		encoder->gridWidth = gridWidth;
+		encoder->gridHeight = gridHeight;
+	}
+
+	{
+		UINT64* cacheKeys = realloc(encoder->cacheKeys, encoder->cacheEntries * sizeof(UINT64));
+		if (!cacheKeys)
+			return FALSE;
+		encoder->cacheKeys = cacheKeys;
+	}
+
+	_aligned_free(encoder->cacheTiles);
+	encoder->cacheTiles = _aligned_malloc(T * T * 4ull * encoder->cacheEntries, 16);
+
+	if (!encoder->cacheTiles)
+		return FALSE;
+
+	freerdp_bitmap_planar_context_free(encoder->planar);
+	encoder->planar = freerdp_bitmap_planar_context_new(planarFlags, T, T);
+
+	if (!encoder->planar)
+		return FALSE;
+
+	if (!bitmap_interleaved_context_reset(encoder->interleaved))
+		return FALSE;
+
+	encoder->numFills = 0;
+	order_encoder_invalidate(encoder);
+	return TRUE;
+}
+
+ORDER_ENCODER_CONTEXT* order_encoder_context_new(void)
+{
+	wObject* obj;
+	const UINT32 T = ORDER_ENCODER_TILE_SIZE;
+	ORDER_ENCODER_CONTEXT* encoder =
+	    (ORDER_ENCODER_CONTEXT*)calloc(1, sizeof(ORDER_ENCODER_CONTEXT));
+
+	if (!encoder)
+		return NULL;
+
+	encoder->cache = HashTable_New(FALSE);
+
+	if (!encoder->cache || !HashTable_SetHashFunction(encoder->cache, order_encoder_key_hash))
+		goto fail;
+
+	obj = HashTable_KeyObject(encoder->cache);
+	obj->fnObjectEquals = order_encoder_key_compare;
+	encoder->interleaved = bitmap_interleaved_context_new(TRUE);
+	encoder->tile = _aligned_malloc(T * T * 4ull, 16);
+	/* Worst case of both compressors, raw planes plus headers */
+	encoder->bitmapDataSize = T * T * 4 + 1024;
+	encoder->bitmapData = _aligned_malloc(encoder->bitmapDataSize, 16);
+
+	if (!encoder->interleaved || !encoder->tile || !encoder->bitmapData)
+		goto fail;
+
+	return encoder;
+fail:
+	order_encoder_context_free(encoder);
+	return NULL;
+}
+
+void order_encoder_context_free(ORDER_ENCODER_CONTEXT* encoder)
+{
+	if (!encoder)
+		return;
+
+	HashTable_Free(encoder->cache);
+	free(encoder->cacheKeys);
+	_aligned_free(encoder->cacheTiles);
+	freerdp_bitmap_planar_context_free(encoder->planar);
+	bitmap_interleaved_context_free(encoder->interleaved);
+	_aligned_free(encoder->tile);
+	_aligned_free(encoder->bitmapData);
+	_aligned_free(encoder->frame);
+	free(encoder->tileValid);
+	free(encoder->rowHashes);
+	free(encoder->fills);
+	free(encoder);
+}
@@ -0,0 +1,206 @@
+#include <winpr/crt.h>
+#include <winpr/crypto.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/nsc.h>
+
+#define ROUND_UP_TO(_b, _n) (((_b) + (_n)-1) & ~((_n)-1))
+#define CLAMP(_v) ((_v) < 0 ? 0 : ((_v) > 0xFF ? 0xFF : (_v)))
+
+/* Plain per pixel AYCoCg to BGRA conversion, the reference for the optimized decoders */
+static void nsc_reference_decode(const BYTE* planes[4], UINT32 width, UINT32 height,
+                                 BYTE colorLossLevel, BOOL subsampled, BYTE* dst)
+{
+	UINT32 x, y;
+	const UINT32 rw = ROUND_UP_TO(width, 8);
+	const BYTE shift = colorLossLevel - 1;
+
+	for (y = 0; y < height; y++)
+	{
+		for (x = 0; x < width; x++)
+		{
+			const UINT32 luma = subsampled ? y * rw + x : y * width + x;
+			const UINT32 chroma = subsampled ? (y / 2) * (rw / 2) + x / 2 : y * width + x;
+			const INT32 y_val = planes[0][luma];
+			const INT32 co_val = (INT8)(planes[1][chroma] << shift);
+			const INT32 cg_val = (INT8)(planes[2][chroma] << shift);
+			*dst++ = CLAMP(y_val - co_val - cg_val);
+			*dst++ = CLAMP(y_val + cg_val);
+			*dst++ = CLAMP(y_val + co_val - cg_val);
+			*dst++ = planes[3][y * width + x];
+		}
+	}
+}
+
+static wStream* nsc_create_message(UINT32 width, UINT32 height, BYTE colorLossLevel,
+                                   BOOL subsampled, BOOL opaque, BYTE* planes[4])
+{
+	size_t x;
+	UINT32 lengths[4];
+	wStream* s;
+	const UINT32 rw = ROUND_UP_TO(width, 8);
+	const UINT32 rh = ROUND_UP_TO(height, 2);
+
+	lengths[0] = subsampled ? rw * height : width * height;
+	lengths[1] = subsampled ? (rw / 2) * (rh / 2) : width * height;
+	lengths[2] = lengths[1];
+	lengths[3] = width * height;
+	s = Stream_New(NULL, 20 + lengths[0] + lengths[1] + lengths[2] + lengths[3]);
+
+	if (!s)
+		return NULL;
+
+	/* Raw planes, a plane byte count of 0 fills the plane with 0xFF */
+	for (x = 0; x < 4; x++)
+		Stream_Write_UINT32(s, (opaque && (x == 3)) ? 0 : lengths[x]);
+
+	Stream_Write_UINT8(s, colorLossLevel);
+	Stream_Write_UINT8(s, subsampled ? 1 : 0);
+	Stream_Zero(s, 2);
+
+	for (x = 0; x < 4; x++)
+	{
+		planes[x] = Stream_Pointer(s);
+		winpr_RAND(planes[x], lengths[x]);
+
+		if (opaque && (x == 3))
+		{
+			FillMemory(planes[x], lengths[x], 0xFF);
+			continue;
+		}
+
+		Stream_Seek(s, lengths[x]);
+	}
+
+	Stream_SealLength(s);
+	return s;
+}
+
+static BOOL nsc_test_decode(NSC_CONTEXT* context, UINT32 width, UINT32 height,
+                            BYTE colorLossLevel, BOOL subsampled, BOOL opaque, UINT32 runs)
+{
+	UINT32 x;
+	BOOL rc = FALSE;
+	BYTE* planes[4] = { 0 };
+	UINT64 start, decode, reference;
+	const size_t size = 4ull * width * height;
+	BYTE* expected = malloc(size + 4 * width);
+	BYTE* actual = malloc(size);
+	wStream* s = nsc_create_message(width, height, colorLossLevel, subsampled, opaque, planes);
+
+	if (!expected || !actual || !s)
+		goto fail;
+
+	start = GetTickCount64();
+
+	for (x = 0; x < runs; x++)
+	{
+		if (!nsc_process_message(context, 32, width, height, Stream_Buffer(s),
+		                         (UINT32)Stream_Length(s), actual, PIXEL_FORMAT_BGRA32, 0, 0, 0,
+		                         width, height, FREERDP_FLIP_NONE))
+			goto fail;
+	}
+
+	decode = GetTickCount64() - start;
+	start = GetTickCount64();
+
+	for (x = 0; x < runs; x++)
+		nsc_reference_decode((const BYTE**)planes, width, height, colorLossLevel, subsampled,
+		                     expected);
+
+	reference = GetTickCount64() - start;
+
+	if (memcmp(expected, actual, size) != 0)
+	{
+		fprintf(stderr,
+		        "NSCodec decode mismatch: %" PRIu32 "x%" PRIu32 " colorloss %" PRIu8
+		        " subsampling %d\n",
+		        width, height, colorLossLevel, subsampled);
+		goto fail;
+	}
+
+	if (runs > 1)
+		printf("NSCodec decode %" PRIu32 "x%" PRIu32 " x%" PRIu32 ": %" PRIu64
+		       " ms, reference %" PRIu64 " ms\n",
+		       width, height, runs, decode, reference);
+
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	free(expected);
+	free(actual);
+	return rc;
+}
+
+/* Out of range levels fail the same way whichever decoder is installed */
+static BOOL nsc_test_invalid_colorloss(NSC_CONTEXT* context)
+{
+	size_t x;
+	const BYTE levels[] = { 0, 8, 0xFF };
+
+	for (x = 0; x < ARRAYSIZE(levels); x++)
+	{
+		BOOL decoded;
+		BYTE* planes[4] = { 0 };
+		BYTE output[4 * 16 * 4] = { 0 };
+		wStream* s = nsc_create_message(16, 4, levels[x], FALSE, FALSE, planes);
+
+		if (!s)
+			return FALSE;
+
+		decoded = nsc_process_message(context, 32, 16, 4, Stream_Buffer(s),
+		                              (UINT32)Stream_Length(s), output, PIXEL_FORMAT_BGRA32, 0, 0,
+		                              0, 16, 4, FREERDP_FLIP_NONE);
+		Stream_Free(s, TRUE);
+
+		if (decoded)
+		{
+			fprintf(stderr, "NSCodec decoded colorloss level %" PRIu8 "\n", levels[x]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+int TestFreeRDPCodecNsc(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t x;
+	BYTE colorLossLevel;
+	const UINT32 sizes[][2] = { { 64, 64 }, { 1, 1 }, { 7, 3 }, { 9, 5 }, { 63, 17 }, { 130, 33 } };
+	NSC_CONTEXT* context = nsc_context_new();
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!context)
+		return -1;
+
+	for (x = 0; x < ARRAYSIZE(sizes); x++)
+	{
+		for (colorLossLevel = 1; colorLossLevel <= 7; colorLossLevel++)
+		{
+			if (!nsc_test_decode(context, sizes[x][0], sizes[x][1], colorLossLevel, FALSE,
+			                     FALSE, 1))
+				goto fail;
+
+			if (!nsc_test_decode(context, sizes[x][0], sizes[x][1], colorLossLevel, TRUE,
+			                     x % 2, 1))
+				goto fail;
+		}
+	}
+
+	if (!nsc_test_invalid_colorloss(context))
+		goto fail;
+
+	if (!nsc_test_decode(context, 1920, 1080, 3, TRUE, TRUE, 20))
+		goto fail;
+
+	rc = 0;
+fail:
+	nsc_context_free(context);
+	return rc;
+}
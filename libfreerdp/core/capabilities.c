@@ -717,10 +717,12 @@ static BOOL rdp_print_order_capability_set(wStream* s)
 
 static BOOL rdp_read_bitmap_cache_capability_set(wStream* s, rdpSettings* settings)
 {
-	WINPR_UNUSED(settings);
 	if (Stream_GetRemainingLength(s) < 36)
 		return FALSE;
 
+	/* Revision 1 bitmap caches do not accept cache bitmap v2 orders */
+	settings->BitmapCacheV2NumCells = 0;
+
 	Stream_Seek_UINT32(s); /* pad1 (4 bytes) */
 	Stream_Seek_UINT32(s); /* pad2 (4 bytes) */
 	Stream_Seek_UINT32(s); /* pad3 (4 bytes) */
@@ -1788,6 +1790,7 @@ static BOOL rdp_print_bitmap_cache_host_support_capability_set(wStream* s)
 	WLog_INFO(TAG, "\tpad2: 0x%04" PRIX16 "", pad2);
 	return TRUE;
 }
+#endif
 
 static void rdp_read_bitmap_cache_cell_info(wStream* s, BITMAP_CACHE_V2_CELL_INFO* cellInfo)
 {
@@ -1800,7 +1803,6 @@ static void rdp_read_bitmap_cache_cell_info(wStream* s, BITMAP_CACHE_V2_CELL_INF
 	cellInfo->numEntries = (info & 0x7FFFFFFF);
 	cellInfo->persistent = (info & 0x80000000) ? 1 : 0;
 }
-#endif
 
 static void rdp_write_bitmap_cache_cell_info(wStream* s, BITMAP_CACHE_V2_CELL_INFO* cellInfo)
 {
@@ -1823,19 +1825,23 @@ static void rdp_write_bitmap_cache_cell_info(wStream* s, BITMAP_CACHE_V2_CELL_IN
 
 static BOOL rdp_read_bitmap_cache_v2_capability_set(wStream* s, rdpSettings* settings)
 {
-	WINPR_UNUSED(settings);
+	UINT32 x;
+	BYTE numCellCaches;
+
 	if (Stream_GetRemainingLength(s) < 36)
 		return FALSE;
 
-	Stream_Seek_UINT16(s); /* cacheFlags (2 bytes) */
-	Stream_Seek_UINT8(s);  /* pad2 (1 byte) */
-	Stream_Seek_UINT8(s);  /* numCellCaches (1 byte) */
-	Stream_Seek(s, 4);     /* bitmapCache0CellInfo (4 bytes) */
-	Stream_Seek(s, 4);     /* bitmapCache1CellInfo (4 bytes) */
-	Stream_Seek(s, 4);     /* bitmapCache2CellInfo (4 bytes) */
-	Stream_Seek(s, 4);     /* bitmapCache3CellInfo (4 bytes) */
-	Stream_Seek(s, 4);     /* bitmapCache4CellInfo (4 bytes) */
-	Stream_Seek(s, 12);    /* pad3 (12 bytes) */
+	Stream_Seek_UINT16(s);               /* cacheFlags (2 bytes) */
+	Stream_Seek_UINT8(s);                /* pad2 (1 byte) */
+	Stream_Read_UINT8(s, numCellCaches); /* numCellCaches (1 byte) */
+
+	/* Remember the client cells, servers sending cache bitmap v2 orders must respect them */
+	for (x = 0; x < 5; x++)
+		rdp_read_bitmap_cache_cell_info(
+		    s, &settings->BitmapCacheV2CellInfo[x]); /* bitmapCacheXCellInfo (4 bytes) */
+
+	settings->BitmapCacheV2NumCells = MIN(numCellCaches, 5);
+	Stream_Seek(s, 12); /* pad3 (12 bytes) */
 	return TRUE;
 }
 
@@ -0,0 +1,331 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * SSPI Credentials Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/tchar.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+#include <freerdp/settings.h>
+
+#include "credentials_cache.h"
+
+#define TAG FREERDP_TAG("core.credentials")
+
+/* A gateway logon authenticates the RPC in and out channels or the RDG channels and then NLA,
+ * reconnects repeat all of it. Handles are shared per identity while in use and kept for a
+ * while afterwards. The identity copy used for lookups lives exactly as long as the handle,
+ * which holds the same secrets, and is wiped with it. */
+#define CREDENTIALS_CACHE_TTL (5 * 60 * 1000)
+#define CREDENTIALS_CACHE_SIZE 8
+
+typedef struct
+{
+	BOOL valid;
+	BYTE* key;
+	size_t keySize;
+	SecurityFunctionTable* table;
+	CredHandle credentials;
+	TimeStamp expiration;
+	UINT32 refs;
+	UINT64 expires;
+} credentials_cache_entry;
+
+typedef struct
+{
+	CRITICAL_SECTION lock;
+	credentials_cache_entry entries[CREDENTIALS_CACHE_SIZE];
+} credentials_cache;
+
+static INIT_ONCE credentials_cache_once = INIT_ONCE_STATIC_INIT;
+static credentials_cache cache;
+
+static BOOL CALLBACK credentials_cache_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+	return InitializeCriticalSectionAndSpinCount(&cache.lock, 4000);
+}
+
+static size_t credentials_identity_size(const SEC_WINNT_AUTH_IDENTITY* identity, UINT32 length)
+{
+	if (identity->Flags & SEC_WINNT_AUTH_IDENTITY_UNICODE)
+		return length * sizeof(WCHAR);
+
+	return length;
+}
+
+static BYTE* credentials_cache_append(BYTE* dst, const void* src, size_t size)
+{
+	if (src && (size > 0))
+		CopyMemory(dst, src, size);
+
+	return dst + size;
+}
+
+/* Package and identity back to back, compared as a whole */
+static BYTE* credentials_cache_key(LPTSTR package, const SEC_WINNT_AUTH_IDENTITY* identity,
+                                   size_t* size)
+{
+	BYTE* key;
+	BYTE* p;
+	size_t userSize = 0, domainSize = 0, passwordSize = 0;
+	const size_t packageSize = (_tcslen(package) + 1) * sizeof(TCHAR);
+
+	if (identity)
+	{
+		/* A password hash for restricted admin mode is flagged by an oversized length */
+		UINT32 passwordLength = identity->PasswordLength;
+
+		if (passwordLength > LB_PASSWORD_MAX_LENGTH)
+			passwordLength -= LB_PASSWORD_MAX_LENGTH;
+
+		userSize = identity->User ? credentials_identity_size(identity, identity->UserLength) : 0;
+		domainSize =
+		    identity->Domain ? credentials_identity_size(identity, identity->DomainLength) : 0;
+		passwordSize =
+		    identity->Password ? credentials_identity_size(identity, passwordLength) : 0;
+	}
+
+	*size = packageSize + 4 * sizeof(UINT32) + userSize + domainSize + passwordSize;
+
+	if (!(p = key = (BYTE*)calloc(*size, sizeof(BYTE))))
+		return NULL;
+
+	p = credentials_cache_append(p, package, packageSize);
+
+	if (identity)
+	{
+		p = credentials_cache_append(p, &identity->Flags, sizeof(UINT32));
+		p = credentials_cache_append(p, &identity->UserLength, sizeof(UINT32));
+		p = credentials_cache_append(p, &identity->DomainLength, sizeof(UINT32));
+		p = credentials_cache_append(p, &identity->PasswordLength, sizeof(UINT32));
+		p = credentials_cache_append(p, identity->User, userSize);
+		p = credentials_cache_append(p, identity->Domain, domainSize);
+		credentials_cache_append(p, identity->Password, passwordSize);
+	}
+
+	return key;
+}
+
+static void credentials_cache_key_free(BYTE* key, size_t size)
+{
+	if (key)
+		memset(key, 0, size);
+
+	free(key);
+}
+
+static void credentials_cache_entry_free(credentials_cache_entry* entry)
+{
+	const SECURITY_STATUS status = entry->table->FreeCredentialsHandle(&entry->credentials);
+
+	if (status != SEC_E_OK)
+	{
+		WLog_WARN(TAG, "FreeCredentialsHandle status %s [0x%08" PRIX32 "]",
+		          GetSecurityStatusString(status), status);
+	}
+
+	/* The package wipes the identity it holds, the key goes as well */
+	credentials_cache_key_free(entry->key, entry->keySize);
+	memset(entry, 0, sizeof(credentials_cache_entry));
+}
+
+static void credentials_cache_expire(UINT64 now)
+{
+	size_t x;
+
+	for (x = 0; x < ARRAYSIZE(cache.entries); x++)
+	{
+		credentials_cache_entry* entry = &cache.entries[x];
+
+		if (entry->valid && (entry->refs == 0) && (entry->expires <= now))
+			credentials_cache_entry_free(entry);
+	}
+}
+
+static credentials_cache_entry* credentials_cache_find(SecurityFunctionTable* table,
+                                                       const BYTE* key, size_t size)
+{
+	size_t x;
+
+	for (x = 0; x < ARRAYSIZE(cache.entries); x++)
+	{
+		credentials_cache_entry* entry = &cache.entries[x];
+
+		if (entry->valid && (entry->table == table) && (entry->keySize == size) &&
+		    (memcmp(entry->key, key, size) == 0))
+			return entry;
+	}
+
+	return NULL;
+}
+
+static credentials_cache_entry* credentials_cache_find_handle(SecurityFunctionTable* table,
+                                                              const CredHandle* credentials)
+{
+	size_t x;
+
+	for (x = 0; x < ARRAYSIZE(cache.entries); x++)
+	{
+		credentials_cache_entry* entry = &cache.entries[x];
+
+		if (entry->valid && (entry->table == table) &&
+		    (entry->credentials.dwLower == credentials->dwLower) &&
+		    (entry->credentials.dwUpper == credentials->dwUpper))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/* An unused slot, or the idle entry expiring first. NULL if all are in use. */
+static credentials_cache_entry* credentials_cache_slot(void)
+{
+	size_t x;
+	credentials_cache_entry* slot = NULL;
+
+	for (x = 0; x < ARRAYSIZE(cache.entries); x++)
+	{
+		credentials_cache_entry* entry = &cache.entries[x];
+
+		if (!entry->valid)
+			return entry;
+
+		if ((entry->refs == 0) && (!slot || (entry->expires < slot->expires)))
+			slot = entry;
+	}
+
+	if (slot)
+		credentials_cache_entry_free(slot);
+
+	return slot;
+}
+
+SECURITY_STATUS credentials_cache_acquire(SecurityFunctionTable* table, LPTSTR package,
+                                          SEC_WINNT_AUTH_IDENTITY* identity,
+                                          PCredHandle credentials, PTimeStamp expiration)
+{
+	SECURITY_STATUS status;
+	credentials_cache_entry* entry;
+	size_t size = 0;
+	BYTE* key = NULL;
+
+	if (!table || !package || !credentials)
+		return SEC_E_INVALID_PARAMETER;
+
+	if (!InitOnceExecuteOnce(&credentials_cache_once, credentials_cache_init, NULL, NULL) ||
+	    !(key = credentials_cache_key(package, identity, &size)))
+	{
+		return table->AcquireCredentialsHandle(NULL, package, SECPKG_CRED_OUTBOUND, NULL, identity,
+		                                       NULL, NULL, credentials, expiration);
+	}
+
+	EnterCriticalSection(&cache.lock);
+	credentials_cache_expire(GetTickCount64());
+
+	if ((entry = credentials_cache_find(table, key, size)))
+	{
+		entry->refs++;
+		WLog_DBG(TAG, "reusing credentials handle, %" PRIu32 " references", entry->refs);
+		*credentials = entry->credentials;
+
+		if (expiration)
+			*expiration = entry->expiration;
+
+		status = SEC_E_OK;
+		goto out;
+	}
+
+	status = table->AcquireCredentialsHandle(NULL, package, SECPKG_CRED_OUTBOUND, NULL, identity,
+	                                         NULL, NULL, credentials, expiration);
+
+	/* Without a free slot the handle is not shared and released the usual way */
+	if ((status != SEC_E_OK) || !(entry = credentials_cache_slot()))
+		goto out;
+
+	entry->valid = TRUE;
+	entry->key = key;
+	entry->keySize = size;
+	entry->table = table;
+	entry->credentials = *credentials;
+	entry->refs = 1;
+	key = NULL;
+
+	if (expiration)
+		entry->expiration = *expiration;
+
+out:
+	LeaveCriticalSection(&cache.lock);
+	credentials_cache_key_free(key, size);
+	return status;
+}
+
+SECURITY_STATUS credentials_cache_release(SecurityFunctionTable* table, PCredHandle credentials)
+{
+	credentials_cache_entry* entry;
+
+	if (!table || !credentials)
+		return SEC_E_INVALID_HANDLE;
+
+	if (!InitOnceExecuteOnce(&credentials_cache_once, credentials_cache_init, NULL, NULL))
+		return table->FreeCredentialsHandle(credentials);
+
+	EnterCriticalSection(&cache.lock);
+	entry = credentials_cache_find_handle(table, credentials);
+
+	if (entry && (entry->refs > 0))
+	{
+		entry->refs--;
+
+		if (entry->refs == 0)
+			entry->expires = GetTickCount64() + CREDENTIALS_CACHE_TTL;
+
+		LeaveCriticalSection(&cache.lock);
+		SecInvalidateHandle(credentials);
+		return SEC_E_OK;
+	}
+
+	LeaveCriticalSection(&cache.lock);
+	return table->FreeCredentialsHandle(credentials);
+}
+
+void credentials_cache_flush(void)
+{
+	size_t x;
+
+	if (!InitOnceExecuteOnce(&credentials_cache_once, credentials_cache_init, NULL, NULL))
+		return;
+
+	EnterCriticalSection(&cache.lock);
+
+	for (x = 0; x < ARRAYSIZE(cache.entries); x++)
+	{
+		credentials_cache_entry* entry = &cache.entries[x];
+
+		if (entry->valid && (entry->refs == 0))
+			credentials_cache_entry_free(entry);
+	}
+
+	LeaveCriticalSection(&cache.lock);
+}
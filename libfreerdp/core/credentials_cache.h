@@ -0,0 +1,39 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * SSPI Credentials Cache
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CORE_CREDENTIALS_CACHE_H
+#define FREERDP_LIB_CORE_CREDENTIALS_CACHE_H
+
+#include <winpr/wtypes.h>
+#include <winpr/sspi.h>
+
+#include <freerdp/api.h>
+
+/* Outbound credentials handle shared by every connection using the same identity, released
+ * with credentials_cache_release */
+FREERDP_LOCAL SECURITY_STATUS credentials_cache_acquire(SecurityFunctionTable* table,
+                                                        LPTSTR package,
+                                                        SEC_WINNT_AUTH_IDENTITY* identity,
+                                                        PCredHandle credentials,
+                                                        PTimeStamp expiration);
+FREERDP_LOCAL SECURITY_STATUS credentials_cache_release(SecurityFunctionTable* table,
+                                                        PCredHandle credentials);
+
+/* Frees all handles not in use right now */
+FREERDP_LOCAL void credentials_cache_flush(void);
+
+#endif /* FREERDP_LIB_CORE_CREDENTIALS_CACHE_H */
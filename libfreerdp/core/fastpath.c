@@ -556,23 +556,21 @@ static int fastpath_recv_update_data(rdpFastPath* fastpath, wStream* s)
 		return -1;
 	}
 
-	if (!Stream_EnsureRemainingCapacity(fastpath->updateData, DstSize))
-		return -1;
-
-	Stream_Write(fastpath->updateData, pDstData, DstSize);
-
 	if (fragmentation == FASTPATH_FRAGMENT_SINGLE)
 	{
+		wStream sbuffer = { 0 };
+		wStream* update = &sbuffer;
+
 		if (fastpath->fragmentation != -1)
 		{
 			WLog_ERR(TAG, "Unexpected FASTPATH_FRAGMENT_SINGLE");
 			goto out_fail;
 		}
 
-		Stream_SealLength(fastpath->updateData);
-		Stream_SetPosition(fastpath->updateData, 0);
-		status = fastpath_recv_update(fastpath, updateCode, fastpath->updateData);
-		Stream_SetPosition(fastpath->updateData, 0);
+		/* Parse in place, pDstData points either into the transport stream or into the
+		 * bulk decompressor history, both stay valid until the next update is read. */
+		Stream_StaticInit(update, pDstData, DstSize);
+		status = fastpath_recv_update(fastpath, updateCode, update);
 
 		if (status < 0)
 		{
@@ -582,9 +580,10 @@ static int fastpath_recv_update_data(rdpFastPath* fastpath, wStream* s)
 	}
 	else
 	{
-		const size_t totalSize = Stream_GetPosition(fastpath->updateData);
+		const size_t totalSize = Stream_GetPosition(fastpath->updateData) + DstSize;
+		const size_t maxSize = transport->settings->MultifragMaxRequestSize;
 
-		if (totalSize > transport->settings->MultifragMaxRequestSize)
+		if (totalSize > maxSize)
 		{
 			WLog_ERR(TAG, "Total size (%" PRIuz ") exceeds MultifragMaxRequestSize (%" PRIu32 ")",
 			         totalSize, transport->settings->MultifragMaxRequestSize);
@@ -599,6 +598,12 @@ static int fastpath_recv_update_data(rdpFastPath* fastpath, wStream* s)
 				goto out_fail;
 			}
 
+			/* The total size is not known up front, reserve the reassembly buffer once for
+			 * the largest update allowed instead of growing it with every fragment. */
+			if (!Stream_EnsureCapacity(fastpath->updateData,
+			                           MIN(maxSize, FASTPATH_REASSEMBLY_RESERVE_SIZE)))
+				goto out_fail;
+
 			fastpath->fragmentation = FASTPATH_FRAGMENT_FIRST;
 		}
 		else if (fragmentation == FASTPATH_FRAGMENT_NEXT)
@@ -622,6 +627,15 @@ static int fastpath_recv_update_data(rdpFastPath* fastpath, wStream* s)
 			}
 
 			fastpath->fragmentation = -1;
+		}
+
+		if (!Stream_EnsureRemainingCapacity(fastpath->updateData, DstSize))
+			goto out_fail;
+
+		Stream_Write(fastpath->updateData, pDstData, DstSize);
+
+		if (fragmentation == FASTPATH_FRAGMENT_LAST)
+		{
 			Stream_SealLength(fastpath->updateData);
 			Stream_SetPosition(fastpath->updateData, 0);
 			status = fastpath_recv_update(fastpath, updateCode, fastpath->updateData);
@@ -36,6 +36,12 @@
  */
 #define FASTPATH_FRAGMENT_SAFE_SIZE 0x3F80
 
+/*
+ * Capacity reserved for reassembling a fragmented update when its first fragment
+ * arrives, bounded by MultifragMaxRequestSize. Larger updates still grow the buffer.
+ */
+#define FASTPATH_REASSEMBLY_RESERVE_SIZE 0x100000
+
 typedef struct rdp_fastpath rdpFastPath;
 
 #include "rdp.h"
@@ -33,6 +33,7 @@
 #include "connection.h"
 #include "message.h"
 #include "buildflags.h"
+#include "credentials_cache.h"
 #include "gateway/rpc_fault.h"
 
 #include <winpr/assert.h>
@@ -665,6 +666,8 @@ void freerdp_context_free(freerdp* instance)
 	freerdp_channels_free(instance->context->channels);
 	free(instance->context);
 	instance->context = NULL;
+	/* The session is gone, credentials kept for its reconnects are not needed anymore */
+	credentials_cache_flush();
 }
 
 int freerdp_get_disconnect_ultimatum(rdpContext* context)
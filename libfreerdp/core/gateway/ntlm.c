@@ -32,6 +32,7 @@
 #include "http.h"
 
 #include "ntlm.h"
+#include "../credentials_cache.h"
 
 #define TAG FREERDP_TAG("core.gateway.ntlm")
 
@@ -97,9 +98,8 @@ BOOL ntlm_client_init(rdpNtlm* ntlm, BOOL http, LPCSTR user, LPCSTR domain, LPCS
 	}
 
 	ntlm->cbMaxToken = ntlm->pPackageInfo->cbMaxToken;
-	status = ntlm->table->AcquireCredentialsHandle(NULL, NTLM_SSP_NAME, SECPKG_CRED_OUTBOUND, NULL,
-	                                               &ntlm->identity, NULL, NULL, &ntlm->credentials,
-	                                               &ntlm->expiration);
+	status = credentials_cache_acquire(ntlm->table, NTLM_SSP_NAME, &ntlm->identity,
+	                                   &ntlm->credentials, &ntlm->expiration);
 
 	if (status != SEC_E_OK)
 	{
@@ -312,6 +312,9 @@ BOOL ntlm_authenticate(rdpNtlm* ntlm, BOOL* pbContinueNeeded)
 
 static void ntlm_client_uninit(rdpNtlm* ntlm)
 {
+	if (ntlm->identity.Password)
+		memset(ntlm->identity.Password, 0, ntlm->identity.PasswordLength * sizeof(WCHAR));
+
 	free(ntlm->identity.User);
 	ntlm->identity.User = NULL;
 	free(ntlm->identity.Domain);
@@ -324,7 +327,7 @@ static void ntlm_client_uninit(rdpNtlm* ntlm)
 	if (ntlm->table)
 	{
 		SECURITY_STATUS status;
-		status = ntlm->table->FreeCredentialsHandle(&ntlm->credentials);
+		status = credentials_cache_release(ntlm->table, &ntlm->credentials);
 
 		if (status != SEC_E_OK)
 		{
@@ -44,6 +44,7 @@
 #include <winpr/registry.h>
 
 #include "nla.h"
+#include "credentials_cache.h"
 
 #define TAG FREERDP_TAG("core.nla")
 
@@ -703,9 +704,8 @@ static int nla_client_init(rdpNla* nla)
 
 	WLog_DBG(TAG, "%s %" PRIu32 " : packageName=%ls ; cbMaxToken=%d", __FUNCTION__, __LINE__,
 	         nla->packageName, nla->cbMaxToken);
-	nla->status = nla->table->AcquireCredentialsHandle(NULL, NLA_PKG_NAME, SECPKG_CRED_OUTBOUND,
-	                                                   NULL, nla->identity, NULL, NULL,
-	                                                   &nla->credentials, &nla->expiration);
+	nla->status = credentials_cache_acquire(nla->table, NLA_PKG_NAME, nla->identity,
+	                                        &nla->credentials, &nla->expiration);
 
 	if (nla->status != SEC_E_OK)
 	{
@@ -928,7 +928,7 @@ static int nla_client_recv_pub_key_auth(rdpNla* nla)
 
 	if (SecIsValidHandle(&nla->credentials))
 	{
-		nla->table->FreeCredentialsHandle(&nla->credentials);
+		credentials_cache_release(nla->table, &nla->credentials);
 		SecInvalidateHandle(&nla->credentials);
 	}
 
@@ -2395,7 +2395,7 @@ void nla_free(rdpNla* nla)
 
 		if (SecIsValidHandle(&nla->credentials))
 		{
-			status = nla->table->FreeCredentialsHandle(&nla->credentials);
+			status = credentials_cache_release(nla->table, &nla->credentials);
 
 			if (status != SEC_E_OK)
 			{
@@ -1020,6 +1020,74 @@ static INLINE BOOL update_read_delta_rects(wStream* s, DELTA_RECT* rectangles, U
 
 	return TRUE;
 }
+static INLINE BOOL update_write_delta(wStream* s, INT32 value)
+{
+	if ((value < -0x4000) || (value > 0x3FFF))
+		return FALSE;
+
+	if ((value >= -0x40) && (value <= 0x3F))
+		Stream_Write_UINT8(s, value & 0x7F);
+	else
+	{
+		Stream_Write_UINT8(s, 0x80 | ((value >> 8) & 0x7F));
+		Stream_Write_UINT8(s, value & 0xFF);
+	}
+
+	return TRUE;
+}
+static INLINE BOOL update_write_delta_rects(wStream* s, const DELTA_RECT* rectangles,
+                                            UINT32 number)
+{
+	UINT32 i;
+	size_t zeroBitsPos;
+	const size_t zeroBitsSize = ((number + 1) / 2);
+
+	if (number > 45)
+		return FALSE;
+
+	if (!Stream_EnsureRemainingCapacity(s, zeroBitsSize + number * 8ull))
+		return FALSE;
+
+	zeroBitsPos = Stream_GetPosition(s);
+	Stream_Zero(s, zeroBitsSize);
+
+	for (i = 0; i < number; i++)
+	{
+		BYTE flags = 0;
+		INT32 left = rectangles[i].left;
+		INT32 top = rectangles[i].top;
+
+		if (i > 0)
+		{
+			left -= rectangles[i - 1].left;
+			top -= rectangles[i - 1].top;
+		}
+
+		if (left == 0)
+			flags |= 0x80;
+		else if (!update_write_delta(s, left))
+			return FALSE;
+
+		if (top == 0)
+			flags |= 0x40;
+		else if (!update_write_delta(s, top))
+			return FALSE;
+
+		if ((i > 0) && (rectangles[i].width == rectangles[i - 1].width))
+			flags |= 0x20;
+		else if (!update_write_delta(s, rectangles[i].width))
+			return FALSE;
+
+		if ((i > 0) && (rectangles[i].height == rectangles[i - 1].height))
+			flags |= 0x10;
+		else if (!update_write_delta(s, rectangles[i].height))
+			return FALSE;
+
+		Stream_Buffer(s)[zeroBitsPos + i / 2] |= (i % 2 == 0) ? flags : (flags >> 4);
+	}
+
+	return TRUE;
+}
 static INLINE BOOL update_read_delta_points(wStream* s, DELTA_POINT* points, int number, INT16 x,
                                             INT16 y)
 {
@@ -1359,6 +1427,48 @@ BOOL update_write_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo,
 	Stream_Write_UINT8(s, byte);
 	return TRUE;
 }
+int update_approximate_multi_opaque_rect_order(ORDER_INFO* orderInfo,
+                                               const MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
+{
+	WINPR_UNUSED(orderInfo);
+	return 32 + 23 + multi_opaque_rect->numRectangles * 8;
+}
+BOOL update_write_multi_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo,
+                                          const MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
+{
+	size_t cbDataPos, end;
+	int inf = update_approximate_multi_opaque_rect_order(orderInfo, multi_opaque_rect);
+
+	if (!Stream_EnsureRemainingCapacity(s, inf))
+		return FALSE;
+
+	orderInfo->fieldFlags = 0;
+	orderInfo->fieldFlags |= ORDER_FIELD_01;
+	update_write_coord(s, multi_opaque_rect->nLeftRect);
+	orderInfo->fieldFlags |= ORDER_FIELD_02;
+	update_write_coord(s, multi_opaque_rect->nTopRect);
+	orderInfo->fieldFlags |= ORDER_FIELD_03;
+	update_write_coord(s, multi_opaque_rect->nWidth);
+	orderInfo->fieldFlags |= ORDER_FIELD_04;
+	update_write_coord(s, multi_opaque_rect->nHeight);
+	orderInfo->fieldFlags |= ORDER_FIELD_05 | ORDER_FIELD_06 | ORDER_FIELD_07;
+	update_write_color(s, multi_opaque_rect->color);
+	orderInfo->fieldFlags |= ORDER_FIELD_08;
+	Stream_Write_UINT8(s, multi_opaque_rect->numRectangles);
+	orderInfo->fieldFlags |= ORDER_FIELD_09;
+	cbDataPos = Stream_GetPosition(s);
+	Stream_Seek_UINT16(s);
+
+	if (!update_write_delta_rects(s, multi_opaque_rect->rectangles,
+	                              multi_opaque_rect->numRectangles))
+		return FALSE;
+
+	end = Stream_GetPosition(s);
+	Stream_SetPosition(s, cbDataPos);
+	Stream_Write_UINT16(s, (UINT16)(end - cbDataPos - 2)); /* cbData (2 bytes) */
+	Stream_SetPosition(s, end);
+	return TRUE;
+}
 static BOOL update_read_draw_nine_grid_order(wStream* s, const ORDER_INFO* orderInfo,
                                              DRAW_NINE_GRID_ORDER* draw_nine_grid)
 {
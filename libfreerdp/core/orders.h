@@ -217,6 +217,13 @@ FREERDP_LOCAL int update_approximate_opaque_rect_order(ORDER_INFO* orderInfo,
 FREERDP_LOCAL BOOL update_write_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo,
                                                   const OPAQUE_RECT_ORDER* opaque_rect);
 
+FREERDP_LOCAL int
+update_approximate_multi_opaque_rect_order(ORDER_INFO* orderInfo,
+                                           const MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect);
+FREERDP_LOCAL BOOL
+update_write_multi_opaque_rect_order(wStream* s, ORDER_INFO* orderInfo,
+                                     const MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect);
+
 FREERDP_LOCAL int update_approximate_line_to_order(ORDER_INFO* orderInfo,
                                                    const LINE_TO_ORDER* line_to);
 FREERDP_LOCAL BOOL update_write_line_to_order(wStream* s, ORDER_INFO* orderInfo,
@@ -62,31 +62,77 @@ typedef struct _wtsChannelMessage wtsChannelMessage;
 static DWORD g_SessionId = 1;
 static wHashTable* g_ServerHandles = NULL;
 
+static void channel_free(rdpPeerChannel* channel);
+
+static UINT32 wts_dvc_channel_id_hash(const void* key)
+{
+	const UINT32* ChannelId = (const UINT32*)key;
+	WINPR_ASSERT(ChannelId);
+	return *ChannelId;
+}
+
+static BOOL wts_dvc_channel_id_equals(const void* key1, const void* key2)
+{
+	const UINT32* ChannelId1 = (const UINT32*)key1;
+	const UINT32* ChannelId2 = (const UINT32*)key2;
+
+	if (!ChannelId1 || !ChannelId2)
+		return (ChannelId1 == ChannelId2);
+
+	return *ChannelId1 == *ChannelId2;
+}
+
+/**
+ * Looks up a dynamic channel and takes a reference on it, so that a concurrent
+ * WTSVirtualChannelClose does not free it while data is still being processed.
+ * The reference must be dropped with channel_release.
+ */
 static rdpPeerChannel* wts_get_dvc_channel_by_id(WTSVirtualChannelManager* vcm, UINT32 ChannelId)
 {
-	int index;
-	int count;
-	BOOL found = FALSE;
-	rdpPeerChannel* channel = NULL;
+	rdpPeerChannel* channel;
 
 	WINPR_ASSERT(vcm);
 
-	ArrayList_Lock(vcm->dynamicVirtualChannels);
-	count = ArrayList_Count(vcm->dynamicVirtualChannels);
+	EnterCriticalSection(&vcm->dvcLock);
+	channel = (rdpPeerChannel*)HashTable_GetItemValue(vcm->dynamicVirtualChannels, &ChannelId);
 
-	for (index = 0; index < count; index++)
-	{
-		channel = (rdpPeerChannel*)ArrayList_GetItem(vcm->dynamicVirtualChannels, index);
-		WINPR_ASSERT(channel);
-		if (channel->channelId == ChannelId)
-		{
-			found = TRUE;
-			break;
-		}
-	}
+	if (channel)
+		InterlockedIncrement(&channel->refCount);
 
-	ArrayList_Unlock(vcm->dynamicVirtualChannels);
-	return found ? channel : NULL;
+	LeaveCriticalSection(&vcm->dvcLock);
+	return channel;
+}
+
+static BOOL wts_insert_dvc_channel(WTSVirtualChannelManager* vcm, rdpPeerChannel* channel)
+{
+	BOOL rc;
+
+	WINPR_ASSERT(vcm);
+	WINPR_ASSERT(channel);
+
+	EnterCriticalSection(&vcm->dvcLock);
+	rc = HashTable_Insert(vcm->dynamicVirtualChannels, &channel->channelId, channel);
+	LeaveCriticalSection(&vcm->dvcLock);
+	return rc;
+}
+
+static void wts_remove_dvc_channel(WTSVirtualChannelManager* vcm, rdpPeerChannel* channel)
+{
+	WINPR_ASSERT(vcm);
+	WINPR_ASSERT(channel);
+
+	EnterCriticalSection(&vcm->dvcLock);
+	HashTable_Remove(vcm->dynamicVirtualChannels, &channel->channelId);
+	LeaveCriticalSection(&vcm->dvcLock);
+}
+
+static void channel_release(rdpPeerChannel* channel)
+{
+	if (!channel)
+		return;
+
+	if (InterlockedDecrement(&channel->refCount) == 0)
+		channel_free(channel);
 }
 
 static BOOL wts_queue_receive_data(rdpPeerChannel* channel, const BYTE* Buffer, UINT32 Length)
@@ -302,16 +348,21 @@ static BOOL wts_read_drdynvc_pdu(rdpPeerChannel* channel)
 
 		if (dvc)
 		{
+			BOOL rc = TRUE;
+
 			switch (Cmd)
 			{
 				case CREATE_REQUEST_PDU:
-					return wts_read_drdynvc_create_response(dvc, channel->receiveData, length);
+					rc = wts_read_drdynvc_create_response(dvc, channel->receiveData, length);
+					break;
 
 				case DATA_FIRST_PDU:
-					return wts_read_drdynvc_data_first(dvc, channel->receiveData, Sp, length);
+					rc = wts_read_drdynvc_data_first(dvc, channel->receiveData, Sp, length);
+					break;
 
 				case DATA_PDU:
-					return wts_read_drdynvc_data(dvc, channel->receiveData, length);
+					rc = wts_read_drdynvc_data(dvc, channel->receiveData, length);
+					break;
 
 				case CLOSE_REQUEST_PDU:
 					wts_read_drdynvc_close_response(dvc);
@@ -321,6 +372,9 @@ static BOOL wts_read_drdynvc_pdu(rdpPeerChannel* channel)
 					WLog_ERR(TAG, "Cmd %d not recognized.", Cmd);
 					break;
 			}
+
+			channel_release(dvc);
+			return rc;
 		}
 		else
 		{
@@ -896,14 +950,24 @@ HANDLE WINAPI FreeRDP_WTSOpenServerA(LPSTR pServerName)
 		goto error_queue;
 
 	vcm->dvc_channel_id_seq = 0;
-	vcm->dynamicVirtualChannels = ArrayList_New(TRUE);
+	vcm->dynamicVirtualChannels = HashTable_New(FALSE);
 
 	if (!vcm->dynamicVirtualChannels)
 		goto error_dynamicVirtualChannels;
 
+	if (!HashTable_SetHashFunction(vcm->dynamicVirtualChannels, wts_dvc_channel_id_hash))
+		goto error_hash;
+
+	HashTable_KeyObject(vcm->dynamicVirtualChannels)->fnObjectEquals = wts_dvc_channel_id_equals;
+
+	if (!InitializeCriticalSectionAndSpinCount(&vcm->dvcLock, 4000))
+		goto error_hash;
+
 	client->ReceiveChannelData = WTSReceiveChannelData;
 	hServer = (HANDLE)vcm;
 	return hServer;
+error_hash:
+	HashTable_Free(vcm->dynamicVirtualChannels);
 error_dynamicVirtualChannels:
 	MessageQueue_Free(vcm->queue);
 error_queue:
@@ -927,8 +991,9 @@ HANDLE WINAPI FreeRDP_WTSOpenServerExA(LPSTR pServerName)
 
 VOID WINAPI FreeRDP_WTSCloseServer(HANDLE hServer)
 {
-	int index;
-	int count;
+	size_t index;
+	size_t count;
+	ULONG_PTR* keys = NULL;
 	rdpPeerChannel* channel;
 	WTSVirtualChannelManager* vcm;
 	vcm = (WTSVirtualChannelManager*)hServer;
@@ -936,17 +1001,20 @@ VOID WINAPI FreeRDP_WTSCloseServer(HANDLE hServer)
 	if (vcm)
 	{
 		HashTable_Remove(g_ServerHandles, (void*)(UINT_PTR)vcm->SessionId);
-		ArrayList_Lock(vcm->dynamicVirtualChannels);
-		count = ArrayList_Count(vcm->dynamicVirtualChannels);
+		EnterCriticalSection(&vcm->dvcLock);
+		count = HashTable_GetKeys(vcm->dynamicVirtualChannels, &keys);
 
 		for (index = 0; index < count; index++)
 		{
-			channel = (rdpPeerChannel*)ArrayList_GetItem(vcm->dynamicVirtualChannels, index);
+			channel = (rdpPeerChannel*)HashTable_GetItemValue(vcm->dynamicVirtualChannels,
+			                                                  (const void*)keys[index]);
 			WTSVirtualChannelClose(channel);
 		}
 
-		ArrayList_Unlock(vcm->dynamicVirtualChannels);
-		ArrayList_Free(vcm->dynamicVirtualChannels);
+		LeaveCriticalSection(&vcm->dvcLock);
+		free(keys);
+		HashTable_Free(vcm->dynamicVirtualChannels);
+		DeleteCriticalSection(&vcm->dvcLock);
 
 		if (vcm->drdynvc_channel)
 		{
@@ -1134,6 +1202,7 @@ static rdpPeerChannel* channel_new(WTSVirtualChannelManager* vcm, freerdp_peer*
 
 	channel->vcm = vcm;
 	channel->client = client;
+	channel->refCount = 1;
 	channel->channelId = ChannelId;
 	channel->index = index;
 	channel->channelType = type;
@@ -1281,7 +1350,7 @@ HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualNam
 
 	channel->channelId = InterlockedIncrement(&vcm->dvc_channel_id_seq);
 
-	if (!ArrayList_Append(vcm->dynamicVirtualChannels, channel))
+	if (!wts_insert_dvc_channel(vcm, channel))
 		goto fail;
 
 	s = Stream_New(NULL, 64);
@@ -1301,7 +1370,7 @@ HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualNam
 fail:
 	Stream_Free(s, TRUE);
 	if (vcm)
-		ArrayList_Remove(vcm->dynamicVirtualChannels, channel);
+		wts_remove_dvc_channel(vcm, channel);
 	channel_free(channel);
 	SetLastError(ERROR_NOT_ENOUGH_MEMORY);
 	return NULL;
@@ -1335,7 +1404,7 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelClose(HANDLE hChannelHandle)
 		}
 		else
 		{
-			ArrayList_Remove(vcm->dynamicVirtualChannels, channel);
+			wts_remove_dvc_channel(vcm, channel);
 
 			if (channel->dvc_open_state == DVC_OPEN_STATE_SUCCEEDED)
 			{
@@ -1357,16 +1426,8 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelClose(HANDLE hChannelHandle)
 			}
 		}
 
-		if (channel->receiveData)
-			Stream_Free(channel->receiveData, TRUE);
-
-		if (channel->queue)
-		{
-			MessageQueue_Free(channel->queue);
-			channel->queue = NULL;
-		}
-
-		free(channel);
+		/* The receive path may still hold a reference to a dynamic channel */
+		channel_release(channel);
 	}
 
 	return ret;
@@ -72,6 +72,7 @@ struct rdp_peer_channel
 	BYTE dvc_open_state;
 	UINT32 dvc_total_length;
 	rdpMcsChannel* mcsChannel;
+	LONG refCount;
 };
 
 struct WTSVirtualChannelManager
@@ -86,7 +87,10 @@ struct WTSVirtualChannelManager
 	BYTE drdynvc_state;
 	LONG dvc_channel_id_seq;
 
-	wArrayList* dynamicVirtualChannels;
+	/* dvcLock is held only to look up, insert or remove channels, the channels themselves are
+	 * kept alive by their reference count */
+	CRITICAL_SECTION dvcLock;
+	wHashTable* dynamicVirtualChannels;
 };
 
 FREERDP_LOCAL BOOL WINAPI FreeRDP_WTSStartRemoteControlSessionW(LPWSTR pTargetServerName,
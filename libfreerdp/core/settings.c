@@ -294,10 +294,10 @@ BOOL freerdp_settings_set_default_order_support(rdpSettings* settings)
 	    freerdp_settings_get_uint32(settings, FreeRDP_GlyphSupportLevel) != GLYPH_SUPPORT_NONE;
 	OrderSupport[NEG_FAST_GLYPH_INDEX] =
 	    freerdp_settings_get_uint32(settings, FreeRDP_GlyphSupportLevel) != GLYPH_SUPPORT_NONE;
-	OrderSupport[NEG_POLYGON_SC_INDEX] = FALSE;
-	OrderSupport[NEG_POLYGON_CB_INDEX] = FALSE;
-	OrderSupport[NEG_ELLIPSE_SC_INDEX] = FALSE;
-	OrderSupport[NEG_ELLIPSE_CB_INDEX] = FALSE;
+	OrderSupport[NEG_POLYGON_SC_INDEX] = TRUE;
+	OrderSupport[NEG_POLYGON_CB_INDEX] = TRUE;
+	OrderSupport[NEG_ELLIPSE_SC_INDEX] = TRUE;
+	OrderSupport[NEG_ELLIPSE_CB_INDEX] = TRUE;
 	return TRUE;
 }
 
@@ -0,0 +1,218 @@
+
+#include <winpr/crt.h>
+#include <winpr/sspi.h>
+#include <winpr/sysinfo.h>
+
+#include "../credentials_cache.h"
+
+#define BENCH_ROUNDS 100000
+
+static void free_identity(SEC_WINNT_AUTH_IDENTITY* identity)
+{
+	free(identity->User);
+	free(identity->Domain);
+	free(identity->Password);
+}
+
+static BOOL same_handle(const CredHandle* a, const CredHandle* b)
+{
+	return (a->dwLower == b->dwLower) && (a->dwUpper == b->dwUpper);
+}
+
+static BOOL test_credentials_reuse(SecurityFunctionTable* table)
+{
+	BOOL rc = FALSE;
+	CredHandle first, second, other, again, saved;
+	SEC_WINNT_AUTH_IDENTITY identity = { 0 };
+	SEC_WINNT_AUTH_IDENTITY changed = { 0 };
+
+	SecInvalidateHandle(&first);
+	SecInvalidateHandle(&second);
+	SecInvalidateHandle(&other);
+	SecInvalidateHandle(&again);
+
+	if ((sspi_SetAuthIdentity(&identity, "user", "domain", "password") < 0) ||
+	    (sspi_SetAuthIdentity(&changed, "user", "domain", "passw0rd") < 0))
+		goto fail;
+
+	/* Gateway in and out channel, same identity */
+	if ((credentials_cache_acquire(table, NTLM_SSP_NAME, &identity, &first, NULL) != SEC_E_OK) ||
+	    (credentials_cache_acquire(table, NTLM_SSP_NAME, &identity, &second, NULL) != SEC_E_OK))
+		goto fail;
+
+	if (!same_handle(&first, &second))
+	{
+		fprintf(stderr, "same identity, different handles\n");
+		goto fail;
+	}
+
+	/* Another password or package must not share it */
+	if (credentials_cache_acquire(table, NTLM_SSP_NAME, &changed, &other, NULL) != SEC_E_OK)
+		goto fail;
+
+	if (same_handle(&first, &other))
+	{
+		fprintf(stderr, "different password, same handle\n");
+		goto fail;
+	}
+
+	if ((credentials_cache_release(table, &other) != SEC_E_OK) ||
+	    (credentials_cache_acquire(table, NEGO_SSP_NAME, &identity, &other, NULL) != SEC_E_OK))
+		goto fail;
+
+	if (same_handle(&first, &other))
+	{
+		fprintf(stderr, "different package, same handle\n");
+		goto fail;
+	}
+
+	/* A reconnect after all users are gone gets the idle handle back */
+	saved = first;
+
+	if ((credentials_cache_release(table, &first) != SEC_E_OK) ||
+	    (credentials_cache_release(table, &second) != SEC_E_OK))
+		goto fail;
+
+	if (SecIsValidHandle(&first) || SecIsValidHandle(&second))
+		goto fail;
+
+	if (credentials_cache_acquire(table, NTLM_SSP_NAME, &identity, &again, NULL) != SEC_E_OK)
+		goto fail;
+
+	if (!same_handle(&again, &saved))
+	{
+		fprintf(stderr, "idle handle not reused\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (SecIsValidHandle(&other))
+		credentials_cache_release(table, &other);
+
+	if (SecIsValidHandle(&again))
+		credentials_cache_release(table, &again);
+
+	credentials_cache_flush();
+	free_identity(&identity);
+	free_identity(&changed);
+	return rc;
+}
+
+/* Handles in use survive a flush, only idle ones are freed */
+static BOOL test_credentials_flush(SecurityFunctionTable* table)
+{
+	BOOL rc = FALSE;
+	CredHandle used, shared;
+	SEC_WINNT_AUTH_IDENTITY identity = { 0 };
+
+	SecInvalidateHandle(&used);
+	SecInvalidateHandle(&shared);
+
+	if (sspi_SetAuthIdentity(&identity, "flush", "domain", "password") < 0)
+		goto fail;
+
+	if (credentials_cache_acquire(table, NTLM_SSP_NAME, &identity, &used, NULL) != SEC_E_OK)
+		goto fail;
+
+	credentials_cache_flush();
+
+	if (credentials_cache_acquire(table, NTLM_SSP_NAME, &identity, &shared, NULL) != SEC_E_OK)
+		goto fail;
+
+	if (!same_handle(&used, &shared))
+	{
+		fprintf(stderr, "flush freed a handle in use\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (SecIsValidHandle(&used))
+		credentials_cache_release(table, &used);
+
+	if (SecIsValidHandle(&shared))
+		credentials_cache_release(table, &shared);
+
+	credentials_cache_flush();
+	free_identity(&identity);
+	return rc;
+}
+
+static BOOL test_credentials_speed(SecurityFunctionTable* table)
+{
+	size_t x;
+	BOOL rc = FALSE;
+	UINT64 start, direct, cached;
+	CredHandle credentials;
+	CredHandle pinned;
+	SEC_WINNT_AUTH_IDENTITY identity = { 0 };
+
+	SecInvalidateHandle(&pinned);
+
+	if (sspi_SetAuthIdentity(&identity, "user", "domain", "password") < 0)
+		goto fail;
+
+	start = GetTickCount64();
+
+	for (x = 0; x < BENCH_ROUNDS; x++)
+	{
+		if (table->AcquireCredentialsHandle(NULL, NTLM_SSP_NAME, SECPKG_CRED_OUTBOUND, NULL,
+		                                    &identity, NULL, NULL, &credentials,
+		                                    NULL) != SEC_E_OK)
+			goto fail;
+
+		table->FreeCredentialsHandle(&credentials);
+	}
+
+	direct = GetTickCount64() - start;
+
+	/* One connection of the session stays up while the others come and go */
+	if (credentials_cache_acquire(table, NTLM_SSP_NAME, &identity, &pinned, NULL) != SEC_E_OK)
+		goto fail;
+
+	start = GetTickCount64();
+
+	for (x = 0; x < BENCH_ROUNDS; x++)
+	{
+		if (credentials_cache_acquire(table, NTLM_SSP_NAME, &identity, &credentials, NULL) !=
+		    SEC_E_OK)
+			goto fail;
+
+		credentials_cache_release(table, &credentials);
+	}
+
+	cached = GetTickCount64() - start;
+	printf("%d credentials handles: AcquireCredentialsHandle %" PRIu64 "ms, cached %" PRIu64
+	       "ms\n",
+	       BENCH_ROUNDS, direct, cached);
+	rc = TRUE;
+fail:
+	if (SecIsValidHandle(&pinned))
+		credentials_cache_release(table, &pinned);
+
+	credentials_cache_flush();
+	free_identity(&identity);
+	return rc;
+}
+
+int TestCredentialsCache(int argc, char* argv[])
+{
+	SecurityFunctionTable* table;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!(table = InitSecurityInterfaceEx(0)))
+		return -1;
+
+	if (!test_credentials_reuse(table))
+		return -1;
+
+	if (!test_credentials_flush(table))
+		return -1;
+
+	if (!test_credentials_speed(table))
+		return -1;
+
+	return 0;
+}
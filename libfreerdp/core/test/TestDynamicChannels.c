@@ -0,0 +1,219 @@
+#include <winpr/crt.h>
+#include <winpr/wtsapi.h>
+#include <winpr/thread.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/channels/channels.h>
+#include <freerdp/channels/drdynvc.h>
+
+#include "../server.h"
+
+#define TEST_DRDYNVC_CHANNEL_ID 1004
+#define TEST_CHANNEL_COUNT 500
+#define TEST_ROUNDS 400
+
+static BOOL test_send_channel_data(freerdp_peer* client, UINT16 channelId, const BYTE* data,
+                                   size_t size)
+{
+	WINPR_UNUSED(client);
+	WINPR_UNUSED(channelId);
+	WINPR_UNUSED(data);
+	WINPR_UNUSED(size);
+	return TRUE;
+}
+
+/* Deliver a drdynvc PDU from the client for dynamic channel ChannelId */
+static BOOL test_receive_pdu(freerdp_peer* peer, BYTE Cmd, UINT32 ChannelId, const BYTE* data,
+                             size_t length)
+{
+	BYTE buffer[64];
+	wStream sbuffer = { 0 };
+	wStream* s = &sbuffer;
+
+	if (length > sizeof(buffer) - 3)
+		return FALSE;
+
+	Stream_StaticInit(s, buffer, sizeof(buffer));
+	Stream_Write_UINT8(s, (Cmd << 4) | 0x01);
+	Stream_Write_UINT16(s, (UINT16)ChannelId);
+	Stream_Write(s, data, length);
+	return peer->ReceiveChannelData(peer, TEST_DRDYNVC_CHANNEL_ID, buffer,
+	                                Stream_GetPosition(s),
+	                                CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST,
+	                                Stream_GetPosition(s));
+}
+
+static size_t test_drain(HANDLE* channels, size_t count)
+{
+	size_t x;
+	size_t messages = 0;
+
+	for (x = 0; x < count; x++)
+	{
+		BYTE buffer[64];
+		ULONG read = 0;
+
+		while (WTSVirtualChannelRead(channels[x], 0, (PCHAR)buffer, sizeof(buffer), &read))
+			messages++;
+	}
+
+	return messages;
+}
+
+struct test_closer
+{
+	HANDLE* channels;
+	size_t count;
+	LONG done;
+};
+
+static DWORD WINAPI test_close_thread(LPVOID arg)
+{
+	size_t x;
+	struct test_closer* closer = (struct test_closer*)arg;
+
+	for (x = 0; x < closer->count; x++)
+	{
+		WTSVirtualChannelClose(closer->channels[x]);
+		closer->channels[x] = NULL;
+	}
+
+	InterlockedExchange(&closer->done, TRUE);
+	return 0;
+}
+
+int TestDynamicChannels(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t x, y;
+	size_t messages;
+	UINT64 start, duration;
+	HANDLE hServer = INVALID_HANDLE_VALUE;
+	HANDLE thread = NULL;
+	freerdp_peer* peer = NULL;
+	rdpMcs* mcs;
+	HANDLE channels[TEST_CHANNEL_COUNT] = { 0 };
+	struct test_closer closer = { 0 };
+	const BYTE caps[] = { 0x00, 0x01, 0x00 };
+	const BYTE created[] = { 0x00, 0x00, 0x00, 0x00 };
+	const BYTE payload[32] = { 0 };
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	WTSRegisterWtsApiFunctionTable(FreeRDP_InitWtsApi());
+	peer = freerdp_peer_new(-1);
+
+	if (!peer || !freerdp_peer_context_new(peer))
+		goto fail;
+
+	peer->SendChannelData = test_send_channel_data;
+	mcs = peer->context->rdp->mcs;
+	mcs->channelCount = 1;
+	sprintf_s(mcs->channels[0].Name, sizeof(mcs->channels[0].Name), "%s",
+	          DRDYNVC_SVC_CHANNEL_NAME);
+	mcs->channels[0].ChannelId = TEST_DRDYNVC_CHANNEL_ID;
+	mcs->channels[0].joined = TRUE;
+
+	hServer = WTSOpenServerA((LPSTR)peer->context);
+
+	if (hServer == INVALID_HANDLE_VALUE)
+		goto fail;
+
+	/* Open drdynvc and complete the capability exchange */
+	peer->activated = TRUE;
+
+	if (!WTSVirtualChannelManagerCheckFileDescriptor(hServer))
+		goto fail;
+
+	if (!test_receive_pdu(peer, CAPABILITY_REQUEST_PDU, 0, caps, sizeof(caps)))
+		goto fail;
+
+	for (x = 0; x < TEST_CHANNEL_COUNT; x++)
+	{
+		char name[16];
+		_snprintf(name, sizeof(name), "dvc%03" PRIuz, x);
+		channels[x] = WTSVirtualChannelOpenEx(((WTSVirtualChannelManager*)hServer)->SessionId,
+		                                      name, WTS_CHANNEL_OPTION_DYNAMIC);
+
+		if (!channels[x])
+			goto fail;
+
+		if (!test_receive_pdu(peer, CREATE_REQUEST_PDU, x + 1, created, sizeof(created)))
+			goto fail;
+	}
+
+	if (!WTSVirtualChannelManagerCheckFileDescriptor(hServer))
+		goto fail;
+
+	/* Interleave data on all channels, as a busy session would */
+	messages = 0;
+	duration = 0;
+
+	for (y = 0; y < TEST_ROUNDS; y++)
+	{
+		start = GetTickCount64();
+
+		for (x = 0; x < TEST_CHANNEL_COUNT; x++)
+		{
+			if (!test_receive_pdu(peer, DATA_PDU, x + 1, payload, sizeof(payload)))
+				goto fail;
+		}
+
+		duration += GetTickCount64() - start;
+		messages += test_drain(channels, TEST_CHANNEL_COUNT);
+	}
+
+	printf("%d data PDUs on %d dynamic channels in %" PRIu64 " ms\n",
+	       TEST_ROUNDS * TEST_CHANNEL_COUNT, TEST_CHANNEL_COUNT, duration);
+
+	if (messages != TEST_ROUNDS * TEST_CHANNEL_COUNT)
+	{
+		fprintf(stderr, "received %" PRIuz " of %d messages\n", messages,
+		        TEST_ROUNDS * TEST_CHANNEL_COUNT);
+		goto fail;
+	}
+
+	/* Close all channels while data for them is still arriving */
+	closer.channels = channels;
+	closer.count = TEST_CHANNEL_COUNT;
+	thread = CreateThread(NULL, 0, test_close_thread, &closer, 0, NULL);
+
+	if (!thread)
+		goto fail;
+
+	while (!InterlockedCompareExchange(&closer.done, FALSE, FALSE))
+	{
+		for (x = 0; x < TEST_CHANNEL_COUNT; x++)
+		{
+			if (!test_receive_pdu(peer, DATA_PDU, x + 1, payload, sizeof(payload)))
+				goto fail;
+		}
+	}
+
+	/* All channels are gone, data for them is ignored */
+	if (!test_receive_pdu(peer, DATA_PDU, 1, payload, sizeof(payload)))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (thread)
+	{
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+
+	if (hServer != INVALID_HANDLE_VALUE)
+		WTSCloseServer(hServer);
+
+	if (peer)
+	{
+		if (peer->context)
+			freerdp_peer_context_free(peer);
+		freerdp_peer_free(peer);
+	}
+
+	return rc;
+}
@@ -0,0 +1,217 @@
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/freerdp.h>
+
+#include "../rdp.h"
+#include "../fastpath.h"
+
+#define TEST_SINGLE_SIZE 15000
+#define TEST_SINGLE_COUNT 2000
+#define TEST_MULTI_SIZE (512 * 1024)
+#define TEST_MULTI_COUNT 60
+#define TEST_FRAGMENT_SIZE 16000
+
+struct test_state
+{
+	const BYTE* bitmap;
+	const BYTE* inPlaceBegin;
+	const BYTE* inPlaceEnd;
+	size_t received;
+	size_t inPlace;
+	BOOL failed;
+};
+
+static struct test_state g_State = { 0 };
+
+static BOOL test_paint(rdpContext* context)
+{
+	WINPR_UNUSED(context);
+	return TRUE;
+}
+
+static BOOL test_surface_bits(rdpContext* context, const SURFACE_BITS_COMMAND* cmd)
+{
+	WINPR_UNUSED(context);
+
+	if (memcmp(cmd->bmp.bitmapData, g_State.bitmap, cmd->bmp.bitmapDataLength) != 0)
+		g_State.failed = TRUE;
+
+	/* Single fragment updates must be handed out from the received PDU itself */
+	if ((cmd->bmp.bitmapData >= g_State.inPlaceBegin) &&
+	    (cmd->bmp.bitmapData < g_State.inPlaceEnd))
+		g_State.inPlace++;
+
+	g_State.received += cmd->bmp.bitmapDataLength;
+	return TRUE;
+}
+
+static void test_write_surface_bits(wStream* s, UINT32 length)
+{
+	Stream_Write_UINT16(s, CMDTYPE_STREAM_SURFACE_BITS);
+	Stream_Write_UINT16(s, 0);  /* destLeft */
+	Stream_Write_UINT16(s, 0);  /* destTop */
+	Stream_Write_UINT16(s, 64); /* destRight */
+	Stream_Write_UINT16(s, 64); /* destBottom */
+	Stream_Write_UINT8(s, 32);  /* bpp */
+	Stream_Write_UINT8(s, 0);   /* flags */
+	Stream_Write_UINT8(s, 0);   /* reserved */
+	Stream_Write_UINT8(s, 0);   /* codecID */
+	Stream_Write_UINT16(s, 64); /* width */
+	Stream_Write_UINT16(s, 64); /* height */
+	Stream_Write_UINT32(s, length);
+	Stream_Write(s, g_State.bitmap, length);
+}
+
+/* Split an update into fast-path update PDUs of at most TEST_FRAGMENT_SIZE bytes */
+static wStream** test_fragment(wStream* update, size_t* count)
+{
+	size_t x;
+	const size_t length = Stream_Length(update);
+	const size_t n = (length + TEST_FRAGMENT_SIZE - 1) / TEST_FRAGMENT_SIZE;
+	wStream** pdus = calloc(n, sizeof(wStream*));
+
+	if (!pdus)
+		return NULL;
+
+	for (x = 0; x < n; x++)
+	{
+		BYTE fragmentation = FASTPATH_FRAGMENT_NEXT;
+		const size_t size = MIN(TEST_FRAGMENT_SIZE, length - x * TEST_FRAGMENT_SIZE);
+
+		if (n == 1)
+			fragmentation = FASTPATH_FRAGMENT_SINGLE;
+		else if (x == 0)
+			fragmentation = FASTPATH_FRAGMENT_FIRST;
+		else if (x == n - 1)
+			fragmentation = FASTPATH_FRAGMENT_LAST;
+
+		pdus[x] = Stream_New(NULL, size + 3);
+
+		if (!pdus[x])
+			return pdus;
+
+		Stream_Write_UINT8(pdus[x], FASTPATH_UPDATETYPE_SURFCMDS | (fragmentation << 4));
+		Stream_Write_UINT16(pdus[x], (UINT16)size);
+		Stream_Write(pdus[x], Stream_Buffer(update) + x * TEST_FRAGMENT_SIZE, size);
+		Stream_SealLength(pdus[x]);
+	}
+
+	*count = n;
+	return pdus;
+}
+
+static BOOL test_replay(rdpFastPath* fastpath, UINT32 length, size_t repeat, BOOL single)
+{
+	size_t x, y;
+	size_t count = 0;
+	UINT64 start, duration;
+	BOOL rc = FALSE;
+	wStream** pdus = NULL;
+	wStream* update = Stream_New(NULL, length + 24);
+
+	if (!update)
+		return FALSE;
+
+	test_write_surface_bits(update, length);
+	Stream_SealLength(update);
+	pdus = test_fragment(update, &count);
+
+	if (!pdus || (count == 0) || ((count == 1) != single))
+		goto fail;
+
+	g_State.received = 0;
+	g_State.inPlace = 0;
+	start = GetTickCount64();
+
+	for (x = 0; x < repeat; x++)
+	{
+		for (y = 0; y < count; y++)
+		{
+			Stream_SetPosition(pdus[y], 0);
+			g_State.inPlaceBegin = Stream_Buffer(pdus[y]);
+			g_State.inPlaceEnd = g_State.inPlaceBegin + Stream_Length(pdus[y]);
+
+			if (fastpath_recv_updates(fastpath, pdus[y]) < 0)
+				goto fail;
+		}
+	}
+
+	duration = GetTickCount64() - start;
+	printf("%s: %" PRIuz " updates of %" PRIu32 " bytes in %" PRIu64 " ms\n",
+	       single ? "single fragment" : "multi fragment", repeat, length, duration);
+
+	if (g_State.failed || (g_State.received != repeat * length))
+		goto fail;
+
+	if (single && (g_State.inPlace != repeat))
+	{
+		fprintf(stderr, "single fragment updates were copied\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (pdus)
+	{
+		for (x = 0; x < count; x++)
+			Stream_Free(pdus[x], TRUE);
+	}
+
+	free(pdus);
+	Stream_Free(update, TRUE);
+	return rc;
+}
+
+int TestFastpath(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t x;
+	BYTE* bitmap = NULL;
+	freerdp* instance = NULL;
+	rdpContext* context;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	bitmap = malloc(TEST_MULTI_SIZE);
+
+	if (!bitmap)
+		goto fail;
+
+	for (x = 0; x < TEST_MULTI_SIZE; x++)
+		bitmap[x] = (BYTE)(x * 7 + (x >> 9));
+
+	g_State.bitmap = bitmap;
+	instance = freerdp_new();
+
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	context = instance->context;
+
+	if (!freerdp_settings_set_uint32(context->settings, FreeRDP_MultifragMaxRequestSize,
+	                                 TEST_MULTI_SIZE + 1024))
+		goto fail;
+
+	context->update->BeginPaint = test_paint;
+	context->update->EndPaint = test_paint;
+	context->update->SurfaceBits = test_surface_bits;
+
+	if (!test_replay(context->rdp->fastpath, TEST_SINGLE_SIZE, TEST_SINGLE_COUNT, TRUE))
+		goto fail;
+
+	if (!test_replay(context->rdp->fastpath, TEST_MULTI_SIZE, TEST_MULTI_COUNT, FALSE))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (instance)
+	{
+		freerdp_context_free(instance);
+		freerdp_free(instance);
+	}
+
+	free(bitmap);
+	return rc;
+}
@@ -0,0 +1,388 @@
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/freerdp.h>
+#include <freerdp/codecs.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/codec/order_encoder.h>
+
+#include "../orders.h"
+
+#define TEST_WIDTH 600
+#define TEST_HEIGHT 420
+#define TEST_FORMAT PIXEL_FORMAT_BGRX32
+
+struct test_stats
+{
+	size_t bytes;
+	size_t orders;
+	size_t opaqueRect;
+	size_t multiOpaqueRect;
+	size_t scrBlt;
+	size_t memBlt;
+	size_t cacheBitmap;
+};
+
+static rdpContext* test_client = NULL;
+static struct test_stats test_stats = { 0 };
+static pOpaqueRect test_opaque_rect_fn = NULL;
+static pMultiOpaqueRect test_multi_opaque_rect_fn = NULL;
+static pScrBlt test_scrblt_fn = NULL;
+static pMemBlt test_memblt_fn = NULL;
+static pCacheBitmapV2 test_cache_bitmap_v2_fn = NULL;
+
+static BOOL test_opaque_rect(rdpContext* context, const OPAQUE_RECT_ORDER* order)
+{
+	test_stats.opaqueRect++;
+	return test_opaque_rect_fn(context, order);
+}
+
+static BOOL test_multi_opaque_rect(rdpContext* context, const MULTI_OPAQUE_RECT_ORDER* order)
+{
+	test_stats.multiOpaqueRect++;
+	return test_multi_opaque_rect_fn(context, order);
+}
+
+static BOOL test_scrblt(rdpContext* context, const SCRBLT_ORDER* order)
+{
+	test_stats.scrBlt++;
+	return test_scrblt_fn(context, order);
+}
+
+static BOOL test_memblt(rdpContext* context, MEMBLT_ORDER* order)
+{
+	test_stats.memBlt++;
+	return test_memblt_fn(context, order);
+}
+
+static BOOL test_cache_bitmap_v2(rdpContext* context, CACHE_BITMAP_V2_ORDER* order)
+{
+	test_stats.cacheBitmap++;
+	return test_cache_bitmap_v2_fn(context, order);
+}
+
+/* Instead of sending the orders PDU, decode it with the client */
+static BOOL test_end_paint(rdpContext* context)
+{
+	UINT16 x;
+	BOOL rc = TRUE;
+	size_t headerLength;
+	rdpUpdate* update = context->update;
+	wStream* s = update->us;
+
+	if (!s)
+		return FALSE;
+
+	headerLength = Stream_Length(s);
+	test_stats.bytes += Stream_GetPosition(s) - headerLength;
+	test_stats.orders += update->numberOrders;
+	Stream_SealLength(s);
+	Stream_SetPosition(s, headerLength + 2);
+
+	for (x = 0; x < update->numberOrders; x++)
+	{
+		if (!update_recv_order(test_client->update, s))
+		{
+			fprintf(stderr, "failed to decode order %" PRIu16 "\n", x);
+			rc = FALSE;
+			break;
+		}
+	}
+
+	if (rc && (Stream_GetRemainingLength(s) != 0))
+	{
+		fprintf(stderr, "%" PRIuz " bytes left after the orders\n", Stream_GetRemainingLength(s));
+		rc = FALSE;
+	}
+
+	update->combineUpdates = FALSE;
+	update->numberOrders = 0;
+	update->us = NULL;
+	Stream_Free(s, TRUE);
+	return rc;
+}
+
+static BOOL test_compare(const BYTE* data, UINT32 depth)
+{
+	UINT32 x, y;
+	const rdpGdi* gdi = test_client->gdi;
+	/* 16 bpp loses the lower bits of the channels */
+	const int tolerance = (depth < 24) ? 8 : 0;
+
+	for (y = 0; y < TEST_HEIGHT; y++)
+	{
+		for (x = 0; x < TEST_WIDTH; x++)
+		{
+			BYTE r1, g1, b1, r2, g2, b2;
+			const UINT32 c1 = ReadColor(&data[y * TEST_WIDTH * 4 + x * 4], TEST_FORMAT);
+			const UINT32 c2 =
+			    ReadColor(&gdi->primary_buffer[y * gdi->stride + x * 4], gdi->dstFormat);
+			SplitColor(c1, TEST_FORMAT, &r1, &g1, &b1, NULL, NULL);
+			SplitColor(c2, gdi->dstFormat, &r2, &g2, &b2, NULL, NULL);
+
+			if ((abs(r1 - r2) > tolerance) || (abs(g1 - g2) > tolerance) ||
+			    (abs(b1 - b2) > tolerance))
+			{
+				fprintf(stderr,
+				        "[%" PRIu32 "bpp] pixel %" PRIu32 "x%" PRIu32
+				        " differs: %02X%02X%02X != %02X%02X%02X\n",
+				        depth, x, y, r1, g1, b1, r2, g2, b2);
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static UINT32 test_color(UINT32 rgb)
+{
+	return FreeRDPGetColor(TEST_FORMAT, (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF, 0xFF);
+}
+
+static void test_fill(BYTE* data, UINT32 left, UINT32 top, UINT32 width, UINT32 height,
+                      UINT32 rgb)
+{
+	UINT32 x, y;
+	const UINT32 color = test_color(rgb);
+
+	for (y = top; y < top + height; y++)
+	{
+		for (x = left; x < left + width; x++)
+			WriteColor(&data[y * TEST_WIDTH * 4 + x * 4], TEST_FORMAT, color);
+	}
+}
+
+static void test_noise(BYTE* data, UINT32 left, UINT32 top, UINT32 width, UINT32 height)
+{
+	UINT32 y;
+
+	for (y = top; y < top + height; y++)
+		winpr_RAND(&data[y * TEST_WIDTH * 4 + left * 4], width * 4);
+}
+
+/* Text like content: a 64x64 pattern repeated on the tile grid */
+static void test_pattern(BYTE* data, UINT32 top, UINT32 rows)
+{
+	UINT32 x, y;
+
+	for (y = top; y < top + rows * 64; y++)
+	{
+		for (x = 0; x < TEST_WIDTH; x++)
+		{
+			const UINT32 color = test_color((((x % 64) ^ (y % 64)) & 0x14) ? 0x202020 : 0xF0F0E0);
+			WriteColor(&data[y * TEST_WIDTH * 4 + x * 4], TEST_FORMAT, color);
+		}
+	}
+}
+
+static BOOL test_send(ORDER_ENCODER_CONTEXT* encoder, rdpContext* server, const BYTE* data,
+                      UINT32 depth, const char* name)
+{
+	const RECTANGLE_16 rect = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	const struct test_stats empty = { 0 };
+	test_stats = empty;
+
+	if (!order_encoder_compose(encoder, server, data, TEST_FORMAT, TEST_WIDTH * 4, &rect))
+	{
+		fprintf(stderr, "[%" PRIu32 "bpp] %s: order_encoder_compose failed\n", depth, name);
+		return FALSE;
+	}
+
+	printf("[%" PRIu32 "bpp] %-8s %5" PRIuz " orders %8" PRIuz " bytes: %" PRIuz
+	       " OpaqueRect %" PRIuz " MultiOpaqueRect %" PRIuz " ScrBlt %" PRIuz " MemBlt %" PRIuz
+	       " CacheBitmapV2\n",
+	       depth, name, test_stats.orders, test_stats.bytes, test_stats.opaqueRect,
+	       test_stats.multiOpaqueRect, test_stats.scrBlt, test_stats.memBlt,
+	       test_stats.cacheBitmap);
+	return test_compare(data, depth);
+}
+
+static freerdp* test_client_new(UINT32 depth)
+{
+	rdpSettings* settings;
+	freerdp* instance = freerdp_new();
+
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	settings = instance->settings;
+	settings->ColorDepth = depth;
+	settings->DesktopWidth = TEST_WIDTH;
+	settings->DesktopHeight = TEST_HEIGHT;
+	settings->BitmapCacheEnabled = TRUE;
+	settings->BitmapCacheVersion = 2;
+	ZeroMemory(settings->OrderSupport, 32);
+	settings->OrderSupport[NEG_SCRBLT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_OPAQUE_RECT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MULTIOPAQUERECT_INDEX] = TRUE;
+	settings->OrderSupport[NEG_MEMBLT_INDEX] = TRUE;
+
+	instance->context->codecs = codecs_new(instance->context);
+
+	if (!instance->context->codecs ||
+	    !freerdp_client_codecs_prepare(instance->context->codecs,
+	                                   FREERDP_CODEC_INTERLEAVED | FREERDP_CODEC_PLANAR,
+	                                   TEST_WIDTH, TEST_HEIGHT))
+		goto fail;
+
+	if (!gdi_init(instance, PIXEL_FORMAT_BGRX32))
+		goto fail;
+
+	return instance;
+fail:
+	if (instance && instance->context)
+	{
+		codecs_free(instance->context->codecs);
+		freerdp_context_free(instance);
+	}
+	freerdp_free(instance);
+	return NULL;
+}
+
+static void test_client_free(freerdp* instance)
+{
+	if (!instance)
+		return;
+
+	gdi_free(instance);
+	codecs_free(instance->context->codecs);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+}
+
+static BOOL test_order_encoder(UINT32 depth)
+{
+	BOOL rc = FALSE;
+	BYTE* data = NULL;
+	freerdp* client = NULL;
+	freerdp_peer* peer = NULL;
+	rdpSettings* settings;
+	rdpUpdate* update;
+	ORDER_ENCODER_CONTEXT* encoder = NULL;
+	const size_t size = TEST_WIDTH * TEST_HEIGHT * 4;
+
+	client = test_client_new(depth);
+	peer = freerdp_peer_new(-1);
+	data = calloc(1, size);
+
+	if (!client || !peer || !data || !freerdp_peer_context_new(peer))
+		goto fail;
+
+	/* Server settings as negotiated with the client */
+	test_client = client->context;
+	settings = peer->settings;
+	settings->ColorDepth = depth;
+	settings->DesktopWidth = TEST_WIDTH;
+	settings->DesktopHeight = TEST_HEIGHT;
+	settings->BitmapCacheV2NumCells = client->settings->BitmapCacheV2NumCells;
+	CopyMemory(settings->BitmapCacheV2CellInfo, client->settings->BitmapCacheV2CellInfo,
+	           sizeof(BITMAP_CACHE_V2_CELL_INFO) * 5);
+	CopyMemory(settings->OrderSupport, client->settings->OrderSupport, 32);
+
+	update = peer->context->update;
+	update->EndPaint = test_end_paint;
+	test_opaque_rect_fn = update->primary->OpaqueRect;
+	test_multi_opaque_rect_fn = update->primary->MultiOpaqueRect;
+	test_scrblt_fn = update->primary->ScrBlt;
+	test_memblt_fn = update->primary->MemBlt;
+	test_cache_bitmap_v2_fn = update->secondary->CacheBitmapV2;
+	update->primary->OpaqueRect = test_opaque_rect;
+	update->primary->MultiOpaqueRect = test_multi_opaque_rect;
+	update->primary->ScrBlt = test_scrblt;
+	update->primary->MemBlt = test_memblt;
+	update->secondary->CacheBitmapV2 = test_cache_bitmap_v2;
+
+	encoder = order_encoder_context_new();
+
+	if (!encoder || !order_encoder_context_reset(encoder, settings, TEST_WIDTH, TEST_HEIGHT))
+		goto fail;
+
+	/* Solid areas with edges off the tile grid */
+	test_fill(data, 0, 0, TEST_WIDTH, TEST_HEIGHT, 0x3A6EA5);
+	test_fill(data, 100, 50, 300, 200, 0xFFFFFF);
+	test_fill(data, 100, 50, 300, 20, 0x000080);
+
+	if (!test_send(encoder, peer->context, data, depth, "solid"))
+		goto fail;
+
+	if (test_stats.memBlt == 0 || test_stats.multiOpaqueRect == 0)
+		goto fail;
+
+	/* Unchanged content is not sent again */
+	if (!test_send(encoder, peer->context, data, depth, "static") || (test_stats.orders != 0))
+		goto fail;
+
+	/* Repeated tiles are drawn from the bitmap cache, the padded edge tile differs */
+	test_pattern(data, 128, 3);
+
+	if (!test_send(encoder, peer->context, data, depth, "pattern") ||
+	    (test_stats.cacheBitmap != 2))
+		goto fail;
+
+	/* Random content in a window */
+	test_noise(data, 70, 30, 330, 90);
+
+	if (!test_send(encoder, peer->context, data, depth, "noise"))
+		goto fail;
+
+	/* Scroll everything up by 37 lines */
+	memmove(data, &data[37 * TEST_WIDTH * 4], size - 37 * TEST_WIDTH * 4);
+	test_fill(data, 0, TEST_HEIGHT - 37, TEST_WIDTH, 37, 0x3A6EA5);
+
+	if (!test_send(encoder, peer->context, data, depth, "scroll") || (test_stats.scrBlt != 1))
+		goto fail;
+
+	/* and down again by 5 lines */
+	memmove(&data[5 * TEST_WIDTH * 4], data, size - 5 * TEST_WIDTH * 4);
+	test_noise(data, 0, 0, TEST_WIDTH, 5);
+
+	if (!test_send(encoder, peer->context, data, depth, "scroll") || (test_stats.scrBlt != 1))
+		goto fail;
+
+	/* A reset sends everything again */
+	if (!order_encoder_context_reset(encoder, settings, TEST_WIDTH, TEST_HEIGHT))
+		goto fail;
+
+	test_fill(data, 0, 0, TEST_WIDTH, TEST_HEIGHT, 0x101010);
+
+	if (!test_send(encoder, peer->context, data, depth, "reset"))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	order_encoder_context_free(encoder);
+
+	if (peer)
+	{
+		if (peer->context)
+			freerdp_peer_context_free(peer);
+		freerdp_peer_free(peer);
+	}
+
+	test_client_free(client);
+	test_client = NULL;
+	free(data);
+	return rc;
+}
+
+int TestOrderEncoder(int argc, char* argv[])
+{
+	size_t x;
+	const UINT32 depths[] = { 32, 24, 16 };
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (x = 0; x < ARRAYSIZE(depths); x++)
+	{
+		if (!test_order_encoder(depths[x]))
+		{
+			fprintf(stderr, "order encoder round trip failed at %" PRIu32 "bpp\n", depths[x]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
@@ -1486,6 +1486,38 @@ static BOOL update_send_opaque_rect(rdpContext* context, const OPAQUE_RECT_ORDER
 	return TRUE;
 }
 
+static BOOL update_send_multi_opaque_rect(rdpContext* context,
+                                          const MULTI_OPAQUE_RECT_ORDER* multi_opaque_rect)
+{
+	wStream* s;
+	size_t offset;
+	int headerLength;
+	ORDER_INFO orderInfo;
+	rdpUpdate* update = context->update;
+	headerLength = update_prepare_order_info(context, &orderInfo, ORDER_TYPE_MULTI_OPAQUE_RECT);
+	update_check_flush(context,
+	                   headerLength + update_approximate_multi_opaque_rect_order(
+	                                      &orderInfo, multi_opaque_rect));
+	s = update->us;
+
+	if (!s)
+		return FALSE;
+
+	offset = Stream_GetPosition(s);
+
+	if (!Stream_EnsureRemainingCapacity(s, headerLength))
+		return FALSE;
+
+	Stream_Seek(s, headerLength);
+
+	if (!update_write_multi_opaque_rect_order(s, &orderInfo, multi_opaque_rect))
+		return FALSE;
+
+	update_write_order_info(context, s, &orderInfo, offset);
+	update->numberOrders++;
+	return TRUE;
+}
+
 static BOOL update_send_line_to(rdpContext* context, const LINE_TO_ORDER* line_to)
 {
 	wStream* s;
@@ -2838,6 +2870,7 @@ void update_register_server_callbacks(rdpUpdate* update)
 	update->primary->PatBlt = update_send_patblt;
 	update->primary->ScrBlt = update_send_scrblt;
 	update->primary->OpaqueRect = update_send_opaque_rect;
+	update->primary->MultiOpaqueRect = update_send_multi_opaque_rect;
 	update->primary->LineTo = update_send_line_to;
 	update->primary->MemBlt = update_send_memblt;
 	update->primary->GlyphIndex = update_send_glyph_index;
@@ -27,19 +27,35 @@
 
 static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-char* crypto_base64_encode(const BYTE* data, size_t length)
+/* Values of the base64 characters, 0xFF for everything else including the '=' padding */
+static const BYTE base64_values[256] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+	0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+size_t crypto_base64_encode_buffer(const BYTE* data, size_t length, char* buffer, size_t size)
 {
-	int c;
-	const BYTE* q;
-	char* p;
-	char* ret;
-	int i = 0;
-	int blocks;
-
-	q = data;
-	p = ret = (char*)malloc((length + 3) * 4 / 3 + 1);
-	if (!p)
-		return NULL;
+	size_t i;
+	char* p = buffer;
+	const BYTE* q = data;
+	const size_t blocks = length / 3;
+
+	if ((!data && (length > 0)) || !buffer || (size < CRYPTO_BASE64_ENCODED_SIZE(length)))
+		return 0;
 
 	/* b1, b2, b3 are input bytes
 	 *
@@ -54,152 +70,159 @@ char* crypto_base64_encode(const BYTE* data, size_t length)
 	 */
 
 	/* first treat complete blocks */
-	blocks = length - (length % 3);
-	for (i = 0; i < blocks; i += 3, q += 3)
+	for (i = 0; i < blocks; i++, q += 3, p += 4)
 	{
-		c = (q[0] << 16) + (q[1] << 8) + q[2];
+		const UINT32 c = ((UINT32)q[0] << 16) | ((UINT32)q[1] << 8) | q[2];
 
-		*p++ = base64[(c & 0x00FC0000) >> 18];
-		*p++ = base64[(c & 0x0003F000) >> 12];
-		*p++ = base64[(c & 0x00000FC0) >> 6];
-		*p++ = base64[c & 0x0000003F];
+		p[0] = base64[c >> 18];
+		p[1] = base64[(c >> 12) & 0x3F];
+		p[2] = base64[(c >> 6) & 0x3F];
+		p[3] = base64[c & 0x3F];
 	}
 
 	/* then remainder */
 	switch (length % 3)
 	{
-		case 0:
-			break;
 		case 1:
-			c = (q[0] << 16);
-			*p++ = base64[(c & 0x00FC0000) >> 18];
-			*p++ = base64[(c & 0x0003F000) >> 12];
+			*p++ = base64[q[0] >> 2];
+			*p++ = base64[(q[0] & 0x03) << 4];
 			*p++ = '=';
 			*p++ = '=';
 			break;
+
 		case 2:
-			c = (q[0] << 16) + (q[1] << 8);
-			*p++ = base64[(c & 0x00FC0000) >> 18];
-			*p++ = base64[(c & 0x0003F000) >> 12];
-			*p++ = base64[(c & 0x00000FC0) >> 6];
+			*p++ = base64[q[0] >> 2];
+			*p++ = base64[((q[0] & 0x03) << 4) | (q[1] >> 4)];
+			*p++ = base64[(q[1] & 0x0F) << 2];
 			*p++ = '=';
 			break;
-	}
 
-	*p = 0;
+		default:
+			break;
+	}
 
-	return ret;
+	*p = '\0';
+	return (size_t)(p - buffer);
 }
 
-static int base64_decode_char(char c)
+char* crypto_base64_encode(const BYTE* data, size_t length)
 {
-	if (c >= 'A' && c <= 'Z')
-		return c - 'A';
+	const size_t size = CRYPTO_BASE64_ENCODED_SIZE(length);
+	char* ret = (char*)malloc(size);
 
-	if (c >= 'a' && c <= 'z')
-		return c - 'a' + 26;
-
-	if (c >= '0' && c <= '9')
-		return c - '0' + 52;
-
-	if (c == '+')
-		return 62;
-
-	if (c == '/')
-		return 63;
+	if (!ret)
+		return NULL;
 
-	if (c == '=')
-		return -1;
+	if ((length > 0) && (crypto_base64_encode_buffer(data, length, ret, size) == 0))
+	{
+		free(ret);
+		return NULL;
+	}
 
-	return -1;
+	ret[size - 1] = '\0';
+	return ret;
 }
 
-static void* base64_decode(const char* s, size_t length, size_t* data_len)
+BOOL crypto_base64_decode_buffer(const char* enc_data, size_t length, BYTE* buffer, size_t size,
+                                 size_t* res_length)
 {
-	int n[4];
-	BYTE* q;
-	BYTE* data;
-	size_t nBlocks, i, outputLen;
+	size_t i, nBlocks, outputLen;
+	UINT32 n0, n1, n2, n3;
+	const BYTE* s = (const BYTE*)enc_data;
+	BYTE* q = buffer;
 
-	if (length % 4)
-		return NULL;
+	if (!enc_data || !buffer || (length < 4) || (length % 4))
+		return FALSE;
 
-	q = data = (BYTE*)malloc(length / 4 * 3 + 1);
-	if (!q)
-		return NULL;
+	/* The padding tells the exact size up front */
+	nBlocks = length / 4;
+	outputLen = nBlocks * 3;
 
-	/* first treat complete blocks */
-	nBlocks = (length / 4);
-	outputLen = 0;
+	if (s[length - 1] == '=')
+		outputLen -= (s[length - 2] == '=') ? 2 : 1;
 
-	if (nBlocks < 1)
-	{
-		free(data);
-		return NULL;
-	}
+	if (size < outputLen)
+		return FALSE;
 
-	for (i = 0; i < nBlocks - 1; i++, q += 3)
+	/* first treat complete blocks, an invalid character sets the high bit of the ORed values */
+	for (i = 0; i < nBlocks - 1; i++, s += 4, q += 3)
 	{
-		n[0] = base64_decode_char(*s++);
-		n[1] = base64_decode_char(*s++);
-		n[2] = base64_decode_char(*s++);
-		n[3] = base64_decode_char(*s++);
-
-		if ((n[0] == -1) || (n[1] == -1) || (n[2] == -1) || (n[3] == -1))
-			goto out_free;
-
-		q[0] = (n[0] << 2) + (n[1] >> 4);
-		q[1] = ((n[1] & 15) << 4) + (n[2] >> 2);
-		q[2] = ((n[2] & 3) << 6) + n[3];
-		outputLen += 3;
+		UINT32 c;
+		n0 = base64_values[s[0]];
+		n1 = base64_values[s[1]];
+		n2 = base64_values[s[2]];
+		n3 = base64_values[s[3]];
+
+		if ((n0 | n1 | n2 | n3) & 0x80)
+			return FALSE;
+
+		c = (n0 << 18) | (n1 << 12) | (n2 << 6) | n3;
+		q[0] = (BYTE)(c >> 16);
+		q[1] = (BYTE)(c >> 8);
+		q[2] = (BYTE)c;
 	}
 
 	/* treat last block */
-	n[0] = base64_decode_char(*s++);
-	n[1] = base64_decode_char(*s++);
-	if ((n[0] == -1) || (n[1] == -1))
-		goto out_free;
+	n0 = base64_values[s[0]];
+	n1 = base64_values[s[1]];
+	n2 = base64_values[s[2]];
+	n3 = base64_values[s[3]];
 
-	n[2] = base64_decode_char(*s++);
-	n[3] = base64_decode_char(*s++);
+	if ((n0 | n1) & 0x80)
+		return FALSE;
 
-	q[0] = (n[0] << 2) + (n[1] >> 4);
-	if (n[2] == -1)
+	q[0] = (BYTE)((n0 << 2) | (n1 >> 4));
+
+	if ((s[2] == '=') && (s[3] == '='))
 	{
 		/* XX== */
-		outputLen += 1;
-		if (n[3] != -1)
-			goto out_free;
-
-		q[1] = ((n[1] & 15) << 4);
 	}
-	else if (n[3] == -1)
+	else if (s[3] == '=')
 	{
-		/* yyy= */
-		outputLen += 2;
-		q[1] = ((n[1] & 15) << 4) + (n[2] >> 2);
-		q[2] = ((n[2] & 3) << 6);
+		/* XXX= */
+		if (n2 & 0x80)
+			return FALSE;
+
+		q[1] = (BYTE)(((n1 & 0x0F) << 4) | (n2 >> 2));
 	}
 	else
 	{
 		/* XXXX */
-		outputLen += 3;
-		q[0] = (n[0] << 2) + (n[1] >> 4);
-		q[1] = ((n[1] & 15) << 4) + (n[2] >> 2);
-		q[2] = ((n[2] & 3) << 6) + n[3];
+		if ((n2 | n3) & 0x80)
+			return FALSE;
+
+		q[1] = (BYTE)(((n1 & 0x0F) << 4) | (n2 >> 2));
+		q[2] = (BYTE)(((n2 & 0x03) << 6) | n3);
 	}
 
-	if (data_len)
-		*data_len = outputLen;
-	data[outputLen] = '\0';
+	if (res_length)
+		*res_length = outputLen;
 
-	return data;
-out_free:
-	free(data);
-	return NULL;
+	return TRUE;
 }
 
 void crypto_base64_decode(const char* enc_data, size_t length, BYTE** dec_data, size_t* res_length)
 {
-	*dec_data = base64_decode(enc_data, length, res_length);
+	/* One more byte for a terminating NUL, callers decode strings as well */
+	BYTE* data = (length % 4) ? NULL : (BYTE*)malloc(CRYPTO_BASE64_DECODED_SIZE(length) + 1);
+	size_t outputLen = 0;
+
+	*dec_data = NULL;
+
+	if (!data)
+		return;
+
+	if (!crypto_base64_decode_buffer(enc_data, length, data, CRYPTO_BASE64_DECODED_SIZE(length),
+	                                 &outputLen))
+	{
+		free(data);
+		return;
+	}
+
+	data[outputLen] = '\0';
+
+	if (res_length)
+		*res_length = outputLen;
+
+	*dec_data = data;
 }
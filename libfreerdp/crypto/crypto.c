@@ -21,8 +21,12 @@
 #include "config.h"
 #endif
 
+#include <sys/stat.h>
+
 #include <winpr/crt.h>
+#include <winpr/synch.h>
 #include <winpr/crypto.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/log.h>
 #include <freerdp/crypto/crypto.h>
@@ -854,18 +858,77 @@ static int verify_cb(int ok, X509_STORE_CTX* csc)
 	return ok;
 }
 
-BOOL x509_verify_certificate(CryptoCert cert, const char* certificate_store_path)
+/* The trusted store is loaded once per process and reused until one of its paths changes.
+ * Verification results are kept per certificate chain for a while, reconnects to the same
+ * server do not walk the chain again. */
+#define X509_STORE_CHECK_INTERVAL 1000
+#define X509_VERIFY_CACHE_TTL (5 * 60 * 1000)
+#define X509_VERIFY_CACHE_SIZE 64
+
+typedef struct
+{
+	BYTE digest[WINPR_SHA256_DIGEST_LENGTH];
+	BOOL status;
+	UINT64 expires;
+} x509_verify_result;
+
+typedef struct
+{
+	CRITICAL_SECTION lock;
+	X509_STORE* store;
+	char* path;
+	INT64 stamps[3];
+	UINT64 checked;
+	UINT32 generation;
+	size_t next;
+	x509_verify_result results[X509_VERIFY_CACHE_SIZE];
+} x509_verify_cache;
+
+static INIT_ONCE x509_verify_once = INIT_ONCE_STATIC_INIT;
+static x509_verify_cache x509_verify;
+
+static BOOL CALLBACK x509_verify_init(PINIT_ONCE once, PVOID param, PVOID* context)
+{
+	WINPR_UNUSED(once);
+	WINPR_UNUSED(param);
+	WINPR_UNUSED(context);
+	return InitializeCriticalSectionAndSpinCount(&x509_verify.lock, 4000);
+}
+
+static INT64 x509_path_stamp(const char* path)
+{
+	struct stat st;
+
+	if (!path || (stat(path, &st) != 0))
+		return 0;
+
+	return (INT64)st.st_mtime;
+}
+
+/* The same locations X509_STORE_set_default_paths and the certificate store path use */
+static void x509_store_stamps(const char* certificate_store_path, INT64* stamps)
+{
+	const char* dir = getenv(X509_get_default_cert_dir_env());
+	const char* file = getenv(X509_get_default_cert_file_env());
+
+	if (!dir)
+		dir = X509_get_default_cert_dir();
+
+	if (!file)
+		file = X509_get_default_cert_file();
+
+	stamps[0] = x509_path_stamp(dir);
+	stamps[1] = x509_path_stamp(file);
+	stamps[2] = x509_path_stamp(certificate_store_path);
+}
+
+static X509_STORE* x509_store_new(const char* certificate_store_path)
 {
-	size_t i;
-	const int purposes[3] = { X509_PURPOSE_SSL_SERVER, X509_PURPOSE_SSL_CLIENT, X509_PURPOSE_ANY };
-	X509_STORE_CTX* csc;
-	BOOL status = FALSE;
-	X509_STORE* cert_ctx = NULL;
 	X509_LOOKUP* lookup = NULL;
-	cert_ctx = X509_STORE_new();
+	X509_STORE* store = X509_STORE_new();
 
-	if (cert_ctx == NULL)
-		goto end;
+	if (store == NULL)
+		return NULL;
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
 	OpenSSL_add_all_algorithms();
@@ -875,13 +938,13 @@ BOOL x509_verify_certificate(CryptoCert cert, const char* certificate_store_path
 	                    NULL);
 #endif
 
-	if (X509_STORE_set_default_paths(cert_ctx) != 1)
-		goto end;
+	if (X509_STORE_set_default_paths(store) != 1)
+		goto fail;
 
-	lookup = X509_STORE_add_lookup(cert_ctx, X509_LOOKUP_hash_dir());
+	lookup = X509_STORE_add_lookup(store, X509_LOOKUP_hash_dir());
 
 	if (lookup == NULL)
-		goto end;
+		goto fail;
 
 	X509_LOOKUP_add_dir(lookup, NULL, X509_FILETYPE_DEFAULT);
 
@@ -890,20 +953,152 @@ BOOL x509_verify_certificate(CryptoCert cert, const char* certificate_store_path
 		X509_LOOKUP_add_dir(lookup, certificate_store_path, X509_FILETYPE_PEM);
 	}
 
-	X509_STORE_set_flags(cert_ctx, 0);
+	X509_STORE_set_flags(store, 0);
+	return store;
+fail:
+	X509_STORE_free(store);
+	return NULL;
+}
+
+/* Called with the lock held, reloads the store when a path or its contents changed */
+static X509_STORE* x509_store_get(const char* certificate_store_path)
+{
+	INT64 stamps[ARRAYSIZE(x509_verify.stamps)];
+	X509_STORE* store;
+	const UINT64 now = GetTickCount64();
+	const BOOL pathChanged =
+	    (certificate_store_path && x509_verify.path)
+	        ? (strcmp(certificate_store_path, x509_verify.path) != 0)
+	        : (certificate_store_path != x509_verify.path);
+
+	if (x509_verify.store && !pathChanged &&
+	    (now - x509_verify.checked < X509_STORE_CHECK_INTERVAL))
+		return x509_verify.store;
+
+	x509_verify.checked = now;
+	x509_store_stamps(certificate_store_path, stamps);
+
+	if (x509_verify.store && !pathChanged &&
+	    (memcmp(stamps, x509_verify.stamps, sizeof(stamps)) == 0))
+		return x509_verify.store;
+
+	if (!(store = x509_store_new(certificate_store_path)))
+		return NULL;
+
+	free(x509_verify.path);
+	x509_verify.path = NULL;
 
+	if (certificate_store_path && !(x509_verify.path = _strdup(certificate_store_path)))
+	{
+		X509_STORE_free(store);
+		return NULL;
+	}
+
+	/* Verifications still running keep their reference to the previous store */
+	X509_STORE_free(x509_verify.store);
+	x509_verify.store = store;
+	CopyMemory(x509_verify.stamps, stamps, sizeof(stamps));
+	ZeroMemory(x509_verify.results, sizeof(x509_verify.results));
+	x509_verify.next = 0;
+	x509_verify.generation++;
+	WLog_DBG(TAG, "loaded trusted certificate store [%s]",
+	         certificate_store_path ? certificate_store_path : "default");
+	return store;
+}
+
+static BOOL x509_verify_digest(CryptoCert cert, BYTE* digest)
+{
+	int i;
+	BOOL rc = FALSE;
+	WINPR_DIGEST_CTX* ctx = winpr_Digest_New();
+	const int count = cert->px509chain ? sk_X509_num(cert->px509chain) : 0;
+
+	if (!ctx || !winpr_Digest_Init(ctx, WINPR_MD_SHA256))
+		goto fail;
+
+	for (i = -1; i < count; i++)
+	{
+		unsigned int length = 0;
+		BYTE md[EVP_MAX_MD_SIZE];
+		X509* xcert = (i < 0) ? cert->px509 : sk_X509_value(cert->px509chain, i);
+
+		if (!X509_digest(xcert, EVP_sha256(), md, &length))
+			goto fail;
+
+		if (!winpr_Digest_Update(ctx, md, length))
+			goto fail;
+	}
+
+	rc = winpr_Digest_Final(ctx, digest, WINPR_SHA256_DIGEST_LENGTH);
+fail:
+	winpr_Digest_Free(ctx);
+	return rc;
+}
+
+static x509_verify_result* x509_verify_find(const BYTE* digest)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAYSIZE(x509_verify.results); i++)
+	{
+		x509_verify_result* result = &x509_verify.results[i];
+
+		if (memcmp(result->digest, digest, sizeof(result->digest)) == 0)
+			return result;
+	}
+
+	return NULL;
+}
+
+static BOOL x509_verify_cached(CryptoCert cert, const BYTE* digest, BOOL* status)
+{
+	const x509_verify_result* result = x509_verify_find(digest);
+
+	if (!result || (result->expires <= GetTickCount64()))
+		return FALSE;
+
+	/* A chain may not expire while its result is cached */
+	if (result->status && ((X509_cmp_current_time(X509_get_notBefore(cert->px509)) >= 0) ||
+	                       (X509_cmp_current_time(X509_get_notAfter(cert->px509)) <= 0)))
+		return FALSE;
+
+	*status = result->status;
+	return TRUE;
+}
+
+static void x509_verify_store_result(const BYTE* digest, BOOL status)
+{
+	x509_verify_result* result = x509_verify_find(digest);
+
+	if (!result)
+	{
+		result = &x509_verify.results[x509_verify.next];
+		x509_verify.next = (x509_verify.next + 1) % ARRAYSIZE(x509_verify.results);
+		CopyMemory(result->digest, digest, sizeof(result->digest));
+	}
+
+	result->status = status;
+	result->expires = GetTickCount64() + X509_VERIFY_CACHE_TTL;
+}
+
+static BOOL x509_verify_chain(X509_STORE* store, CryptoCert cert)
+{
+	size_t i;
+	const int purposes[3] = { X509_PURPOSE_SSL_SERVER, X509_PURPOSE_SSL_CLIENT, X509_PURPOSE_ANY };
+
+	/* Server certificates verify with the first purpose, the others are only tried for
+	 * certificates lacking the server authentication usage */
 	for (i = 0; i < ARRAYSIZE(purposes); i++)
 	{
 		int err = -1, rc = -1;
-		int purpose = purposes[i];
-		csc = X509_STORE_CTX_new();
+		X509_STORE_CTX* csc = X509_STORE_CTX_new();
 
 		if (csc == NULL)
 			goto skip;
-		if (!X509_STORE_CTX_init(csc, cert_ctx, cert->px509, cert->px509chain))
+		if (!X509_STORE_CTX_init(csc, store, cert->px509, cert->px509chain))
 			goto skip;
 
-		X509_STORE_CTX_set_purpose(csc, purpose);
+		X509_STORE_CTX_set_purpose(csc, purposes[i]);
 		X509_STORE_CTX_set_verify_cb(csc, verify_cb);
 
 		rc = X509_verify_cert(csc);
@@ -911,16 +1106,59 @@ BOOL x509_verify_certificate(CryptoCert cert, const char* certificate_store_path
 	skip:
 		X509_STORE_CTX_free(csc);
 		if (rc == 1)
-		{
-			status = TRUE;
-			break;
-		}
+			return TRUE;
 		else if (err != X509_V_ERR_INVALID_PURPOSE)
 			break;
 	}
 
-	X509_STORE_free(cert_ctx);
+	return FALSE;
+}
+
+BOOL x509_verify_certificate(CryptoCert cert, const char* certificate_store_path)
+{
+	UINT32 generation;
+	BOOL status = FALSE;
+	X509_STORE* store;
+	BYTE digest[WINPR_SHA256_DIGEST_LENGTH];
+	BOOL cacheable;
+
+	if (!cert || !cert->px509)
+		return FALSE;
+
+	if (!InitOnceExecuteOnce(&x509_verify_once, x509_verify_init, NULL, NULL))
+		return FALSE;
+
+	cacheable = x509_verify_digest(cert, digest);
+	EnterCriticalSection(&x509_verify.lock);
+
+	if (!(store = x509_store_get(certificate_store_path)))
+		goto end;
+
+	if (cacheable && x509_verify_cached(cert, digest, &status))
+	{
+		WLog_DBG(TAG, "certificate chain verification %s (cached)",
+		         status ? "succeeded" : "failed");
+		goto end;
+	}
+
+	generation = x509_verify.generation;
+#if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
+	status = x509_verify_chain(store, cert);
+#else
+	/* The store is safe for concurrent use, verify without holding the lock */
+	X509_STORE_up_ref(store);
+	LeaveCriticalSection(&x509_verify.lock);
+	status = x509_verify_chain(store, cert);
+	X509_STORE_free(store);
+	EnterCriticalSection(&x509_verify.lock);
+#endif
+
+	/* Results from a store replaced meanwhile are not kept */
+	if (cacheable && (generation == x509_verify.generation))
+		x509_verify_store_result(digest, status);
+
 end:
+	LeaveCriticalSection(&x509_verify.lock);
 	return status;
 }
 
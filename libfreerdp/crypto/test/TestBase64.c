@@ -17,8 +17,15 @@
  * limitations under the License.
  */
 
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
 #include <freerdp/crypto/crypto.h>
 
+#define FUZZ_ROUNDS 2000
+#define BENCH_SIZE (64 * 1024)
+#define BENCH_ROUNDS 500
+
 struct Encode64test
 {
 	const char* input;
@@ -38,6 +45,116 @@ static const struct Encode64test encodeTests[] = {
 	{ NULL, -1, NULL }, /*  /!\ last one  /!\ */
 };
 
+static BOOL test_base64_roundtrip(void)
+{
+	size_t i;
+	BOOL rc = FALSE;
+	BYTE data[300];
+	BYTE decoded[sizeof(data)];
+	char encoded[CRYPTO_BASE64_ENCODED_SIZE(sizeof(data))];
+
+	for (i = 0; i < FUZZ_ROUNDS; i++)
+	{
+		size_t x, len, outLen = 0;
+		const size_t length = (size_t)rand() % sizeof(data);
+
+		for (x = 0; x < length; x++)
+			data[x] = (BYTE)rand();
+
+		/* The documented sizes are exact, one byte less must fail */
+		len = CRYPTO_BASE64_ENCODED_SIZE(length) - 1;
+
+		if ((length > 0) && (crypto_base64_encode_buffer(data, length, encoded, len) != 0))
+			goto fail;
+
+		if (crypto_base64_encode_buffer(data, length, encoded, sizeof(encoded)) != len)
+			goto fail;
+
+		if ((strlen(encoded) != len) || (len % 4 != 0))
+			goto fail;
+
+		if (length == 0)
+			continue;
+
+		if (!crypto_base64_decode_buffer(encoded, len, decoded, length, &outLen) ||
+		    (outLen != length) || (memcmp(data, decoded, length) != 0))
+			goto fail;
+
+		if (crypto_base64_decode_buffer(encoded, len, decoded, length - 1, &outLen))
+			goto fail;
+
+		/* Any character outside of the alphabet is rejected */
+		x = (size_t)rand() % len;
+
+		if (encoded[x] != '=')
+		{
+			encoded[x] = "\0 -.!\x80\xFF\n"[rand() % 8];
+
+			if (crypto_base64_decode_buffer(encoded, len, decoded, sizeof(decoded), &outLen))
+				goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	if (!rc)
+		fprintf(stderr, "ko, round trip %" PRIuz " failed\n", i);
+
+	return rc;
+}
+
+/* Large blobs, like the base64 payloads of .rdp files and gateway tokens */
+static BOOL test_base64_speed(void)
+{
+	size_t i;
+	BOOL rc = FALSE;
+	UINT64 start, encode, decode;
+	BYTE* data = calloc(BENCH_SIZE, sizeof(BYTE));
+	BYTE* decoded = calloc(BENCH_SIZE, sizeof(BYTE));
+	char* encoded = calloc(CRYPTO_BASE64_ENCODED_SIZE(BENCH_SIZE), sizeof(char));
+	size_t len = 0;
+
+	if (!data || !decoded || !encoded)
+		goto fail;
+
+	for (i = 0; i < BENCH_SIZE; i++)
+		data[i] = (BYTE)rand();
+
+	start = GetTickCount64();
+
+	for (i = 0; i < BENCH_ROUNDS; i++)
+	{
+		len = crypto_base64_encode_buffer(data, BENCH_SIZE, encoded,
+		                                  CRYPTO_BASE64_ENCODED_SIZE(BENCH_SIZE));
+
+		if (len == 0)
+			goto fail;
+	}
+
+	encode = GetTickCount64() - start;
+	start = GetTickCount64();
+
+	for (i = 0; i < BENCH_ROUNDS; i++)
+	{
+		if (!crypto_base64_decode_buffer(encoded, len, decoded, BENCH_SIZE, NULL))
+			goto fail;
+	}
+
+	decode = GetTickCount64() - start;
+
+	if (memcmp(data, decoded, BENCH_SIZE) != 0)
+		goto fail;
+
+	printf("%d x %d bytes: base64 encode %" PRIu64 "ms, decode %" PRIu64 "ms\n", BENCH_ROUNDS,
+	       BENCH_SIZE, encode, decode);
+	rc = TRUE;
+fail:
+	free(data);
+	free(decoded);
+	free(encoded);
+	return rc;
+}
+
 int TestBase64(int argc, char* argv[])
 {
 	int i, testNb = 0;
@@ -107,6 +224,26 @@ int TestBase64(int argc, char* argv[])
 		return -1;
 	}
 
+	crypto_base64_decode("AA=A", 4, &decoded, &outLen);
+
+	if (decoded)
+	{
+		fprintf(stderr, "ko, = in a wrong place\n");
+		return -1;
+	}
+
 	fprintf(stderr, "ok\n");
+	testNb++;
+	fprintf(stderr, "%d:base64 round trip...", testNb);
+	srand((unsigned)GetTickCount());
+
+	if (!test_base64_roundtrip())
+		return -1;
+
+	fprintf(stderr, "ok\n");
+
+	if (!test_base64_speed())
+		return -1;
+
 	return 0;
 }
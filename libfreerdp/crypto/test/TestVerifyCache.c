@@ -0,0 +1,153 @@
+
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/file.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/crypto/crypto.h>
+
+#define TEST_VERIFY_ROUNDS 2000
+
+/* A self signed certificate, trusted once it is placed in the certificate store path */
+static const char pem[] = "-----BEGIN CERTIFICATE-----\n"
+                          "MIIBkjCCATmgAwIBAgIUczxppUwsh4eVwIyX1/xiXTxM1CkwCgYIKoZIzj0EAwIw\n"
+                          "HjEcMBoGA1UEAwwTRnJlZVJEUCB2ZXJpZnkgdGVzdDAgFw0yNjEwMTgwNjAzMzNa\n"
+                          "GA8yMTI2MDkyNDA2MDMzM1owHjEcMBoGA1UEAwwTRnJlZVJEUCB2ZXJpZnkgdGVz\n"
+                          "dDBZMBMGByqGSM49AgEGCCqGSM49AwEHA0IABBEj4+F9ZS1ao2xSTaZNcH8hzFOs\n"
+                          "vn6ueCNhw3ivNlHXJ8V9N6FgTBfCp09tTJVyzt9NNpEusMBhqABOXAoZFvejUzBR\n"
+                          "MB0GA1UdDgQWBBRChF0ldM7/IciyVsWylYA//ZztIDAfBgNVHSMEGDAWgBRChF0l\n"
+                          "dM7/IciyVsWylYA//ZztIDAPBgNVHRMBAf8EBTADAQH/MAoGCCqGSM49BAMCA0cA\n"
+                          "MEQCIHlsdtXXOmgRWOc25Iaex2cfUP9VtJjX3NiDBw7TcbEUAiAE44IQKsGzDV6J\n"
+                          "FbagtMd3vQq+DPe+0wD0FpcImvu0kA==\n"
+                          "-----END CERTIFICATE-----";
+
+static BOOL expect_verify(CryptoCert cert, const char* path, BOOL expected, const char* what)
+{
+	UINT64 start = GetTickCount64();
+	const BOOL status = x509_verify_certificate(cert, path);
+
+	printf("%s: %s in %" PRIu64 "ms\n", what, status ? "trusted" : "untrusted",
+	       GetTickCount64() - start);
+
+	if (status == expected)
+		return TRUE;
+
+	fprintf(stderr, "%s: expected the certificate to be %s\n", what,
+	        expected ? "trusted" : "untrusted");
+	return FALSE;
+}
+
+static BOOL add_to_store(X509* xcert, const char* path)
+{
+	BOOL rc = FALSE;
+	FILE* fp = NULL;
+	char name[32] = { 0 };
+	char* file;
+
+	_snprintf(name, sizeof(name), "%08lx.0", X509_subject_name_hash(xcert));
+
+	if (!(file = GetCombinedPath(path, name)))
+		return FALSE;
+
+	if ((fp = winpr_fopen(file, "w")) && (fwrite(pem, strlen(pem), 1, fp) == 1))
+		rc = TRUE;
+
+	if (fp)
+		fclose(fp);
+
+	free(file);
+	return rc;
+}
+
+static void remove_store(const char* path)
+{
+	WIN32_FIND_DATAA data = { 0 };
+	char* pattern = GetCombinedPath(path, "*.0");
+	HANDLE find = pattern ? FindFirstFileA(pattern, &data) : INVALID_HANDLE_VALUE;
+
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			char* file = GetCombinedPath(path, data.cFileName);
+
+			if (file)
+				DeleteFileA(file);
+
+			free(file);
+		} while (FindNextFileA(find, &data));
+
+		FindClose(find);
+	}
+
+	free(pattern);
+	RemoveDirectoryA(path);
+}
+
+int TestVerifyCache(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t x;
+	UINT64 start;
+	char name[64] = { 0 };
+	char* temp = GetKnownPath(KNOWN_PATH_TEMP);
+	char* path = NULL;
+	struct crypto_cert_struct cert = { 0 };
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	_snprintf(name, sizeof(name), "TestVerifyCache-%" PRIu32, GetCurrentProcessId());
+
+	if (!temp || !(path = GetCombinedPath(temp, name)))
+		goto fail;
+
+	if (!CreateDirectoryA(path, NULL))
+		goto fail;
+
+	if (!(cert.px509 = crypto_cert_from_pem(pem, strlen(pem), FALSE)))
+		goto fail;
+
+	/* The first verification loads the store, the second one is answered from the cache */
+	if (!expect_verify(&cert, path, FALSE, "empty store") ||
+	    !expect_verify(&cert, path, FALSE, "empty store, cached"))
+		goto fail;
+
+	/* Adding a certificate changes the store path, the store is reloaded and the cache
+	 * flushed once the paths are checked again */
+	Sleep(1100);
+
+	if (!add_to_store(cert.px509, path))
+		goto fail;
+
+	Sleep(1100);
+
+	if (!expect_verify(&cert, path, TRUE, "certificate added") ||
+	    !expect_verify(&cert, path, TRUE, "certificate added, cached"))
+		goto fail;
+
+	/* A different certificate store path replaces the store */
+	if (!expect_verify(&cert, NULL, FALSE, "default store") ||
+	    !expect_verify(&cert, path, TRUE, "certificate store again"))
+		goto fail;
+
+	start = GetTickCount64();
+
+	for (x = 0; x < TEST_VERIFY_ROUNDS; x++)
+	{
+		if (!x509_verify_certificate(&cert, path))
+			goto fail;
+	}
+
+	printf("%d verifications of a cached chain: %" PRIu64 "ms\n", TEST_VERIFY_ROUNDS,
+	       GetTickCount64() - start);
+	rc = 0;
+fail:
+	X509_free(cert.px509);
+
+	if (path)
+		remove_store(path);
+
+	free(path);
+	free(temp);
+	return rc;
+}
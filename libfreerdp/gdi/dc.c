@@ -50,6 +50,7 @@ HGDI_DC gdi_GetDC(void)
 
 	hDC->format = PIXEL_FORMAT_XRGB32;
 	hDC->drawMode = GDI_R2_BLACK;
+	hDC->polyFillMode = GDI_FILL_ALTERNATE;
 	hDC->clip = gdi_CreateRectRgn(0, 0, 0, 0);
 
 	if (!hDC->clip)
@@ -77,6 +78,7 @@ HGDI_DC gdi_CreateDC(UINT32 format)
 		return NULL;
 
 	hDC->drawMode = GDI_R2_BLACK;
+	hDC->polyFillMode = GDI_FILL_ALTERNATE;
 
 	if (!(hDC->clip = gdi_CreateRectRgn(0, 0, 0, 0)))
 		goto fail;
@@ -127,6 +129,7 @@ HGDI_DC gdi_CreateCompatibleDC(HGDI_DC hdc)
 	hDC->clip->null = TRUE;
 	hDC->format = hdc->format;
 	hDC->drawMode = hdc->drawMode;
+	hDC->polyFillMode = hdc->polyFillMode;
 	hDC->hwnd = NULL;
 	return hDC;
 }
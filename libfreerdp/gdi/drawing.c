@@ -65,6 +65,93 @@ INT32 gdi_SetROP2(HGDI_DC hdc, INT32 fnDrawMode)
 	return prevDrawMode;
 }
 
+/**
+ * Combine a pixel with a pen or brush color according to a binary raster operation.
+ * @param rop binary raster operation (GDI_R2_*)
+ * @param pixelPtr pixel to update
+ * @param pen pen or brush color in format
+ * @param format pixel format
+ * @return nonzero if successful, 0 for an unknown raster operation
+ */
+
+BOOL gdi_rop2_color(UINT32 rop, BYTE* pixelPtr, UINT32 pen, UINT32 format)
+{
+	const UINT32 srcPixel = ReadColor(pixelPtr, format);
+	UINT32 dstPixel;
+
+	switch (rop)
+	{
+		case GDI_R2_BLACK: /* LineTo_BLACK */
+			dstPixel = FreeRDPGetColor(format, 0, 0, 0, 0xFF);
+			break;
+
+		case GDI_R2_NOTMERGEPEN: /* LineTo_NOTMERGEPEN */
+			dstPixel = ~(srcPixel | pen);
+			break;
+
+		case GDI_R2_MASKNOTPEN: /* LineTo_MASKNOTPEN */
+			dstPixel = srcPixel & ~pen;
+			break;
+
+		case GDI_R2_NOTCOPYPEN: /* LineTo_NOTCOPYPEN */
+			dstPixel = ~pen;
+			break;
+
+		case GDI_R2_MASKPENNOT: /* LineTo_MASKPENNOT */
+			dstPixel = pen & ~srcPixel;
+			break;
+
+		case GDI_R2_NOT: /* LineTo_NOT */
+			dstPixel = ~srcPixel;
+			break;
+
+		case GDI_R2_XORPEN: /* LineTo_XORPEN */
+			dstPixel = srcPixel ^ pen;
+			break;
+
+		case GDI_R2_NOTMASKPEN: /* LineTo_NOTMASKPEN */
+			dstPixel = ~(srcPixel & pen);
+			break;
+
+		case GDI_R2_MASKPEN: /* LineTo_MASKPEN */
+			dstPixel = srcPixel & pen;
+			break;
+
+		case GDI_R2_NOTXORPEN: /* LineTo_NOTXORPEN */
+			dstPixel = ~(srcPixel ^ pen);
+			break;
+
+		case GDI_R2_NOP: /* LineTo_NOP */
+			dstPixel = srcPixel;
+			break;
+
+		case GDI_R2_MERGENOTPEN: /* LineTo_MERGENOTPEN */
+			dstPixel = srcPixel | ~pen;
+			break;
+
+		case GDI_R2_COPYPEN: /* LineTo_COPYPEN */
+			dstPixel = pen;
+			break;
+
+		case GDI_R2_MERGEPENNOT: /* LineTo_MERGEPENNOT */
+			dstPixel = srcPixel | ~pen;
+			break;
+
+		case GDI_R2_MERGEPEN: /* LineTo_MERGEPEN */
+			dstPixel = srcPixel | pen;
+			break;
+
+		case GDI_R2_WHITE: /* LineTo_WHITE */
+			dstPixel = FreeRDPGetColor(format, 0xFF, 0xFF, 0xFF, 0xFF);
+			break;
+
+		default:
+			return FALSE;
+	}
+
+	return WriteColor(pixelPtr, format, dstPixel);
+}
+
 /**
  * Get the current background color.\n
  * @msdn{dd144852}
@@ -138,3 +225,34 @@ UINT32 gdi_SetTextColor(HGDI_DC hdc, UINT32 crColor)
 	hdc->textColor = crColor;
 	return previousTextColor;
 }
+
+/**
+ * Get the current polygon fill mode.\n
+ * @msdn{dd144958}
+ * @param hdc device context
+ * @return polygon fill mode
+ */
+
+INT32 gdi_GetPolyFillMode(HGDI_DC hdc)
+{
+	return hdc->polyFillMode;
+}
+
+/**
+ * Set the current polygon fill mode.\n
+ * @msdn{dd145101}
+ * @param hdc device context
+ * @param iPolyFillMode polygon fill mode
+ * @return previous polygon fill mode on success, 0 on failure
+ */
+
+INT32 gdi_SetPolyFillMode(HGDI_DC hdc, INT32 iPolyFillMode)
+{
+	INT32 previousPolyFillMode = hdc->polyFillMode;
+
+	if ((iPolyFillMode != GDI_FILL_ALTERNATE) && (iPolyFillMode != GDI_FILL_WINDING))
+		return 0;
+
+	hdc->polyFillMode = iPolyFillMode;
+	return previousPolyFillMode;
+}
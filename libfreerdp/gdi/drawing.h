@@ -32,11 +32,14 @@ extern "C"
 
 	FREERDP_LOCAL INT32 gdi_GetROP2(HGDI_DC hdc);
 	FREERDP_LOCAL INT32 gdi_SetROP2(HGDI_DC hdc, INT32 fnDrawMode);
+	FREERDP_LOCAL BOOL gdi_rop2_color(UINT32 rop, BYTE* pixelPtr, UINT32 pen, UINT32 format);
 	FREERDP_LOCAL UINT32 gdi_GetBkColor(HGDI_DC hdc);
 	FREERDP_LOCAL UINT32 gdi_SetBkColor(HGDI_DC hdc, UINT32 crColor);
 	FREERDP_LOCAL UINT32 gdi_GetBkMode(HGDI_DC hdc);
 	FREERDP_LOCAL INT32 gdi_SetBkMode(HGDI_DC hdc, INT32 iBkMode);
 	FREERDP_LOCAL UINT32 gdi_SetTextColor(HGDI_DC hdc, UINT32 crColor);
+	FREERDP_LOCAL INT32 gdi_GetPolyFillMode(HGDI_DC hdc);
+	FREERDP_LOCAL INT32 gdi_SetPolyFillMode(HGDI_DC hdc, INT32 iPolyFillMode);
 
 #ifdef __cplusplus
 }
@@ -48,6 +48,9 @@
 
 #define TAG FREERDP_TAG("gdi")
 
+/* A growing primary buffer gets this fraction as headroom for further growth */
+#define GDI_PRIMARY_HEADROOM 8
+
 /* Ternary Raster Operation Table */
 typedef struct
 {
@@ -564,29 +567,18 @@ static BOOL gdi_dstblt(rdpContext* context, const DSTBLT_ORDER* dstblt)
 	                  dstblt->nHeight, NULL, 0, 0, gdi_rop3_code(dstblt->bRop), &gdi->palette);
 }
 
-static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
+/**
+ * Creates the gdi brush of an order brush, hatch and pattern brushes are expanded to an 8x8
+ * bitmap in the drawing format returned in hBmp, which the caller frees with the brush.
+ */
+static HGDI_BRUSH gdi_create_order_brush(rdpGdi* gdi, const rdpBrush* brush, UINT32 foreColor,
+                                         UINT32 backColor, HGDI_BITMAP* hBmp)
 {
-	const rdpBrush* brush = &patblt->brush;
-	UINT32 foreColor;
-	UINT32 backColor;
-	UINT32 originalColor;
-	HGDI_BRUSH originalBrush, hbrush = NULL;
-	rdpGdi* gdi = context->gdi;
-	BOOL ret = FALSE;
-	const DWORD rop = gdi_rop3_code(patblt->bRop);
-	INT32 nXSrc = 0;
-	INT32 nYSrc = 0;
 	BYTE data[8 * 8 * 4];
-	HGDI_BITMAP hBmp = NULL;
-
-	if (!gdi_decode_color(gdi, patblt->foreColor, &foreColor, NULL))
-		return FALSE;
+	HGDI_BRUSH hbrush = NULL;
+	rdpContext* context = gdi->context;
 
-	if (!gdi_decode_color(gdi, patblt->backColor, &backColor, NULL))
-		return FALSE;
-
-	originalColor = gdi_SetTextColor(gdi->drawing->hdc, foreColor);
-	originalBrush = gdi->drawing->hdc->brush;
+	*hBmp = NULL;
 
 	switch (brush->style)
 	{
@@ -601,14 +593,14 @@ static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 
 			if (!freerdp_image_copy_from_monochrome(data, gdi->drawing->hdc->format, 0, 0, 0, 8, 8,
 			                                        hatched, backColor, foreColor, &gdi->palette))
-				goto out_error;
+				return NULL;
 
-			hBmp = gdi_CreateBitmapEx(8, 8, gdi->drawing->hdc->format, 0, data, NULL);
+			*hBmp = gdi_CreateBitmapEx(8, 8, gdi->drawing->hdc->format, 0, data, NULL);
 
-			if (!hBmp)
-				goto out_error;
+			if (!*hBmp)
+				return NULL;
 
-			hbrush = gdi_CreateHatchBrush(hBmp);
+			hbrush = gdi_CreateHatchBrush(*hBmp);
 		}
 		break;
 
@@ -627,22 +619,22 @@ static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 
 				if (!freerdp_image_copy(data, gdi->drawing->hdc->format, 0, 0, 0, 8, 8, brush->data,
 				                        brushFormat, 0, 0, 0, &gdi->palette, FREERDP_FLIP_NONE))
-					goto out_error;
+					return NULL;
 			}
 			else
 			{
 				if (!freerdp_image_copy_from_monochrome(data, gdi->drawing->hdc->format, 0, 0, 0, 8,
 				                                        8, brush->data, backColor, foreColor,
 				                                        &gdi->palette))
-					goto out_error;
+					return NULL;
 			}
 
-			hBmp = gdi_CreateBitmapEx(8, 8, gdi->drawing->hdc->format, 0, data, NULL);
+			*hBmp = gdi_CreateBitmapEx(8, 8, gdi->drawing->hdc->format, 0, data, NULL);
 
-			if (!hBmp)
-				goto out_error;
+			if (!*hBmp)
+				return NULL;
 
-			hbrush = gdi_CreatePatternBrush(hBmp);
+			hbrush = gdi_CreatePatternBrush(*hBmp);
 		}
 		break;
 
@@ -655,12 +647,42 @@ static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
 	{
 		hbrush->nXOrg = brush->x;
 		hbrush->nYOrg = brush->y;
+	}
+
+	return hbrush;
+}
+
+static BOOL gdi_patblt(rdpContext* context, PATBLT_ORDER* patblt)
+{
+	const rdpBrush* brush = &patblt->brush;
+	UINT32 foreColor;
+	UINT32 backColor;
+	UINT32 originalColor;
+	HGDI_BRUSH originalBrush, hbrush = NULL;
+	rdpGdi* gdi = context->gdi;
+	BOOL ret = FALSE;
+	const DWORD rop = gdi_rop3_code(patblt->bRop);
+	INT32 nXSrc = 0;
+	INT32 nYSrc = 0;
+	HGDI_BITMAP hBmp = NULL;
+
+	if (!gdi_decode_color(gdi, patblt->foreColor, &foreColor, NULL))
+		return FALSE;
+
+	if (!gdi_decode_color(gdi, patblt->backColor, &backColor, NULL))
+		return FALSE;
+
+	originalColor = gdi_SetTextColor(gdi->drawing->hdc, foreColor);
+	originalBrush = gdi->drawing->hdc->brush;
+	hbrush = gdi_create_order_brush(gdi, brush, foreColor, backColor, &hBmp);
+
+	if (hbrush)
+	{
 		gdi->drawing->hdc->brush = hbrush;
 		ret = gdi_BitBlt(gdi->drawing->hdc, patblt->nLeftRect, patblt->nTopRect, patblt->nWidth,
 		                 patblt->nHeight, gdi->primary->hdc, nXSrc, nYSrc, rop, &gdi->palette);
 	}
 
-out_error:
 	gdi_DeleteObject((HGDIOBJECT)hBmp);
 	gdi_DeleteObject((HGDIOBJECT)hbrush);
 	gdi->drawing->hdc->brush = originalBrush;
@@ -944,28 +966,199 @@ out_fail:
 	return ret;
 }
 
+/**
+ * Fills order polygons and ellipses on the drawing surface with a brush or outlines them with a
+ * pen. The device context state the shapes use is restored afterwards.
+ */
+static BOOL gdi_draw_shape(rdpGdi* gdi, UINT32 bRop2, UINT32 fillMode, HGDI_BRUSH hbrush,
+                           HGDI_PEN hpen, UINT32 bkMode, UINT32 bkColor, const GDI_POINT* points,
+                           int numPoints, const GDI_RECT* ellipse)
+{
+	BOOL ret;
+	HGDI_DC hdc = gdi->drawing->hdc;
+	const HGDI_BRUSH originalBrush = hdc->brush;
+	const HGDI_PEN originalPen = hdc->pen;
+	const INT32 originalRop2 = gdi_GetROP2(hdc);
+	const INT32 originalFillMode = gdi_GetPolyFillMode(hdc);
+	const UINT32 originalBkMode = gdi_GetBkMode(hdc);
+	const UINT32 originalBkColor = gdi_SetBkColor(hdc, bkColor);
+
+	hdc->brush = hbrush;
+	hdc->pen = hpen;
+	gdi_SetROP2(hdc, (INT32)bRop2);
+	gdi_SetBkMode(hdc, (INT32)bkMode);
+
+	if (points && !gdi_SetPolyFillMode(hdc, (INT32)fillMode))
+		WLog_WARN(TAG, "unknown polygon fill mode %" PRIu32 ", using alternate", fillMode);
+
+	if (points)
+		ret = gdi_Polygon(hdc, (GDI_POINT*)points, numPoints);
+	else
+		ret = gdi_Ellipse(hdc, ellipse->left, ellipse->top, ellipse->right, ellipse->bottom);
+
+	gdi_SetBkColor(hdc, originalBkColor);
+	hdc->bkMode = (INT32)originalBkMode;
+	gdi_SetPolyFillMode(hdc, originalFillMode);
+	gdi_SetROP2(hdc, originalRop2);
+	hdc->pen = originalPen;
+	hdc->brush = originalBrush;
+	return ret;
+}
+
+static BOOL gdi_order_brush_is_monochrome(const rdpBrush* brush)
+{
+	return (brush->style == GDI_BS_HATCHED) ||
+	       ((brush->style == GDI_BS_PATTERN) && (brush->bpp <= 1));
+}
+
+/* Polygon orders send the start point and numPoints deltas to the following points */
+static GDI_POINT* gdi_polygon_points(INT32 xStart, INT32 yStart, const DELTA_POINT* deltas,
+                                     UINT32 numPoints)
+{
+	UINT32 i;
+	GDI_POINT* points = calloc(numPoints + 1, sizeof(GDI_POINT));
+
+	if (!points)
+		return NULL;
+
+	points[0].x = xStart;
+	points[0].y = yStart;
+
+	for (i = 0; i < numPoints; i++)
+	{
+		points[i + 1].x = points[i].x + deltas[i].x;
+		points[i + 1].y = points[i].y + deltas[i].y;
+	}
+
+	return points;
+}
+
 static BOOL gdi_polygon_sc(rdpContext* context, const POLYGON_SC_ORDER* polygon_sc)
 {
-	WLog_WARN(TAG, "%s: not implemented", __FUNCTION__);
-	return FALSE;
+	UINT32 color;
+	BOOL ret = FALSE;
+	HGDI_BRUSH hbrush = NULL;
+	GDI_POINT* points = NULL;
+	rdpGdi* gdi = context->gdi;
+
+	if (!gdi_decode_color(gdi, polygon_sc->brushColor, &color, NULL))
+		return FALSE;
+
+	points = gdi_polygon_points(polygon_sc->xStart, polygon_sc->yStart, polygon_sc->points,
+	                            polygon_sc->numPoints);
+	hbrush = gdi_CreateSolidBrush(color);
+
+	if (points && hbrush)
+		ret = gdi_draw_shape(gdi, polygon_sc->bRop2, polygon_sc->fillMode, hbrush, NULL,
+		                     GDI_OPAQUE, 0, points, (int)polygon_sc->numPoints + 1, NULL);
+
+	gdi_DeleteObject((HGDIOBJECT)hbrush);
+	free(points);
+	return ret;
 }
 
 static BOOL gdi_polygon_cb(rdpContext* context, POLYGON_CB_ORDER* polygon_cb)
 {
-	WLog_WARN(TAG, "%s: not implemented", __FUNCTION__);
-	return FALSE;
+	UINT32 foreColor;
+	UINT32 backColor;
+	BOOL ret = FALSE;
+	HGDI_BRUSH hbrush = NULL;
+	HGDI_BITMAP hBmp = NULL;
+	GDI_POINT* points = NULL;
+	rdpGdi* gdi = context->gdi;
+	UINT32 bkMode = GDI_OPAQUE;
+
+	if (!gdi_decode_color(gdi, polygon_cb->foreColor, &foreColor, NULL))
+		return FALSE;
+
+	if (!gdi_decode_color(gdi, polygon_cb->backColor, &backColor, NULL))
+		return FALSE;
+
+	if ((polygon_cb->backMode == BACKMODE_TRANSPARENT) &&
+	    gdi_order_brush_is_monochrome(&polygon_cb->brush) && (foreColor != backColor))
+		bkMode = GDI_TRANSPARENT;
+
+	points = gdi_polygon_points(polygon_cb->xStart, polygon_cb->yStart, polygon_cb->points,
+	                            polygon_cb->numPoints);
+	hbrush = gdi_create_order_brush(gdi, &polygon_cb->brush, foreColor, backColor, &hBmp);
+
+	if (points && hbrush)
+		ret = gdi_draw_shape(gdi, polygon_cb->bRop2, polygon_cb->fillMode, hbrush, NULL, bkMode,
+		                     backColor, points, (int)polygon_cb->numPoints + 1, NULL);
+
+	gdi_DeleteObject((HGDIOBJECT)hBmp);
+	gdi_DeleteObject((HGDIOBJECT)hbrush);
+	free(points);
+	return ret;
 }
 
+/* A fillMode of 0 draws the outline of the ellipse, any other the filled ellipse */
 static BOOL gdi_ellipse_sc(rdpContext* context, const ELLIPSE_SC_ORDER* ellipse_sc)
 {
-	WLog_WARN(TAG, "%s: not implemented", __FUNCTION__);
-	return FALSE;
+	UINT32 color;
+	BOOL ret = FALSE;
+	HGDI_PEN hpen = NULL;
+	HGDI_BRUSH hbrush = NULL;
+	rdpGdi* gdi = context->gdi;
+	GDI_RECT rect = { 0 };
+
+	if (!gdi_decode_color(gdi, ellipse_sc->color, &color, NULL))
+		return FALSE;
+
+	rect.left = ellipse_sc->leftRect;
+	rect.top = ellipse_sc->topRect;
+	rect.right = ellipse_sc->rightRect;
+	rect.bottom = ellipse_sc->bottomRect;
+
+	if (ellipse_sc->fillMode == 0)
+		hpen = gdi_CreatePen(GDI_PS_SOLID, 1, color, gdi->drawing->hdc->format, &gdi->palette);
+	else
+		hbrush = gdi_CreateSolidBrush(color);
+
+	if (hpen || hbrush)
+		ret = gdi_draw_shape(gdi, ellipse_sc->bRop2, GDI_FILL_ALTERNATE, hbrush, hpen,
+		                     GDI_OPAQUE, 0, NULL, 0, &rect);
+
+	gdi_DeleteObject((HGDIOBJECT)hbrush);
+	gdi_DeleteObject((HGDIOBJECT)hpen);
+	return ret;
 }
 
 static BOOL gdi_ellipse_cb(rdpContext* context, const ELLIPSE_CB_ORDER* ellipse_cb)
 {
-	WLog_WARN(TAG, "%s: not implemented", __FUNCTION__);
-	return FALSE;
+	UINT32 foreColor;
+	UINT32 backColor;
+	BOOL ret = FALSE;
+	HGDI_BRUSH hbrush = NULL;
+	HGDI_BITMAP hBmp = NULL;
+	rdpGdi* gdi = context->gdi;
+	GDI_RECT rect = { 0 };
+	UINT32 bkMode = GDI_OPAQUE;
+
+	if (!gdi_decode_color(gdi, ellipse_cb->foreColor, &foreColor, NULL))
+		return FALSE;
+
+	if (!gdi_decode_color(gdi, ellipse_cb->backColor, &backColor, NULL))
+		return FALSE;
+
+	/* Like PolygonCB, the top bit of bRop2 selects a transparent brush background */
+	if ((ellipse_cb->bRop2 & 0x80) && gdi_order_brush_is_monochrome(&ellipse_cb->brush) &&
+	    (foreColor != backColor))
+		bkMode = GDI_TRANSPARENT;
+
+	rect.left = ellipse_cb->leftRect;
+	rect.top = ellipse_cb->topRect;
+	rect.right = ellipse_cb->rightRect;
+	rect.bottom = ellipse_cb->bottomRect;
+	hbrush = gdi_create_order_brush(gdi, &ellipse_cb->brush, foreColor, backColor, &hBmp);
+
+	if (hbrush)
+		ret = gdi_draw_shape(gdi, ellipse_cb->bRop2 & 0x1F, GDI_FILL_ALTERNATE, hbrush, NULL,
+		                     bkMode, backColor, NULL, 0, &rect);
+
+	gdi_DeleteObject((HGDIOBJECT)hBmp);
+	gdi_DeleteObject((HGDIOBJECT)hbrush);
+	return ret;
 }
 
 static BOOL gdi_frame_marker(rdpContext* context, const FRAME_MARKER_ORDER* frameMarker)
@@ -1178,6 +1371,7 @@ static BOOL gdi_init_primary(rdpGdi* gdi, UINT32 stride, UINT32 format, BYTE* bu
 	gdi_SelectObject(gdi->primary->hdc, (HGDIOBJECT)gdi->primary->bitmap);
 	gdi->primary->org_bitmap = NULL;
 	gdi->primary_buffer = gdi->primary->bitmap->data;
+	gdi->primary_size = buffer ? 0 : 1ull * gdi->stride * gdi->height;
 
 	if (!(gdi->primary->hdc->hwnd = (HGDI_WND)calloc(1, sizeof(GDI_WND))))
 		goto fail_hwnd;
@@ -1209,6 +1403,72 @@ fail_primary:
 	return FALSE;
 }
 
+/**
+ * Resizes an internally allocated primary buffer in place. Smaller sizes keep the allocation
+ * and only clip the view, larger ones reallocate with headroom and keep the current contents.
+ * Intermediate sizes of a window drag do not reallocate the framebuffer each time.
+ */
+static BOOL gdi_resize_primary(rdpGdi* gdi, UINT32 width, UINT32 height)
+{
+	UINT32 y;
+	const HGDI_BITMAP old = gdi->primary->bitmap;
+	const UINT32 bpp = GetBytesPerPixel(gdi->dstFormat);
+	UINT32 capacityWidth = old->scanline / bpp;
+	UINT32 capacityHeight = (UINT32)(gdi->primary_size / old->scanline);
+
+	if ((width > capacityWidth) || (height > capacityHeight))
+	{
+		BYTE* data;
+		HGDI_BITMAP bitmap;
+		UINT32 stride;
+		size_t size;
+		const UINT32 copyWidth = MIN(width, (UINT32)old->width);
+		const UINT32 copyHeight = MIN(height, (UINT32)old->height);
+
+		/* Both directions get headroom, a drag usually grows both of them */
+		capacityWidth = MAX(capacityWidth, width + width / GDI_PRIMARY_HEADROOM);
+		capacityHeight = MAX(capacityHeight, height + height / GDI_PRIMARY_HEADROOM);
+
+		stride = (capacityWidth * bpp + 15) & ~15u;
+		size = 1ull * stride * capacityHeight;
+
+		if (!(data = _aligned_malloc(size, 16)))
+			return FALSE;
+
+		ZeroMemory(data, size);
+
+		for (y = 0; y < copyHeight; y++)
+			CopyMemory(&data[1ull * y * stride], &old->data[1ull * y * old->scanline],
+			           1ull * copyWidth * bpp);
+
+		if (!(bitmap = gdi_CreateBitmapEx(width, height, gdi->dstFormat, stride, data,
+		                                  _aligned_free)))
+		{
+			_aligned_free(data);
+			return FALSE;
+		}
+
+		gdi_SelectObject(gdi->primary->hdc, (HGDIOBJECT)bitmap);
+		gdi_DeleteObject((HGDIOBJECT)old);
+		gdi->primary->bitmap = bitmap;
+		gdi->primary_buffer = data;
+		gdi->primary_size = size;
+		gdi->stride = stride;
+	}
+	else
+	{
+		old->width = (INT32)width;
+		old->height = (INT32)height;
+	}
+
+	gdi->width = (INT32)width;
+	gdi->height = (INT32)height;
+	gdi_SetNullClipRgn(gdi->primary->hdc);
+	gdi->primary->hdc->hwnd->invalid->null = TRUE;
+	gdi->primary->hdc->hwnd->ninvalid = 0;
+	return TRUE;
+}
+
 BOOL gdi_resize(rdpGdi* gdi, UINT32 width, UINT32 height)
 {
 	return gdi_resize_ex(gdi, width, height, 0, 0, NULL, NULL);
@@ -1227,6 +1487,10 @@ BOOL gdi_resize_ex(rdpGdi* gdi, UINT32 width, UINT32 height, UINT32 stride, UINT
 	    (!buffer || (gdi->primary_buffer == buffer)))
 		return TRUE;
 
+	if (!buffer && (stride == 0) && ((format == 0) || (format == gdi->dstFormat)) &&
+	    (gdi->primary_size > 0) && (width > 0) && (height > 0))
+		return gdi_resize_primary(gdi, width, height);
+
 	if (gdi->drawing == gdi->primary)
 		gdi->drawing = NULL;
 
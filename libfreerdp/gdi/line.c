@@ -37,116 +37,162 @@
 #include "clipping.h"
 #include "line.h"
 
-/**
- * Draw a line from the current position to the given position.\n
- * @msdn{dd145029}
- * @param hdc device context
- * @param nXEnd ending x position
- * @param nYEnd ending y position
- * @return nonzero if successful, 0 otherwise
- */
-static BOOL gdi_rop_color(UINT32 rop, BYTE* pixelPtr, UINT32 pen, UINT32 format)
+typedef struct
 {
-	const UINT32 srcPixel = ReadColor(pixelPtr, format);
-	UINT32 dstPixel;
+	BYTE* data;
+	UINT32 format;
+	UINT32 bpp;
+	INT32 stride;
+	INT32 rop2;
+	UINT32 pen;
+	BYTE penPixel[4];
+} gdiLine;
 
-	switch (rop)
-	{
-		case GDI_R2_BLACK: /* LineTo_BLACK */
-			dstPixel = FreeRDPGetColor(format, 0, 0, 0, 0xFF);
-			break;
+/* Writes count pixels starting at dst, step bytes apart */
+static void gdi_line_span(const gdiLine* line, BYTE* dst, INT32 step, UINT32 count)
+{
+	UINT32 i;
 
-		case GDI_R2_NOTMERGEPEN: /* LineTo_NOTMERGEPEN */
-			dstPixel = ~(srcPixel | pen);
-			break;
+	if (count == 0)
+		return;
 
-		case GDI_R2_MASKNOTPEN: /* LineTo_MASKNOTPEN */
-			dstPixel = srcPixel & ~pen;
-			break;
+	if (line->rop2 != GDI_R2_COPYPEN)
+	{
+		for (i = 0; i < count; i++)
+		{
+			gdi_rop2_color(line->rop2, dst, line->pen, line->format);
+			dst += step;
+		}
 
-		case GDI_R2_NOTCOPYPEN: /* LineTo_NOTCOPYPEN */
-			dstPixel = ~pen;
-			break;
+		return;
+	}
 
-		case GDI_R2_MASKPENNOT: /* LineTo_MASKPENNOT */
-			dstPixel = pen & ~srcPixel;
-			break;
+	if (step == (INT32)line->bpp)
+	{
+		/* Horizontal runs are filled by doubling the already written pixels */
+		const size_t size = 1ULL * count * line->bpp;
+		size_t filled = line->bpp;
+		memcpy(dst, line->penPixel, line->bpp);
 
-		case GDI_R2_NOT: /* LineTo_NOT */
-			dstPixel = ~srcPixel;
-			break;
+		while (filled < size)
+		{
+			const size_t copy = MIN(filled, size - filled);
+			memcpy(&dst[filled], dst, copy);
+			filled += copy;
+		}
 
-		case GDI_R2_XORPEN: /* LineTo_XORPEN */
-			dstPixel = srcPixel ^ pen;
-			break;
+		return;
+	}
 
-		case GDI_R2_NOTMASKPEN: /* LineTo_NOTMASKPEN */
-			dstPixel = ~(srcPixel & pen);
-			break;
+	if (line->bpp == 4)
+	{
+		for (i = 0; i < count; i++)
+		{
+			memcpy(dst, line->penPixel, 4);
+			dst += step;
+		}
+	}
+	else
+	{
+		for (i = 0; i < count; i++)
+		{
+			memcpy(dst, line->penPixel, line->bpp);
+			dst += step;
+		}
+	}
+}
 
-		case GDI_R2_MASKPEN: /* LineTo_MASKPEN */
-			dstPixel = srcPixel & pen;
-			break;
+/* Clips the half open run [*a, b) walked in direction s against [min, max] */
+static UINT32 gdi_line_clip_run(INT32* a, INT32 b, INT32 s, INT32 min, INT32 max)
+{
+	INT32 first = *a;
+	INT32 last = b - s;
 
-		case GDI_R2_NOTXORPEN: /* LineTo_NOTXORPEN */
-			dstPixel = ~(srcPixel ^ pen);
-			break;
+	if (s < 0)
+	{
+		const INT32 tmp = first;
+		first = last;
+		last = tmp;
+	}
 
-		case GDI_R2_NOP: /* LineTo_NOP */
-			dstPixel = srcPixel;
-			break;
+	first = MAX(first, min);
+	last = MIN(last, max);
 
-		case GDI_R2_MERGENOTPEN: /* LineTo_MERGENOTPEN */
-			dstPixel = srcPixel | ~pen;
-			break;
+	if (first > last)
+		return 0;
 
-		case GDI_R2_COPYPEN: /* LineTo_COPYPEN */
-			dstPixel = pen;
-			break;
+	*a = (s < 0) ? last : first;
+	return (UINT32)(last - first + 1);
+}
 
-		case GDI_R2_MERGEPENNOT: /* LineTo_MERGEPENNOT */
-			dstPixel = srcPixel | ~pen;
-			break;
+/**
+ * Bresenham with a running pixel pointer. The bounds are only checked when the line leaves the
+ * clipping box, which callers determine once per line.
+ */
+static void gdi_line_bresenham(const gdiLine* line, INT32 x1, INT32 y1, INT32 x2, INT32 y2,
+                               INT32 bx1, INT32 by1, INT32 bx2, INT32 by2, BOOL clip)
+{
+	INT32 x = x1;
+	INT32 y = y1;
+	const INT32 dx = (x1 > x2) ? x1 - x2 : x2 - x1;
+	const INT32 dy = (y1 > y2) ? y1 - y2 : y2 - y1;
+	const INT32 sx = (x1 < x2) ? 1 : -1;
+	const INT32 sy = (y1 < y2) ? 1 : -1;
+	const SSIZE_T xstep = sx * (SSIZE_T)line->bpp;
+	const SSIZE_T ystep = sy * (SSIZE_T)line->stride;
+	SSIZE_T offset = y * (SSIZE_T)line->stride + x * (SSIZE_T)line->bpp;
+	INT32 e = dx - dy;
+
+	while ((x != x2) || (y != y2))
+	{
+		const INT32 e2 = 2 * e;
 
-		case GDI_R2_MERGEPEN: /* LineTo_MERGEPEN */
-			dstPixel = srcPixel | pen;
-			break;
+		if (!clip || ((x >= bx1) && (x <= bx2) && (y >= by1) && (y <= by2)))
+		{
+			BYTE* pixel = &line->data[offset];
 
-		case GDI_R2_WHITE: /* LineTo_WHITE */
-			dstPixel = FreeRDPGetColor(format, 0xFF, 0xFF, 0xFF, 0xFF);
-			break;
+			if (line->rop2 == GDI_R2_COPYPEN)
+				memcpy(pixel, line->penPixel, line->bpp);
+			else
+				gdi_rop2_color(line->rop2, pixel, line->pen, line->format);
+		}
 
-		default:
-			return FALSE;
-	}
+		if (e2 > -dy)
+		{
+			e -= dy;
+			x += sx;
+			offset += xstep;
+		}
 
-	return WriteColor(pixelPtr, format, dstPixel);
+		if (e2 < dx)
+		{
+			e += dx;
+			y += sy;
+			offset += ystep;
+		}
+	}
 }
 
+/**
+ * Draw a line from the current position to the given position.\n
+ * @msdn{dd145029}
+ * @param hdc device context
+ * @param nXEnd ending x position
+ * @param nYEnd ending y position
+ * @return nonzero if successful, 0 otherwise
+ */
 BOOL gdi_LineTo(HGDI_DC hdc, UINT32 nXEnd, UINT32 nYEnd)
 {
-	INT32 x, y;
 	INT32 x1, y1;
 	INT32 x2, y2;
-	INT32 e, e2;
-	INT32 dx, dy;
-	INT32 sx, sy;
 	INT32 bx1, by1;
 	INT32 bx2, by2;
+	gdiLine line;
 	HGDI_BITMAP bmp;
-	UINT32 pen;
-	INT32 rop2 = gdi_GetROP2(hdc);
 	x1 = hdc->pen->posX;
 	y1 = hdc->pen->posY;
 	x2 = nXEnd;
 	y2 = nYEnd;
-	dx = (x1 > x2) ? x1 - x2 : x2 - x1;
-	dy = (y1 > y2) ? y1 - y2 : y2 - y1;
-	sx = (x1 < x2) ? 1 : -1;
-	sy = (y1 < y2) ? 1 : -1;
-	e = dx - dy;
-	x = x1;
-	y = y1;
 	bmp = (HGDI_BITMAP)hdc->selectedObject;
 
 	if (hdc->clip->null)
@@ -172,36 +218,59 @@ BOOL gdi_LineTo(HGDI_DC hdc, UINT32 nXEnd, UINT32 nYEnd)
 	if (!gdi_InvalidateRegion(hdc, bx1, by1, bx2 - bx1 + 1, by2 - by1 + 1))
 		return FALSE;
 
-	pen = gdi_GetPenColor(hdc->pen, bmp->format);
+	line.data = bmp->data;
+	line.format = bmp->format;
+	line.bpp = GetBytesPerPixel(bmp->format);
+	line.stride = (INT32)bmp->scanline;
+	line.rop2 = gdi_GetROP2(hdc);
+	line.pen = gdi_GetPenColor(hdc->pen, bmp->format);
 
-	while (1)
+	if ((line.bpp == 0) || (line.bpp > sizeof(line.penPixel)))
+		return FALSE;
+
+	if (line.rop2 == GDI_R2_NOP)
+		return TRUE;
+
+	if (line.rop2 == GDI_R2_COPYPEN)
+		WriteColor(line.penPixel, line.format, line.pen);
+
+	if (y1 == y2)
 	{
-		if (!(x == x2 && y == y2))
-		{
-			if ((x >= bx1 && x <= bx2) && (y >= by1 && y <= by2))
-			{
-				BYTE* pixel = gdi_GetPointer(bmp, x, y);
-				gdi_rop_color(rop2, pixel, pen, bmp->format);
-			}
-		}
-		else
-		{
-			break;
-		}
+		const INT32 sx = (x1 < x2) ? 1 : -1;
+		const UINT32 count = gdi_line_clip_run(&x1, x2, sx, bx1, bx2);
 
-		e2 = 2 * e;
+		if ((y1 < by1) || (y1 > by2) || (count == 0))
+			return TRUE;
 
-		if (e2 > -dy)
-		{
-			e -= dy;
-			x += sx;
-		}
+		if (sx < 0)
+			x1 -= (INT32)count - 1;
 
-		if (e2 < dx)
-		{
-			e += dx;
-			y += sy;
-		}
+		gdi_line_span(&line, &line.data[y1 * line.stride + x1 * (INT32)line.bpp],
+		              (INT32)line.bpp, count);
+	}
+	else if (x1 == x2)
+	{
+		const INT32 sy = (y1 < y2) ? 1 : -1;
+		const UINT32 count = gdi_line_clip_run(&y1, y2, sy, by1, by2);
+
+		if ((x1 < bx1) || (x1 > bx2) || (count == 0))
+			return TRUE;
+
+		gdi_line_span(&line, &line.data[y1 * line.stride + x1 * (INT32)line.bpp],
+		              sy * line.stride, count);
+	}
+	else
+	{
+		const INT32 minX = MIN(x1, x2);
+		const INT32 maxX = MAX(x1, x2);
+		const INT32 minY = MIN(y1, y2);
+		const INT32 maxY = MAX(y1, y2);
+
+		if ((maxX < bx1) || (minX > bx2) || (maxY < by1) || (minY > by2))
+			return TRUE;
+
+		gdi_line_bresenham(&line, x1, y1, x2, y2, bx1, by1, bx2, by2,
+		                   (minX < bx1) || (maxX > bx2) || (minY < by1) || (maxY > by2));
 	}
 
 	return TRUE;
@@ -31,86 +31,429 @@
 #include <freerdp/gdi/gdi.h>
 
 #include <freerdp/gdi/bitmap.h>
+#include <freerdp/gdi/pen.h>
 #include <freerdp/gdi/region.h>
 #include <freerdp/gdi/shape.h>
 
 #include <freerdp/log.h>
 
 #include "clipping.h"
+#include "drawing.h"
+#include "line.h"
 #include "../gdi/gdi.h"
 
 #define TAG FREERDP_TAG("gdi.shape")
 
-static void Ellipse_Bresenham(HGDI_DC hdc, int x1, int y1, int x2, int y2)
+/* Scanline fills of polygons and ellipses with a brush (or a pen color) and the current ROP2 */
+typedef struct
 {
-	INT32 e, e2;
-	INT32 dx, dy;
-	INT32 a, b, c;
-	a = (x1 < x2) ? x2 - x1 : x1 - x2;
-	b = (y1 < y2) ? y2 - y1 : y1 - y2;
-	c = b & 1;
-	dx = 4 * (1 - a) * b * b;
-	dy = 4 * (c + 1) * a * a;
-	e = dx + dy + c * a * a;
-
-	if (x1 > x2)
+	HGDI_DC hdc;
+	HGDI_BITMAP bmp;
+	HGDI_BRUSH brush;
+	UINT32 color;
+	UINT32 bpp;
+	INT32 rop2;
+	BOOL transparent;
+	INT32 left;
+	INT32 top;
+	INT32 right;
+	INT32 bottom;
+} gdiFill;
+
+static BOOL gdi_fill_init(gdiFill* fill, HGDI_DC hdc, HGDI_BRUSH brush, UINT32 color)
+{
+	HGDI_BITMAP bmp = (HGDI_BITMAP)hdc->selectedObject;
+
+	if (!bmp)
+		return FALSE;
+
+	fill->hdc = hdc;
+	fill->bmp = bmp;
+	fill->brush = NULL;
+	fill->color = color;
+	fill->bpp = GetBytesPerPixel(hdc->format);
+	fill->rop2 = gdi_GetROP2(hdc);
+	fill->transparent = FALSE;
+	fill->left = 0;
+	fill->top = 0;
+	fill->right = bmp->width;
+	fill->bottom = bmp->height;
+
+	if (brush)
+	{
+		switch (brush->style)
+		{
+			case GDI_BS_SOLID:
+				fill->color = brush->color;
+				break;
+
+			case GDI_BS_HATCHED:
+			case GDI_BS_PATTERN:
+				if (!brush->pattern || (brush->pattern->width == 0) ||
+				    (brush->pattern->height == 0))
+					return FALSE;
+
+				fill->brush = brush;
+				/* Background pixels of hatch and monochrome brushes are not drawn */
+				fill->transparent = (hdc->bkMode == GDI_TRANSPARENT);
+				break;
+
+			default:
+				return FALSE;
+		}
+	}
+
+	if (!hdc->clip->null)
 	{
-		x1 = x2;
-		x2 += a;
+		fill->left = MAX(fill->left, hdc->clip->x);
+		fill->top = MAX(fill->top, hdc->clip->y);
+		fill->right = MIN(fill->right, hdc->clip->x + hdc->clip->w);
+		fill->bottom = MIN(fill->bottom, hdc->clip->y + hdc->clip->h);
 	}
 
-	if (y1 > y2)
-		y1 = y2;
+	return TRUE;
+}
+
+static BOOL gdi_fill_pattern_color(const gdiFill* fill, INT32 x, INT32 y, UINT32* color)
+{
+	const HGDI_BRUSH brush = fill->brush;
+	const HGDI_BITMAP pattern = brush->pattern;
+	const UINT32 px = (x + pattern->width - (brush->nXOrg % pattern->width)) % pattern->width;
+	const UINT32 py = (y + pattern->height - (brush->nYOrg % pattern->height)) % pattern->height;
+	const BYTE* src =
+	    &pattern->data[py * pattern->scanline + px * GetBytesPerPixel(pattern->format)];
+	*color = ReadColor(src, pattern->format);
+
+	if (pattern->format != fill->hdc->format)
+		*color = FreeRDPConvertColor(*color, pattern->format, fill->hdc->format, NULL);
+
+	return !fill->transparent || (*color != fill->hdc->bkColor);
+}
+
+/* Fills the pixels [x1, x2) of row y */
+static void gdi_fill_span(const gdiFill* fill, INT32 y, INT32 x1, INT32 x2)
+{
+	INT32 x;
+	BYTE* dst;
+
+	if ((y < fill->top) || (y >= fill->bottom))
+		return;
+
+	x1 = MAX(x1, fill->left);
+	x2 = MIN(x2, fill->right);
+
+	if (x1 >= x2)
+		return;
 
-	y1 += (b + 1) / 2;
-	y2 = y1 - c;
-	a *= 8 * a;
-	c = 8 * b * b;
+	dst = &fill->bmp->data[1ULL * y * fill->bmp->scanline + 1ULL * x1 * fill->bpp];
 
-	do
+	if (!fill->brush && (fill->rop2 == GDI_R2_COPYPEN))
 	{
-		gdi_SetPixel(hdc, x2, y1, 0);
-		gdi_SetPixel(hdc, x1, y1, 0);
-		gdi_SetPixel(hdc, x1, y2, 0);
-		gdi_SetPixel(hdc, x2, y2, 0);
-		e2 = 2 * e;
+		const size_t size = 1ULL * (x2 - x1) * fill->bpp;
+		size_t filled = fill->bpp;
+		WriteColor(dst, fill->hdc->format, fill->color);
 
-		if (e2 >= dx)
+		while (filled < size)
 		{
-			x1++;
-			x2--;
-			e += dx += c;
+			const size_t copy = MIN(filled, size - filled);
+			memcpy(&dst[filled], dst, copy);
+			filled += copy;
 		}
 
-		if (e2 <= dy)
+		return;
+	}
+
+	for (x = x1; x < x2; x++)
+	{
+		UINT32 color = fill->color;
+
+		if (!fill->brush || gdi_fill_pattern_color(fill, x, y, &color))
+			gdi_rop2_color(fill->rop2, dst, color, fill->hdc->format);
+
+		dst += fill->bpp;
+	}
+}
+
+static BOOL gdi_fill_invalidate(const gdiFill* fill, INT32 left, INT32 top, INT32 right,
+                                INT32 bottom)
+{
+	left = MAX(left, fill->left);
+	top = MAX(top, fill->top);
+	right = MIN(right, fill->right);
+	bottom = MIN(bottom, fill->bottom);
+
+	if ((left >= right) || (top >= bottom))
+		return TRUE;
+
+	return gdi_InvalidateRegion(fill->hdc, left, top, right - left, bottom - top);
+}
+
+typedef struct
+{
+	INT64 x;
+	INT32 winding;
+} gdiCrossing;
+
+static int gdi_crossing_compare(const void* pva, const void* pvb)
+{
+	const gdiCrossing* a = (const gdiCrossing*)pva;
+	const gdiCrossing* b = (const gdiCrossing*)pvb;
+
+	if (a->x < b->x)
+		return -1;
+
+	return (a->x > b->x) ? 1 : 0;
+}
+
+/* Floor of a / b for b > 0 */
+static INT64 gdi_floor_div(INT64 a, INT64 b)
+{
+	const INT64 q = a / b;
+	return ((a % b) != 0 && (a < 0)) ? q - 1 : q;
+}
+
+/**
+ * Fills the interior of closed polygons sampled at pixel centers, so shared edges of adjacent
+ * polygons are drawn once: pixels on the left and top edges are inside, the ones on the right and
+ * bottom edges are not.
+ */
+static BOOL gdi_fill_polygons(const gdiFill* fill, const GDI_POINT* points, const int* counts,
+                              int nCount, INT32 fillMode)
+{
+	int i, j;
+	INT32 y;
+	size_t total = 0;
+	INT32 top = INT32_MAX;
+	INT32 bottom = INT32_MIN;
+	INT32 left = INT32_MAX;
+	INT32 right = INT32_MIN;
+	gdiCrossing* crossings;
+
+	for (i = 0; i < nCount; i++)
+	{
+		if (counts[i] < 0)
+			return FALSE;
+
+		for (j = 0; j < counts[i]; j++)
 		{
-			y1++;
-			y2--;
-			e += dy += a;
+			const GDI_POINT* pt = &points[total + (size_t)j];
+			top = MIN(top, pt->y);
+			bottom = MAX(bottom, pt->y);
+			left = MIN(left, pt->x);
+			right = MAX(right, pt->x);
 		}
-	} while (x1 <= x2);
 
-	while (y1 - y2 < b)
+		total += (size_t)counts[i];
+	}
+
+	if ((total < 3) || (top >= bottom))
+		return TRUE;
+
+	if (!gdi_fill_invalidate(fill, left, top, right, bottom))
+		return FALSE;
+
+	crossings = calloc(total, sizeof(gdiCrossing));
+
+	if (!crossings)
+		return FALSE;
+
+	top = MAX(top, fill->top);
+	bottom = MIN(bottom, fill->bottom);
+
+	for (y = top; y < bottom; y++)
 	{
-		gdi_SetPixel(hdc, x1 - 1, ++y1, 0);
-		gdi_SetPixel(hdc, x1 - 1, --y2, 0);
+		size_t k, n = 0;
+		INT32 winding = 0;
+		const GDI_POINT* poly = points;
+
+		for (i = 0; i < nCount; i++)
+		{
+			for (j = 0; j < counts[i]; j++)
+			{
+				const GDI_POINT* p0 = &poly[j];
+				const GDI_POINT* p1 = &poly[(j + 1) % counts[i]];
+				const GDI_POINT* a = (p0->y < p1->y) ? p0 : p1;
+				const GDI_POINT* b = (p0->y < p1->y) ? p1 : p0;
+				INT64 dy, num;
+
+				if ((p0->y == p1->y) || (y < a->y) || (y >= b->y))
+					continue;
+
+				/* First pixel whose center lies right of the edge crossing at y + 0.5 */
+				dy = b->y - a->y;
+				num = 2LL * a->x * dy + (2LL * (y - a->y) + 1) * (b->x - a->x) - dy;
+				crossings[n].x = -gdi_floor_div(-num, 2 * dy);
+				crossings[n].winding = (p0->y < p1->y) ? 1 : -1;
+				n++;
+			}
+
+			poly += counts[i];
+		}
+
+		qsort(crossings, n, sizeof(gdiCrossing), gdi_crossing_compare);
+
+		for (k = 0; k + 1 < n; k++)
+		{
+			BOOL inside;
+
+			if (fillMode == GDI_FILL_WINDING)
+			{
+				winding += crossings[k].winding;
+				inside = (winding != 0);
+			}
+			else
+				inside = ((k % 2) == 0);
+
+			if (inside)
+				gdi_fill_span(fill, y, (INT32)MAX(crossings[k].x, INT32_MIN),
+				              (INT32)MIN(crossings[k + 1].x, INT32_MAX));
+		}
 	}
+
+	free(crossings);
+	return TRUE;
 }
 
 /**
- * Draw an ellipse
+ * Pixels of an ellipse inscribed in a w x h box at the origin whose center is inside the ellipse,
+ * for row y: the span [*x1, *x2). Doubling the coordinates keeps the test in integers.
+ */
+static BOOL gdi_ellipse_inside(INT64 w, INT64 h, UINT64 limit, INT64 x)
+{
+	const INT64 X = 2 * x + 1 - w;
+	return (UINT64)(X * X) * (UINT64)(h * h) < limit;
+}
+
+static void gdi_ellipse_span(INT64 w, INT64 h, INT64 y, INT64* x1, INT64* x2)
+{
+	INT64 lo, hi;
+	UINT64 limit;
+	const INT64 Y = 2 * y + 1 - h;
+
+	*x1 = *x2 = 0;
+
+	if ((y < 0) || (y >= h))
+		return;
+
+	/* X = 2 * x + 1 - w is inside for X^2 * h^2 < w^2 * (h^2 - Y^2) */
+	limit = (UINT64)(w * w) * (UINT64)(h * h - Y * Y);
+	hi = (w - 1) / 2;
+
+	if (!gdi_ellipse_inside(w, h, limit, hi))
+		return;
+
+	/* Leftmost inside pixel, the span is symmetric */
+	lo = -1;
+
+	while (hi - lo > 1)
+	{
+		const INT64 mid = lo + (hi - lo) / 2;
+
+		if (gdi_ellipse_inside(w, h, limit, mid))
+			hi = mid;
+		else
+			lo = mid;
+	}
+
+	*x1 = hi;
+	*x2 = w - hi;
+}
+
+static BOOL gdi_draw_ellipse(HGDI_DC hdc, INT32 left, INT32 top, INT32 right, INT32 bottom)
+{
+	INT32 y;
+	gdiFill brush;
+	gdiFill pen;
+	BOOL fillBrush = FALSE;
+	BOOL fillPen = FALSE;
+	const INT64 w = (INT64)right - left;
+	const INT64 h = (INT64)bottom - top;
+
+	if ((w <= 0) || (h <= 0))
+		return TRUE;
+
+	if ((w > UINT16_MAX) || (h > UINT16_MAX))
+		return FALSE;
+
+	if (hdc->brush && (hdc->brush->style != GDI_BS_NULL))
+	{
+		if (!gdi_fill_init(&brush, hdc, hdc->brush, 0))
+			return FALSE;
+
+		fillBrush = TRUE;
+	}
+
+	if (hdc->pen && (hdc->pen->style != GDI_PS_NULL))
+	{
+		HGDI_BITMAP bmp = (HGDI_BITMAP)hdc->selectedObject;
+
+		if (!bmp || !gdi_fill_init(&pen, hdc, NULL, gdi_GetPenColor(hdc->pen, bmp->format)))
+			return FALSE;
+
+		fillPen = TRUE;
+	}
+
+	if (!fillBrush && !fillPen)
+		return TRUE;
+
+	if (!gdi_fill_invalidate(fillBrush ? &brush : &pen, left, top, right, bottom))
+		return FALSE;
+
+	for (y = 0; y < h; y++)
+	{
+		INT64 x1, x2, prev1, prev2, next1, next2, inner1, inner2;
+		gdi_ellipse_span(w, h, y, &x1, &x2);
+
+		if (x1 >= x2)
+			continue;
+
+		/* The outline is what is not covered by the rows above and below */
+		gdi_ellipse_span(w, h, y - 1, &prev1, &prev2);
+		gdi_ellipse_span(w, h, y + 1, &next1, &next2);
+		inner1 = MAX(x1 + 1, MAX(prev1, next1));
+		inner2 = MIN(x2 - 1, MIN(prev2, next2));
+
+		if ((prev1 >= prev2) || (next1 >= next2) || (inner1 >= inner2))
+			inner1 = inner2 = x2;
+
+		if (!fillPen)
+		{
+			inner1 = x1;
+			inner2 = x2;
+		}
+
+		if (fillBrush)
+			gdi_fill_span(&brush, top + (INT32)y, left + (INT32)inner1, left + (INT32)inner2);
+
+		if (fillPen)
+		{
+			gdi_fill_span(&pen, top + (INT32)y, left + (INT32)x1, left + (INT32)inner1);
+
+			if (inner2 > inner1)
+				gdi_fill_span(&pen, top + (INT32)y, left + (INT32)inner2, left + (INT32)x2);
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Draw an ellipse: the outline with the current pen, the interior with the current brush
  * @msdn{dd162510}
  * @param hdc device context
  * @param nLeftRect x1
  * @param nTopRect y1
- * @param nRightRect x2
- * @param nBottomRect y2
+ * @param nRightRect x2 (exclusive)
+ * @param nBottomRect y2 (exclusive)
  * @return nonzero if successful, 0 otherwise
  */
 BOOL gdi_Ellipse(HGDI_DC hdc, int nLeftRect, int nTopRect, int nRightRect, int nBottomRect)
 {
-	Ellipse_Bresenham(hdc, nLeftRect, nTopRect, nRightRect, nBottomRect);
-	return TRUE;
+	if (!hdc)
+		return FALSE;
+
+	return gdi_draw_ellipse(hdc, MIN(nLeftRect, nRightRect), MIN(nTopRect, nBottomRect),
+	                        MAX(nLeftRect, nRightRect), MAX(nTopRect, nBottomRect));
 }
 
 /**
@@ -222,12 +565,12 @@ BOOL gdi_FillRect(HGDI_DC hdc, const HGDI_RECT rect, HGDI_BRUSH hbr)
  */
 BOOL gdi_Polygon(HGDI_DC hdc, GDI_POINT* lpPoints, int nCount)
 {
-	WLog_ERR(TAG, "Not implemented!");
-	return FALSE;
+	return gdi_PolyPolygon(hdc, lpPoints, &nCount, 1);
 }
 
 /**
- * Draw a series of closed polygons
+ * Draw a series of closed polygons, filled with the current brush according to the current
+ * polygon fill mode and outlined with the current pen.
  * @msdn{dd162818}
  * @param hdc device context
  * @param lpPoints array of series of points
@@ -237,8 +580,54 @@ BOOL gdi_Polygon(HGDI_DC hdc, GDI_POINT* lpPoints, int nCount)
  */
 BOOL gdi_PolyPolygon(HGDI_DC hdc, GDI_POINT* lpPoints, int* lpPolyCounts, int nCount)
 {
-	WLog_ERR(TAG, "Not implemented!");
-	return FALSE;
+	int i, j;
+	GDI_POINT* poly = lpPoints;
+
+	if (!hdc || !lpPoints || !lpPolyCounts || (nCount < 0))
+		return FALSE;
+
+	if (hdc->brush && (hdc->brush->style != GDI_BS_NULL))
+	{
+		gdiFill fill;
+
+		if (!gdi_fill_init(&fill, hdc, hdc->brush, 0))
+			return FALSE;
+
+		if (!gdi_fill_polygons(&fill, lpPoints, lpPolyCounts, nCount, gdi_GetPolyFillMode(hdc)))
+			return FALSE;
+	}
+
+	if (!hdc->pen || (hdc->pen->style == GDI_PS_NULL))
+		return TRUE;
+
+	for (i = 0; i < nCount; i++)
+	{
+		GDI_POINT pt;
+
+		if (lpPolyCounts[i] < 2)
+		{
+			poly += MAX(lpPolyCounts[i], 0);
+			continue;
+		}
+
+		if (!gdi_MoveToEx(hdc, poly[0].x, poly[0].y, &pt))
+			return FALSE;
+
+		for (j = 1; j <= lpPolyCounts[i]; j++)
+		{
+			const GDI_POINT* next = &poly[j % lpPolyCounts[i]];
+
+			if (!gdi_LineTo(hdc, next->x, next->y) || !gdi_MoveToEx(hdc, next->x, next->y, NULL))
+				return FALSE;
+		}
+
+		if (!gdi_MoveToEx(hdc, pt.x, pt.y, NULL))
+			return FALSE;
+
+		poly += lpPolyCounts[i];
+	}
+
+	return TRUE;
 }
 
 BOOL gdi_Rectangle(HGDI_DC hdc, INT32 nXDst, INT32 nYDst, INT32 nWidth, INT32 nHeight)
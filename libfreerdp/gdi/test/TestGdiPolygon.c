@@ -0,0 +1,286 @@
+
+#include <freerdp/gdi/gdi.h>
+
+#include <freerdp/gdi/dc.h>
+#include <freerdp/gdi/pen.h>
+#include <freerdp/gdi/shape.h>
+#include <freerdp/gdi/region.h>
+#include <freerdp/gdi/bitmap.h>
+
+#include <winpr/crt.h>
+
+#include "brush.h"
+#include "clipping.h"
+#include "drawing.h"
+#include "helpers.h"
+
+/* Polygon(), PolyPolygon() and Ellipse() Test Data, pixels are filled if their centre is inside */
+static const BYTE polygon_case_1[256] = {
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+};
+
+static const BYTE polygon_case_2[256] = {
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\xFF\xFF\xFF\xFF\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+};
+
+static const BYTE polygon_case_3[256] = {
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+};
+
+static const BYTE ellipse_case_1[256] = {
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF"
+	"\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF"
+	"\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF"
+	"\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF"
+	"\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF"
+	"\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+};
+
+static const BYTE ellipse_case_2[256] = {
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\xFF\xFF\xFF"
+	"\xFF\xFF\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00\xFF\xFF"
+	"\xFF\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00\xFF"
+	"\xFF\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00\xFF"
+	"\xFF\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00\xFF"
+	"\xFF\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00\xFF"
+	"\xFF\xFF\x00\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00\xFF\xFF"
+	"\xFF\xFF\xFF\x00\x00\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+};
+
+static const BYTE pattern_case_1[256] = {
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+	"\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\xFF"
+	"\xFF\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF"
+	"\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\xFF"
+	"\xFF\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF"
+	"\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\xFF"
+	"\xFF\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF"
+	"\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\xFF"
+	"\xFF\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF"
+	"\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\xFF"
+	"\xFF\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF"
+	"\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\xFF"
+	"\xFF\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF"
+	"\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\xFF"
+	"\xFF\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF\x00\xFF"
+	"\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+};
+
+static HGDI_BITMAP test_checker_pattern(UINT32 format, UINT32 foreColor, UINT32 backColor)
+{
+	UINT32 x, y;
+	HGDI_BITMAP pattern;
+	BYTE* data = _aligned_malloc(8ULL * 8 * GetBytesPerPixel(format), 16);
+
+	if (!data)
+		return NULL;
+
+	for (y = 0; y < 8; y++)
+	{
+		for (x = 0; x < 8; x++)
+		{
+			BYTE* dst = &data[(y * 8 + x) * GetBytesPerPixel(format)];
+			WriteColor(dst, format, ((x + y) % 2 == 0) ? foreColor : backColor);
+		}
+	}
+
+	if (!(pattern = gdi_CreateBitmap(8, 8, format, data)))
+		_aligned_free(data);
+
+	return pattern;
+}
+
+static BOOL test_shape(HGDI_DC hdc, const gdiPalette* hPalette, HGDI_BITMAP hBmp,
+                       const BYTE* expected, const char* name)
+{
+	char buffer[1024];
+	BOOL rc;
+	HGDI_BITMAP hExpected = test_convert_to_bitmap(expected, PIXEL_FORMAT_RGB8, 0, 0, 0,
+	                                               hdc->format, 0, 0, 0, 16, 16, hPalette);
+
+	if (!hExpected)
+		return FALSE;
+
+	_snprintf(buffer, sizeof(buffer), "%s [%s]", name, FreeRDPGetColorFormatName(hdc->format));
+	rc = test_assert_bitmaps_equal(hBmp, hExpected, buffer, hPalette);
+	gdi_DeleteObject((HGDIOBJECT)hExpected);
+	return rc;
+}
+
+static BOOL test_clear(HGDI_DC hdc, const gdiPalette* hPalette)
+{
+	return gdi_BitBlt(hdc, 0, 0, 16, 16, hdc, 0, 0, GDI_WHITENESS, hPalette);
+}
+
+static BOOL test_format(UINT32 format)
+{
+	UINT32 i;
+	BOOL rc = FALSE;
+	gdiPalette g;
+	HGDI_DC hdc = NULL;
+	HGDI_PEN pen = NULL;
+	HGDI_BRUSH solid = NULL;
+	HGDI_BRUSH checker = NULL;
+	HGDI_BITMAP pattern = NULL;
+	HGDI_BITMAP hBmp = NULL;
+	const UINT32 black = FreeRDPGetColor(format, 0, 0, 0, 0xFF);
+	const UINT32 gray = FreeRDPGetColor(format, 0x80, 0x80, 0x80, 0xFF);
+	GDI_POINT triangle[] = { { 0, 0 }, { 16, 0 }, { 0, 16 } };
+	GDI_POINT squares[] = { { 2, 2 },   { 10, 2 },  { 10, 10 }, { 2, 10 },
+		                    { 6, 6 },   { 14, 6 },  { 14, 14 }, { 6, 14 } };
+	GDI_POINT square[] = { { 1, 1 }, { 15, 1 }, { 15, 15 }, { 1, 15 } };
+	int counts[] = { 4, 4 };
+	g.format = format;
+
+	for (i = 0; i < 256; i++)
+		g.palette[i] = FreeRDPGetColor(format, i, i, i, 0xFF);
+
+	if (!(hdc = gdi_GetDC()))
+		goto fail;
+
+	hdc->format = format;
+	gdi_SetNullClipRgn(hdc);
+	pen = gdi_CreatePen(1, 1, black, format, &g);
+	solid = gdi_CreateSolidBrush(black);
+	pattern = test_checker_pattern(format, black, gray);
+	hBmp = gdi_CreateCompatibleBitmap(hdc, 16, 16);
+
+	if (!pen || !solid || !pattern || !hBmp)
+		goto fail;
+
+	if (!(checker = gdi_CreatePatternBrush(pattern)))
+		goto fail;
+
+	gdi_SelectObject(hdc, (HGDIOBJECT)hBmp);
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+
+	/* Brush only, the pen is selected for the outline tests */
+	hdc->pen = NULL;
+	hdc->brush = solid;
+
+	if (!test_clear(hdc, &g) || !gdi_Polygon(hdc, triangle, ARRAYSIZE(triangle)) ||
+	    !test_shape(hdc, &g, hBmp, polygon_case_1, "Polygon"))
+		goto fail;
+
+	gdi_SetPolyFillMode(hdc, GDI_FILL_ALTERNATE);
+
+	if (!test_clear(hdc, &g) || !gdi_PolyPolygon(hdc, squares, counts, ARRAYSIZE(counts)) ||
+	    !test_shape(hdc, &g, hBmp, polygon_case_2, "PolyPolygon ALTERNATE"))
+		goto fail;
+
+	gdi_SetPolyFillMode(hdc, GDI_FILL_WINDING);
+
+	if (!test_clear(hdc, &g) || !gdi_PolyPolygon(hdc, squares, counts, ARRAYSIZE(counts)) ||
+	    !test_shape(hdc, &g, hBmp, polygon_case_3, "PolyPolygon WINDING"))
+		goto fail;
+
+	if (!test_clear(hdc, &g) || !gdi_Ellipse(hdc, 1, 2, 15, 12) ||
+	    !test_shape(hdc, &g, hBmp, ellipse_case_1, "Ellipse brush"))
+		goto fail;
+
+	/* Background pixels of the pattern are skipped in transparent mode */
+	hdc->brush = checker;
+	gdi_SetBkColor(hdc, gray);
+	gdi_SetBkMode(hdc, GDI_TRANSPARENT);
+
+	if (!test_clear(hdc, &g) || !gdi_Polygon(hdc, square, ARRAYSIZE(square)) ||
+	    !test_shape(hdc, &g, hBmp, pattern_case_1, "Polygon transparent pattern"))
+		goto fail;
+
+	hdc->brush = NULL;
+	gdi_SelectObject(hdc, (HGDIOBJECT)pen);
+
+	if (!test_clear(hdc, &g) || !gdi_Ellipse(hdc, 1, 2, 15, 12) ||
+	    !test_shape(hdc, &g, hBmp, ellipse_case_2, "Ellipse pen"))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	gdi_DeleteObject((HGDIOBJECT)checker);
+	gdi_DeleteObject((HGDIOBJECT)solid);
+	gdi_DeleteObject((HGDIOBJECT)pattern);
+	gdi_DeleteObject((HGDIOBJECT)hBmp);
+	gdi_DeleteObject((HGDIOBJECT)pen);
+	gdi_DeleteDC(hdc);
+	return rc;
+}
+
+int TestGdiPolygon(int argc, char* argv[])
+{
+	UINT32 x;
+	const UINT32 formats[] = { PIXEL_FORMAT_RGB16, PIXEL_FORMAT_BGR24, PIXEL_FORMAT_BGRX32,
+		                       PIXEL_FORMAT_RGBA32 };
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (x = 0; x < ARRAYSIZE(formats); x++)
+	{
+		if (!test_format(formats[x]))
+			return -1;
+	}
+
+	return 0;
+}
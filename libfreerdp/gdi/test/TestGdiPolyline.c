@@ -0,0 +1,352 @@
+
+#include <freerdp/gdi/gdi.h>
+
+#include <freerdp/gdi/dc.h>
+#include <freerdp/gdi/pen.h>
+#include <freerdp/gdi/region.h>
+#include <freerdp/gdi/bitmap.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include "line.h"
+#include "clipping.h"
+#include "drawing.h"
+
+#define TEST_WIDTH 97
+#define TEST_HEIGHT 61
+#define TEST_LINES 400
+
+/* Per pixel LineTo as implemented before the span and pointer stepping kernels */
+static void reference_rop(UINT32 rop, BYTE* pixelPtr, UINT32 pen, UINT32 format)
+{
+	const UINT32 srcPixel = ReadColor(pixelPtr, format);
+	UINT32 dstPixel;
+
+	switch (rop)
+	{
+		case GDI_R2_BLACK:
+			dstPixel = FreeRDPGetColor(format, 0, 0, 0, 0xFF);
+			break;
+
+		case GDI_R2_NOTMERGEPEN:
+			dstPixel = ~(srcPixel | pen);
+			break;
+
+		case GDI_R2_MASKNOTPEN:
+			dstPixel = srcPixel & ~pen;
+			break;
+
+		case GDI_R2_NOTCOPYPEN:
+			dstPixel = ~pen;
+			break;
+
+		case GDI_R2_MASKPENNOT:
+			dstPixel = pen & ~srcPixel;
+			break;
+
+		case GDI_R2_NOT:
+			dstPixel = ~srcPixel;
+			break;
+
+		case GDI_R2_XORPEN:
+			dstPixel = srcPixel ^ pen;
+			break;
+
+		case GDI_R2_NOTMASKPEN:
+			dstPixel = ~(srcPixel & pen);
+			break;
+
+		case GDI_R2_MASKPEN:
+			dstPixel = srcPixel & pen;
+			break;
+
+		case GDI_R2_NOTXORPEN:
+			dstPixel = ~(srcPixel ^ pen);
+			break;
+
+		case GDI_R2_NOP:
+			dstPixel = srcPixel;
+			break;
+
+		case GDI_R2_MERGENOTPEN:
+		case GDI_R2_MERGEPENNOT:
+			dstPixel = srcPixel | ~pen;
+			break;
+
+		case GDI_R2_COPYPEN:
+			dstPixel = pen;
+			break;
+
+		case GDI_R2_MERGEPEN:
+			dstPixel = srcPixel | pen;
+			break;
+
+		case GDI_R2_WHITE:
+			dstPixel = FreeRDPGetColor(format, 0xFF, 0xFF, 0xFF, 0xFF);
+			break;
+
+		default:
+			return;
+	}
+
+	WriteColor(pixelPtr, format, dstPixel);
+}
+
+static void reference_line_to(HGDI_DC hdc, INT32 x2, INT32 y2)
+{
+	INT32 bx1, by1, bx2, by2;
+	const HGDI_BITMAP bmp = (HGDI_BITMAP)hdc->selectedObject;
+	const UINT32 pen = gdi_GetPenColor(hdc->pen, bmp->format);
+	const INT32 x1 = hdc->pen->posX;
+	const INT32 y1 = hdc->pen->posY;
+	const INT32 dx = (x1 > x2) ? x1 - x2 : x2 - x1;
+	const INT32 dy = (y1 > y2) ? y1 - y2 : y2 - y1;
+	const INT32 sx = (x1 < x2) ? 1 : -1;
+	const INT32 sy = (y1 < y2) ? 1 : -1;
+	INT32 e = dx - dy;
+	INT32 x = x1;
+	INT32 y = y1;
+
+	if (hdc->clip->null)
+	{
+		bx1 = MIN(x1, x2);
+		by1 = MIN(y1, y2);
+		bx2 = MAX(x1, x2);
+		by2 = MAX(y1, y2);
+	}
+	else
+	{
+		bx1 = hdc->clip->x;
+		by1 = hdc->clip->y;
+		bx2 = bx1 + hdc->clip->w - 1;
+		by2 = by1 + hdc->clip->h - 1;
+	}
+
+	bx1 = MAX(bx1, 0);
+	by1 = MAX(by1, 0);
+	bx2 = MIN(bx2, bmp->width - 1);
+	by2 = MIN(by2, bmp->height - 1);
+
+	while ((x != x2) || (y != y2))
+	{
+		const INT32 e2 = 2 * e;
+
+		if ((x >= bx1) && (x <= bx2) && (y >= by1) && (y <= by2))
+			reference_rop(gdi_GetROP2(hdc), gdi_GetPointer(bmp, x, y), pen, bmp->format);
+
+		if (e2 > -dy)
+		{
+			e -= dy;
+			x += sx;
+		}
+
+		if (e2 < dx)
+		{
+			e += dx;
+			y += sy;
+		}
+	}
+
+	hdc->pen->posX = x2;
+	hdc->pen->posY = y2;
+}
+
+static void test_random_point(GDI_POINT* pt, UINT32 shape, const GDI_POINT* from, UINT32 width,
+                              UINT32 height)
+{
+	const UINT32 x = rand() % width;
+	const UINT32 y = rand() % height;
+
+	switch (shape % 4)
+	{
+		case 0: /* horizontal */
+			pt->x = x;
+			pt->y = from->y;
+			break;
+
+		case 1: /* vertical */
+			pt->x = from->x;
+			pt->y = y;
+			break;
+
+		case 2: /* diagonal */
+		{
+			const INT32 d = (rand() % 60) - 30;
+			pt->x = (UINT32)MAX((INT32)from->x + d, 0) % width;
+			pt->y = (UINT32)MAX((INT32)from->y + ((rand() & 1) ? d : -d), 0) % height;
+		}
+		break;
+
+		default:
+			pt->x = x;
+			pt->y = y;
+			break;
+	}
+}
+
+static BOOL test_lines(UINT32 format)
+{
+	BOOL rc = FALSE;
+	UINT32 rop2, i;
+	HGDI_DC hdc = NULL;
+	HGDI_PEN pen = NULL;
+	HGDI_BITMAP actual = NULL;
+	HGDI_BITMAP expected = NULL;
+	const UINT32 bpp = GetBytesPerPixel(format);
+	const size_t size = 1ULL * TEST_WIDTH * TEST_HEIGHT * bpp;
+
+	if (!(hdc = gdi_GetDC()))
+		goto fail;
+
+	hdc->format = format;
+
+	if (!(pen = gdi_CreatePen(1, 1, FreeRDPGetColor(format, 0x31, 0xC4, 0x7A, 0xFF), format,
+	                          NULL)))
+		goto fail;
+
+	gdi_SelectObject(hdc, (HGDIOBJECT)pen);
+	actual = gdi_CreateCompatibleBitmap(hdc, TEST_WIDTH, TEST_HEIGHT);
+	expected = gdi_CreateCompatibleBitmap(hdc, TEST_WIDTH, TEST_HEIGHT);
+
+	if (!actual || !expected)
+		goto fail;
+
+	for (rop2 = GDI_R2_BLACK; rop2 <= GDI_R2_WHITE; rop2++)
+	{
+		GDI_POINT from = { 0 };
+		GDI_POINT to = { 0 };
+		gdi_SetROP2(hdc, (INT32)rop2);
+
+		for (i = 0; i < size; i++)
+			actual->data[i] = (BYTE)rand();
+
+		CopyMemory(expected->data, actual->data, size);
+
+		for (i = 0; i < TEST_LINES; i++)
+		{
+			/* Mostly inside, sometimes beyond the right and bottom edges */
+			test_random_point(&to, i, &from, TEST_WIDTH + 20, TEST_HEIGHT + 20);
+
+			if (i % 3 == 0)
+				gdi_SetNullClipRgn(hdc);
+			else
+				gdi_SetClipRgn(hdc, rand() % TEST_WIDTH, rand() % TEST_HEIGHT,
+				               rand() % TEST_WIDTH, rand() % TEST_HEIGHT);
+
+			gdi_SelectObject(hdc, (HGDIOBJECT)expected);
+			gdi_MoveToEx(hdc, from.x, from.y, NULL);
+			reference_line_to(hdc, (INT32)to.x, (INT32)to.y);
+
+			gdi_SelectObject(hdc, (HGDIOBJECT)actual);
+			gdi_MoveToEx(hdc, from.x, from.y, NULL);
+
+			if (!gdi_LineTo(hdc, to.x, to.y))
+				goto fail;
+
+			if (memcmp(actual->data, expected->data, size) != 0)
+			{
+				fprintf(stderr,
+				        "[%s] rop2 %" PRIu32 " line %" PRIu32 "x%" PRIu32 " -> %" PRIu32
+				        "x%" PRIu32 " differs\n",
+				        FreeRDPGetColorFormatName(format), rop2, from.x, from.y, to.x, to.y);
+				goto fail;
+			}
+
+			from = to;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	gdi_DeleteObject((HGDIOBJECT)actual);
+	gdi_DeleteObject((HGDIOBJECT)expected);
+	gdi_DeleteObject((HGDIOBJECT)pen);
+	gdi_DeleteDC(hdc);
+	return rc;
+}
+
+/* Polyline order streams, the way charting and CAD applications send them. Only run with the
+ * benchmark argument, the timings are not checked. */
+static BOOL test_polyline_speed(void)
+{
+	BOOL rc = FALSE;
+	UINT32 i;
+	UINT64 start, polyline, reference;
+	HGDI_DC hdc = NULL;
+	HGDI_PEN pen = NULL;
+	HGDI_BITMAP bmp = NULL;
+	GDI_POINT* points = NULL;
+	const UINT32 format = PIXEL_FORMAT_BGRX32;
+	const UINT32 count = 200000;
+
+	if (!(hdc = gdi_GetDC()))
+		goto fail;
+
+	hdc->format = format;
+
+	if (!(pen = gdi_CreatePen(1, 1, FreeRDPGetColor(format, 0, 0, 0, 0xFF), format, NULL)))
+		goto fail;
+
+	gdi_SelectObject(hdc, (HGDIOBJECT)pen);
+
+	if (!(bmp = gdi_CreateCompatibleBitmap(hdc, 1920, 1080)))
+		goto fail;
+
+	gdi_SelectObject(hdc, (HGDIOBJECT)bmp);
+	gdi_SetNullClipRgn(hdc);
+	gdi_SetROP2(hdc, GDI_R2_COPYPEN);
+
+	if (!(points = calloc(count, sizeof(GDI_POINT))))
+		goto fail;
+
+	for (i = 0; i < count; i++)
+	{
+		const GDI_POINT* from = (i > 0) ? &points[i - 1] : &points[0];
+		test_random_point(&points[i], i, from, 1920, 1080);
+	}
+
+	start = GetTickCount64();
+
+	if (!gdi_Polyline(hdc, points, count))
+		goto fail;
+
+	polyline = GetTickCount64() - start;
+	start = GetTickCount64();
+	gdi_MoveToEx(hdc, points[0].x, points[0].y, NULL);
+
+	for (i = 0; i < count; i++)
+		reference_line_to(hdc, (INT32)points[i].x, (INT32)points[i].y);
+
+	reference = GetTickCount64() - start;
+	printf("%" PRIu32 " polyline segments at 1920x1080: %" PRIu64 "ms, per pixel LineTo %" PRIu64
+	       "ms\n",
+	       count, polyline, reference);
+	rc = TRUE;
+fail:
+	free(points);
+	gdi_DeleteObject((HGDIOBJECT)bmp);
+	gdi_DeleteObject((HGDIOBJECT)pen);
+	gdi_DeleteDC(hdc);
+	return rc;
+}
+
+int TestGdiPolyline(int argc, char* argv[])
+{
+	UINT32 x;
+	const UINT32 formats[] = { PIXEL_FORMAT_RGB16, PIXEL_FORMAT_BGR24, PIXEL_FORMAT_BGRX32,
+		                       PIXEL_FORMAT_RGBA32 };
+	const BOOL benchmark = (argc > 1) && (strcmp(argv[1], "benchmark") == 0);
+	srand(0x5EED);
+
+	for (x = 0; x < ARRAYSIZE(formats); x++)
+	{
+		if (!test_lines(formats[x]))
+			return -1;
+	}
+
+	if (benchmark && !test_polyline_speed())
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,162 @@
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+
+#include <freerdp/gdi/dc.h>
+#include <freerdp/gdi/shape.h>
+#include <freerdp/gdi/region.h>
+
+#include <winpr/crt.h>
+
+#include "brush.h"
+
+#define TEST_WIDTH 800
+#define TEST_HEIGHT 600
+#define TEST_MARKER 0x11223344
+
+static freerdp* test_client_new(void)
+{
+	freerdp* instance = freerdp_new();
+
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	instance->settings->DesktopWidth = TEST_WIDTH;
+	instance->settings->DesktopHeight = TEST_HEIGHT;
+
+	if (!gdi_init(instance, PIXEL_FORMAT_BGRX32))
+		goto fail;
+
+	return instance;
+fail:
+	if (instance && instance->context)
+		freerdp_context_free(instance);
+	freerdp_free(instance);
+	return NULL;
+}
+
+static void test_client_free(freerdp* instance)
+{
+	if (!instance)
+		return;
+
+	gdi_free(instance);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+}
+
+static UINT32 test_pixel(rdpGdi* gdi, UINT32 x, UINT32 y)
+{
+	return ReadColor(&gdi->primary_buffer[1ull * y * gdi->stride + x * 4], gdi->dstFormat);
+}
+
+static BOOL test_check(rdpGdi* gdi, INT32 width, INT32 height, const char* what)
+{
+	if ((gdi->width == width) && (gdi->height == height) &&
+	    (gdi->primary->bitmap->width == width) && (gdi->primary->bitmap->height == height) &&
+	    (gdi->primary_buffer == gdi->primary->bitmap->data) &&
+	    (gdi->stride == gdi->primary->bitmap->scanline) &&
+	    (1ull * gdi->stride * gdi->height <= gdi->primary_size))
+		return TRUE;
+
+	fprintf(stderr, "%s: %" PRId32 "x%" PRId32 " primary %" PRId32 "x%" PRId32 " stride %" PRIu32
+	                "\n",
+	        what, width, height, gdi->primary->bitmap->width, gdi->primary->bitmap->height,
+	        gdi->stride);
+	return FALSE;
+}
+
+/* A window drag, growing and shrinking in small steps */
+static BOOL test_resize_drag(void)
+{
+	BOOL rc = FALSE;
+	INT32 size;
+	UINT32 reallocations = 0;
+	GDI_RECT rect = { 0 };
+	HGDI_BRUSH brush = NULL;
+	freerdp* instance = test_client_new();
+	rdpGdi* gdi = instance ? instance->context->gdi : NULL;
+
+	if (!gdi)
+		goto fail;
+
+	WriteColor(&gdi->primary_buffer[10 * gdi->stride + 10 * 4], gdi->dstFormat, TEST_MARKER);
+
+	for (size = 0; size <= 400; size += 8)
+	{
+		BYTE* buffer = gdi->primary_buffer;
+
+		if (!gdi_resize(gdi, TEST_WIDTH + size, TEST_HEIGHT + size) ||
+		    !test_check(gdi, TEST_WIDTH + size, TEST_HEIGHT + size, "grow"))
+			goto fail;
+
+		if (buffer != gdi->primary_buffer)
+			reallocations++;
+	}
+
+	/* Growing keeps the contents, the server repaints after the resize anyway */
+	if (test_pixel(gdi, 10, 10) != TEST_MARKER)
+	{
+		fprintf(stderr, "contents lost while growing\n");
+		goto fail;
+	}
+
+	if (reallocations > 6)
+	{
+		fprintf(stderr, "%" PRIu32 " reallocations while growing\n", reallocations);
+		goto fail;
+	}
+
+	for (size = 400; size >= -200; size -= 8)
+	{
+		BYTE* buffer = gdi->primary_buffer;
+
+		if (!gdi_resize(gdi, TEST_WIDTH + size, TEST_HEIGHT + size) ||
+		    !test_check(gdi, TEST_WIDTH + size, TEST_HEIGHT + size, "shrink"))
+			goto fail;
+
+		if (buffer != gdi->primary_buffer)
+		{
+			fprintf(stderr, "reallocated while shrinking to %" PRId32 "x%" PRId32 "\n",
+			        TEST_WIDTH + size, TEST_HEIGHT + size);
+			goto fail;
+		}
+	}
+
+	/* Drawing is clipped to the current size, not to the allocation */
+	if (!(brush = gdi_CreateSolidBrush(FreeRDPGetColor(gdi->dstFormat, 0xFF, 0, 0, 0xFF))))
+		goto fail;
+
+	WriteColor(&gdi->primary_buffer[10 * gdi->stride + gdi->width * 4], gdi->dstFormat,
+	           TEST_MARKER);
+	rect.right = gdi->width + 100;
+	rect.bottom = gdi->height + 100;
+
+	if (!gdi_FillRect(gdi->primary->hdc, &rect, brush))
+		goto fail;
+
+	if ((test_pixel(gdi, 10, 10) == TEST_MARKER) ||
+	    (test_pixel(gdi, (UINT32)gdi->width, 10) != TEST_MARKER))
+	{
+		fprintf(stderr, "fill not clipped to the resized primary\n");
+		goto fail;
+	}
+
+	printf("%" PRIu32 " reallocations growing by 400 pixels in 8 pixel steps\n", reallocations);
+	rc = TRUE;
+fail:
+	gdi_DeleteObject((HGDIOBJECT)brush);
+	test_client_free(instance);
+	return rc;
+}
+
+int TestGdiResize(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_resize_drag())
+		return -1;
+
+	return 0;
+}
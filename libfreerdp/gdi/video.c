@@ -26,6 +26,7 @@
 #include <freerdp/gdi/region.h>
 
 #define TAG FREERDP_TAG("video")
+#define GDI_VIDEO_TIMER_INTERVAL 20 /* ms between presentation checks */
 
 typedef struct
 {
@@ -161,7 +162,14 @@ static void gdi_video_timer(void* context, TimerEventArgs* timer)
 	rdpGdi* gdi = ctx->gdi;
 
 	if (gdi && gdi->video)
+	{
+		/* Frames are queued from the channel thread, keep polling while the channel is attached */
+		const UINT64 due = timer->now + GDI_VIDEO_TIMER_INTERVAL;
 		gdi->video->timer(gdi->video, timer->now);
+
+		if (!timer->due || (due < timer->due))
+			timer->due = due;
+	}
 }
 
 void gdi_video_data_init(rdpGdi* gdi, VideoClientContext* video)
@@ -0,0 +1,442 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/stream.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/wtsapi.h>
+#include <winpr/collections.h>
+
+#include <freerdp/channels/rdpdr.h>
+#include <freerdp/server/rdpdr.h>
+
+#define TEST_DEVICES 4
+#define TEST_FILES_PER_DEVICE 2
+#define TEST_FILES (TEST_DEVICES * TEST_FILES_PER_DEVICE)
+#define TEST_FILE_SIZE (2 * 1024 * 1024)
+#define TEST_READ_SIZE (64 * 1024)
+#define TEST_READ_WINDOW 4
+
+typedef struct
+{
+	UINT32 deviceId;
+	UINT32 fileId;
+	FILE* fp;
+	CRITICAL_SECTION lock;
+
+	UINT32 nextRequest;
+	UINT32 nextCompletion;
+	BOOL failed;
+} test_file;
+
+/* Loopback client, serves read requests from files in a (tmpfs) directory */
+static struct
+{
+	CRITICAL_SECTION lock;
+	HANDLE event;
+	wQueue* pending;
+	test_file files[TEST_FILES];
+} g_Client;
+
+static RdpdrServerContext* g_Context = NULL;
+static HANDLE g_Done = NULL;
+static LONG g_Completed = 0;
+
+static BYTE test_pattern(size_t index, size_t offset)
+{
+	return (BYTE)((offset >> 8) + offset + index * 13);
+}
+
+static test_file* test_find_file(UINT32 deviceId, UINT32 fileId)
+{
+	size_t x;
+
+	for (x = 0; x < TEST_FILES; x++)
+	{
+		test_file* file = &g_Client.files[x];
+
+		if ((file->deviceId == deviceId) && (file->fileId == fileId))
+			return file;
+	}
+
+	return NULL;
+}
+
+static void test_client_push(wStream* s)
+{
+	EnterCriticalSection(&g_Client.lock);
+	Queue_Enqueue(g_Client.pending, s);
+	SetEvent(g_Client.event);
+	LeaveCriticalSection(&g_Client.lock);
+}
+
+static BOOL test_client_serve_read(UINT32 deviceId, UINT32 fileId, UINT32 completionId,
+                                   UINT32 length, UINT64 offset)
+{
+	size_t read = 0;
+	UINT32 ioStatus = STATUS_SUCCESS;
+	test_file* file = test_find_file(deviceId, fileId);
+	wStream* s = Stream_New(NULL, 20 + length);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT16(s, RDPDR_CTYP_CORE);
+	Stream_Write_UINT16(s, PAKID_CORE_DEVICE_IOCOMPLETION);
+	Stream_Write_UINT32(s, deviceId);
+	Stream_Write_UINT32(s, completionId);
+
+	if (file)
+	{
+		EnterCriticalSection(&file->lock);
+
+		if (_fseeki64(file->fp, (INT64)offset, SEEK_SET) == 0)
+			read = fread(Stream_Buffer(s) + 20, 1, length, file->fp);
+
+		LeaveCriticalSection(&file->lock);
+	}
+	else
+		ioStatus = STATUS_INVALID_HANDLE;
+
+	Stream_Write_UINT32(s, ioStatus);
+	Stream_Write_UINT32(s, (UINT32)read);
+	Stream_Seek(s, read);
+	Stream_SealLength(s);
+	test_client_push(s);
+	return TRUE;
+}
+
+static HANDLE WINAPI test_VirtualChannelOpen(HANDLE hServer, DWORD SessionId, LPSTR pVirtualName)
+{
+	WINPR_UNUSED(hServer);
+	WINPR_UNUSED(SessionId);
+	WINPR_UNUSED(pVirtualName);
+	return (HANDLE)&g_Client;
+}
+
+static BOOL WINAPI test_VirtualChannelClose(HANDLE hChannelHandle)
+{
+	WINPR_UNUSED(hChannelHandle);
+	return TRUE;
+}
+
+static BOOL WINAPI test_VirtualChannelRead(HANDLE hChannelHandle, ULONG TimeOut, PCHAR Buffer,
+                                           ULONG BufferSize, PULONG pBytesRead)
+{
+	wStream* s;
+	WINPR_UNUSED(hChannelHandle);
+	WINPR_UNUSED(TimeOut);
+
+	EnterCriticalSection(&g_Client.lock);
+	s = (wStream*)Queue_Peek(g_Client.pending);
+
+	if (!s)
+	{
+		ResetEvent(g_Client.event);
+		LeaveCriticalSection(&g_Client.lock);
+		*pBytesRead = 0;
+		SetLastError(ERROR_NO_DATA);
+		return FALSE;
+	}
+
+	*pBytesRead = (ULONG)Stream_Length(s);
+
+	if (Buffer && (BufferSize > 0))
+	{
+		if (BufferSize < *pBytesRead)
+		{
+			LeaveCriticalSection(&g_Client.lock);
+			return FALSE;
+		}
+
+		CopyMemory(Buffer, Stream_Buffer(s), *pBytesRead);
+		Queue_Dequeue(g_Client.pending);
+		Stream_Free(s, TRUE);
+
+		if (Queue_Count(g_Client.pending) == 0)
+			ResetEvent(g_Client.event);
+	}
+
+	LeaveCriticalSection(&g_Client.lock);
+	return TRUE;
+}
+
+static BOOL WINAPI test_VirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer, ULONG Length,
+                                            PULONG pBytesWritten)
+{
+	wStream sbuffer = { 0 };
+	wStream* s = &sbuffer;
+	UINT16 component, packetId;
+	UINT32 deviceId, fileId, completionId, majorFunction, minorFunction, length;
+	UINT64 offset;
+	WINPR_UNUSED(hChannelHandle);
+
+	Stream_StaticInit(s, (BYTE*)Buffer, Length);
+
+	if (pBytesWritten)
+		*pBytesWritten = Length;
+
+	if (Stream_GetRemainingLength(s) < 24)
+		return TRUE;
+
+	Stream_Read_UINT16(s, component);
+	Stream_Read_UINT16(s, packetId);
+
+	if ((component != RDPDR_CTYP_CORE) || (packetId != PAKID_CORE_DEVICE_IOREQUEST))
+		return TRUE;
+
+	Stream_Read_UINT32(s, deviceId);
+	Stream_Read_UINT32(s, fileId);
+	Stream_Read_UINT32(s, completionId);
+	Stream_Read_UINT32(s, majorFunction);
+	Stream_Read_UINT32(s, minorFunction);
+	WINPR_UNUSED(minorFunction);
+
+	if ((majorFunction != IRP_MJ_READ) || (Stream_GetRemainingLength(s) < 12))
+		return FALSE;
+
+	Stream_Read_UINT32(s, length);
+	Stream_Read_UINT64(s, offset);
+	return test_client_serve_read(deviceId, fileId, completionId, length, offset);
+}
+
+static BOOL WINAPI test_VirtualChannelQuery(HANDLE hChannelHandle,
+                                            WTS_VIRTUAL_CLASS WtsVirtualClass, PVOID* ppBuffer,
+                                            DWORD* pBytesReturned)
+{
+	HANDLE* event;
+	WINPR_UNUSED(hChannelHandle);
+
+	if (WtsVirtualClass != WTSVirtualEventHandle)
+		return FALSE;
+
+	event = (HANDLE*)calloc(1, sizeof(HANDLE));
+
+	if (!event)
+		return FALSE;
+
+	*event = g_Client.event;
+	*ppBuffer = event;
+	*pBytesReturned = sizeof(HANDLE);
+	return TRUE;
+}
+
+static VOID WINAPI test_FreeMemory(PVOID pMemory)
+{
+	free(pMemory);
+}
+
+static WtsApiFunctionTable testWtsApi = { 0 };
+
+static BOOL test_request_read(test_file* file)
+{
+	BOOL rc = TRUE;
+
+	/* Requests go out in offset order, the initial window is sent while reads complete */
+	EnterCriticalSection(&file->lock);
+
+	if (file->nextRequest < TEST_FILE_SIZE)
+	{
+		const UINT32 offset = file->nextRequest;
+		file->nextRequest += TEST_READ_SIZE;
+		rc = g_Context->DriveReadFile(g_Context, file, file->deviceId, file->fileId,
+		                              TEST_READ_SIZE, offset) == CHANNEL_RC_OK;
+	}
+
+	LeaveCriticalSection(&file->lock);
+	return rc;
+}
+
+static void test_read_complete(RdpdrServerContext* context, void* callbackData, UINT32 ioStatus,
+                               const char* buffer, UINT32 length)
+{
+	UINT32 x;
+	test_file* file = (test_file*)callbackData;
+	const size_t index = (size_t)(file - g_Client.files);
+	WINPR_UNUSED(context);
+
+	/* Completions for one file handle are delivered in request order */
+	if ((ioStatus != STATUS_SUCCESS) || (length != TEST_READ_SIZE))
+		file->failed = TRUE;
+
+	for (x = 0; (x < length) && !file->failed; x++)
+	{
+		if ((BYTE)buffer[x] != test_pattern(index, file->nextCompletion + x))
+			file->failed = TRUE;
+	}
+
+	file->nextCompletion += length;
+
+	/* Keep the read window of the file full */
+	if (!test_request_read(file))
+		file->failed = TRUE;
+
+	if (InterlockedIncrement(&g_Completed) == TEST_FILES * (TEST_FILE_SIZE / TEST_READ_SIZE))
+		SetEvent(g_Done);
+}
+
+static BOOL test_create_file(const char* path, size_t index)
+{
+	size_t x;
+	BOOL rc = FALSE;
+	BYTE* data = malloc(TEST_FILE_SIZE);
+	FILE* fp = winpr_fopen(path, "wb");
+
+	if (!data || !fp)
+		goto fail;
+
+	for (x = 0; x < TEST_FILE_SIZE; x++)
+		data[x] = test_pattern(index, x);
+
+	rc = fwrite(data, 1, TEST_FILE_SIZE, fp) == TEST_FILE_SIZE;
+fail:
+	if (fp)
+		fclose(fp);
+	free(data);
+	return rc;
+}
+
+int TestServerRdpdr(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t x, y;
+	UINT64 start, duration;
+	char name[32] = { 0 };
+	char* paths[TEST_FILES] = { 0 };
+	char* base = NULL;
+	char* directory = NULL;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	testWtsApi.pVirtualChannelOpen = test_VirtualChannelOpen;
+	testWtsApi.pVirtualChannelClose = test_VirtualChannelClose;
+	testWtsApi.pVirtualChannelRead = test_VirtualChannelRead;
+	testWtsApi.pVirtualChannelWrite = test_VirtualChannelWrite;
+	testWtsApi.pVirtualChannelQuery = test_VirtualChannelQuery;
+	testWtsApi.pFreeMemory = test_FreeMemory;
+
+	if (!WTSRegisterWtsApiFunctionTable(&testWtsApi))
+		return -1;
+
+	InitializeCriticalSection(&g_Client.lock);
+	g_Client.event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	g_Client.pending = Queue_New(FALSE, -1, -1);
+	g_Done = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	if (!g_Client.event || !g_Client.pending || !g_Done)
+		goto fail;
+
+	/* Prefer tmpfs so the benchmark measures the channel and not the disk */
+	if (winpr_PathFileExists("/dev/shm"))
+		base = _strdup("/dev/shm");
+	else
+		base = GetKnownPath(KNOWN_PATH_TEMP);
+
+	sprintf_s(name, sizeof(name), "TestServerRdpdr.%" PRIu32, GetCurrentProcessId());
+	directory = GetCombinedPath(base, name);
+
+	if (!directory || !CreateDirectoryA(directory, NULL))
+		goto fail;
+
+	for (x = 0; x < TEST_FILES; x++)
+	{
+		test_file* file = &g_Client.files[x];
+		sprintf_s(name, sizeof(name), "file%" PRIuz, x);
+		paths[x] = GetCombinedPath(directory, name);
+
+		if (!paths[x] || !test_create_file(paths[x], x))
+			goto fail;
+
+		InitializeCriticalSection(&file->lock);
+		file->deviceId = (UINT32)(x / TEST_FILES_PER_DEVICE) + 1;
+		file->fileId = (UINT32)(x % TEST_FILES_PER_DEVICE) + 1;
+		file->fp = winpr_fopen(paths[x], "rb");
+
+		if (!file->fp)
+			goto fail;
+	}
+
+	g_Context = rdpdr_server_context_new(WTS_CURRENT_SERVER_HANDLE);
+
+	if (!g_Context)
+		goto fail;
+
+	g_Context->OnDriveReadFileComplete = test_read_complete;
+
+	if (g_Context->Start(g_Context) != CHANNEL_RC_OK)
+		goto fail;
+
+	start = GetTickCount64();
+
+	for (y = 0; y < TEST_READ_WINDOW; y++)
+	{
+		for (x = 0; x < TEST_FILES; x++)
+		{
+			if (!test_request_read(&g_Client.files[x]))
+				goto fail_stop;
+		}
+	}
+
+	if (WaitForSingleObject(g_Done, 30000) != WAIT_OBJECT_0)
+	{
+		fprintf(stderr, "timed out after %" PRId32 " completions\n", g_Completed);
+		goto fail_stop;
+	}
+
+	duration = GetTickCount64() - start;
+	printf("%d files, %d x %d byte reads in flight per file: %d MiB in %" PRIu64 " ms\n",
+	       TEST_FILES, TEST_READ_WINDOW, TEST_READ_SIZE, TEST_FILES * TEST_FILE_SIZE / 1024 / 1024,
+	       duration);
+
+	rc = 0;
+	for (x = 0; x < TEST_FILES; x++)
+	{
+		if (g_Client.files[x].failed || (g_Client.files[x].nextCompletion != TEST_FILE_SIZE))
+		{
+			fprintf(stderr, "file %" PRIuz " was not read correctly\n", x);
+			rc = -1;
+		}
+	}
+
+fail_stop:
+	g_Context->Stop(g_Context);
+fail:
+	rdpdr_server_context_free(g_Context);
+
+	for (x = 0; x < TEST_FILES; x++)
+	{
+		test_file* file = &g_Client.files[x];
+
+		if (file->fp)
+		{
+			fclose(file->fp);
+			DeleteCriticalSection(&file->lock);
+		}
+
+		if (paths[x])
+			winpr_DeleteFile(paths[x]);
+
+		free(paths[x]);
+	}
+
+	if (directory)
+		winpr_RemoveDirectory(directory);
+
+	free(directory);
+	free(base);
+
+	if (g_Client.pending)
+	{
+		while (Queue_Count(g_Client.pending) > 0)
+			Stream_Free((wStream*)Queue_Dequeue(g_Client.pending), TRUE);
+
+		Queue_Free(g_Client.pending);
+	}
+
+	CloseHandle(g_Client.event);
+	CloseHandle(g_Done);
+	DeleteCriticalSection(&g_Client.lock);
+	return rc;
+}
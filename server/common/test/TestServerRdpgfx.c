@@ -0,0 +1,802 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/thread.h>
+#include <winpr/wtsapi.h>
+#include <winpr/collections.h>
+
+#include <freerdp/codec/zgfx.h>
+#include <freerdp/channels/rdpgfx.h>
+#include <freerdp/server/rdpgfx.h>
+
+#define TEST_CACHE_ENTRY_SIZE (64 * 64 * 4)
+#define TEST_FRAMES 200
+
+/* Loopback client, collects the decompressed PDUs the server writes */
+static struct
+{
+	CRITICAL_SECTION lock;
+	HANDLE event;
+	HANDLE offered;
+	wQueue* pending;
+	ZGFX_CONTEXT* zgfx;
+	wStream* received;
+	UINT32 writes;
+} g_Client;
+
+static HANDLE WINAPI test_VirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualName, DWORD flags)
+{
+	WINPR_UNUSED(SessionId);
+	WINPR_UNUSED(pVirtualName);
+	WINPR_UNUSED(flags);
+	return (HANDLE)&g_Client;
+}
+
+static BOOL WINAPI test_VirtualChannelClose(HANDLE hChannelHandle)
+{
+	WINPR_UNUSED(hChannelHandle);
+	return TRUE;
+}
+
+static BOOL WINAPI test_VirtualChannelRead(HANDLE hChannelHandle, ULONG TimeOut, PCHAR Buffer,
+                                           ULONG BufferSize, PULONG pBytesRead)
+{
+	wStream* s;
+	WINPR_UNUSED(hChannelHandle);
+	WINPR_UNUSED(TimeOut);
+
+	EnterCriticalSection(&g_Client.lock);
+	s = (wStream*)Queue_Peek(g_Client.pending);
+
+	if (!s)
+	{
+		ResetEvent(g_Client.event);
+		LeaveCriticalSection(&g_Client.lock);
+		*pBytesRead = 0;
+		SetLastError(ERROR_NO_DATA);
+		return FALSE;
+	}
+
+	*pBytesRead = (ULONG)Stream_Length(s);
+
+	if (Buffer && (BufferSize > 0))
+	{
+		if (BufferSize < *pBytesRead)
+		{
+			LeaveCriticalSection(&g_Client.lock);
+			return FALSE;
+		}
+
+		CopyMemory(Buffer, Stream_Buffer(s), *pBytesRead);
+		Queue_Dequeue(g_Client.pending);
+		Stream_Free(s, TRUE);
+
+		if (Queue_Count(g_Client.pending) == 0)
+			ResetEvent(g_Client.event);
+	}
+
+	LeaveCriticalSection(&g_Client.lock);
+	return TRUE;
+}
+
+static BOOL WINAPI test_VirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer, ULONG Length,
+                                            PULONG pBytesWritten)
+{
+	BOOL rc = FALSE;
+	BYTE* data = NULL;
+	UINT32 size = 0;
+	WINPR_UNUSED(hChannelHandle);
+
+	EnterCriticalSection(&g_Client.lock);
+	g_Client.writes++;
+
+	if ((zgfx_decompress(g_Client.zgfx, (const BYTE*)Buffer, Length, &data, &size, 0) >= 0) &&
+	    Stream_EnsureRemainingCapacity(g_Client.received, size))
+	{
+		Stream_Write(g_Client.received, data, size);
+		rc = TRUE;
+	}
+
+	LeaveCriticalSection(&g_Client.lock);
+	free(data);
+
+	if (pBytesWritten)
+		*pBytesWritten = Length;
+
+	return rc;
+}
+
+static BOOL WINAPI test_VirtualChannelQuery(HANDLE hChannelHandle,
+                                            WTS_VIRTUAL_CLASS WtsVirtualClass, PVOID* ppBuffer,
+                                            DWORD* pBytesReturned)
+{
+	WINPR_UNUSED(hChannelHandle);
+
+	if (WtsVirtualClass == WTSVirtualEventHandle)
+	{
+		HANDLE* event = (HANDLE*)calloc(1, sizeof(HANDLE));
+
+		if (!event)
+			return FALSE;
+
+		*event = g_Client.event;
+		*ppBuffer = event;
+		*pBytesReturned = sizeof(HANDLE);
+		return TRUE;
+	}
+
+	if (WtsVirtualClass == WTSVirtualChannelReady)
+	{
+		BOOL* ready = (BOOL*)calloc(1, sizeof(BOOL));
+
+		if (!ready)
+			return FALSE;
+
+		*ready = TRUE;
+		*ppBuffer = ready;
+		*pBytesReturned = sizeof(BOOL);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static BOOL WINAPI test_QuerySessionInformationA(HANDLE hServer, DWORD SessionId,
+                                                 WTS_INFO_CLASS WTSInfoClass, LPSTR* ppBuffer,
+                                                 DWORD* pBytesReturned)
+{
+	ULONG* id;
+	WINPR_UNUSED(hServer);
+
+	if (WTSInfoClass != WTSSessionId)
+		return FALSE;
+
+	if (!(id = (ULONG*)calloc(1, sizeof(ULONG))))
+		return FALSE;
+
+	*id = SessionId;
+	*ppBuffer = (LPSTR)id;
+	*pBytesReturned = sizeof(ULONG);
+	return TRUE;
+}
+
+static VOID WINAPI test_FreeMemory(PVOID pMemory)
+{
+	free(pMemory);
+}
+
+static WtsApiFunctionTable testWtsApi = { 0 };
+
+static UINT test_cache_import_offer(RdpgfxServerContext* context,
+                                    const RDPGFX_CACHE_IMPORT_OFFER_PDU* pdu)
+{
+	WINPR_UNUSED(context);
+	WINPR_UNUSED(pdu);
+	SetEvent(g_Client.offered);
+	return CHANNEL_RC_OK;
+}
+
+static void test_client_reset(void)
+{
+	EnterCriticalSection(&g_Client.lock);
+	Stream_SetPosition(g_Client.received, 0);
+	g_Client.writes = 0;
+	ResetEvent(g_Client.offered);
+	LeaveCriticalSection(&g_Client.lock);
+}
+
+/* Deliver a RDPGFX_CACHE_IMPORT_OFFER_PDU from the client */
+static BOOL test_client_offer(const RDPGFX_CACHE_ENTRY_METADATA* entries, UINT16 count)
+{
+	UINT16 x;
+	const size_t length = RDPGFX_HEADER_SIZE + 2 + count * 12ULL;
+	wStream* s = Stream_New(NULL, length);
+
+	if (!s)
+		return FALSE;
+
+	Stream_Write_UINT16(s, RDPGFX_CMDID_CACHEIMPORTOFFER);
+	Stream_Write_UINT16(s, 0);
+	Stream_Write_UINT32(s, (UINT32)length);
+	Stream_Write_UINT16(s, count);
+
+	for (x = 0; x < count; x++)
+	{
+		Stream_Write_UINT64(s, entries[x].cacheKey);
+		Stream_Write_UINT32(s, entries[x].bitmapLength);
+	}
+
+	Stream_SealLength(s);
+	EnterCriticalSection(&g_Client.lock);
+	Queue_Enqueue(g_Client.pending, s);
+	SetEvent(g_Client.event);
+	LeaveCriticalSection(&g_Client.lock);
+	return TRUE;
+}
+
+/* Find the first PDU with cmdId in what the client received, s is set to its body */
+static BOOL test_client_find_pdu(UINT16 cmdId, wStream* s)
+{
+	size_t offset = 0;
+	const size_t length = Stream_GetPosition(g_Client.received);
+
+	while (offset + RDPGFX_HEADER_SIZE <= length)
+	{
+		UINT16 id;
+		UINT32 pduLength;
+
+		Stream_StaticInit(s, Stream_Buffer(g_Client.received) + offset, length - offset);
+		Stream_Read_UINT16(s, id);
+		Stream_Seek_UINT16(s); /* flags */
+		Stream_Read_UINT32(s, pduLength);
+
+		if ((pduLength < RDPGFX_HEADER_SIZE) || (pduLength > length - offset))
+			return FALSE;
+
+		if (id == cmdId)
+		{
+			Stream_SetLength(s, pduLength);
+			return TRUE;
+		}
+
+		offset += pduLength;
+	}
+
+	return FALSE;
+}
+
+/* Count the PDUs with cmdId the client received, FALSE if the PDU stream is broken */
+static BOOL test_client_count_pdus(UINT16 cmdId, size_t* count)
+{
+	size_t offset = 0;
+	wStream sbuffer = { 0 };
+	wStream* s = &sbuffer;
+	const size_t length = Stream_GetPosition(g_Client.received);
+
+	*count = 0;
+
+	while (offset < length)
+	{
+		UINT16 id;
+		UINT32 pduLength;
+
+		if (length - offset < RDPGFX_HEADER_SIZE)
+			return FALSE;
+
+		Stream_StaticInit(s, Stream_Buffer(g_Client.received) + offset, length - offset);
+		Stream_Read_UINT16(s, id);
+		Stream_Seek_UINT16(s); /* flags */
+		Stream_Read_UINT32(s, pduLength);
+
+		if ((pduLength < RDPGFX_HEADER_SIZE) || (pduLength > length - offset))
+			return FALSE;
+
+		if (id == cmdId)
+			(*count)++;
+
+		offset += pduLength;
+	}
+
+	return TRUE;
+}
+
+/* Wait until the client received a PDU with cmdId, the channel thread sends asynchronously */
+static BOOL test_client_wait_pdu(UINT16 cmdId)
+{
+	BOOL found = FALSE;
+	wStream sbuffer = { 0 };
+	const UINT64 end = GetTickCount64() + 10000;
+
+	while (!found && (GetTickCount64() < end))
+	{
+		EnterCriticalSection(&g_Client.lock);
+		found = test_client_find_pdu(cmdId, &sbuffer);
+		LeaveCriticalSection(&g_Client.lock);
+
+		if (!found)
+			Sleep(1);
+	}
+
+	return found;
+}
+
+static RdpgfxServerContext* test_server_open(BOOL autoCacheImport)
+{
+	UINT error = CHANNEL_RC_OK;
+	RDPGFX_CAPSET capsSet = { 0 };
+	RDPGFX_CAPS_CONFIRM_PDU confirm = { 0 };
+	RdpgfxServerContext* context = rdpgfx_server_context_new(WTS_CURRENT_SERVER_HANDLE);
+
+	if (!context)
+		return NULL;
+
+	/* A new connection starts a new compression history */
+	zgfx_context_reset(g_Client.zgfx, FALSE);
+	context->autoCacheImport = autoCacheImport;
+	context->CacheImportOffer = test_cache_import_offer;
+
+	if (!context->Open(context))
+	{
+		rdpgfx_server_context_free(context);
+		return NULL;
+	}
+
+	capsSet.version = RDPGFX_CAPVERSION_10;
+	capsSet.length = 4;
+	confirm.capsSet = &capsSet;
+	IFCALLRET(context->CapsConfirm, error, context, &confirm);
+
+	if (error)
+	{
+		rdpgfx_server_context_free(context);
+		return NULL;
+	}
+
+	return context;
+}
+
+/* Offers go to the CacheImportOffer callback, no reply unless asked for */
+static BOOL test_cache_import_callback(void)
+{
+	BOOL rc = FALSE;
+	wStream sbuffer = { 0 };
+	const RDPGFX_CACHE_ENTRY_METADATA entries[] = { { 0x1111, TEST_CACHE_ENTRY_SIZE } };
+	RdpgfxServerContext* context = test_server_open(FALSE);
+
+	if (!context)
+		return FALSE;
+
+	test_client_reset();
+
+	if (!test_client_offer(entries, ARRAYSIZE(entries)) ||
+	    (WaitForSingleObject(g_Client.offered, 10000) != WAIT_OBJECT_0))
+		goto fail;
+
+	/* Joins the channel thread, the offer is completely handled afterwards */
+	context->Close(context);
+
+	if (test_client_find_pdu(RDPGFX_CMDID_CACHEIMPORTREPLY, &sbuffer))
+	{
+		fprintf(stderr, "unexpected CacheImportReply\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	rdpgfx_server_context_free(context);
+	return rc;
+}
+
+/* Imports go to free slots in offer order, entries that do not fit are refused */
+static BOOL test_cache_import_reply(void)
+{
+	BOOL rc = FALSE;
+	UINT16 x, count;
+	UINT error = CHANNEL_RC_OK;
+	wStream sbuffer = { 0 };
+	wStream* s = &sbuffer;
+	RDPGFX_SURFACE_TO_CACHE_PDU surfaceToCache = { 0 };
+	const RDPGFX_CACHE_ENTRY_METADATA entries[] = { { 0x1111, TEST_CACHE_ENTRY_SIZE },
+		                                            { 0x2222, 200 * 1024 * 1024 },
+		                                            { 0x3333, TEST_CACHE_ENTRY_SIZE } };
+	const UINT16 expected[] = { 2, 0, 3 };
+	RdpgfxServerContext* context = test_server_open(TRUE);
+
+	if (!context)
+		return FALSE;
+
+	/* Slot 1 is in use by this connection */
+	surfaceToCache.cacheKey = 0x4444;
+	surfaceToCache.cacheSlot = 1;
+	surfaceToCache.rectSrc.right = 64;
+	surfaceToCache.rectSrc.bottom = 64;
+	IFCALLRET(context->SurfaceToCache, error, context, &surfaceToCache);
+
+	if (error)
+		goto fail;
+
+	test_client_reset();
+
+	if (!test_client_offer(entries, ARRAYSIZE(entries)) ||
+	    (WaitForSingleObject(g_Client.offered, 10000) != WAIT_OBJECT_0))
+		goto fail;
+
+	context->Close(context);
+
+	if (!test_client_find_pdu(RDPGFX_CMDID_CACHEIMPORTREPLY, s) ||
+	    (Stream_GetRemainingLength(s) < 2))
+	{
+		fprintf(stderr, "missing CacheImportReply\n");
+		goto fail;
+	}
+
+	Stream_Read_UINT16(s, count);
+
+	if ((count != ARRAYSIZE(expected)) || (Stream_GetRemainingLength(s) < 2ULL * count))
+		goto fail;
+
+	for (x = 0; x < count; x++)
+	{
+		UINT16 slot;
+		Stream_Read_UINT16(s, slot);
+
+		if (slot != expected[x])
+		{
+			fprintf(stderr, "entry %" PRIu16 ": slot %" PRIu16 ", expected %" PRIu16 "\n", x,
+			        slot, expected[x]);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	rdpgfx_server_context_free(context);
+	return rc;
+}
+
+/* Imports count against the cache size including the slots filled before, imported and stored
+ * bitmaps can be looked up, and full caches hand out used slots */
+static BOOL test_cache_occupancy(void)
+{
+	BOOL rc = FALSE;
+	UINT16 x, count, slot;
+	UINT error = CHANNEL_RC_OK;
+	wStream sbuffer = { 0 };
+	wStream* s = &sbuffer;
+	RDPGFX_SURFACE_TO_CACHE_PDU surfaceToCache = { 0 };
+	const RDPGFX_CACHE_ENTRY_METADATA entries[] = { { 0x1111, 30 * 1024 * 1024 },
+		                                            { 0x2222, 30 * 1024 * 1024 },
+		                                            { 0x3333, TEST_CACHE_ENTRY_SIZE } };
+	const UINT16 expected[] = { 2, 0, 3 };
+	RdpgfxServerContext* context = test_server_open(TRUE);
+
+	if (!context)
+		return FALSE;
+
+	/* 64 MB of the 100 MB cache are in use by this connection */
+	surfaceToCache.cacheKey = 0x4444;
+	surfaceToCache.cacheSlot = 1;
+	surfaceToCache.rectSrc.right = 4096;
+	surfaceToCache.rectSrc.bottom = 4096;
+	IFCALLRET(context->SurfaceToCache, error, context, &surfaceToCache);
+
+	if (error)
+		goto fail;
+
+	test_client_reset();
+
+	/* The cache state is checked before Close resets it */
+	if (!test_client_offer(entries, ARRAYSIZE(entries)) ||
+	    !test_client_wait_pdu(RDPGFX_CMDID_CACHEIMPORTREPLY))
+		goto fail;
+
+	if (!test_client_find_pdu(RDPGFX_CMDID_CACHEIMPORTREPLY, s) ||
+	    (Stream_GetRemainingLength(s) < 2))
+	{
+		fprintf(stderr, "missing CacheImportReply\n");
+		goto fail;
+	}
+
+	Stream_Read_UINT16(s, count);
+
+	if ((count != ARRAYSIZE(expected)) || (Stream_GetRemainingLength(s) < 2ULL * count))
+		goto fail;
+
+	for (x = 0; x < count; x++)
+	{
+		Stream_Read_UINT16(s, slot);
+
+		if (slot != expected[x])
+		{
+			fprintf(stderr, "entry %" PRIu16 ": slot %" PRIu16 ", expected %" PRIu16 "\n", x,
+			        slot, expected[x]);
+			goto fail;
+		}
+	}
+
+	if (!rdpgfx_server_cache_lookup(context, 0x4444, &slot) || (slot != 1) ||
+	    !rdpgfx_server_cache_lookup(context, 0x1111, &slot) || (slot != 2) ||
+	    rdpgfx_server_cache_lookup(context, 0x2222, &slot))
+	{
+		fprintf(stderr, "cache lookup failed\n");
+		goto fail;
+	}
+
+	/* A free slot while the bitmap fits, otherwise a used slot that makes room for it */
+	if (!rdpgfx_server_cache_alloc_slot(context, 4 * 1024 * 1024, &slot) || (slot != 4))
+	{
+		fprintf(stderr, "expected free slot 4\n");
+		goto fail;
+	}
+
+	if (!rdpgfx_server_cache_alloc_slot(context, 10 * 1024 * 1024, &slot) || (slot != 1))
+	{
+		fprintf(stderr, "expected slot 1 to be reused\n");
+		goto fail;
+	}
+
+	surfaceToCache.cacheKey = 0x5555;
+	surfaceToCache.rectSrc.right = 64;
+	surfaceToCache.rectSrc.bottom = 64;
+	IFCALLRET(context->SurfaceToCache, error, context, &surfaceToCache);
+
+	if (error || rdpgfx_server_cache_lookup(context, 0x4444, &slot) ||
+	    !rdpgfx_server_cache_lookup(context, 0x5555, &slot) || (slot != 1))
+	{
+		fprintf(stderr, "overwritten slot still found by its old key\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	rdpgfx_server_context_free(context);
+	return rc;
+}
+
+/* All PDUs of a batch go out with a single channel write */
+static BOOL test_frame_batch(void)
+{
+	size_t x;
+	BOOL rc = FALSE;
+	UINT error = CHANNEL_RC_OK;
+	RECTANGLE_16 fillRect = { 0, 0, 64, 64 };
+	RDPGFX_CREATE_SURFACE_PDU createSurface = { 0 };
+	RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU surfaceToOutput = { 0 };
+	RDPGFX_START_FRAME_PDU startFrame = { 0 };
+	RDPGFX_SOLID_FILL_PDU solidFill = { 0 };
+	RDPGFX_END_FRAME_PDU endFrame = { 0 };
+	const UINT16 expected[] = { RDPGFX_CMDID_CREATESURFACE, RDPGFX_CMDID_MAPSURFACETOOUTPUT,
+		                        RDPGFX_CMDID_STARTFRAME, RDPGFX_CMDID_SOLIDFILL,
+		                        RDPGFX_CMDID_ENDFRAME };
+	RdpgfxServerContext* context = test_server_open(FALSE);
+
+	if (!context)
+		return FALSE;
+
+	test_client_reset();
+	createSurface.width = 1024;
+	createSurface.height = 768;
+	createSurface.pixelFormat = GFX_PIXEL_FORMAT_XRGB_8888;
+	solidFill.fillRectCount = 1;
+	solidFill.fillRects = &fillRect;
+	IFCALLRET(context->BeginFrameBatch, error, context);
+
+	if (error)
+		goto fail;
+
+	IFCALLRET(context->CreateSurface, error, context, &createSurface);
+
+	if (!error)
+		IFCALLRET(context->MapSurfaceToOutput, error, context, &surfaceToOutput);
+
+	if (!error)
+		IFCALLRET(context->StartFrame, error, context, &startFrame);
+
+	if (!error)
+		IFCALLRET(context->SolidFill, error, context, &solidFill);
+
+	if (!error)
+		IFCALLRET(context->EndFrame, error, context, &endFrame);
+
+	if (error || (g_Client.writes != 0))
+		goto fail;
+
+	IFCALLRET(context->SubmitFrameBatch, error, context);
+
+	if (error || (g_Client.writes != 1))
+	{
+		fprintf(stderr, "%" PRIu32 " channel writes for one batch\n", g_Client.writes);
+		goto fail;
+	}
+
+	for (x = 0; x < ARRAYSIZE(expected); x++)
+	{
+		size_t count;
+
+		if (!test_client_count_pdus(expected[x], &count) || (count != 1))
+		{
+			fprintf(stderr, "PDU 0x%04" PRIX16 " missing from the batch\n", expected[x]);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	rdpgfx_server_context_free(context);
+	return rc;
+}
+
+static DWORD WINAPI test_send_thread(LPVOID arg)
+{
+	size_t x;
+	RECTANGLE_16 fillRect = { 0, 0, 64, 64 };
+	RDPGFX_SOLID_FILL_PDU solidFill = { 0 };
+	RdpgfxServerContext* context = (RdpgfxServerContext*)arg;
+
+	solidFill.fillRectCount = 1;
+	solidFill.fillRects = &fillRect;
+
+	for (x = 0; x < TEST_FRAMES; x++)
+	{
+		if (context->SolidFill(context, &solidFill) != CHANNEL_RC_OK)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* PDUs sent by other threads while a batch is collected are not mixed into it */
+static BOOL test_frame_batch_threads(void)
+{
+	size_t x;
+	BOOL rc = FALSE;
+	size_t starts = 0, ends = 0, fills = 0;
+	DWORD status = 1;
+	HANDLE thread = NULL;
+	RDPGFX_START_FRAME_PDU startFrame = { 0 };
+	RDPGFX_END_FRAME_PDU endFrame = { 0 };
+	RdpgfxServerContext* context = test_server_open(FALSE);
+
+	if (!context)
+		return FALSE;
+
+	test_client_reset();
+
+	if (!(thread = CreateThread(NULL, 0, test_send_thread, context, 0, NULL)))
+		goto fail;
+
+	for (x = 0; x < TEST_FRAMES; x++)
+	{
+		startFrame.frameId = endFrame.frameId = (UINT32)x;
+
+		if ((context->BeginFrameBatch(context) != CHANNEL_RC_OK) ||
+		    (context->StartFrame(context, &startFrame) != CHANNEL_RC_OK))
+			goto fail;
+
+		/* Let the other thread send while the batch is open */
+		Sleep(1);
+
+		if ((context->EndFrame(context, &endFrame) != CHANNEL_RC_OK) ||
+		    (context->SubmitFrameBatch(context) != CHANNEL_RC_OK))
+			goto fail;
+	}
+
+	WaitForSingleObject(thread, INFINITE);
+	GetExitCodeThread(thread, &status);
+
+	if (status != 0)
+		goto fail;
+
+	if (!test_client_count_pdus(RDPGFX_CMDID_STARTFRAME, &starts) ||
+	    !test_client_count_pdus(RDPGFX_CMDID_ENDFRAME, &ends) ||
+	    !test_client_count_pdus(RDPGFX_CMDID_SOLIDFILL, &fills))
+	{
+		fprintf(stderr, "broken PDU stream\n");
+		goto fail;
+	}
+
+	if ((starts != TEST_FRAMES) || (ends != TEST_FRAMES) || (fills != TEST_FRAMES) ||
+	    (g_Client.writes != 2 * TEST_FRAMES))
+	{
+		fprintf(stderr,
+		        "%" PRIuz " frames, %" PRIuz " fills in %" PRIu32 " writes, expected %d each\n",
+		        starts, fills, g_Client.writes, TEST_FRAMES);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (thread)
+	{
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+
+	rdpgfx_server_context_free(context);
+	return rc;
+}
+
+/* An open batch does not block the PDUs of other threads */
+static BOOL test_frame_batch_open(void)
+{
+	BOOL rc = FALSE;
+	DWORD status = 1;
+	HANDLE thread = NULL;
+	RdpgfxServerContext* context = test_server_open(FALSE);
+
+	if (!context)
+		return FALSE;
+
+	test_client_reset();
+
+	if ((context->BeginFrameBatch(context) != CHANNEL_RC_OK) ||
+	    !(thread = CreateThread(NULL, 0, test_send_thread, context, 0, NULL)))
+		goto fail;
+
+	if (WaitForSingleObject(thread, 5000) != WAIT_OBJECT_0)
+	{
+		fprintf(stderr, "another thread was blocked by an open batch\n");
+		goto fail;
+	}
+
+	GetExitCodeThread(thread, &status);
+
+	if ((status != 0) || (g_Client.writes != TEST_FRAMES) ||
+	    (context->SubmitFrameBatch(context) != CHANNEL_RC_OK))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (thread)
+	{
+		/* Unblocks the thread if the open batch blocked it */
+		if (!rc)
+			context->SubmitFrameBatch(context);
+
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+
+	rdpgfx_server_context_free(context);
+	return rc;
+}
+
+int TestServerRdpgfx(int argc, char* argv[])
+{
+	int rc = -1;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	testWtsApi.pVirtualChannelOpenEx = test_VirtualChannelOpenEx;
+	testWtsApi.pVirtualChannelClose = test_VirtualChannelClose;
+	testWtsApi.pVirtualChannelRead = test_VirtualChannelRead;
+	testWtsApi.pVirtualChannelWrite = test_VirtualChannelWrite;
+	testWtsApi.pVirtualChannelQuery = test_VirtualChannelQuery;
+	testWtsApi.pQuerySessionInformationA = test_QuerySessionInformationA;
+	testWtsApi.pFreeMemory = test_FreeMemory;
+
+	if (!WTSRegisterWtsApiFunctionTable(&testWtsApi))
+		return -1;
+
+	InitializeCriticalSection(&g_Client.lock);
+	g_Client.event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	g_Client.offered = CreateEvent(NULL, TRUE, FALSE, NULL);
+	g_Client.pending = Queue_New(FALSE, -1, -1);
+	g_Client.zgfx = zgfx_context_new(FALSE);
+	g_Client.received = Stream_New(NULL, 1024);
+
+	if (!g_Client.event || !g_Client.offered || !g_Client.pending || !g_Client.zgfx ||
+	    !g_Client.received)
+		goto fail;
+
+	if (!test_cache_import_callback())
+		goto fail;
+
+	if (!test_cache_import_reply())
+		goto fail;
+
+	if (!test_cache_occupancy())
+		goto fail;
+
+	if (!test_frame_batch())
+		goto fail;
+
+	if (!test_frame_batch_threads())
+		goto fail;
+
+	if (!test_frame_batch_open())
+		goto fail;
+
+	rc = 0;
+fail:
+	Stream_Free(g_Client.received, TRUE);
+	zgfx_context_free(g_Client.zgfx);
+	Queue_Free(g_Client.pending);
+	CloseHandle(g_Client.offered);
+	CloseHandle(g_Client.event);
+	DeleteCriticalSection(&g_Client.lock);
+	return rc;
+}
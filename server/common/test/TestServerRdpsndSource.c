@@ -0,0 +1,406 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+#include <winpr/thread.h>
+#include <winpr/wtsapi.h>
+
+#include <freerdp/server/rdpsnd.h>
+
+#define TEST_CLIENTS 8
+#define TEST_FRAMES_PER_CALL 441
+#define TEST_CALLS 200
+#define TEST_FREE_ROUNDS 100
+
+static size_t g_Written = 0;
+static size_t g_Wave2Count = 0;
+static size_t g_Wave2Length = 0;
+static UINT16 g_Wave2Format = 0;
+
+static HANDLE WINAPI test_VirtualChannelOpen(HANDLE hServer, DWORD SessionId, LPSTR pVirtualName)
+{
+	WINPR_UNUSED(hServer);
+	WINPR_UNUSED(SessionId);
+	WINPR_UNUSED(pVirtualName);
+	return (HANDLE)&g_Written;
+}
+
+static BOOL WINAPI test_VirtualChannelClose(HANDLE hChannelHandle)
+{
+	WINPR_UNUSED(hChannelHandle);
+	return TRUE;
+}
+
+static BOOL WINAPI test_VirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer, ULONG Length,
+                                            PULONG pBytesWritten)
+{
+	WINPR_UNUSED(hChannelHandle);
+	g_Written += Length;
+
+	/* Remember the last Wave2 PDU, its audio data follows a 16 byte header */
+	if ((Length >= 16) && ((BYTE)Buffer[0] == SNDC_WAVE2))
+	{
+		g_Wave2Count++;
+		g_Wave2Length = Length - 16;
+		g_Wave2Format = (BYTE)Buffer[6] | ((BYTE)Buffer[7] << 8);
+	}
+
+	if (pBytesWritten)
+		*pBytesWritten = Length;
+
+	return TRUE;
+}
+
+static BOOL WINAPI test_VirtualChannelQuery(HANDLE hChannelHandle,
+                                            WTS_VIRTUAL_CLASS WtsVirtualClass, PVOID* ppBuffer,
+                                            DWORD* pBytesReturned)
+{
+	HANDLE* event;
+	WINPR_UNUSED(hChannelHandle);
+
+	if (WtsVirtualClass != WTSVirtualEventHandle)
+		return FALSE;
+
+	event = (HANDLE*)calloc(1, sizeof(HANDLE));
+
+	if (!event)
+		return FALSE;
+
+	*ppBuffer = event;
+	*pBytesReturned = sizeof(HANDLE);
+	return TRUE;
+}
+
+static VOID WINAPI test_FreeMemory(PVOID pMemory)
+{
+	free(pMemory);
+}
+
+static WtsApiFunctionTable testWtsApi = { 0 };
+
+/* Stereo to mono downmix, the encoding work available without external codecs */
+static const AUDIO_FORMAT client_format = { WAVE_FORMAT_PCM, 1, 44100, 88200, 2, 16, 0, NULL };
+static const AUDIO_FORMAT stereo_format = { WAVE_FORMAT_PCM, 2, 44100, 176400, 4, 16, 0, NULL };
+
+static RdpsndServerContext* test_context_new_ex(const AUDIO_FORMAT* src_format,
+                                                const AUDIO_FORMAT* client_formats,
+                                                UINT16 num_client_formats)
+{
+	UINT16 x;
+	RdpsndServerContext* context = rdpsnd_server_context_new(WTS_CURRENT_SERVER_HANDLE);
+
+	if (!context)
+		return NULL;
+
+	context->src_format = (AUDIO_FORMAT*)src_format;
+	context->client_formats = (AUDIO_FORMAT*)calloc(num_client_formats, sizeof(AUDIO_FORMAT));
+
+	if (!context->client_formats)
+		goto fail;
+
+	for (x = 0; x < num_client_formats; x++)
+		context->client_formats[x] = client_formats[x];
+
+	context->num_client_formats = num_client_formats;
+	context->clientVersion = 0x08; /* CHANNEL_VERSION_WIN_8, send Wave2 PDUs */
+
+	if (context->Initialize(context, FALSE) != CHANNEL_RC_OK)
+		goto fail;
+
+	if (context->SelectFormat(context, 0) != CHANNEL_RC_OK)
+	{
+		context->Stop(context);
+		goto fail;
+	}
+
+	return context;
+fail:
+	rdpsnd_server_context_free(context);
+	return NULL;
+}
+
+static RdpsndServerContext* test_context_new(const AUDIO_FORMAT* src_format,
+                                             const AUDIO_FORMAT* client_format)
+{
+	return test_context_new_ex(src_format, client_format, 1);
+}
+
+static void test_context_free(RdpsndServerContext* context)
+{
+	if (!context)
+		return;
+
+	context->Stop(context);
+	rdpsnd_server_context_free(context);
+}
+
+static void fill_samples(INT16* samples, size_t frames, size_t offset)
+{
+	size_t x;
+
+	for (x = 0; x < frames; x++)
+	{
+		/* 441 Hz triangle wave */
+		const INT32 phase = (INT32)((offset + x) % 100);
+		const INT16 value = (INT16)((phase < 50) ? (phase * 320 - 8000) : (24000 - phase * 320));
+		samples[2 * x] = value;
+		samples[2 * x + 1] = value;
+	}
+}
+
+/* Samples queued on the context itself survive blocks sent by a shared source */
+static BOOL test_pending_frames(const AUDIO_FORMAT* src_format, const INT16* samples)
+{
+	BOOL rc = FALSE;
+	RdpsndServerSource* source = NULL;
+	RdpsndServerContext* context = test_context_new(src_format, &client_format);
+
+	if (!context)
+		return FALSE;
+
+	/* Less than a block, nothing is sent yet */
+	g_Wave2Count = 0;
+
+	if ((context->SendSamples(context, samples, 10, 0) != CHANNEL_RC_OK) || (g_Wave2Count != 0))
+		goto fail;
+
+	if (!(source = rdpsnd_server_source_new(src_format, 0)) ||
+	    !rdpsnd_server_source_add_context(source, context))
+		goto fail;
+
+	if ((rdpsnd_server_source_send_samples(source, samples, TEST_FRAMES_PER_CALL * 10, 0) !=
+	     CHANNEL_RC_OK) ||
+	    (g_Wave2Count == 0))
+		goto fail;
+
+	if (!rdpsnd_server_source_remove_context(source, context))
+		goto fail;
+
+	/* Closing the channel flushes the 10 pending frames */
+	g_Wave2Count = 0;
+
+	if ((context->Close(context) != CHANNEL_RC_OK) || (g_Wave2Count != 1) ||
+	    (g_Wave2Length != 10 * client_format.nBlockAlign))
+	{
+		fprintf(stderr, "pending frames lost: %" PRIuz " PDUs, %" PRIuz " bytes\n", g_Wave2Count,
+		        g_Wave2Length);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	test_context_free(context);
+	rdpsnd_server_source_free(source);
+	return rc;
+}
+
+/* A subscribed context selecting another format gets blocks in that format */
+static BOOL test_select_format(const AUDIO_FORMAT* src_format, const INT16* samples)
+{
+	BOOL rc = FALSE;
+	size_t monoLength;
+	RdpsndServerSource* source = NULL;
+	const AUDIO_FORMAT formats[] = { client_format, stereo_format };
+	RdpsndServerContext* context = test_context_new_ex(src_format, formats, ARRAYSIZE(formats));
+
+	if (!context)
+		return FALSE;
+
+	if (!(source = rdpsnd_server_source_new(src_format, 0)) ||
+	    !rdpsnd_server_source_add_context(source, context))
+		goto fail;
+
+	g_Wave2Count = 0;
+
+	if ((rdpsnd_server_source_send_samples(source, samples, TEST_FRAMES_PER_CALL * 10, 0) !=
+	     CHANNEL_RC_OK) ||
+	    (g_Wave2Count == 0) || (g_Wave2Format != 0))
+		goto fail;
+
+	monoLength = g_Wave2Length;
+
+	if (context->SelectFormat(context, 1) != CHANNEL_RC_OK)
+		goto fail;
+
+	g_Wave2Count = 0;
+
+	if ((rdpsnd_server_source_send_samples(source, samples, TEST_FRAMES_PER_CALL * 10, 0) !=
+	     CHANNEL_RC_OK) ||
+	    (g_Wave2Count == 0))
+		goto fail;
+
+	/* Same block duration, twice the channels */
+	if ((g_Wave2Format != 1) || (g_Wave2Length != 2 * monoLength))
+	{
+		fprintf(stderr, "format %" PRIu16 ", %" PRIuz " bytes after switching from %" PRIuz "\n",
+		        g_Wave2Format, g_Wave2Length, monoLength);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	test_context_free(context);
+	rdpsnd_server_source_free(source);
+	return rc;
+}
+
+static DWORD WINAPI test_source_free_thread(LPVOID arg)
+{
+	rdpsnd_server_source_free((RdpsndServerSource*)arg);
+	return 0;
+}
+
+/* A source and its subscribed context may be freed by different threads at the same time */
+static BOOL test_concurrent_free(const AUDIO_FORMAT* src_format)
+{
+	size_t x;
+
+	for (x = 0; x < TEST_FREE_ROUNDS; x++)
+	{
+		HANDLE thread;
+		RdpsndServerSource* source = NULL;
+		RdpsndServerContext* context = test_context_new(src_format, &client_format);
+
+		if (!context || !(source = rdpsnd_server_source_new(src_format, 0)) ||
+		    !rdpsnd_server_source_add_context(source, context))
+		{
+			test_context_free(context);
+			rdpsnd_server_source_free(source);
+			return FALSE;
+		}
+
+		thread = CreateThread(NULL, 0, test_source_free_thread, source, 0, NULL);
+
+		if (!thread)
+		{
+			test_context_free(context);
+			rdpsnd_server_source_free(source);
+			return FALSE;
+		}
+
+		test_context_free(context);
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+
+	return TRUE;
+}
+
+int TestServerRdpsndSource(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t x, y;
+	UINT64 start, perClient, shared;
+	size_t writtenPerClient, writtenShared;
+	const AUDIO_FORMAT src_format = { WAVE_FORMAT_PCM, 2, 44100, 176400, 4, 16, 0, NULL };
+	RdpsndServerContext* contexts[TEST_CLIENTS] = { 0 };
+	RdpsndServerSource* source = NULL;
+	INT16* samples = NULL;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	testWtsApi.pVirtualChannelOpen = test_VirtualChannelOpen;
+	testWtsApi.pVirtualChannelClose = test_VirtualChannelClose;
+	testWtsApi.pVirtualChannelWrite = test_VirtualChannelWrite;
+	testWtsApi.pVirtualChannelQuery = test_VirtualChannelQuery;
+	testWtsApi.pFreeMemory = test_FreeMemory;
+
+	if (!WTSRegisterWtsApiFunctionTable(&testWtsApi))
+		return -1;
+
+	samples = (INT16*)calloc(TEST_FRAMES_PER_CALL * TEST_CALLS, 2 * sizeof(INT16));
+
+	if (!samples)
+		goto fail;
+
+	fill_samples(samples, TEST_FRAMES_PER_CALL * TEST_CALLS, 0);
+
+	for (x = 0; x < TEST_CLIENTS; x++)
+	{
+		contexts[x] = test_context_new(&src_format, &client_format);
+
+		if (!contexts[x])
+			goto fail;
+	}
+
+	/* Every context encodes the samples on its own */
+	g_Written = 0;
+	start = GetTickCount64();
+
+	for (y = 0; y < TEST_CALLS; y++)
+	{
+		const INT16* buf = &samples[y * TEST_FRAMES_PER_CALL * 2];
+
+		for (x = 0; x < TEST_CLIENTS; x++)
+		{
+			if (contexts[x]->SendSamples(contexts[x], buf, TEST_FRAMES_PER_CALL, 0) !=
+			    CHANNEL_RC_OK)
+				goto fail;
+		}
+	}
+
+	perClient = GetTickCount64() - start;
+	writtenPerClient = g_Written;
+
+	/* One shared source encodes once and fans out */
+	source = rdpsnd_server_source_new(&src_format, 0);
+
+	if (!source)
+		goto fail;
+
+	for (x = 0; x < TEST_CLIENTS; x++)
+	{
+		if (!rdpsnd_server_source_add_context(source, contexts[x]))
+			goto fail;
+	}
+
+	g_Written = 0;
+	start = GetTickCount64();
+
+	for (y = 0; y < TEST_CALLS; y++)
+	{
+		const INT16* buf = &samples[y * TEST_FRAMES_PER_CALL * 2];
+
+		if (rdpsnd_server_source_send_samples(source, buf, TEST_FRAMES_PER_CALL, 0) !=
+		    CHANNEL_RC_OK)
+			goto fail;
+	}
+
+	shared = GetTickCount64() - start;
+	writtenShared = g_Written;
+	printf("%d clients, %d calls: per client encode %" PRIu64 " ms, shared encode %" PRIu64
+	       " ms\n",
+	       TEST_CLIENTS, TEST_CALLS, perClient, shared);
+
+	/* Both paths must produce the same amount of wave data on the wire */
+	if (writtenShared != writtenPerClient)
+	{
+		fprintf(stderr, "written mismatch: per client %" PRIuz ", shared %" PRIuz "\n",
+		        writtenPerClient, writtenShared);
+		goto fail;
+	}
+
+	if (!rdpsnd_server_source_remove_context(source, contexts[0]))
+		goto fail;
+
+	if (rdpsnd_server_source_remove_context(source, contexts[0]))
+		goto fail;
+
+	if (!test_pending_frames(&src_format, samples))
+		goto fail;
+
+	if (!test_select_format(&src_format, samples))
+		goto fail;
+
+	if (!test_concurrent_free(&src_format))
+		goto fail;
+
+	rc = 0;
+fail:
+	for (x = 0; x < TEST_CLIENTS; x++)
+		test_context_free(contexts[x]);
+
+	rdpsnd_server_source_free(source);
+	free(samples);
+	return rc;
+}
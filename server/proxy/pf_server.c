@@ -363,6 +363,7 @@ static BOOL pf_server_initialize_peer_connection(freerdp_peer* peer)
 static DWORD WINAPI pf_server_handle_peer(LPVOID arg)
 {
 	HANDLE eventHandles[32];
+	WINPR_WAIT_SET* waitSet = NULL;
 	HANDLE ChannelEvent;
 	DWORD eventCount;
 	DWORD tmp;
@@ -388,6 +389,10 @@ static DWORD WINAPI pf_server_handle_peer(LPVOID arg)
 	/* Main client event handling loop */
 	ChannelEvent = WTSVirtualChannelManagerGetEventHandle(ps->vcm);
 
+	/* The handles only change with the transport, keep them registered between waits */
+	if (!(waitSet = winpr_WaitSet_New()))
+		goto fail;
+
 	while (1)
 	{
 		eventCount = 0;
@@ -405,11 +410,18 @@ static DWORD WINAPI pf_server_handle_peer(LPVOID arg)
 		eventHandles[eventCount++] = ChannelEvent;
 		eventHandles[eventCount++] = pdata->abort_event;
 		eventHandles[eventCount++] = WTSVirtualChannelManagerGetEventHandle(ps->vcm);
-		status = WaitForMultipleObjects(eventCount, eventHandles, FALSE, INFINITE);
+
+		if (!winpr_WaitSet_Update(waitSet, eventHandles, eventCount))
+		{
+			WLog_ERR(TAG, "winpr_WaitSet_Update failed");
+			break;
+		}
+
+		status = winpr_WaitSet_Wait(waitSet, INFINITE);
 
 		if (status == WAIT_FAILED)
 		{
-			WLog_ERR(TAG, "WaitForMultipleObjects failed (status: %d)", status);
+			WLog_ERR(TAG, "winpr_WaitSet_Wait failed (status: %d)", status);
 			break;
 		}
 
@@ -460,7 +472,7 @@ static DWORD WINAPI pf_server_handle_peer(LPVOID arg)
 	}
 
 fail:
-
+	winpr_WaitSet_Free(waitSet);
 	pc = (rdpContext*)pdata->pc;
 	LOG_INFO(TAG, ps, "starting shutdown of connection");
 	LOG_INFO(TAG, ps, "stopping proxy's client");
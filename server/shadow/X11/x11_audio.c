@@ -0,0 +1,665 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 Shadow Desktop Audio Capture
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/log.h>
+#include <freerdp/server/rdpsnd.h>
+
+#if defined(WITH_PULSE)
+#include <pulse/pulseaudio.h>
+#endif
+
+#if defined(WITH_ALSA)
+#include <alsa/asoundlib.h>
+#endif
+
+#include "x11_audio.h"
+
+#define TAG SERVER_TAG("shadow.x11.audio")
+
+/* Capture period, samples are handed to the rdpsnd source at this rate */
+#define X11_AUDIO_PERIOD_MS 10
+/* Audio per wave PDU sent to the clients */
+#define X11_AUDIO_BLOCK_MS 20
+/* Periods buffered by the capture device or the sender before old samples are dropped */
+#define X11_AUDIO_MAX_PERIODS 4
+/* Blocks a client may leave unconfirmed before blocks are dropped for it */
+#define X11_AUDIO_MAX_PENDING_BLOCKS 4
+
+#define X11_AUDIO_PULSE_DEVICE "@DEFAULT_MONITOR@"
+#define X11_AUDIO_ALSA_DEVICE "hw:Loopback,1,0"
+
+typedef struct
+{
+	BYTE* data;
+	size_t frames;
+	UINT16 wTimestamp; /* Capture time of the first frame */
+} x11ShadowAudioPeriod;
+
+struct x11_shadow_audio
+{
+	rdpShadowSubsystem* subsystem;
+	RdpsndServerSource* source;
+	AUDIO_FORMAT format;
+	size_t bytes_per_frame;
+	size_t period_frames;
+
+	/* Captured periods, sent to the clients by the sender thread. The last queued period may
+	 * still be filling up. */
+	CRITICAL_SECTION lock;
+	x11ShadowAudioPeriod periods[X11_AUDIO_MAX_PERIODS];
+	size_t head;
+	size_t queued;
+	HANDLE dataEvent;
+	HANDLE senderStopEvent;
+	HANDLE senderThread;
+	BYTE* period;
+
+#if defined(WITH_PULSE)
+	pa_threaded_mainloop* mainloop;
+	pa_context* context;
+	pa_stream* stream;
+#endif
+
+#if defined(WITH_ALSA)
+	snd_pcm_t* capture;
+	BYTE* buffer;
+	HANDLE stopEvent;
+	HANDLE thread;
+#endif
+};
+
+BOOL x11_shadow_audio_write(x11ShadowAudio* audio, const void* data, size_t frames,
+                            UINT32 timestamp)
+{
+	size_t offset = 0;
+	const BYTE* samples = (const BYTE*)data;
+
+	if (!audio || !data)
+		return FALSE;
+
+	EnterCriticalSection(&audio->lock);
+
+	while (offset < frames)
+	{
+		size_t count;
+		x11ShadowAudioPeriod* period = NULL;
+
+		if (audio->queued > 0)
+			period = &audio->periods[(audio->head + audio->queued - 1) % X11_AUDIO_MAX_PERIODS];
+
+		if (!period || (period->frames == audio->period_frames))
+		{
+			/* The sender is behind, drop the oldest period to keep the latency bounded */
+			if (audio->queued == X11_AUDIO_MAX_PERIODS)
+			{
+				audio->head = (audio->head + 1) % X11_AUDIO_MAX_PERIODS;
+				audio->queued--;
+			}
+
+			period = &audio->periods[(audio->head + audio->queued) % X11_AUDIO_MAX_PERIODS];
+			period->frames = 0;
+			period->wTimestamp =
+			    (UINT16)(timestamp + offset * 1000 / audio->format.nSamplesPerSec);
+			audio->queued++;
+		}
+
+		count = MIN(frames - offset, audio->period_frames - period->frames);
+		CopyMemory(&period->data[period->frames * audio->bytes_per_frame],
+		           &samples[offset * audio->bytes_per_frame], count * audio->bytes_per_frame);
+		period->frames += count;
+		offset += count;
+
+		if (period->frames == audio->period_frames)
+			SetEvent(audio->dataEvent);
+	}
+
+	LeaveCriticalSection(&audio->lock);
+	return TRUE;
+}
+
+#if defined(WITH_PULSE) || defined(WITH_ALSA)
+/* Capture time of the first of the frames just delivered by the capture device */
+static UINT32 x11_shadow_audio_capture_time(const x11ShadowAudio* audio, size_t frames)
+{
+	return GetTickCount() - (UINT32)(frames * 1000 / audio->format.nSamplesPerSec);
+}
+#endif
+
+/* Takes the oldest complete period, returns FALSE if there is none */
+static BOOL x11_shadow_audio_read(x11ShadowAudio* audio, UINT16* wTimestamp)
+{
+	BOOL rc = FALSE;
+	const x11ShadowAudioPeriod* period;
+	EnterCriticalSection(&audio->lock);
+	period = &audio->periods[audio->head];
+
+	if ((audio->queued > 0) && (period->frames == audio->period_frames))
+	{
+		CopyMemory(audio->period, period->data, period->frames * audio->bytes_per_frame);
+		*wTimestamp = period->wTimestamp;
+		audio->head = (audio->head + 1) % X11_AUDIO_MAX_PERIODS;
+		audio->queued--;
+		rc = TRUE;
+	}
+
+	period = &audio->periods[audio->head];
+
+	if ((audio->queued == 0) || (period->frames < audio->period_frames))
+		ResetEvent(audio->dataEvent);
+
+	LeaveCriticalSection(&audio->lock);
+	return rc;
+}
+
+/* Encoding and sending to the clients may block, the capture callbacks only queue */
+static DWORD WINAPI x11_shadow_audio_sender_thread(LPVOID arg)
+{
+	DWORD status;
+	UINT16 wTimestamp;
+	x11ShadowAudio* audio = (x11ShadowAudio*)arg;
+	HANDLE events[2];
+	events[0] = audio->senderStopEvent;
+	events[1] = audio->dataEvent;
+
+	for (;;)
+	{
+		status = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+
+		if (status != WAIT_OBJECT_0 + 1)
+			break;
+
+		while (x11_shadow_audio_read(audio, &wTimestamp))
+		{
+			const UINT rc = rdpsnd_server_source_send_samples(
+			    audio->source, audio->period, (int)audio->period_frames, wTimestamp);
+
+			if (rc != CHANNEL_RC_OK)
+				WLog_DBG(TAG, "rdpsnd_server_source_send_samples failed with error %" PRIu32 "",
+				         rc);
+		}
+	}
+
+	if (status == WAIT_FAILED)
+		WLog_ERR(TAG, "WaitForMultipleObjects failed with error %" PRIu32 "", GetLastError());
+
+	ExitThread(0);
+	return 0;
+}
+
+static void x11_shadow_audio_sender_stop(x11ShadowAudio* audio)
+{
+	if (audio->senderThread)
+	{
+		SetEvent(audio->senderStopEvent);
+		WaitForSingleObject(audio->senderThread, INFINITE);
+		CloseHandle(audio->senderThread);
+		audio->senderThread = NULL;
+	}
+}
+
+#if defined(WITH_PULSE)
+static void x11_shadow_audio_pulse_context_state(pa_context* context, void* userdata)
+{
+	x11ShadowAudio* audio = (x11ShadowAudio*)userdata;
+
+	switch (pa_context_get_state(context))
+	{
+		case PA_CONTEXT_READY:
+		case PA_CONTEXT_FAILED:
+		case PA_CONTEXT_TERMINATED:
+			pa_threaded_mainloop_signal(audio->mainloop, 0);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void x11_shadow_audio_pulse_stream_state(pa_stream* stream, void* userdata)
+{
+	x11ShadowAudio* audio = (x11ShadowAudio*)userdata;
+
+	switch (pa_stream_get_state(stream))
+	{
+		case PA_STREAM_READY:
+		case PA_STREAM_FAILED:
+		case PA_STREAM_TERMINATED:
+			pa_threaded_mainloop_signal(audio->mainloop, 0);
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void x11_shadow_audio_pulse_read(pa_stream* stream, size_t length, void* userdata)
+{
+	const void* data;
+	x11ShadowAudio* audio = (x11ShadowAudio*)userdata;
+
+	while (pa_stream_readable_size(stream) > 0)
+	{
+		if ((pa_stream_peek(stream, &data, &length) < 0) || (length == 0))
+			break;
+
+		/* data is NULL for holes in the record buffer */
+		if (data)
+		{
+			const size_t frames = length / audio->bytes_per_frame;
+			x11_shadow_audio_write(audio, data, frames,
+			                       x11_shadow_audio_capture_time(audio, frames));
+		}
+
+		pa_stream_drop(stream);
+	}
+}
+
+static void x11_shadow_audio_pulse_stop(x11ShadowAudio* audio)
+{
+	if (audio->stream)
+	{
+		pa_threaded_mainloop_lock(audio->mainloop);
+		pa_stream_disconnect(audio->stream);
+		pa_stream_unref(audio->stream);
+		audio->stream = NULL;
+		pa_threaded_mainloop_unlock(audio->mainloop);
+	}
+
+	if (audio->mainloop)
+		pa_threaded_mainloop_stop(audio->mainloop);
+
+	if (audio->context)
+	{
+		pa_context_disconnect(audio->context);
+		pa_context_unref(audio->context);
+		audio->context = NULL;
+	}
+
+	if (audio->mainloop)
+	{
+		pa_threaded_mainloop_free(audio->mainloop);
+		audio->mainloop = NULL;
+	}
+}
+
+static BOOL x11_shadow_audio_pulse_start(x11ShadowAudio* audio)
+{
+	pa_context_state_t context_state;
+	pa_stream_state_t stream_state;
+	pa_buffer_attr buffer_attr = { 0 };
+	pa_sample_spec sample_spec = { 0 };
+	const UINT32 period_bytes = (UINT32)(audio->period_frames * audio->bytes_per_frame);
+	sample_spec.format = PA_SAMPLE_S16LE;
+	sample_spec.rate = audio->format.nSamplesPerSec;
+	sample_spec.channels = (uint8_t)audio->format.nChannels;
+	audio->mainloop = pa_threaded_mainloop_new();
+
+	if (!audio->mainloop)
+		return FALSE;
+
+	audio->context = pa_context_new(pa_threaded_mainloop_get_api(audio->mainloop), "freerdp");
+
+	if (!audio->context)
+		goto fail;
+
+	pa_context_set_state_callback(audio->context, x11_shadow_audio_pulse_context_state, audio);
+
+	if (pa_context_connect(audio->context, NULL, PA_CONTEXT_NOAUTOSPAWN, NULL) < 0)
+	{
+		WLog_DBG(TAG, "pa_context_connect failed (%d)", pa_context_errno(audio->context));
+		goto fail;
+	}
+
+	pa_threaded_mainloop_lock(audio->mainloop);
+
+	if (pa_threaded_mainloop_start(audio->mainloop) < 0)
+		goto fail_unlock;
+
+	for (;;)
+	{
+		context_state = pa_context_get_state(audio->context);
+
+		if (context_state == PA_CONTEXT_READY)
+			break;
+
+		if (!PA_CONTEXT_IS_GOOD(context_state))
+			goto fail_unlock;
+
+		pa_threaded_mainloop_wait(audio->mainloop);
+	}
+
+	audio->stream = pa_stream_new(audio->context, "desktop audio", &sample_spec, NULL);
+
+	if (!audio->stream)
+		goto fail_unlock;
+
+	pa_stream_set_state_callback(audio->stream, x11_shadow_audio_pulse_stream_state, audio);
+	pa_stream_set_read_callback(audio->stream, x11_shadow_audio_pulse_read, audio);
+	/* Small fragments and a short record buffer keep the capture latency bounded */
+	buffer_attr.maxlength = period_bytes * X11_AUDIO_MAX_PERIODS;
+	buffer_attr.tlength = (UINT32)-1;
+	buffer_attr.prebuf = (UINT32)-1;
+	buffer_attr.minreq = (UINT32)-1;
+	buffer_attr.fragsize = period_bytes;
+
+	if (pa_stream_connect_record(audio->stream, X11_AUDIO_PULSE_DEVICE, &buffer_attr,
+	                             PA_STREAM_ADJUST_LATENCY) < 0)
+		goto fail_unlock;
+
+	for (;;)
+	{
+		stream_state = pa_stream_get_state(audio->stream);
+
+		if (stream_state == PA_STREAM_READY)
+			break;
+
+		if (!PA_STREAM_IS_GOOD(stream_state))
+			goto fail_unlock;
+
+		pa_threaded_mainloop_wait(audio->mainloop);
+	}
+
+	pa_threaded_mainloop_unlock(audio->mainloop);
+	WLog_INFO(TAG, "capturing desktop audio from PulseAudio %s", X11_AUDIO_PULSE_DEVICE);
+	return TRUE;
+fail_unlock:
+	WLog_DBG(TAG, "PulseAudio capture failed (%d)", pa_context_errno(audio->context));
+	pa_threaded_mainloop_unlock(audio->mainloop);
+fail:
+	x11_shadow_audio_pulse_stop(audio);
+	return FALSE;
+}
+#endif
+
+#if defined(WITH_ALSA)
+static DWORD WINAPI x11_shadow_audio_alsa_thread(LPVOID arg)
+{
+	int rc;
+	snd_pcm_sframes_t frames;
+	x11ShadowAudio* audio = (x11ShadowAudio*)arg;
+
+	while (WaitForSingleObject(audio->stopEvent, 0) != WAIT_OBJECT_0)
+	{
+		/* Wait with a timeout so that a stop request is noticed without input */
+		rc = snd_pcm_wait(audio->capture, 100);
+
+		if (rc == 0)
+			continue;
+
+		frames = (rc > 0) ? snd_pcm_readi(audio->capture, audio->buffer, audio->period_frames)
+		                  : rc;
+
+		if (frames == -EAGAIN)
+			continue;
+
+		if (frames < 0)
+		{
+			rc = snd_pcm_recover(audio->capture, (int)frames, 0);
+
+			if (rc < 0)
+			{
+				WLog_ERR(TAG, "snd_pcm_readi (%s)", snd_strerror(rc));
+				break;
+			}
+
+			continue;
+		}
+
+		x11_shadow_audio_write(audio, audio->buffer, (size_t)frames,
+		                       x11_shadow_audio_capture_time(audio, (size_t)frames));
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+static void x11_shadow_audio_alsa_stop(x11ShadowAudio* audio)
+{
+	if (audio->thread)
+	{
+		SetEvent(audio->stopEvent);
+		WaitForSingleObject(audio->thread, INFINITE);
+		CloseHandle(audio->thread);
+		audio->thread = NULL;
+	}
+
+	if (audio->stopEvent)
+	{
+		CloseHandle(audio->stopEvent);
+		audio->stopEvent = NULL;
+	}
+
+	if (audio->capture)
+	{
+		snd_pcm_close(audio->capture);
+		audio->capture = NULL;
+	}
+
+	free(audio->buffer);
+	audio->buffer = NULL;
+}
+
+static BOOL x11_shadow_audio_alsa_start(x11ShadowAudio* audio)
+{
+	int error;
+	unsigned int rate = audio->format.nSamplesPerSec;
+	snd_pcm_uframes_t period_size = audio->period_frames;
+	snd_pcm_uframes_t buffer_size = audio->period_frames * X11_AUDIO_MAX_PERIODS;
+	snd_pcm_hw_params_t* hw_params = NULL;
+
+	if ((error = snd_pcm_open(&audio->capture, X11_AUDIO_ALSA_DEVICE, SND_PCM_STREAM_CAPTURE,
+	                          0)) < 0)
+	{
+		WLog_DBG(TAG, "snd_pcm_open (%s)", snd_strerror(error));
+		audio->capture = NULL;
+		return FALSE;
+	}
+
+	if ((error = snd_pcm_hw_params_malloc(&hw_params)) < 0)
+		goto fail;
+
+	snd_pcm_hw_params_any(audio->capture, hw_params);
+	snd_pcm_hw_params_set_access(audio->capture, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+	snd_pcm_hw_params_set_format(audio->capture, hw_params, SND_PCM_FORMAT_S16_LE);
+	snd_pcm_hw_params_set_rate_near(audio->capture, hw_params, &rate, NULL);
+	snd_pcm_hw_params_set_channels(audio->capture, hw_params, audio->format.nChannels);
+	snd_pcm_hw_params_set_period_size_near(audio->capture, hw_params, &period_size, NULL);
+	snd_pcm_hw_params_set_buffer_size_near(audio->capture, hw_params, &buffer_size);
+	error = snd_pcm_hw_params(audio->capture, hw_params);
+	snd_pcm_hw_params_free(hw_params);
+
+	if (error < 0)
+		goto fail;
+
+	if (rate != audio->format.nSamplesPerSec)
+	{
+		WLog_WARN(TAG, "ALSA capture rate %" PRIu32 " not supported", audio->format.nSamplesPerSec);
+		goto fail;
+	}
+
+	if ((error = snd_pcm_prepare(audio->capture)) < 0)
+		goto fail;
+
+	audio->buffer = (BYTE*)calloc(audio->period_frames, audio->bytes_per_frame);
+
+	if (!audio->buffer)
+		goto fail;
+
+	if (!(audio->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(audio->thread =
+	          CreateThread(NULL, 0, x11_shadow_audio_alsa_thread, (void*)audio, 0, NULL)))
+		goto fail;
+
+	WLog_INFO(TAG, "capturing desktop audio from ALSA %s", X11_AUDIO_ALSA_DEVICE);
+	return TRUE;
+fail:
+	if (error < 0)
+		WLog_DBG(TAG, "ALSA capture failed (%s)", snd_strerror(error));
+
+	x11_shadow_audio_alsa_stop(audio);
+	return FALSE;
+}
+#endif
+
+x11ShadowAudio* x11_shadow_audio_new(rdpShadowSubsystem* subsystem)
+{
+	size_t x;
+	x11ShadowAudio* audio = (x11ShadowAudio*)calloc(1, sizeof(x11ShadowAudio));
+
+	if (!audio)
+		return NULL;
+
+	audio->subsystem = subsystem;
+	audio->format.wFormatTag = WAVE_FORMAT_PCM;
+	audio->format.nChannels = 2;
+	audio->format.nSamplesPerSec = 44100;
+	audio->format.wBitsPerSample = 16;
+	audio->format.nBlockAlign = 4;
+	audio->format.nAvgBytesPerSec = 44100 * 4;
+	audio->bytes_per_frame = audio->format.nBlockAlign;
+	audio->period_frames = audio->format.nSamplesPerSec * X11_AUDIO_PERIOD_MS / 1000;
+
+	if (!InitializeCriticalSectionAndSpinCount(&audio->lock, 4000))
+	{
+		free(audio);
+		return NULL;
+	}
+
+	/* The queued periods share one allocation, the sender copies the oldest to the first */
+	audio->period =
+	    (BYTE*)calloc(audio->period_frames * (X11_AUDIO_MAX_PERIODS + 1), audio->bytes_per_frame);
+
+	if (!audio->period)
+	{
+		DeleteCriticalSection(&audio->lock);
+		free(audio);
+		return NULL;
+	}
+
+	for (x = 0; x < X11_AUDIO_MAX_PERIODS; x++)
+		audio->periods[x].data = &audio->period[(x + 1) * audio->period_frames *
+		                                        audio->bytes_per_frame];
+
+	audio->source = rdpsnd_server_source_new(&audio->format, X11_AUDIO_BLOCK_MS);
+
+	if (!audio->source)
+		goto fail;
+
+	rdpsnd_server_source_set_max_pending_blocks(audio->source, X11_AUDIO_MAX_PENDING_BLOCKS);
+
+	if (!(audio->dataEvent = CreateEvent(NULL, TRUE, FALSE, NULL)) ||
+	    !(audio->senderStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(audio->senderThread =
+	          CreateThread(NULL, 0, x11_shadow_audio_sender_thread, (void*)audio, 0, NULL)))
+		goto fail;
+
+	return audio;
+fail:
+	x11_shadow_audio_free(audio);
+	return NULL;
+}
+
+void x11_shadow_audio_free(x11ShadowAudio* audio)
+{
+	if (!audio)
+		return;
+
+	x11_shadow_audio_stop(audio);
+	x11_shadow_audio_sender_stop(audio);
+
+	if (audio->senderStopEvent)
+		CloseHandle(audio->senderStopEvent);
+
+	if (audio->dataEvent)
+		CloseHandle(audio->dataEvent);
+
+	rdpsnd_server_source_free(audio->source);
+	free(audio->period);
+	DeleteCriticalSection(&audio->lock);
+	free(audio);
+}
+
+RdpsndServerSource* x11_shadow_audio_get_source(x11ShadowAudio* audio)
+{
+	if (!audio)
+		return NULL;
+
+	return audio->source;
+}
+
+BOOL x11_shadow_audio_start(x11ShadowAudio* audio)
+{
+	BOOL started = FALSE;
+
+	if (!audio)
+		return FALSE;
+
+#if defined(WITH_PULSE)
+	started = x11_shadow_audio_pulse_start(audio);
+#endif
+#if defined(WITH_ALSA)
+
+	if (!started)
+		started = x11_shadow_audio_alsa_start(audio);
+
+#endif
+
+	if (!started)
+	{
+		WLog_INFO(TAG, "No desktop audio capture device available");
+		return FALSE;
+	}
+
+	/* Clients subscribe under the same lock, see shadow_rdpsnd.c */
+	EnterCriticalSection(&audio->subsystem->server->lock);
+	audio->subsystem->rdpsndSource = audio->source;
+	LeaveCriticalSection(&audio->subsystem->server->lock);
+	return TRUE;
+}
+
+void x11_shadow_audio_stop(x11ShadowAudio* audio)
+{
+	if (!audio)
+		return;
+
+	EnterCriticalSection(&audio->subsystem->server->lock);
+
+	if (audio->subsystem->rdpsndSource == audio->source)
+		audio->subsystem->rdpsndSource = NULL;
+
+	LeaveCriticalSection(&audio->subsystem->server->lock);
+
+#if defined(WITH_PULSE)
+	x11_shadow_audio_pulse_stop(audio);
+#endif
+#if defined(WITH_ALSA)
+	x11_shadow_audio_alsa_stop(audio);
+#endif
+}
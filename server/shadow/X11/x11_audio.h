@@ -0,0 +1,46 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 Shadow Desktop Audio Capture
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_X11_AUDIO_H
+#define FREERDP_SERVER_SHADOW_X11_AUDIO_H
+
+#include <freerdp/server/shadow.h>
+
+typedef struct x11_shadow_audio x11ShadowAudio;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	x11ShadowAudio* x11_shadow_audio_new(rdpShadowSubsystem* subsystem);
+	void x11_shadow_audio_free(x11ShadowAudio* audio);
+
+	BOOL x11_shadow_audio_start(x11ShadowAudio* audio);
+	void x11_shadow_audio_stop(x11ShadowAudio* audio);
+
+	/* Queues captured frames, a sender thread hands them to the rdpsnd source. The timestamp
+	 * is the capture time of the first frame in milliseconds. */
+	BOOL x11_shadow_audio_write(x11ShadowAudio* audio, const void* data, size_t frames,
+	                            UINT32 timestamp);
+	RdpsndServerSource* x11_shadow_audio_get_source(x11ShadowAudio* audio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_X11_AUDIO_H */
@@ -409,41 +409,26 @@ static void x11_shadow_message_free(UINT32 id, SHADOW_MSG_OUT* msg)
 
 static int x11_shadow_pointer_position_update(x11ShadowSubsystem* subsystem)
 {
-	UINT32 msgId = SHADOW_MSG_OUT_POINTER_POSITION_UPDATE_ID;
 	rdpShadowServer* server;
-	SHADOW_MSG_OUT_POINTER_POSITION_UPDATE templateMsg;
 	int count = 0;
 	size_t index = 0;
 
 	if (!subsystem || !subsystem->common.server || !subsystem->common.server->clients)
 		return -1;
 
-	templateMsg.xPos = subsystem->common.pointerX;
-	templateMsg.yPos = subsystem->common.pointerY;
-	templateMsg.common.Free = x11_shadow_message_free;
 	server = subsystem->common.server;
 	ArrayList_Lock(server->clients);
 
 	for (index = 0; index < ArrayList_Count(server->clients); index++)
 	{
-		SHADOW_MSG_OUT_POINTER_POSITION_UPDATE* msg;
 		rdpShadowClient* client = (rdpShadowClient*)ArrayList_GetItem(server->clients, index);
 
 		/* Skip the client which send us the latest mouse event */
 		if (client == subsystem->lastMouseClient)
 			continue;
 
-		msg = malloc(sizeof(templateMsg));
-
-		if (!msg)
-		{
-			count = -1;
-			break;
-		}
-
-		memcpy(msg, &templateMsg, sizeof(templateMsg));
-
-		if (shadow_client_post_msg(client, NULL, msgId, (SHADOW_MSG_OUT*)msg, NULL))
+		if (shadow_client_post_pointer_position(client, subsystem->common.pointerX,
+		                                        subsystem->common.pointerY))
 			count++;
 	}
 
@@ -1415,6 +1400,15 @@ static int x11_shadow_subsystem_start(rdpShadowSubsystem* sub)
 		return -1;
 	}
 
+	/* Desktop audio is optional, the session continues without it */
+	subsystem->audio = x11_shadow_audio_new(sub);
+
+	if (subsystem->audio && !x11_shadow_audio_start(subsystem->audio))
+	{
+		x11_shadow_audio_free(subsystem->audio);
+		subsystem->audio = NULL;
+	}
+
 	return 1;
 }
 
@@ -1425,6 +1419,9 @@ static int x11_shadow_subsystem_stop(rdpShadowSubsystem* sub)
 	if (!subsystem)
 		return -1;
 
+	x11_shadow_audio_free(subsystem->audio);
+	subsystem->audio = NULL;
+
 	if (subsystem->thread)
 	{
 		if (MessageQueue_PostQuit(subsystem->common.MsgPipe->In, 0))
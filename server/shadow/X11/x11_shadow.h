@@ -31,6 +31,8 @@ typedef struct x11_shadow_subsystem x11ShadowSubsystem;
 
 #include <X11/Xlib.h>
 
+#include "x11_audio.h"
+
 #ifdef WITH_XSHM
 #include <X11/extensions/XShm.h>
 #endif
@@ -89,6 +91,7 @@ struct x11_shadow_subsystem
 	UINT32 cursorMaxWidth;
 	UINT32 cursorMaxHeight;
 	rdpShadowClient* lastMouseClient;
+	x11ShadowAudio* audio;
 
 #ifdef WITH_XDAMAGE
 	GC xshm_gc;
@@ -38,6 +38,9 @@
 
 #define TAG CLIENT_TAG("shadow")
 
+/* Planar GFX frames are sent in tiles of this size through the client bitmap cache */
+#define SHADOW_GFX_TILE_SIZE 64
+
 struct _SHADOW_GFX_STATUS
 {
 	BOOL gfxOpened;
@@ -187,6 +190,9 @@ static BOOL shadow_client_context_new(freerdp_peer* peer, rdpContext* context)
 	freerdp_settings_set_bool(settings, FreeRDP_NSCodec, NSCodec);
 	settings->RemoteFxCodec = srvSettings->RemoteFxCodec;
 	settings->BitmapCacheV3Enabled = TRUE;
+	/* Clients without bitmap codecs are served with drawing orders from the bitmap cache */
+	settings->BitmapCacheEnabled = TRUE;
+	settings->OrderSupport[NEG_MEMBLT_INDEX] = TRUE;
 	settings->FrameMarkerCommandEnabled = TRUE;
 	settings->SurfaceFrameMarkerEnabled = TRUE;
 	settings->SupportGraphicsPipeline = TRUE;
@@ -591,6 +597,11 @@ static BOOL shadow_client_activate(freerdp_peer* peer)
 	client->activated = TRUE;
 	client->inLobby = client->mayView ? FALSE : TRUE;
 
+	/* The client pointer cache is reset on (re)activation */
+	ZeroMemory(client->pointerCache, sizeof(client->pointerCache));
+	client->pointerCacheNext = 0;
+	client->pointerCacheIndex = UINT32_MAX;
+
 	if (shadow_encoder_reset(client->encoder) < 0)
 	{
 		WLog_ERR(TAG, "Failed to reset encoder");
@@ -992,6 +1003,127 @@ static INLINE UINT32 rdpgfx_estimate_h264_avc420(RDPGFX_AVC420_BITMAP_STREAM* ha
 	       havc420->length;
 }
 
+/* The key only depends on the tile content, so it stays valid in the persistent cache of the
+ * client and tiles can be reused across connections */
+static UINT64 shadow_client_tile_key(const BYTE* data, UINT32 step, UINT32 rowSize,
+                                     UINT32 height)
+{
+	UINT32 x, y;
+	UINT64 hash = 0xCBF29CE484222325ULL ^ ((UINT64)rowSize << 32) ^ height;
+
+	for (y = 0; y < height; y++)
+	{
+		const BYTE* row = &data[y * step];
+
+		for (x = 0; x + 8 <= rowSize; x += 8)
+		{
+			UINT64 value;
+			memcpy(&value, &row[x], sizeof(value));
+			hash = (hash ^ value) * 0x100000001B3ULL;
+			hash ^= hash >> 29;
+		}
+
+		for (; x < rowSize; x++)
+			hash = (hash ^ row[x]) * 0x100000001B3ULL;
+	}
+
+	return hash;
+}
+
+/**
+ * Function description
+ * Send a planar frame tile by tile. Tiles held in the client bitmap cache are
+ * copied with CacheToSurface, the others are encoded and stored in the cache
+ * with SurfaceToCache. Planar is lossless, so a cached tile matches the
+ * desktop exactly.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT shadow_client_send_surface_gfx_planar(rdpShadowClient* client,
+                                                  const RDPGFX_SURFACE_COMMAND* cmd,
+                                                  const RDPGFX_START_FRAME_PDU* cmdstart,
+                                                  const RDPGFX_END_FRAME_PDU* cmdend,
+                                                  const BYTE* pSrcData, UINT32 nSrcStep,
+                                                  UINT32 SrcFormat)
+{
+	UINT32 x, y, w, h;
+	UINT error = CHANNEL_RC_OK;
+	RdpgfxServerContext* rdpgfx = client->rdpgfx;
+	rdpShadowEncoder* encoder = client->encoder;
+	const UINT32 bpp = GetBytesPerPixel(SrcFormat);
+
+	if (!freerdp_bitmap_planar_context_reset(encoder->planar, SHADOW_GFX_TILE_SIZE,
+	                                         SHADOW_GFX_TILE_SIZE))
+		return CHANNEL_RC_NO_MEMORY;
+
+	freerdp_planar_topdown_image(encoder->planar, TRUE);
+	IFCALLRET(rdpgfx->StartFrame, error, rdpgfx, cmdstart);
+
+	/* Tiles are aligned to the desktop, not to the updated area */
+	for (y = cmd->top; !error && (y < cmd->bottom); y += h)
+	{
+		h = MIN(SHADOW_GFX_TILE_SIZE - y % SHADOW_GFX_TILE_SIZE, cmd->bottom - y);
+
+		for (x = cmd->left; !error && (x < cmd->right); x += w)
+		{
+			UINT16 cacheSlot;
+			UINT64 cacheKey;
+			const BYTE* src = &pSrcData[y * nSrcStep + x * bpp];
+
+			w = MIN(SHADOW_GFX_TILE_SIZE - x % SHADOW_GFX_TILE_SIZE, cmd->right - x);
+			cacheKey = shadow_client_tile_key(src, nSrcStep, w * bpp, h);
+
+			if (rdpgfx_server_cache_lookup(rdpgfx, cacheKey, &cacheSlot))
+			{
+				RDPGFX_POINT16 destPt = { (UINT16)x, (UINT16)y };
+				RDPGFX_CACHE_TO_SURFACE_PDU pdu = { 0 };
+				pdu.cacheSlot = cacheSlot;
+				pdu.surfaceId = cmd->surfaceId;
+				pdu.destPtsCount = 1;
+				pdu.destPts = &destPt;
+				IFCALLRET(rdpgfx->CacheToSurface, error, rdpgfx, &pdu);
+			}
+			else
+			{
+				RDPGFX_SURFACE_COMMAND tile = *cmd;
+				tile.left = x;
+				tile.top = y;
+				tile.right = x + w;
+				tile.bottom = y + h;
+				tile.width = w;
+				tile.height = h;
+				tile.codecId = RDPGFX_CODECID_PLANAR;
+				tile.data = freerdp_bitmap_compress_planar(encoder->planar, src, SrcFormat, w, h,
+				                                           nSrcStep, NULL, &tile.length);
+
+				if (!tile.data)
+					return ERROR_INTERNAL_ERROR;
+
+				IFCALLRET(rdpgfx->SurfaceCommand, error, rdpgfx, &tile);
+				free(tile.data);
+
+				if (!error && rdpgfx_server_cache_alloc_slot(rdpgfx, w * h * 4, &cacheSlot))
+				{
+					RDPGFX_SURFACE_TO_CACHE_PDU pdu = { 0 };
+					pdu.surfaceId = cmd->surfaceId;
+					pdu.cacheKey = cacheKey;
+					pdu.cacheSlot = cacheSlot;
+					pdu.rectSrc.left = (UINT16)x;
+					pdu.rectSrc.top = (UINT16)y;
+					pdu.rectSrc.right = (UINT16)(x + w);
+					pdu.rectSrc.bottom = (UINT16)(y + h);
+					IFCALLRET(rdpgfx->SurfaceToCache, error, rdpgfx, &pdu);
+				}
+			}
+		}
+	}
+
+	if (!error)
+		IFCALLRET(rdpgfx->EndFrame, error, rdpgfx, cmdend);
+
+	return error;
+}
+
 /**
  * Function description
  *
@@ -1238,32 +1370,18 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 	}
 	else if (freerdp_settings_get_bool(settings, FreeRDP_GfxPlanar))
 	{
-		BOOL rc;
-		const UINT32 w = cmd.right - cmd.left;
-		const UINT32 h = cmd.bottom - cmd.top;
-		const BYTE* src = &pSrcData[cmd.top * nSrcStep + cmd.left * GetBytesPerPixel(SrcFormat)];
 		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_PLANAR) < 0)
 		{
 			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_PLANAR");
 			return FALSE;
 		}
 
-		rc = freerdp_bitmap_planar_context_reset(encoder->planar, w, h);
-		WINPR_ASSERT(rc);
-		freerdp_planar_topdown_image(encoder->planar, TRUE);
-
-		cmd.data = freerdp_bitmap_compress_planar(encoder->planar, src, SrcFormat, w, h, nSrcStep,
-		                                          NULL, &cmd.length);
-		WINPR_ASSERT(cmd.data || (cmd.length == 0));
+		error = shadow_client_send_surface_gfx_planar(client, &cmd, &cmdstart, &cmdend, pSrcData,
+		                                              nSrcStep, SrcFormat);
 
-		cmd.codecId = RDPGFX_CODECID_PLANAR;
-
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, &cmd, &cmdstart,
-		          &cmdend);
-		free(cmd.data);
 		if (error)
 		{
-			WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
+			WLog_ERR(TAG, "Sending the planar frame failed with error %" PRIu32 "", error);
 			return FALSE;
 		}
 	}
@@ -1777,29 +1895,49 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 
 	if (settings->SupportGraphicsPipeline && pStatus->gfxOpened)
 	{
+		UINT error = CHANNEL_RC_OK;
+		RdpgfxServerContext* rdpgfx = client->rdpgfx;
+
 		/* GFX/h264 always full screen encoded */
 		nWidth = settings->DesktopWidth;
 		nHeight = settings->DesktopHeight;
 
+		/* The frame, and the surface setup before the first one, go out with one channel write */
+		IFCALLRET(rdpgfx->BeginFrameBatch, error, rdpgfx);
+
+		if (error)
+		{
+			WLog_ERR(TAG, "BeginFrameBatch failed with error %" PRIu32 "", error);
+			ret = FALSE;
+			goto out;
+		}
+
 		/* Create primary surface if have not */
 		if (!pStatus->gfxSurfaceCreated)
 		{
 			/* Only init surface when we have h264 supported */
-			if (!(ret = shadow_client_rdpgfx_reset_graphic(client)))
-				goto out;
-
-			if (!(ret = shadow_client_rdpgfx_new_surface(client)))
-				goto out;
+			ret = shadow_client_rdpgfx_reset_graphic(client) &&
+			      shadow_client_rdpgfx_new_surface(client);
+			pStatus->gfxSurfaceCreated = ret;
+		}
 
-			pStatus->gfxSurfaceCreated = TRUE;
+		if (ret)
+		{
+			WINPR_ASSERT(nWidth >= 0);
+			WINPR_ASSERT(nWidth <= UINT16_MAX);
+			WINPR_ASSERT(nHeight >= 0);
+			WINPR_ASSERT(nHeight <= UINT16_MAX);
+			ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, SrcFormat, 0, 0,
+			                                     (UINT16)nWidth, (UINT16)nHeight);
 		}
 
-		WINPR_ASSERT(nWidth >= 0);
-		WINPR_ASSERT(nWidth <= UINT16_MAX);
-		WINPR_ASSERT(nHeight >= 0);
-		WINPR_ASSERT(nHeight <= UINT16_MAX);
-		ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, SrcFormat, 0, 0,
-		                                     (UINT16)nWidth, (UINT16)nHeight);
+		IFCALLRET(rdpgfx->SubmitFrameBatch, error, rdpgfx);
+
+		if (error)
+		{
+			WLog_ERR(TAG, "SubmitFrameBatch failed with error %" PRIu32 "", error);
+			ret = FALSE;
+		}
 	}
 	else if (settings->RemoteFxCodec || freerdp_settings_get_bool(settings, FreeRDP_NSCodec))
 	{
@@ -1814,6 +1952,23 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 		ret = shadow_client_send_surface_bits(client, pSrcData, nSrcStep, (UINT16)nXSrc,
 		                                      (UINT16)nYSrc, (UINT16)nWidth, (UINT16)nHeight);
 	}
+	else if (order_encoder_supported(settings))
+	{
+		/* Clients without bitmap codecs: only the changed tiles are sent, as drawing orders */
+		rdpShadowEncoder* encoder = client->encoder;
+		const RECTANGLE_16 rect = { (UINT16)nXSrc, (UINT16)nYSrc, (UINT16)(nXSrc + nWidth),
+			                        (UINT16)(nYSrc + nHeight) };
+
+		if (shadow_encoder_prepare(encoder, FREERDP_CODEC_DRAWING_ORDERS) < 0)
+		{
+			WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_DRAWING_ORDERS");
+			ret = FALSE;
+			goto out;
+		}
+
+		ret = order_encoder_compose(encoder->orders, context, pSrcData, SrcFormat, nSrcStep,
+		                            &rect);
+	}
 	else
 	{
 		WINPR_ASSERT(nXSrc >= 0);
@@ -1925,6 +2080,62 @@ static INLINE BOOL shadow_client_no_surface_update(rdpShadowClient* client,
 	return shadow_client_surface_update(client, &(surface->invalidRegion));
 }
 
+static UINT64 shadow_client_pointer_hash(const SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE* msg)
+{
+	size_t x;
+	UINT64 hash = 14695981039346656037ULL;
+	const UINT32 header[] = { msg->xHot, msg->yHot, msg->width, msg->height };
+	const BYTE* data[] = { (const BYTE*)header, msg->xorMaskData, msg->andMaskData };
+	const size_t length[] = { sizeof(header), msg->lengthXorMask, msg->lengthAndMask };
+
+	/* FNV-1a over the pointer shape */
+	for (x = 0; x < ARRAYSIZE(data); x++)
+	{
+		size_t y;
+
+		for (y = 0; y < length[x]; y++)
+		{
+			hash ^= data[x][y];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	/* 0 marks an empty cache entry */
+	return hash ? hash : 1;
+}
+
+/**
+ * Find the pointer shape in the client pointer cache. If it is not cached the
+ * entry it replaces is returned in cacheIndex and the shape must be sent.
+ */
+static BOOL shadow_client_lookup_pointer(rdpShadowClient* client,
+                                         const SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE* msg,
+                                         UINT32* cacheIndex)
+{
+	UINT32 index;
+	UINT32 cacheSize;
+	const UINT64 hash = shadow_client_pointer_hash(msg);
+	const rdpSettings* settings = client->context.settings;
+
+	WINPR_ASSERT(settings);
+	cacheSize = freerdp_settings_get_uint32(settings, FreeRDP_PointerCacheSize);
+	cacheSize = MAX(1, MIN(cacheSize, SHADOW_POINTER_CACHE_SIZE));
+
+	for (index = 0; index < cacheSize; index++)
+	{
+		if (client->pointerCache[index] == hash)
+		{
+			*cacheIndex = index;
+			return TRUE;
+		}
+	}
+
+	index = client->pointerCacheNext++ % cacheSize;
+	client->pointerCache[index] = hash;
+	*cacheIndex = index;
+	return FALSE;
+}
+
 static int shadow_client_subsystem_process_message(rdpShadowClient* client, wMessage* message)
 {
 	rdpContext* context = (rdpContext*)client;
@@ -1941,11 +2152,28 @@ static int shadow_client_subsystem_process_message(rdpShadowClient* client, wMes
 	{
 		case SHADOW_MSG_OUT_POINTER_POSITION_UPDATE_ID:
 		{
+			UINT32 xPos, yPos;
 			POINTER_POSITION_UPDATE pointerPosition;
 			const SHADOW_MSG_OUT_POINTER_POSITION_UPDATE* msg =
 			    (const SHADOW_MSG_OUT_POINTER_POSITION_UPDATE*)message->wParam;
-			pointerPosition.xPos = msg->xPos;
-			pointerPosition.yPos = msg->yPos;
+
+			if (msg)
+			{
+				xPos = msg->xPos;
+				yPos = msg->yPos;
+			}
+			else
+			{
+				/* Posted by shadow_client_post_pointer_position, pick up the latest position */
+				EnterCriticalSection(&client->lock);
+				xPos = client->pendingPointerX;
+				yPos = client->pendingPointerY;
+				client->pointerPending = FALSE;
+				LeaveCriticalSection(&client->lock);
+			}
+
+			pointerPosition.xPos = xPos;
+			pointerPosition.yPos = yPos;
 
 			WINPR_ASSERT(client->server);
 			if (client->server->shareSubRect)
@@ -1956,12 +2184,12 @@ static int shadow_client_subsystem_process_message(rdpShadowClient* client, wMes
 
 			if (client->activated)
 			{
-				if ((msg->xPos != client->pointerX) || (msg->yPos != client->pointerY))
+				if ((xPos != client->pointerX) || (yPos != client->pointerY))
 				{
 					WINPR_ASSERT(update->pointer);
 					IFCALL(update->pointer->PointerPosition, context, &pointerPosition);
-					client->pointerX = msg->xPos;
-					client->pointerY = msg->yPos;
+					client->pointerX = xPos;
+					client->pointerY = yPos;
 				}
 			}
 
@@ -1977,9 +2205,25 @@ static int shadow_client_subsystem_process_message(rdpShadowClient* client, wMes
 			    (const SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE*)message->wParam;
 
 			WINPR_ASSERT(msg);
+
+			if (!client->activated)
+				break;
+
+			if (shadow_client_lookup_pointer(client, msg, &pointerCached.cacheIndex))
+			{
+				/* The shape is already in the client pointer cache */
+				if (pointerCached.cacheIndex != client->pointerCacheIndex)
+				{
+					IFCALL(update->pointer->PointerCached, context, &pointerCached);
+					client->pointerCacheIndex = pointerCached.cacheIndex;
+				}
+
+				break;
+			}
+
 			pointerNew.xorBpp = 24;
 			pointerColor = &(pointerNew.colorPtrAttr);
-			pointerColor->cacheIndex = 0;
+			pointerColor->cacheIndex = pointerCached.cacheIndex;
 			pointerColor->xPos = msg->xHot;
 			pointerColor->yPos = msg->yHot;
 			pointerColor->width = msg->width;
@@ -1988,14 +2232,9 @@ static int shadow_client_subsystem_process_message(rdpShadowClient* client, wMes
 			pointerColor->lengthXorMask = msg->lengthXorMask;
 			pointerColor->xorMaskData = msg->xorMaskData;
 			pointerColor->andMaskData = msg->andMaskData;
-			pointerCached.cacheIndex = pointerColor->cacheIndex;
-
-			if (client->activated)
-			{
-				IFCALL(update->pointer->PointerNew, context, &pointerNew);
-				IFCALL(update->pointer->PointerCached, context, &pointerCached);
-			}
-
+			IFCALL(update->pointer->PointerNew, context, &pointerNew);
+			IFCALL(update->pointer->PointerCached, context, &pointerCached);
+			client->pointerCacheIndex = pointerCached.cacheIndex;
 			break;
 		}
 
@@ -2038,17 +2277,98 @@ static int shadow_client_subsystem_process_message(rdpShadowClient* client, wMes
 	return 1;
 }
 
+/**
+ * Process the queued subsystem messages. Pointer updates and the audio volume
+ * are accumulated, only the latest of each is sent once the queue is empty.
+ *
+ * @return FALSE if the client thread was asked to quit
+ */
+BOOL shadow_client_drain_messages(rdpShadowClient* client)
+{
+	wMessage message = { 0 };
+	wMessage pointerPositionMsg;
+	wMessage pointerAlphaMsg;
+	wMessage audioVolumeMsg;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->MsgQueue);
+
+	pointerPositionMsg.id = 0;
+	pointerPositionMsg.Free = NULL;
+	pointerAlphaMsg.id = 0;
+	pointerAlphaMsg.Free = NULL;
+	audioVolumeMsg.id = 0;
+	audioVolumeMsg.Free = NULL;
+
+	while (MessageQueue_Peek(client->MsgQueue, &message, TRUE))
+	{
+		if (message.id == WMQ_QUIT)
+		{
+			break;
+		}
+
+		switch (message.id)
+		{
+			case SHADOW_MSG_OUT_POINTER_POSITION_UPDATE_ID:
+				/* Abandon previous message */
+				shadow_client_free_queued_message(&pointerPositionMsg);
+				pointerPositionMsg = message;
+				break;
+
+			case SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE_ID:
+				/* Abandon previous message */
+				shadow_client_free_queued_message(&pointerAlphaMsg);
+				pointerAlphaMsg = message;
+				break;
+
+			case SHADOW_MSG_OUT_AUDIO_OUT_VOLUME_ID:
+				/* Abandon previous message */
+				shadow_client_free_queued_message(&audioVolumeMsg);
+				audioVolumeMsg = message;
+				break;
+
+			default:
+				shadow_client_subsystem_process_message(client, &message);
+				break;
+		}
+	}
+
+	if (message.id == WMQ_QUIT)
+	{
+		/* Release stored message */
+		shadow_client_free_queued_message(&pointerPositionMsg);
+		shadow_client_free_queued_message(&pointerAlphaMsg);
+		shadow_client_free_queued_message(&audioVolumeMsg);
+		return FALSE;
+	}
+
+	/* Process accumulated messages if needed */
+	if (pointerPositionMsg.id)
+	{
+		shadow_client_subsystem_process_message(client, &pointerPositionMsg);
+	}
+
+	if (pointerAlphaMsg.id)
+	{
+		shadow_client_subsystem_process_message(client, &pointerAlphaMsg);
+	}
+
+	if (audioVolumeMsg.id)
+	{
+		shadow_client_subsystem_process_message(client, &audioVolumeMsg);
+	}
+
+	return TRUE;
+}
+
 static DWORD WINAPI shadow_client_thread(LPVOID arg)
 {
 	rdpShadowClient* client = (rdpShadowClient*)arg;
 	BOOL rc;
 	DWORD status;
 	DWORD nCount;
-	wMessage message;
-	wMessage pointerPositionMsg;
-	wMessage pointerAlphaMsg;
-	wMessage audioVolumeMsg;
 	HANDLE events[32] = { 0 };
+	WINPR_WAIT_SET* waitSet = NULL;
 	HANDLE ChannelEvent;
 	void* UpdateSubscriber;
 	HANDLE UpdateEvent;
@@ -2111,12 +2431,19 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 	rc = freerdp_settings_set_bool(settings, FreeRDP_HasExtendedMouseEvent, TRUE);
 	WINPR_ASSERT(rc);
 
+	/* The handles only change with the transport, keep them registered between waits */
+	waitSet = winpr_WaitSet_New();
+
+	if (!waitSet)
+		goto fail;
+
 	while (1)
 	{
 		nCount = 0;
 		events[nCount++] = UpdateEvent;
 		{
-			DWORD tmp = peer->GetEventHandles(peer, &events[nCount], 64 - nCount);
+			DWORD tmp =
+			    peer->GetEventHandles(peer, &events[nCount], ARRAYSIZE(events) - 2 - nCount);
 
 			if (tmp == 0)
 			{
@@ -2128,7 +2455,11 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 		}
 		events[nCount++] = ChannelEvent;
 		events[nCount++] = MessageQueue_Event(MsgQueue);
-		status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
+
+		if (!winpr_WaitSet_Update(waitSet, events, nCount))
+			goto fail;
+
+		status = winpr_WaitSet_Wait(waitSet, INFINITE);
 
 		if (status == WAIT_FAILED)
 			goto fail;
@@ -2257,73 +2588,8 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 
 		if (WaitForSingleObject(MessageQueue_Event(MsgQueue), 0) == WAIT_OBJECT_0)
 		{
-			/* Drain messages. Pointer update could be accumulated. */
-			pointerPositionMsg.id = 0;
-			pointerPositionMsg.Free = NULL;
-			pointerAlphaMsg.id = 0;
-			pointerAlphaMsg.Free = NULL;
-			audioVolumeMsg.id = 0;
-			audioVolumeMsg.Free = NULL;
-
-			while (MessageQueue_Peek(MsgQueue, &message, TRUE))
-			{
-				if (message.id == WMQ_QUIT)
-				{
-					break;
-				}
-
-				switch (message.id)
-				{
-					case SHADOW_MSG_OUT_POINTER_POSITION_UPDATE_ID:
-						/* Abandon previous message */
-						shadow_client_free_queued_message(&pointerPositionMsg);
-						pointerPositionMsg = message;
-						break;
-
-					case SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE_ID:
-						/* Abandon previous message */
-						shadow_client_free_queued_message(&pointerAlphaMsg);
-						pointerAlphaMsg = message;
-						break;
-
-					case SHADOW_MSG_OUT_AUDIO_OUT_VOLUME_ID:
-						/* Abandon previous message */
-						shadow_client_free_queued_message(&audioVolumeMsg);
-						audioVolumeMsg = message;
-						break;
-
-					default:
-						shadow_client_subsystem_process_message(client, &message);
-						break;
-				}
-			}
-
-			if (message.id == WMQ_QUIT)
-			{
-				/* Release stored message */
-				shadow_client_free_queued_message(&pointerPositionMsg);
-				shadow_client_free_queued_message(&pointerAlphaMsg);
-				shadow_client_free_queued_message(&audioVolumeMsg);
+			if (!shadow_client_drain_messages(client))
 				goto fail;
-			}
-			else
-			{
-				/* Process accumulated messages if needed */
-				if (pointerPositionMsg.id)
-				{
-					shadow_client_subsystem_process_message(client, &pointerPositionMsg);
-				}
-
-				if (pointerAlphaMsg.id)
-				{
-					shadow_client_subsystem_process_message(client, &pointerAlphaMsg);
-				}
-
-				if (audioVolumeMsg.id)
-				{
-					shadow_client_subsystem_process_message(client, &audioVolumeMsg);
-				}
-			}
 		}
 	}
 
@@ -2366,6 +2632,7 @@ fail:
 	}
 
 out:
+	winpr_WaitSet_Free(waitSet);
 	WINPR_ASSERT(peer->Disconnect);
 	peer->Disconnect(peer);
 	freerdp_peer_context_free(peer);
@@ -2469,6 +2736,37 @@ BOOL shadow_client_post_msg(rdpShadowClient* client, void* context, UINT32 type,
 	return shadow_client_dispatch_msg(client, &message);
 }
 
+BOOL shadow_client_post_pointer_position(rdpShadowClient* client, UINT32 x, UINT32 y)
+{
+	BOOL post;
+	wMessage message = { 0 };
+
+	if (!client)
+		return FALSE;
+
+	EnterCriticalSection(&client->lock);
+	client->pendingPointerX = x;
+	client->pendingPointerY = y;
+	post = !client->pointerPending;
+	client->pointerPending = TRUE;
+	LeaveCriticalSection(&client->lock);
+
+	/* A message is already on its way and will pick up the new position */
+	if (!post)
+		return TRUE;
+
+	message.id = SHADOW_MSG_OUT_POINTER_POSITION_UPDATE_ID;
+
+	WINPR_ASSERT(client->MsgQueue);
+	if (MessageQueue_Dispatch(client->MsgQueue, &message))
+		return TRUE;
+
+	EnterCriticalSection(&client->lock);
+	client->pointerPending = FALSE;
+	LeaveCriticalSection(&client->lock);
+	return FALSE;
+}
+
 int shadow_client_boardcast_msg(rdpShadowServer* server, void* context, UINT32 type,
                                 SHADOW_MSG_OUT* msg, void* lParam)
 {
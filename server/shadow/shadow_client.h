@@ -27,6 +27,7 @@ extern "C"
 #endif
 
 	BOOL shadow_client_accepted(freerdp_listener* instance, freerdp_peer* client);
+	BOOL shadow_client_drain_messages(rdpShadowClient* client);
 
 #ifdef __cplusplus
 }
@@ -231,6 +231,28 @@ fail:
 	return -1;
 }
 
+static int shadow_encoder_init_orders(rdpShadowEncoder* encoder)
+{
+	rdpContext* context = (rdpContext*)encoder->client;
+
+	if (!encoder->orders)
+		encoder->orders = order_encoder_context_new();
+
+	if (!encoder->orders)
+		goto fail;
+
+	if (!order_encoder_context_reset(encoder->orders, context->settings, encoder->width,
+	                                 encoder->height))
+		goto fail;
+
+	encoder->codecs |= FREERDP_CODEC_DRAWING_ORDERS;
+	return 1;
+fail:
+	order_encoder_context_free(encoder->orders);
+	encoder->orders = NULL;
+	return -1;
+}
+
 static int shadow_encoder_init_h264(rdpShadowEncoder* encoder)
 {
 	if (!encoder->h264)
@@ -338,6 +360,18 @@ static int shadow_encoder_uninit_interleaved(rdpShadowEncoder* encoder)
 	return 1;
 }
 
+static int shadow_encoder_uninit_orders(rdpShadowEncoder* encoder)
+{
+	if (encoder->orders)
+	{
+		order_encoder_context_free(encoder->orders);
+		encoder->orders = NULL;
+	}
+
+	encoder->codecs &= (UINT32)~FREERDP_CODEC_DRAWING_ORDERS;
+	return 1;
+}
+
 static int shadow_encoder_uninit_h264(rdpShadowEncoder* encoder)
 {
 	if (encoder->h264)
@@ -380,6 +414,7 @@ static int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 		shadow_encoder_uninit_planar(encoder);
 
 		shadow_encoder_uninit_interleaved(encoder);
+		shadow_encoder_uninit_orders(encoder);
 		shadow_encoder_uninit_h264(encoder);
 
 	    shadow_encoder_uninit_progressive(encoder);
@@ -456,6 +491,16 @@ int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs)
 			return -1;
 	}
 
+	if ((codecs & FREERDP_CODEC_DRAWING_ORDERS) &&
+	    !(encoder->codecs & FREERDP_CODEC_DRAWING_ORDERS))
+	{
+		WLog_DBG(TAG, "initializing drawing order encoder");
+		status = shadow_encoder_init_orders(encoder);
+
+		if (status < 0)
+			return -1;
+	}
+
 	if ((codecs & (FREERDP_CODEC_AVC420 | FREERDP_CODEC_AVC444)) &&
 	    !(encoder->codecs & (FREERDP_CODEC_AVC420 | FREERDP_CODEC_AVC444)))
 	{
@@ -40,6 +40,9 @@ int shadow_client_rdpgfx_init(rdpShadowClient* client)
 
 	rdpgfx->custom = client;
 
+	/* Planar frames copy tiles from the client bitmap cache, including the imported ones */
+	rdpgfx->autoCacheImport = TRUE;
+
 	return 1;
 }
 
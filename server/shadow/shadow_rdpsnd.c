@@ -34,6 +34,7 @@
 static void rdpsnd_activated(RdpsndServerContext* context)
 {
 	const AUDIO_FORMAT* agreed_format = NULL;
+	rdpShadowClient* client;
 	UINT16 i = 0, j = 0;
 
 	for (i = 0; i < context->num_client_formats; i++)
@@ -57,7 +58,18 @@ static void rdpsnd_activated(RdpsndServerContext* context)
 		return;
 	}
 
-	context->SelectFormat(context, i);
+	if (context->SelectFormat(context, i) != CHANNEL_RC_OK)
+		return;
+
+	client = (rdpShadowClient*)context->data;
+	/* The subsystem publishes and withdraws the source under the server lock */
+	EnterCriticalSection(&client->server->lock);
+
+	if (client->subsystem->rdpsndSource &&
+	    !rdpsnd_server_source_add_context(client->subsystem->rdpsndSource, context))
+		WLog_WARN(TAG, "Failed to subscribe client to the desktop audio source");
+
+	LeaveCriticalSection(&client->server->lock);
 }
 
 int shadow_client_rdpsnd_init(rdpShadowClient* client)
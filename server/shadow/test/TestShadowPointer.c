@@ -0,0 +1,292 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/collections.h>
+
+#include <freerdp/server/shadow.h>
+
+#include "../shadow_client.h"
+
+typedef struct
+{
+	size_t positions;
+	UINT32 xPos;
+	UINT32 yPos;
+	size_t shapes;
+	UINT32 xHot;
+	UINT32 width;
+	size_t cached;
+	UINT32 cacheIndex;
+} test_pointer_updates;
+
+static test_pointer_updates g_Updates = { 0 };
+
+static BOOL test_PointerPosition(rdpContext* context, const POINTER_POSITION_UPDATE* pointer)
+{
+	WINPR_UNUSED(context);
+	g_Updates.positions++;
+	g_Updates.xPos = pointer->xPos;
+	g_Updates.yPos = pointer->yPos;
+	return TRUE;
+}
+
+static BOOL test_PointerNew(rdpContext* context, const POINTER_NEW_UPDATE* pointer)
+{
+	WINPR_UNUSED(context);
+	g_Updates.shapes++;
+	g_Updates.xHot = pointer->colorPtrAttr.xPos;
+	g_Updates.width = pointer->colorPtrAttr.width;
+	return TRUE;
+}
+
+static BOOL test_PointerCached(rdpContext* context, const POINTER_CACHED_UPDATE* pointer)
+{
+	WINPR_UNUSED(context);
+	g_Updates.cached++;
+	g_Updates.cacheIndex = pointer->cacheIndex;
+	return TRUE;
+}
+
+static void test_client_free(rdpShadowClient* client)
+{
+	if (!client)
+		return;
+
+	if (client->MsgQueue)
+	{
+		/* Release whatever a failed test left queued */
+		MessageQueue_PostQuit(client->MsgQueue, 0);
+		shadow_client_drain_messages(client);
+		MessageQueue_Free(client->MsgQueue);
+	}
+
+	if (client->context.update)
+		free(client->context.update->pointer);
+
+	free(client->context.update);
+	freerdp_settings_free(client->context.settings);
+	free(client->server);
+	DeleteCriticalSection(&client->lock);
+	free(client);
+}
+
+/* Just enough of an activated client for the subsystem message path */
+static rdpShadowClient* test_client_new(void)
+{
+	rdpPointerUpdate* pointer;
+	rdpShadowClient* client = (rdpShadowClient*)calloc(1, sizeof(rdpShadowClient));
+
+	if (!client)
+		return NULL;
+
+	if (!InitializeCriticalSectionAndSpinCount(&client->lock, 4000))
+	{
+		free(client);
+		return NULL;
+	}
+
+	client->activated = TRUE;
+	client->pointerCacheIndex = UINT32_MAX;
+	client->server = (rdpShadowServer*)calloc(1, sizeof(rdpShadowServer));
+	client->MsgQueue = MessageQueue_New(NULL);
+	client->context.settings = freerdp_settings_new(0);
+	client->context.update = (rdpUpdate*)calloc(1, sizeof(rdpUpdate));
+
+	if (!client->server || !client->MsgQueue || !client->context.settings ||
+	    !client->context.update)
+		goto fail;
+
+	pointer = (rdpPointerUpdate*)calloc(1, sizeof(rdpPointerUpdate));
+
+	if (!pointer)
+		goto fail;
+
+	pointer->PointerPosition = test_PointerPosition;
+	pointer->PointerNew = test_PointerNew;
+	pointer->PointerCached = test_PointerCached;
+	client->context.update->pointer = pointer;
+	return client;
+fail:
+	test_client_free(client);
+	return NULL;
+}
+
+static void test_shape_free(UINT32 id, SHADOW_MSG_OUT* msg)
+{
+	SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE* shape = (SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE*)msg;
+	WINPR_UNUSED(id);
+
+	free(shape->xorMaskData);
+	free(shape->andMaskData);
+	free(shape);
+}
+
+/* A size x size pointer, its hotspot and pixels derived from the id */
+static BOOL test_post_shape(rdpShadowClient* client, UINT32 id, UINT32 size)
+{
+	SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE* shape;
+
+	shape = (SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE*)calloc(1, sizeof(*shape));
+
+	if (!shape)
+		return FALSE;
+
+	shape->common.Free = test_shape_free;
+	shape->xHot = id;
+	shape->yHot = id;
+	shape->width = size;
+	shape->height = size;
+	shape->lengthXorMask = size * size * 3;
+	shape->lengthAndMask = size * size / 8;
+	shape->xorMaskData = (BYTE*)malloc(shape->lengthXorMask);
+	shape->andMaskData = (BYTE*)calloc(1, shape->lengthAndMask);
+
+	if (!shape->xorMaskData || !shape->andMaskData)
+	{
+		test_shape_free(0, &shape->common);
+		return FALSE;
+	}
+
+	memset(shape->xorMaskData, (int)id, shape->lengthXorMask);
+
+	/* The queue holds the only reference */
+	if (!shadow_client_post_msg(client, NULL, SHADOW_MSG_OUT_POINTER_ALPHA_UPDATE_ID,
+	                            &shape->common, NULL))
+	{
+		test_shape_free(0, &shape->common);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Moves posted before the client thread runs end up as one position update */
+static BOOL test_position_coalescing(rdpShadowClient* client)
+{
+	UINT32 x;
+
+	ZeroMemory(&g_Updates, sizeof(g_Updates));
+
+	for (x = 0; x < 100; x++)
+	{
+		if (!shadow_client_post_pointer_position(client, 10 + x, 20 + x))
+			return FALSE;
+	}
+
+	if (MessageQueue_Size(client->MsgQueue) != 1)
+	{
+		fprintf(stderr, "%" PRIuz " queued position messages\n",
+		        MessageQueue_Size(client->MsgQueue));
+		return FALSE;
+	}
+
+	if (!shadow_client_drain_messages(client))
+		return FALSE;
+
+	if ((g_Updates.positions != 1) || (g_Updates.xPos != 109) || (g_Updates.yPos != 119))
+	{
+		fprintf(stderr, "%" PRIuz " position updates, last %" PRIu32 "x%" PRIu32 "\n",
+		        g_Updates.positions, g_Updates.xPos, g_Updates.yPos);
+		return FALSE;
+	}
+
+	/* The next move is posted again */
+	if (!shadow_client_post_pointer_position(client, 1, 2) ||
+	    !shadow_client_drain_messages(client))
+		return FALSE;
+
+	return (g_Updates.positions == 2) && (g_Updates.xPos == 1) && (g_Updates.yPos == 2);
+}
+
+/* Shapes and moves queued together: one update of each, the last shape and position win */
+static BOOL test_shape_coalescing(rdpShadowClient* client)
+{
+	UINT32 x;
+
+	ZeroMemory(&g_Updates, sizeof(g_Updates));
+
+	for (x = 1; x <= 3; x++)
+	{
+		if (!test_post_shape(client, x, 8 * x) ||
+		    !shadow_client_post_pointer_position(client, 100 * x, 200 * x))
+			return FALSE;
+	}
+
+	if (!shadow_client_drain_messages(client))
+		return FALSE;
+
+	if ((g_Updates.positions != 1) || (g_Updates.xPos != 300) || (g_Updates.yPos != 600) ||
+	    (g_Updates.shapes != 1) || (g_Updates.xHot != 3) || (g_Updates.width != 24) ||
+	    (g_Updates.cached != 1))
+	{
+		fprintf(stderr,
+		        "%" PRIuz " positions at %" PRIu32 "x%" PRIu32 ", %" PRIuz
+		        " shapes, last hotspot %" PRIu32 " width %" PRIu32 "\n",
+		        g_Updates.positions, g_Updates.xPos, g_Updates.yPos, g_Updates.shapes,
+		        g_Updates.xHot, g_Updates.width);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Shapes the client has cached are not sent again */
+static BOOL test_shape_cache(rdpShadowClient* client)
+{
+	UINT32 current;
+
+	ZeroMemory(&g_Updates, sizeof(g_Updates));
+
+	if (!test_post_shape(client, 3, 24) || !shadow_client_drain_messages(client))
+		return FALSE;
+
+	/* Still the current pointer, nothing to do */
+	if ((g_Updates.shapes != 0) || (g_Updates.cached != 0))
+		return FALSE;
+
+	current = client->pointerCacheIndex;
+
+	if (!test_post_shape(client, 4, 16) || !shadow_client_drain_messages(client))
+		return FALSE;
+
+	if ((g_Updates.shapes != 1) || (g_Updates.cached != 1) || (g_Updates.cacheIndex == current))
+		return FALSE;
+
+	/* Switching back only selects the cached entry */
+	if (!test_post_shape(client, 3, 24) || !shadow_client_drain_messages(client))
+		return FALSE;
+
+	if ((g_Updates.shapes != 1) || (g_Updates.cached != 2) || (g_Updates.cacheIndex != current))
+	{
+		fprintf(stderr, "%" PRIuz " shapes, %" PRIuz " cached, index %" PRIu32 "\n",
+		        g_Updates.shapes, g_Updates.cached, g_Updates.cacheIndex);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int TestShadowPointer(int argc, char* argv[])
+{
+	int rc = -1;
+	rdpShadowClient* client;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!(client = test_client_new()))
+		return -1;
+
+	if (!test_position_coalescing(client))
+		goto fail;
+
+	if (!test_shape_coalescing(client))
+		goto fail;
+
+	if (!test_shape_cache(client))
+		goto fail;
+
+	rc = 0;
+fail:
+	test_client_free(client);
+	return rc;
+}
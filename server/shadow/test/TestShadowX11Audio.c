@@ -0,0 +1,284 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/interlocked.h>
+#include <winpr/sysinfo.h>
+#include <winpr/wtsapi.h>
+
+#include <freerdp/server/shadow.h>
+
+#include "../X11/x11_audio.h"
+
+#define TEST_CLIENTS 4
+/* 10 ms capture periods of the X11 audio capture, 20 ms blocks to the clients */
+#define TEST_PERIOD_FRAMES 441
+#define TEST_BLOCK_FRAMES 882
+/* Clients never confirm, the capture allows 4 unconfirmed blocks */
+#define TEST_BLOCKS 4
+/* Capture time of the first frame, far from the current tick count */
+#define TEST_STAMP 0x4000
+
+typedef struct
+{
+	size_t count;
+	size_t length;
+	BOOL mismatch;
+	UINT16 stamps[TEST_BLOCKS];
+} test_channel;
+
+static test_channel g_Channels[TEST_CLIENTS] = { 0 };
+static LONG g_Opened = 0;
+static LONG g_Sent = 0;
+
+static HANDLE WINAPI test_VirtualChannelOpen(HANDLE hServer, DWORD SessionId, LPSTR pVirtualName)
+{
+	const LONG index = InterlockedIncrement(&g_Opened) - 1;
+	WINPR_UNUSED(hServer);
+	WINPR_UNUSED(SessionId);
+	WINPR_UNUSED(pVirtualName);
+
+	if (index >= TEST_CLIENTS)
+		return NULL;
+
+	return (HANDLE)&g_Channels[index];
+}
+
+static BOOL WINAPI test_VirtualChannelClose(HANDLE hChannelHandle)
+{
+	WINPR_UNUSED(hChannelHandle);
+	return TRUE;
+}
+
+static BOOL WINAPI test_VirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer, ULONG Length,
+                                            PULONG pBytesWritten)
+{
+	test_channel* channel = (test_channel*)hChannelHandle;
+
+	/* Wave2 PDUs, the audio data follows a 16 byte header */
+	if ((Length >= 16) && ((BYTE)Buffer[0] == SNDC_WAVE2))
+	{
+		if (channel->count && (channel->length != Length - 16))
+			channel->mismatch = TRUE;
+
+		if (channel->count < TEST_BLOCKS)
+			channel->stamps[channel->count] = (UINT16)(((BYTE)Buffer[5] << 8) | (BYTE)Buffer[4]);
+
+		channel->count++;
+		channel->length = Length - 16;
+		InterlockedIncrement(&g_Sent);
+	}
+
+	if (pBytesWritten)
+		*pBytesWritten = Length;
+
+	return TRUE;
+}
+
+static BOOL WINAPI test_VirtualChannelQuery(HANDLE hChannelHandle,
+                                            WTS_VIRTUAL_CLASS WtsVirtualClass, PVOID* ppBuffer,
+                                            DWORD* pBytesReturned)
+{
+	HANDLE* event;
+	WINPR_UNUSED(hChannelHandle);
+
+	if (WtsVirtualClass != WTSVirtualEventHandle)
+		return FALSE;
+
+	event = (HANDLE*)calloc(1, sizeof(HANDLE));
+
+	if (!event)
+		return FALSE;
+
+	*ppBuffer = event;
+	*pBytesReturned = sizeof(HANDLE);
+	return TRUE;
+}
+
+static VOID WINAPI test_FreeMemory(PVOID pMemory)
+{
+	free(pMemory);
+}
+
+static WtsApiFunctionTable testWtsApi = { 0 };
+
+static const AUDIO_FORMAT src_format = { WAVE_FORMAT_PCM, 2, 44100, 176400, 4, 16, 0, NULL };
+static const AUDIO_FORMAT client_format = { WAVE_FORMAT_PCM, 1, 44100, 88200, 2, 16, 0, NULL };
+
+static RdpsndServerContext* test_context_new(void)
+{
+	RdpsndServerContext* context = rdpsnd_server_context_new(WTS_CURRENT_SERVER_HANDLE);
+
+	if (!context)
+		return NULL;
+
+	context->src_format = (AUDIO_FORMAT*)&src_format;
+	context->client_formats = (AUDIO_FORMAT*)calloc(1, sizeof(AUDIO_FORMAT));
+
+	if (!context->client_formats)
+		goto fail;
+
+	context->client_formats[0] = client_format;
+	context->num_client_formats = 1;
+	context->clientVersion = 0x08; /* CHANNEL_VERSION_WIN_8, send Wave2 PDUs */
+
+	if (context->Initialize(context, FALSE) != CHANNEL_RC_OK)
+		goto fail;
+
+	if (context->SelectFormat(context, 0) != CHANNEL_RC_OK)
+	{
+		context->Stop(context);
+		goto fail;
+	}
+
+	return context;
+fail:
+	rdpsnd_server_context_free(context);
+	return NULL;
+}
+
+static void test_context_free(RdpsndServerContext* context)
+{
+	if (!context)
+		return;
+
+	context->Stop(context);
+	rdpsnd_server_context_free(context);
+}
+
+/* The sender thread delivers asynchronously, give it up to 5 seconds */
+static BOOL test_wait_sent(LONG expected)
+{
+	const UINT64 end = GetTickCount64() + 5000;
+
+	while (InterlockedCompareExchange(&g_Sent, 0, 0) < expected)
+	{
+		if (GetTickCount64() > end)
+			return FALSE;
+
+		Sleep(1);
+	}
+
+	return TRUE;
+}
+
+/* Feeds a fake capture stream in fragments of uneven size, like PulseAudio delivers them.
+ * The stream starts start frames after TEST_STAMP. */
+static BOOL test_capture(x11ShadowAudio* audio, const INT16* samples, size_t frames, size_t start)
+{
+	size_t x;
+	size_t offset = 0;
+	const size_t fragments[] = { 100, TEST_PERIOD_FRAMES, 7, 300 };
+
+	for (x = 0; offset < frames; x++)
+	{
+		const size_t fragment = fragments[x % ARRAYSIZE(fragments)];
+		const size_t count = MIN(fragment, frames - offset);
+
+		const UINT32 timestamp = (UINT32)(TEST_STAMP + (start + offset) * 1000 / 44100);
+
+		if (!x11_shadow_audio_write(audio, &samples[offset * 2], count, timestamp))
+			return FALSE;
+
+		offset += count;
+	}
+
+	return TRUE;
+}
+
+int TestShadowX11Audio(int argc, char* argv[])
+{
+	int rc = -1;
+	size_t x;
+	rdpShadowServer server = { 0 };
+	rdpShadowSubsystem subsystem = { 0 };
+	RdpsndServerContext* contexts[TEST_CLIENTS] = { 0 };
+	x11ShadowAudio* audio = NULL;
+	RdpsndServerSource* source;
+	INT16* samples = NULL;
+	const size_t frames = TEST_BLOCK_FRAMES * 2;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	testWtsApi.pVirtualChannelOpen = test_VirtualChannelOpen;
+	testWtsApi.pVirtualChannelClose = test_VirtualChannelClose;
+	testWtsApi.pVirtualChannelWrite = test_VirtualChannelWrite;
+	testWtsApi.pVirtualChannelQuery = test_VirtualChannelQuery;
+	testWtsApi.pFreeMemory = test_FreeMemory;
+
+	if (!WTSRegisterWtsApiFunctionTable(&testWtsApi))
+		return -1;
+
+	if (!InitializeCriticalSectionAndSpinCount(&server.lock, 4000))
+		return -1;
+
+	subsystem.server = &server;
+	samples = (INT16*)calloc(frames, 2 * sizeof(INT16));
+
+	if (!samples)
+		goto fail;
+
+	for (x = 0; x < frames * 2; x++)
+		samples[x] = (INT16)(x * 64);
+
+	if (!(audio = x11_shadow_audio_new(&subsystem)))
+		goto fail;
+
+	source = x11_shadow_audio_get_source(audio);
+
+	for (x = 0; x < TEST_CLIENTS; x++)
+	{
+		if (!(contexts[x] = test_context_new()) ||
+		    !rdpsnd_server_source_add_context(source, contexts[x]))
+			goto fail;
+	}
+
+	/* Two blocks per round, the sender queue holds four periods */
+	for (x = 0; x < TEST_BLOCKS / 2; x++)
+	{
+		if (!test_capture(audio, samples, frames, x * frames) ||
+		    !test_wait_sent((LONG)((x + 1) * 2 * TEST_CLIENTS)))
+		{
+			fprintf(stderr, "%" PRId32 " blocks sent after round %" PRIuz "\n", g_Sent, x);
+			goto fail;
+		}
+	}
+
+	/* Every client gets every block, encoded once to the client format */
+	for (x = 0; x < TEST_CLIENTS; x++)
+	{
+		if ((g_Channels[x].count != TEST_BLOCKS) || g_Channels[x].mismatch ||
+		    (g_Channels[x].length != TEST_BLOCK_FRAMES * client_format.nBlockAlign))
+		{
+			fprintf(stderr, "client %" PRIuz ": %" PRIuz " blocks of %" PRIuz " bytes\n", x,
+			        g_Channels[x].count, g_Channels[x].length);
+			goto fail;
+		}
+	}
+
+	/* Blocks carry the capture time of their last period, 10 ms after the first one */
+	for (x = 0; x < TEST_BLOCKS; x++)
+	{
+		const UINT16 expected = (UINT16)(TEST_STAMP + (2 * x + 1) * 10);
+		const INT32 delta = (INT16)(g_Channels[0].stamps[x] - expected);
+
+		if ((delta < -1) || (delta > 1))
+		{
+			fprintf(stderr, "block %" PRIuz ": timestamp %" PRIu16 ", expected %" PRIu16 "\n", x,
+			        g_Channels[0].stamps[x], expected);
+			goto fail;
+		}
+	}
+
+	rc = 0;
+fail:
+	/* Stops the sender thread before the contexts go away */
+	x11_shadow_audio_free(audio);
+
+	for (x = 0; x < TEST_CLIENTS; x++)
+		test_context_free(contexts[x]);
+
+	free(samples);
+	DeleteCriticalSection(&server.lock);
+	return rc;
+}
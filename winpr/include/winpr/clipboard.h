@@ -89,9 +89,15 @@ extern "C"
 	WINPR_API UINT32 ClipboardGetFormatId(wClipboard* clipboard, const char* name);
 	WINPR_API const char* ClipboardGetFormatName(wClipboard* clipboard, UINT32 formatId);
 	WINPR_API void* ClipboardGetData(wClipboard* clipboard, UINT32 formatId, UINT32* pSize);
+	/* Like ClipboardGetData without a copy, the data stays valid until ClipboardReleaseData */
+	WINPR_API const void* ClipboardGetDataRef(wClipboard* clipboard, UINT32 formatId,
+	                                          UINT32* pSize);
+	WINPR_API void ClipboardReleaseData(const void* data);
 	WINPR_API BOOL ClipboardSetData(wClipboard* clipboard, UINT32 formatId, const void* data,
 	                                UINT32 size);
 
+	WINPR_API UINT32 ClipboardGetSequenceNumber(wClipboard* clipboard);
+
 	WINPR_API UINT64 ClipboardGetOwner(wClipboard* clipboard);
 	WINPR_API void ClipboardSetOwner(wClipboard* clipboard, UINT64 ownerId);
 
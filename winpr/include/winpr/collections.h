@@ -165,6 +165,8 @@ extern "C"
 		void* value;
 
 		wListDictionaryItem* next;
+		wListDictionaryItem* prev;
+		wListDictionaryItem* bucketNext;
 	};
 
 	/* WARNING: Do not access structs directly, the API will be reworked
@@ -177,6 +179,11 @@ extern "C"
 		wListDictionaryItem* head;
 		wObject objectKey;
 		wObject objectValue;
+
+		wListDictionaryItem* tail;
+		wListDictionaryItem** buckets;
+		size_t numOfBuckets;
+		size_t count;
 	};
 	typedef struct _wListDictionary wListDictionary;
 
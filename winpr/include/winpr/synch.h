@@ -404,6 +404,26 @@ extern "C"
 
 	WINPR_API void* GetEventWaitObject(HANDLE hEvent);
 
+	/**
+	 * A wait set registers handles once for repeated waits, a wait behaves like
+	 * WaitForMultipleObjects(count, handles, FALSE, dwMilliseconds) with the handles in the
+	 * order they were added. Handles must be removed before they are closed, handles whose file
+	 * descriptor changes (WSAEventSelect) must be removed and added again, which
+	 * winpr_WaitSet_Update does for wait loops that collect their handles on every iteration.
+	 */
+	typedef struct winpr_wait_set WINPR_WAIT_SET;
+
+	WINPR_API WINPR_WAIT_SET* winpr_WaitSet_New(void);
+	WINPR_API void winpr_WaitSet_Free(WINPR_WAIT_SET* set);
+
+	WINPR_API BOOL winpr_WaitSet_Add(WINPR_WAIT_SET* set, HANDLE hHandle);
+	WINPR_API BOOL winpr_WaitSet_Remove(WINPR_WAIT_SET* set, HANDLE hHandle);
+	WINPR_API BOOL winpr_WaitSet_Update(WINPR_WAIT_SET* set, const HANDLE* lpHandles,
+	                                    DWORD nCount);
+	WINPR_API DWORD winpr_WaitSet_Count(const WINPR_WAIT_SET* set);
+
+	WINPR_API DWORD winpr_WaitSet_Wait(WINPR_WAIT_SET* set, DWORD dwMilliseconds);
+
 #ifdef __cplusplus
 }
 #endif
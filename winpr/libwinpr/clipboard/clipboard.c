@@ -22,6 +22,7 @@
 #endif
 
 #include <winpr/crt.h>
+#include <winpr/interlocked.h>
 #include <winpr/collections.h>
 #include <winpr/wlog.h>
 
@@ -155,18 +156,49 @@ void ClipboardUnlock(wClipboard* clipboard)
 	LeaveCriticalSection(&(clipboard->lock));
 }
 
+static wClipboardBuffer* ClipboardBufferNew(UINT32 formatId, const void* data, UINT32 size)
+{
+	wClipboardBuffer* buffer = (wClipboardBuffer*)malloc(sizeof(wClipboardBuffer) + size);
+
+	if (!buffer)
+		return NULL;
+
+	buffer->refCount = 1;
+	buffer->formatId = formatId;
+	buffer->size = size;
+	buffer->reserved = 0;
+
+	if (size > 0)
+		CopyMemory(&buffer[1], data, size);
+
+	return buffer;
+}
+
+static void ClipboardBufferRelease(wClipboardBuffer* buffer)
+{
+	if (buffer && (InterlockedDecrement(&buffer->refCount) == 0))
+		free(buffer);
+}
+
+/* Drops the clipboard data and its conversions, references held by callers stay valid */
+static void ClipboardReleaseBuffers(wClipboard* clipboard)
+{
+	UINT32 index;
+
+	for (index = 0; index < clipboard->numConverted; index++)
+		ClipboardBufferRelease(clipboard->converted[index]);
+
+	clipboard->numConverted = 0;
+	ClipboardBufferRelease(clipboard->data);
+	clipboard->data = NULL;
+}
+
 BOOL ClipboardEmpty(wClipboard* clipboard)
 {
 	if (!clipboard)
 		return FALSE;
 
-	if (clipboard->data)
-	{
-		free((void*)clipboard->data);
-		clipboard->data = NULL;
-	}
-
-	clipboard->size = 0;
+	ClipboardReleaseBuffers(clipboard);
 	clipboard->formatId = 0;
 	clipboard->sequenceNumber++;
 	return TRUE;
@@ -422,60 +454,164 @@ const char* ClipboardGetFormatName(wClipboard* clipboard, UINT32 formatId)
 	return format->formatName;
 }
 
-void* ClipboardGetData(wClipboard* clipboard, UINT32 formatId, UINT32* pSize)
+/**
+ * Returns the clipboard data in the requested format. Each format is synthesized once per
+ * clipboard content, later requests are served from the conversion cache.
+ */
+static wClipboardBuffer* ClipboardGetBuffer(wClipboard* clipboard, UINT32 formatId)
 {
-	UINT32 SrcSize = 0;
-	UINT32 DstSize = 0;
-	void* pSrcData = NULL;
-	void* pDstData = NULL;
+	UINT32 index;
+	UINT32 DstSize;
+	void* pDstData;
+	wClipboardBuffer* buffer;
 	wClipboardFormat* format;
 	wClipboardSynthesizer* synthesizer;
 
-	if (!clipboard)
-		return NULL;
-
-	if (!pSize)
+	if (!clipboard->data)
 		return NULL;
 
-	*pSize = 0;
 	format = ClipboardFindFormat(clipboard, clipboard->formatId, NULL);
 
 	if (!format)
 		return NULL;
 
-	SrcSize = clipboard->size;
-	pSrcData = (void*)clipboard->data;
-
 	if (formatId == format->formatId)
+		return clipboard->data;
+
+	for (index = 0; index < clipboard->numConverted; index++)
 	{
-		DstSize = SrcSize;
-		pDstData = malloc(DstSize);
+		if (clipboard->converted[index]->formatId == formatId)
+			return clipboard->converted[index];
+	}
+
+	synthesizer = ClipboardFindSynthesizer(format, formatId);
+
+	if (!synthesizer || !synthesizer->pfnSynthesize)
+		return NULL;
+
+	DstSize = clipboard->data->size;
+	pDstData = synthesizer->pfnSynthesize(clipboard, format->formatId, &clipboard->data[1],
+	                                      &DstSize);
+
+	if (!pDstData)
+		return NULL;
 
-		if (!pDstData)
-			return NULL;
+	buffer = ClipboardBufferNew(formatId, pDstData, DstSize);
+	free(pDstData);
 
-		CopyMemory(pDstData, pSrcData, SrcSize);
-		*pSize = DstSize;
+	if (!buffer)
+		return NULL;
+
+	if (clipboard->numConverted == clipboard->maxConverted)
+	{
+		const UINT32 maxConverted = (clipboard->maxConverted > 0) ? clipboard->maxConverted * 2 : 4;
+		wClipboardBuffer** converted = (wClipboardBuffer**)realloc(
+		    clipboard->converted, maxConverted * sizeof(wClipboardBuffer*));
+
+		if (!converted)
+		{
+			/* Not cached, the reference is handed to the caller */
+			WLog_WARN(TAG, "failed to cache the clipboard conversion to 0x%08" PRIX32, formatId);
+			return buffer;
+		}
+
+		clipboard->converted = converted;
+		clipboard->maxConverted = maxConverted;
 	}
-	else
+
+	clipboard->converted[clipboard->numConverted++] = buffer;
+	return buffer;
+}
+
+static BOOL ClipboardBufferIsCached(wClipboard* clipboard, const wClipboardBuffer* buffer)
+{
+	UINT32 index;
+
+	if (buffer == clipboard->data)
+		return TRUE;
+
+	for (index = 0; index < clipboard->numConverted; index++)
 	{
-		synthesizer = ClipboardFindSynthesizer(format, formatId);
+		if (clipboard->converted[index] == buffer)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+void* ClipboardGetData(wClipboard* clipboard, UINT32 formatId, UINT32* pSize)
+{
+	void* pDstData;
+	wClipboardBuffer* buffer;
 
-		if (!synthesizer || !synthesizer->pfnSynthesize)
-			return NULL;
+	if (!clipboard)
+		return NULL;
+
+	if (!pSize)
+		return NULL;
 
-		DstSize = SrcSize;
-		pDstData = synthesizer->pfnSynthesize(clipboard, format->formatId, pSrcData, &DstSize);
-		if (pDstData)
-			*pSize = DstSize;
+	*pSize = 0;
+	buffer = ClipboardGetBuffer(clipboard, formatId);
+
+	if (!buffer)
+		return NULL;
+
+	pDstData = malloc(buffer->size);
+
+	if (pDstData)
+	{
+		CopyMemory(pDstData, &buffer[1], buffer->size);
+		*pSize = buffer->size;
 	}
 
+	if (!ClipboardBufferIsCached(clipboard, buffer))
+		ClipboardBufferRelease(buffer);
+
 	return pDstData;
 }
 
+const void* ClipboardGetDataRef(wClipboard* clipboard, UINT32 formatId, UINT32* pSize)
+{
+	wClipboardBuffer* buffer;
+
+	if (!clipboard || !pSize)
+		return NULL;
+
+	*pSize = 0;
+	buffer = ClipboardGetBuffer(clipboard, formatId);
+
+	if (!buffer)
+		return NULL;
+
+	if (ClipboardBufferIsCached(clipboard, buffer))
+		InterlockedIncrement(&buffer->refCount);
+
+	*pSize = buffer->size;
+	return &buffer[1];
+}
+
+void ClipboardReleaseData(const void* data)
+{
+	if (data)
+		ClipboardBufferRelease(&((wClipboardBuffer*)data)[-1]);
+}
+
+/* Conversions of file lists read the files and the delegate state, not only the data */
+static BOOL ClipboardIsFileList(wClipboard* clipboard, UINT32 formatId)
+{
+	const wClipboardFormat* format = ClipboardFindFormat(clipboard, formatId, NULL);
+
+	if (!format || !format->formatName)
+		return FALSE;
+
+	return (strcmp(format->formatName, "text/uri-list") == 0) ||
+	       (strcmp(format->formatName, "FileGroupDescriptorW") == 0);
+}
+
 BOOL ClipboardSetData(wClipboard* clipboard, UINT32 formatId, const void* data, UINT32 size)
 {
 	wClipboardFormat* format;
+	wClipboardBuffer* buffer;
 
 	if (!clipboard)
 		return FALSE;
@@ -485,19 +621,38 @@ BOOL ClipboardSetData(wClipboard* clipboard, UINT32 formatId, const void* data,
 	if (!format)
 		return FALSE;
 
-	free((void*)clipboard->data);
-	clipboard->data = malloc(size);
+	/* Setting the same content again keeps the conversions already done, it still counts as a
+	 * change for ClipboardGetSequenceNumber */
+	if (clipboard->data && (clipboard->formatId == formatId) && (clipboard->data->size == size) &&
+	    !ClipboardIsFileList(clipboard, formatId))
+	{
+		if ((size == 0) || (memcmp(&clipboard->data[1], data, size) == 0))
+		{
+			clipboard->sequenceNumber++;
+			return TRUE;
+		}
+	}
 
-	if (!clipboard->data)
+	buffer = ClipboardBufferNew(formatId, data, size);
+	ClipboardReleaseBuffers(clipboard);
+
+	if (!buffer)
 		return FALSE;
 
-	memcpy(clipboard->data, data, size);
-	clipboard->size = size;
+	clipboard->data = buffer;
 	clipboard->formatId = formatId;
 	clipboard->sequenceNumber++;
 	return TRUE;
 }
 
+UINT32 ClipboardGetSequenceNumber(wClipboard* clipboard)
+{
+	if (!clipboard)
+		return 0;
+
+	return clipboard->sequenceNumber;
+}
+
 UINT64 ClipboardGetOwner(wClipboard* clipboard)
 {
 	if (!clipboard)
@@ -603,9 +758,8 @@ void ClipboardDestroy(wClipboard* clipboard)
 		}
 	}
 
-	free((void*)clipboard->data);
-	clipboard->data = NULL;
-	clipboard->size = 0;
+	ClipboardReleaseBuffers(clipboard);
+	free(clipboard->converted);
 	clipboard->numFormats = 0;
 	free(clipboard->formats);
 	DeleteCriticalSection(&(clipboard->lock));
@@ -26,6 +26,7 @@
 
 typedef struct _wClipboardFormat wClipboardFormat;
 typedef struct _wClipboardSynthesizer wClipboardSynthesizer;
+typedef struct _wClipboardBuffer wClipboardBuffer;
 
 struct _wClipboardFormat
 {
@@ -42,6 +43,15 @@ struct _wClipboardSynthesizer
 	CLIPBOARD_SYNTHESIZE_FN pfnSynthesize;
 };
 
+/* Reference counted clipboard data, the payload follows the header */
+struct _wClipboardBuffer
+{
+	volatile LONG refCount;
+	UINT32 formatId;
+	UINT32 size;
+	UINT32 reserved;
+};
+
 struct _wClipboard
 {
 	UINT64 ownerId;
@@ -55,11 +65,16 @@ struct _wClipboard
 
 	/* clipboard data */
 
-	UINT32 size;
-	void* data;
+	wClipboardBuffer* data;
 	UINT32 formatId;
 	UINT32 sequenceNumber;
 
+	/* conversions of the clipboard data, synthesized on first request */
+
+	UINT32 numConverted;
+	UINT32 maxConverted;
+	wClipboardBuffer** converted;
+
 	/* clipboard file handling */
 
 	wArrayList* localFiles;
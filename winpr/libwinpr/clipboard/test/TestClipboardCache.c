@@ -0,0 +1,248 @@
+
+#include <ctype.h>
+
+#include <winpr/crt.h>
+#include <winpr/print.h>
+#include <winpr/sysinfo.h>
+#include <winpr/clipboard.h>
+
+static UINT32 synthesized = 0;
+
+static void* test_synthesize_upper(wClipboard* clipboard, UINT32 formatId, const void* data,
+                                   UINT32* pSize)
+{
+	UINT32 index;
+	char* pDstData;
+	WINPR_UNUSED(clipboard);
+	WINPR_UNUSED(formatId);
+	synthesized++;
+
+	if (!(pDstData = malloc(*pSize)))
+		return NULL;
+
+	for (index = 0; index < *pSize; index++)
+		pDstData[index] = (char)toupper(((const char*)data)[index]);
+
+	return pDstData;
+}
+
+static BOOL test_conversion_cache(wClipboard* clipboard, UINT32 textId, UINT32 upperId)
+{
+	BOOL rc = FALSE;
+	UINT32 size = 0;
+	UINT32 refSize = 0;
+	UINT32 sequence;
+	char* copy = NULL;
+	const char* ref1 = NULL;
+	const char* ref2 = NULL;
+	const char* old = NULL;
+	const char text[] = "lazy conversion";
+	const char other[] = "other content";
+
+	if (!ClipboardRegisterSynthesizer(clipboard, textId, upperId, test_synthesize_upper))
+		return FALSE;
+
+	synthesized = 0;
+
+	if (!ClipboardSetData(clipboard, textId, text, sizeof(text)) || (synthesized != 0))
+		goto fail;
+
+	/* The conversion runs once, on the first request */
+	copy = ClipboardGetData(clipboard, upperId, &size);
+	ref1 = ClipboardGetDataRef(clipboard, upperId, &refSize);
+	ref2 = ClipboardGetDataRef(clipboard, upperId, &refSize);
+
+	if (!copy || !ref1 || (ref1 != ref2) || (synthesized != 1))
+		goto fail;
+
+	if ((size != sizeof(text)) || (refSize != size) || (strcmp(copy, "LAZY CONVERSION") != 0) ||
+	    (memcmp(copy, ref1, size) != 0))
+		goto fail;
+
+	/* Setting the same content again keeps the cache, the sequence number moves on */
+	sequence = ClipboardGetSequenceNumber(clipboard);
+
+	if (!ClipboardSetData(clipboard, textId, text, sizeof(text)))
+		goto fail;
+
+	ClipboardReleaseData(ref2);
+	ref2 = ClipboardGetDataRef(clipboard, upperId, &refSize);
+
+	if ((ref2 != ref1) || (synthesized != 1) ||
+	    (ClipboardGetSequenceNumber(clipboard) != sequence + 1))
+		goto fail;
+
+	/* New content is converted again, references to the old content stay valid */
+	if (!ClipboardSetData(clipboard, textId, other, sizeof(other)))
+		goto fail;
+
+	old = ref1;
+	ref1 = NULL;
+	ClipboardReleaseData(ref2);
+	ref2 = ClipboardGetDataRef(clipboard, upperId, &refSize);
+
+	if (!ref2 || (synthesized != 2) || (strcmp(ref2, "OTHER CONTENT") != 0) ||
+	    (strcmp(old, "LAZY CONVERSION") != 0))
+		goto fail;
+
+	/* The source format is returned without conversion */
+	ClipboardReleaseData(ref2);
+	ref2 = ClipboardGetDataRef(clipboard, textId, &refSize);
+
+	if (!ref2 || (refSize != sizeof(other)) || (strcmp(ref2, other) != 0) || (synthesized != 2))
+		goto fail;
+
+	/* Formats without a synthesizer are not available */
+	if (ClipboardGetDataRef(clipboard, CF_DIB, &refSize) || (refSize != 0))
+		goto fail;
+
+	if (!ClipboardEmpty(clipboard) || ClipboardGetDataRef(clipboard, textId, &refSize))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (!rc)
+		fprintf(stderr, "%s failed, %" PRIu32 " conversions\n", __FUNCTION__, synthesized);
+
+	free(copy);
+	ClipboardReleaseData(old);
+	ClipboardReleaseData(ref1);
+	ClipboardReleaseData(ref2);
+	return rc;
+}
+
+/* A file list converts again when set again, the files may have changed meanwhile */
+static BOOL test_file_list_not_cached(wClipboard* clipboard, UINT32 upperId)
+{
+	UINT32 size = 0;
+	const char uris[] = "file:///tmp/a\r\n";
+	const UINT32 uriId = ClipboardRegisterFormat(clipboard, "text/uri-list");
+	char* data;
+
+	if (!uriId || !ClipboardRegisterSynthesizer(clipboard, uriId, upperId, test_synthesize_upper))
+		return FALSE;
+
+	synthesized = 0;
+
+	if (!ClipboardSetData(clipboard, uriId, uris, sizeof(uris)))
+		return FALSE;
+
+	data = ClipboardGetData(clipboard, upperId, &size);
+	free(data);
+
+	if (!data || !ClipboardSetData(clipboard, uriId, uris, sizeof(uris)))
+		return FALSE;
+
+	data = ClipboardGetData(clipboard, upperId, &size);
+	free(data);
+
+	if (!data || (synthesized != 2))
+	{
+		fprintf(stderr, "%s failed, %" PRIu32 " conversions\n", __FUNCTION__, synthesized);
+		return FALSE;
+	}
+
+	return ClipboardEmpty(clipboard);
+}
+
+static BOOL test_image_speed(wClipboard* clipboard)
+{
+	UINT32 index;
+	UINT32 size = 0;
+	BOOL rc = FALSE;
+	UINT64 start, copies, refs;
+	BITMAPFILEHEADER* fileHeader;
+	BITMAPINFOHEADER* infoHeader;
+	const UINT32 width = 3840;
+	const UINT32 height = 2160;
+	const UINT32 bmpSize =
+	    sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER) + width * height * 4;
+	const UINT32 bmpId = ClipboardGetFormatId(clipboard, "image/bmp");
+	BYTE* bmp = calloc(1, bmpSize);
+
+	if (!bmp)
+		return FALSE;
+
+	fileHeader = (BITMAPFILEHEADER*)bmp;
+	infoHeader = (BITMAPINFOHEADER*)&bmp[sizeof(BITMAPFILEHEADER)];
+	fileHeader->bfType = 0x4D42;
+	fileHeader->bfSize = bmpSize;
+	fileHeader->bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+	infoHeader->biSize = sizeof(BITMAPINFOHEADER);
+	infoHeader->biWidth = (LONG)width;
+	infoHeader->biHeight = (LONG)height;
+	infoHeader->biPlanes = 1;
+	infoHeader->biBitCount = 32;
+	infoHeader->biSizeImage = width * height * 4;
+
+	if (!ClipboardSetData(clipboard, bmpId, bmp, bmpSize))
+		goto fail;
+
+	/* An X11 application asking for the same screenshot a few times */
+	start = GetTickCount64();
+
+	for (index = 0; index < 16; index++)
+	{
+		void* dib = ClipboardGetData(clipboard, CF_DIB, &size);
+
+		if (!dib || (size != bmpSize - sizeof(BITMAPFILEHEADER)))
+			goto fail;
+
+		free(dib);
+	}
+
+	copies = GetTickCount64() - start;
+	start = GetTickCount64();
+
+	for (index = 0; index < 16; index++)
+	{
+		const void* dib = ClipboardGetDataRef(clipboard, CF_DIB, &size);
+
+		if (!dib || (size != bmpSize - sizeof(BITMAPFILEHEADER)) ||
+		    (memcmp(dib, infoHeader, sizeof(BITMAPINFOHEADER)) != 0))
+			goto fail;
+
+		ClipboardReleaseData(dib);
+	}
+
+	refs = GetTickCount64() - start;
+	printf("16 requests of a %" PRIu32 "x%" PRIu32 " DIB: copies %" PRIu64
+	       "ms, references %" PRIu64 "ms\n",
+	       width, height, copies, refs);
+	rc = TRUE;
+fail:
+	free(bmp);
+	return rc;
+}
+
+int TestClipboardCache(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT32 textId, upperId;
+	wClipboard* clipboard;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!(clipboard = ClipboardCreate()))
+		return -1;
+
+	textId = ClipboardRegisterFormat(clipboard, "text/x-test");
+	upperId = ClipboardRegisterFormat(clipboard, "text/x-test-upper");
+
+	if (!textId || !upperId)
+		goto fail;
+
+	if (!test_conversion_cache(clipboard, textId, upperId))
+		goto fail;
+
+	if (!test_file_list_not_cached(clipboard, upperId))
+		goto fail;
+
+	if (!test_image_speed(clipboard))
+		goto fail;
+
+	rc = 0;
+fail:
+	ClipboardDestroy(clipboard);
+	return rc;
+}
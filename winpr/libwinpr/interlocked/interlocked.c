@@ -249,7 +249,16 @@ LONG InterlockedExchange(LONG volatile* Target, LONG Value)
 #ifdef __GNUC__
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Watomic-implicit-seq-cst"
-	return __sync_val_compare_and_swap(Target, *Target, Value);
+	LONG previous;
+
+	/* A single compare and swap does not exchange if Target changed after reading it */
+	do
+	{
+		previous = *Target;
+	} while (__sync_val_compare_and_swap(Target, previous, Value) != previous);
+
+	return previous;
+#pragma GCC diagnostic pop
 #else
 	return 0;
 #endif
@@ -40,11 +40,32 @@
 #include <mach/semaphore.h>
 #endif
 
+#if defined(__linux__) && !defined(WINPR_CRITICAL_SECTION_DISABLE_FUTEX)
+#define WINPR_CRITICAL_SECTION_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
 #ifndef _WIN32
 
 #include "../log.h"
 #define TAG WINPR_TAG("synch.critical")
 
+#if defined(WINPR_CRITICAL_SECTION_FUTEX)
+/**
+ * On Linux LockCount is a futex word instead of a counter of EnterCriticalSection calls:
+ * -1 unlocked, 0 locked, 1 locked and threads may sleep in the kernel. Neither taking a free
+ * section, nor taking it after spinning, nor leaving a section nobody sleeps on needs a system
+ * call. Recursion only touches RecursionCount. See "Futexes Are Tricky", Ulrich Drepper.
+ */
+#define CRITICAL_SECTION_UNLOCKED -1
+#define CRITICAL_SECTION_LOCKED 0
+#define CRITICAL_SECTION_CONTENDED 1
+
+/* Spin budget of sections initialized without spin count, in cpu relax steps */
+#define CRITICAL_SECTION_DEFAULT_SPIN 128
+#endif
+
 VOID InitializeCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
 {
 	InitializeCriticalSectionEx(lpCriticalSection, 0, 0);
@@ -73,6 +94,11 @@ BOOL InitializeCriticalSectionEx(LPCRITICAL_SECTION lpCriticalSection, DWORD dwS
 	lpCriticalSection->SpinCount = 0;
 	lpCriticalSection->RecursionCount = 0;
 	lpCriticalSection->OwningThread = NULL;
+#if defined(WINPR_CRITICAL_SECTION_FUTEX)
+	lpCriticalSection->LockSemaphore = NULL;
+	SetCriticalSectionSpinCount(lpCriticalSection, dwSpinCount);
+	return TRUE;
+#else
 	lpCriticalSection->LockSemaphore = (winpr_sem_t*)malloc(sizeof(winpr_sem_t));
 
 	if (!lpCriticalSection->LockSemaphore)
@@ -95,6 +121,7 @@ BOOL InitializeCriticalSectionEx(LPCRITICAL_SECTION lpCriticalSection, DWORD dwS
 out_fail:
 	free(lpCriticalSection->LockSemaphore);
 	return FALSE;
+#endif
 }
 
 BOOL InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount)
@@ -124,6 +151,151 @@ DWORD SetCriticalSectionSpinCount(LPCRITICAL_SECTION lpCriticalSection, DWORD dw
 #endif
 }
 
+#if defined(WINPR_CRITICAL_SECTION_FUTEX)
+static DWORD critical_default_spin(void)
+{
+#if defined(WINPR_CRITICAL_SECTION_DISABLE_SPINCOUNT)
+	return 0;
+#else
+	static LONG processors = 0;
+	LONG count = processors;
+
+	if (count == 0)
+	{
+		SYSTEM_INFO sysinfo;
+		GetNativeSystemInfo(&sysinfo);
+		count = (LONG)sysinfo.dwNumberOfProcessors;
+		processors = count;
+	}
+
+	return (count > 1) ? CRITICAL_SECTION_DEFAULT_SPIN : 0;
+#endif
+}
+
+static INLINE void critical_cpu_relax(void)
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	__builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+static INLINE LONG critical_state(LPCRITICAL_SECTION lpCriticalSection)
+{
+	return *((volatile LONG*)&lpCriticalSection->LockCount);
+}
+
+static INLINE BOOL critical_try_lock(LPCRITICAL_SECTION lpCriticalSection)
+{
+	return InterlockedCompareExchange(&lpCriticalSection->LockCount, CRITICAL_SECTION_LOCKED,
+	                                  CRITICAL_SECTION_UNLOCKED) == CRITICAL_SECTION_UNLOCKED;
+}
+
+/**
+ * Spins while the owner is expected to leave soon. The pause between two attempts doubles, and
+ * spinning stops as soon as other threads sleep on the section.
+ */
+static BOOL critical_spin(LPCRITICAL_SECTION lpCriticalSection)
+{
+	DWORD spin = 0;
+	DWORD pause = 1;
+	DWORD spinCount = (DWORD)lpCriticalSection->SpinCount;
+
+	if (!spinCount)
+		spinCount = critical_default_spin();
+
+	while (spin < spinCount)
+	{
+		DWORD x;
+		const LONG state = critical_state(lpCriticalSection);
+
+		if (state == CRITICAL_SECTION_CONTENDED)
+			break;
+
+		if ((state == CRITICAL_SECTION_UNLOCKED) && critical_try_lock(lpCriticalSection))
+			return TRUE;
+
+		for (x = 0; x < pause; x++)
+			critical_cpu_relax();
+
+		spin += pause;
+
+		if (pause < 64)
+			pause *= 2;
+	}
+
+	return FALSE;
+}
+
+static VOID critical_lock_slow(LPCRITICAL_SECTION lpCriticalSection)
+{
+	/* Mark the section contended, the owner then wakes one sleeper when leaving */
+	while (InterlockedExchange(&lpCriticalSection->LockCount, CRITICAL_SECTION_CONTENDED) !=
+	       CRITICAL_SECTION_UNLOCKED)
+	{
+		syscall(SYS_futex, &lpCriticalSection->LockCount, FUTEX_WAIT_PRIVATE,
+		        CRITICAL_SECTION_CONTENDED, NULL, NULL, 0);
+	}
+}
+
+static VOID critical_unlock(LPCRITICAL_SECTION lpCriticalSection)
+{
+	if (InterlockedExchange(&lpCriticalSection->LockCount, CRITICAL_SECTION_UNLOCKED) ==
+	    CRITICAL_SECTION_CONTENDED)
+		syscall(SYS_futex, &lpCriticalSection->LockCount, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+VOID EnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	HANDLE current_thread = (HANDLE)(ULONG_PTR)GetCurrentThreadId();
+
+	if (!critical_try_lock(lpCriticalSection))
+	{
+		/* Section is already locked. Check if it is owned by the current thread. */
+		if (lpCriticalSection->OwningThread == current_thread)
+		{
+			lpCriticalSection->RecursionCount++;
+			return;
+		}
+
+		if (!critical_spin(lpCriticalSection))
+			critical_lock_slow(lpCriticalSection);
+	}
+
+	lpCriticalSection->RecursionCount = 1;
+	lpCriticalSection->OwningThread = current_thread;
+}
+
+BOOL TryEnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	HANDLE current_thread = (HANDLE)(ULONG_PTR)GetCurrentThreadId();
+
+	if (critical_try_lock(lpCriticalSection))
+	{
+		lpCriticalSection->RecursionCount = 1;
+		lpCriticalSection->OwningThread = current_thread;
+		return TRUE;
+	}
+
+	if (lpCriticalSection->OwningThread == current_thread)
+	{
+		lpCriticalSection->RecursionCount++;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+VOID LeaveCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
+{
+	if (--lpCriticalSection->RecursionCount < 1)
+	{
+		lpCriticalSection->OwningThread = NULL;
+		critical_unlock(lpCriticalSection);
+	}
+}
+#else
 static VOID _WaitForCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
 {
 #if defined(__APPLE__)
@@ -239,6 +411,7 @@ VOID LeaveCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
 		InterlockedDecrement(&lpCriticalSection->LockCount);
 	}
 }
+#endif
 
 VOID DeleteCriticalSection(LPCRITICAL_SECTION lpCriticalSection)
 {
@@ -0,0 +1,151 @@
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#define TEST_TOTAL_ENTERS (1 << 20)
+
+typedef struct
+{
+	CRITICAL_SECTION lock;
+	HANDLE start;
+	UINT32 enters;
+	UINT64 counter;
+	UINT64 shadow;
+} TEST_CONTENTION;
+
+/* A short critical section, like a queue or a stream pool operation */
+static DWORD WINAPI test_contention_thread(LPVOID arg)
+{
+	UINT32 x;
+	TEST_CONTENTION* test = (TEST_CONTENTION*)arg;
+
+	WaitForSingleObject(test->start, INFINITE);
+
+	for (x = 0; x < test->enters; x++)
+	{
+		EnterCriticalSection(&test->lock);
+
+		/* Every fourth enter recurses, recursion must not touch the lock word */
+		if ((x & 3) == 0)
+		{
+			if (!TryEnterCriticalSection(&test->lock))
+			{
+				LeaveCriticalSection(&test->lock);
+				return 1;
+			}
+
+			test->shadow++;
+			LeaveCriticalSection(&test->lock);
+		}
+		else
+			test->shadow++;
+
+		test->counter++;
+		LeaveCriticalSection(&test->lock);
+	}
+
+	return 0;
+}
+
+static BOOL test_contention(UINT32 threads, DWORD spinCount)
+{
+	UINT32 x;
+	UINT64 start, elapsed;
+	BOOL rc = FALSE;
+	HANDLE* handles = NULL;
+	TEST_CONTENTION test = { 0 };
+
+	if (!InitializeCriticalSectionAndSpinCount(&test.lock, spinCount))
+		return FALSE;
+
+	test.enters = TEST_TOTAL_ENTERS / threads;
+
+	if (!(test.start = CreateEvent(NULL, TRUE, FALSE, NULL)))
+		goto fail;
+
+	if (!(handles = (HANDLE*)calloc(threads, sizeof(HANDLE))))
+		goto fail;
+
+	for (x = 0; x < threads; x++)
+	{
+		if (!(handles[x] = CreateThread(NULL, 0, test_contention_thread, &test, 0, NULL)))
+			goto fail;
+	}
+
+	start = GetTickCount64();
+	SetEvent(test.start);
+
+	for (x = 0; x < threads; x++)
+	{
+		DWORD exitCode = 1;
+
+		if ((WaitForSingleObject(handles[x], INFINITE) != WAIT_OBJECT_0) ||
+		    !GetExitCodeThread(handles[x], &exitCode) || (exitCode != 0))
+			goto fail;
+	}
+
+	elapsed = GetTickCount64() - start;
+
+	if ((test.counter != (UINT64)test.enters * threads) || (test.shadow != test.counter))
+	{
+		fprintf(stderr,
+		        "%" PRIu32 " threads: counted %" PRIu64 "/%" PRIu64 " enters, expected %" PRIu64
+		        "\n",
+		        threads, test.counter, test.shadow, (UINT64)test.enters * threads);
+		goto fail;
+	}
+
+	if ((test.lock.RecursionCount != 0) || (test.lock.OwningThread != NULL))
+	{
+		fprintf(stderr, "%" PRIu32 " threads: section left owned\n", threads);
+		goto fail;
+	}
+
+	printf("%2" PRIu32 " threads, spin count %4" PRIu32 ": %" PRIu64 " enters in %" PRIu64
+	       "ms\n",
+	       threads, spinCount, test.counter, elapsed);
+	rc = TRUE;
+fail:
+	if (handles)
+	{
+		SetEvent(test.start);
+
+		for (x = 0; x < threads; x++)
+		{
+			if (handles[x])
+			{
+				WaitForSingleObject(handles[x], INFINITE);
+				CloseHandle(handles[x]);
+			}
+		}
+	}
+
+	free(handles);
+
+	if (test.start)
+		CloseHandle(test.start);
+
+	DeleteCriticalSection(&test.lock);
+	return rc;
+}
+
+int TestSynchCriticalContention(int argc, char* argv[])
+{
+	UINT32 threads;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (threads = 1; threads <= 64; threads *= 2)
+	{
+		/* The default of InitializeCriticalSection and the spin count used in FreeRDP */
+		if (!test_contention(threads, 0))
+			return -1;
+
+		if (!test_contention(threads, 4000))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,260 @@
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+
+#define TEST_EVENTS 8
+#define BENCH_EVENTS 32
+#define BENCH_WAITS 100000
+
+static BOOL expect_wait(WINPR_WAIT_SET* set, DWORD timeout, DWORD expected, const char* what)
+{
+	const DWORD status = winpr_WaitSet_Wait(set, timeout);
+
+	if (status == expected)
+		return TRUE;
+
+	fprintf(stderr, "%s: winpr_WaitSet_Wait returned 0x%08" PRIX32 ", expected 0x%08" PRIX32 "\n",
+	        what, status, expected);
+	return FALSE;
+}
+
+static BOOL test_wait_set_events(void)
+{
+	size_t x;
+	BOOL rc = FALSE;
+	HANDLE events[TEST_EVENTS] = { 0 };
+	WINPR_WAIT_SET* set = winpr_WaitSet_New();
+
+	if (!set)
+		return FALSE;
+
+	for (x = 0; x < ARRAYSIZE(events); x++)
+	{
+		if (!(events[x] = CreateEvent(NULL, TRUE, FALSE, NULL)))
+			goto fail;
+
+		if (!winpr_WaitSet_Add(set, events[x]))
+			goto fail;
+	}
+
+	if (!expect_wait(set, 0, WAIT_TIMEOUT, "nothing signaled"))
+		goto fail;
+
+	if (!expect_wait(set, 20, WAIT_TIMEOUT, "nothing signaled, timeout"))
+		goto fail;
+
+	/* Level triggered, the lowest signaled index wins as long as it is set */
+	SetEvent(events[5]);
+	SetEvent(events[2]);
+
+	if (!expect_wait(set, 0, WAIT_OBJECT_0 + 2, "lowest index") ||
+	    !expect_wait(set, INFINITE, WAIT_OBJECT_0 + 2, "still signaled"))
+		goto fail;
+
+	ResetEvent(events[2]);
+
+	if (!expect_wait(set, 0, WAIT_OBJECT_0 + 5, "after reset"))
+		goto fail;
+
+	/* Removing shifts the indices like removing from a handle array */
+	if (!winpr_WaitSet_Remove(set, events[2]) || (winpr_WaitSet_Count(set) != TEST_EVENTS - 1))
+		goto fail;
+
+	if (!expect_wait(set, 0, WAIT_OBJECT_0 + 4, "after remove"))
+		goto fail;
+
+	/* The same handle twice shares the descriptor */
+	if (!winpr_WaitSet_Add(set, events[5]) ||
+	    !expect_wait(set, 0, WAIT_OBJECT_0 + 4, "duplicate handle"))
+		goto fail;
+
+	if (!winpr_WaitSet_Remove(set, events[5]) ||
+	    !expect_wait(set, 0, WAIT_OBJECT_0 + TEST_EVENTS - 2, "duplicate removed"))
+		goto fail;
+
+	/* Update keeps an identical set and rebuilds a changed one */
+	if (!winpr_WaitSet_Update(set, events, 4) || (winpr_WaitSet_Count(set) != 4) ||
+	    !expect_wait(set, 0, WAIT_TIMEOUT, "update"))
+		goto fail;
+
+	if (!winpr_WaitSet_Update(set, events, 4) ||
+	    !winpr_WaitSet_Update(set, &events[4], 4) ||
+	    !expect_wait(set, 0, WAIT_OBJECT_0 + 1, "update changed"))
+		goto fail;
+
+	if (!winpr_WaitSet_Update(set, NULL, 0) || !expect_wait(set, 0, WAIT_FAILED, "empty"))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	winpr_WaitSet_Free(set);
+
+	for (x = 0; x < ARRAYSIZE(events); x++)
+	{
+		if (events[x])
+			CloseHandle(events[x]);
+	}
+
+	return rc;
+}
+
+static BOOL test_wait_set_semaphore(void)
+{
+	BOOL rc = FALSE;
+	HANDLE event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	HANDLE semaphore = CreateSemaphore(NULL, 2, 2, NULL);
+	WINPR_WAIT_SET* set = winpr_WaitSet_New();
+
+	if (!event || !semaphore || !set)
+		goto fail;
+
+	if (!winpr_WaitSet_Add(set, event) || !winpr_WaitSet_Add(set, semaphore))
+		goto fail;
+
+	/* Every wait consumes one count, as with WaitForMultipleObjects */
+	if (!expect_wait(set, 0, WAIT_OBJECT_0 + 1, "semaphore 1") ||
+	    !expect_wait(set, 0, WAIT_OBJECT_0 + 1, "semaphore 2") ||
+	    !expect_wait(set, 0, WAIT_TIMEOUT, "semaphore consumed"))
+		goto fail;
+
+	if (!ReleaseSemaphore(semaphore, 1, NULL) ||
+	    !expect_wait(set, 0, WAIT_OBJECT_0 + 1, "semaphore released"))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	winpr_WaitSet_Free(set);
+
+	if (semaphore)
+		CloseHandle(semaphore);
+
+	if (event)
+		CloseHandle(event);
+
+	return rc;
+}
+
+static DWORD WINAPI test_signal_thread(LPVOID arg)
+{
+	Sleep(50);
+	SetEvent((HANDLE)arg);
+	return 0;
+}
+
+static BOOL test_wait_set_thread(void)
+{
+	BOOL rc = FALSE;
+	HANDLE thread = NULL;
+	HANDLE idle = CreateEvent(NULL, TRUE, FALSE, NULL);
+	HANDLE event = CreateEvent(NULL, TRUE, FALSE, NULL);
+	WINPR_WAIT_SET* set = winpr_WaitSet_New();
+
+	if (!idle || !event || !set)
+		goto fail;
+
+	if (!winpr_WaitSet_Add(set, idle) || !winpr_WaitSet_Add(set, event))
+		goto fail;
+
+	if (!(thread = CreateThread(NULL, 0, test_signal_thread, event, 0, NULL)))
+		goto fail;
+
+	if (!expect_wait(set, INFINITE, WAIT_OBJECT_0 + 1, "signaled by thread"))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (thread)
+	{
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+
+	winpr_WaitSet_Free(set);
+
+	if (event)
+		CloseHandle(event);
+
+	if (idle)
+		CloseHandle(idle);
+
+	return rc;
+}
+
+/* A wait loop over a fixed set of handles, the way channel and peer threads wait */
+static BOOL test_wait_set_speed(void)
+{
+	size_t x;
+	BOOL rc = FALSE;
+	UINT64 start, multiple, waitset;
+	HANDLE events[BENCH_EVENTS] = { 0 };
+	WINPR_WAIT_SET* set = winpr_WaitSet_New();
+
+	if (!set)
+		return FALSE;
+
+	for (x = 0; x < ARRAYSIZE(events); x++)
+	{
+		if (!(events[x] = CreateEvent(NULL, TRUE, FALSE, NULL)))
+			goto fail;
+
+		if (!winpr_WaitSet_Add(set, events[x]))
+			goto fail;
+	}
+
+	SetEvent(events[BENCH_EVENTS - 1]);
+	start = GetTickCount64();
+
+	for (x = 0; x < BENCH_WAITS; x++)
+	{
+		if (WaitForMultipleObjects(BENCH_EVENTS, events, FALSE, INFINITE) !=
+		    WAIT_OBJECT_0 + BENCH_EVENTS - 1)
+			goto fail;
+	}
+
+	multiple = GetTickCount64() - start;
+	start = GetTickCount64();
+
+	for (x = 0; x < BENCH_WAITS; x++)
+	{
+		if (winpr_WaitSet_Wait(set, INFINITE) != WAIT_OBJECT_0 + BENCH_EVENTS - 1)
+			goto fail;
+	}
+
+	waitset = GetTickCount64() - start;
+	printf("%d waits on %d handles: WaitForMultipleObjects %" PRIu64 "ms, wait set %" PRIu64
+	       "ms\n",
+	       BENCH_WAITS, BENCH_EVENTS, multiple, waitset);
+	rc = TRUE;
+fail:
+	winpr_WaitSet_Free(set);
+
+	for (x = 0; x < ARRAYSIZE(events); x++)
+	{
+		if (events[x])
+			CloseHandle(events[x]);
+	}
+
+	return rc;
+}
+
+int TestSynchWaitSet(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_wait_set_events())
+		return -1;
+
+	if (!test_wait_set_semaphore())
+		return -1;
+
+	if (!test_wait_set_thread())
+		return -1;
+
+	if (!test_wait_set_speed())
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,501 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * Synchronization Functions
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include "../log.h"
+#define TAG WINPR_TAG("sync.waitset")
+
+/**
+ * A wait set keeps the handles of a wait loop registered between waits. On Linux the file
+ * descriptors are added to an epoll instance once, a wait is a single level triggered
+ * epoll_wait. Other POSIX systems keep the pollset of the set and only rebuild it after the
+ * set changed, Windows passes the handles to WaitForMultipleObjects.
+ */
+
+#ifndef _WIN32
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include "pollset.h"
+#include "../handle/handle.h"
+
+typedef struct
+{
+	int fd;
+	ULONG mode;
+} WINPR_WAIT_SET_ENTRY;
+
+#endif
+
+struct winpr_wait_set
+{
+	HANDLE* handles;
+	size_t count;
+	size_t capacity;
+#ifndef _WIN32
+	WINPR_WAIT_SET_ENTRY* entries;
+#ifdef HAVE_SYS_EPOLL_H
+	int epfd;
+	struct epoll_event* events;
+#else
+	WINPR_POLL_SET pollset;
+	BOOL pollsetValid;
+#endif
+#endif
+};
+
+#ifndef _WIN32
+static BOOL waitset_resolve(HANDLE handle, WINPR_WAIT_SET_ENTRY* entry)
+{
+	ULONG Type;
+	WINPR_HANDLE* Object;
+
+	if (!winpr_Handle_GetInfo(handle, &Type, &Object))
+	{
+		WLog_ERR(TAG, "invalid handle");
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	entry->fd = winpr_Handle_getFd(Object);
+	entry->mode = Object->Mode;
+
+	if (entry->fd < 0)
+	{
+		WLog_ERR(TAG, "handle type %" PRIu32 " has no file descriptor", Type);
+		SetLastError(ERROR_INVALID_HANDLE);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static UINT32 waitset_mode_to_epoll(ULONG mode)
+{
+	UINT32 events = 0;
+
+	if (mode & WINPR_FD_READ)
+		events |= EPOLLIN;
+
+	if (mode & WINPR_FD_WRITE)
+		events |= EPOLLOUT;
+
+	return events;
+}
+
+/* Several handles may share a descriptor, epoll knows each descriptor once */
+static ULONG waitset_fd_mode(const WINPR_WAIT_SET* set, int fd)
+{
+	size_t x;
+	ULONG mode = 0;
+
+	for (x = 0; x < set->count; x++)
+	{
+		if (set->entries[x].fd == fd)
+			mode |= set->entries[x].mode;
+	}
+
+	return mode;
+}
+
+static BOOL waitset_register(WINPR_WAIT_SET* set, int fd, ULONG oldMode, ULONG newMode)
+{
+	int op;
+	struct epoll_event event = { 0 };
+
+	if (oldMode == newMode)
+		return TRUE;
+
+	if (!newMode)
+	{
+		/* The descriptor might already be closed, which removed it from the epoll set */
+		epoll_ctl(set->epfd, EPOLL_CTL_DEL, fd, &event);
+		return TRUE;
+	}
+
+	op = oldMode ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+	event.events = waitset_mode_to_epoll(newMode);
+	event.data.fd = fd;
+
+	if (epoll_ctl(set->epfd, op, fd, &event) < 0)
+	{
+		WLog_ERR(TAG, "epoll_ctl(%d) for fd %d failed [%d] %s", op, fd, errno, strerror(errno));
+		SetLastError(ERROR_INTERNAL_ERROR);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+#else
+static void waitset_invalidate(WINPR_WAIT_SET* set)
+{
+	if (set->pollsetValid)
+		pollset_uninit(&set->pollset);
+
+	set->pollsetValid = FALSE;
+}
+#endif
+#endif
+
+WINPR_WAIT_SET* winpr_WaitSet_New(void)
+{
+	WINPR_WAIT_SET* set = (WINPR_WAIT_SET*)calloc(1, sizeof(WINPR_WAIT_SET));
+
+	if (!set)
+		return NULL;
+
+#if !defined(_WIN32) && defined(HAVE_SYS_EPOLL_H)
+	set->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (set->epfd < 0)
+	{
+		WLog_ERR(TAG, "epoll_create1 failed [%d] %s", errno, strerror(errno));
+		free(set);
+		return NULL;
+	}
+#endif
+	return set;
+}
+
+void winpr_WaitSet_Free(WINPR_WAIT_SET* set)
+{
+	if (!set)
+		return;
+
+#ifndef _WIN32
+#ifdef HAVE_SYS_EPOLL_H
+	close(set->epfd);
+	free(set->events);
+#else
+	waitset_invalidate(set);
+#endif
+	free(set->entries);
+#endif
+	free(set->handles);
+	free(set);
+}
+
+static BOOL waitset_grow(WINPR_WAIT_SET* set)
+{
+	HANDLE* handles;
+	const size_t capacity = set->capacity ? set->capacity * 2 : 16;
+
+	if (set->count < set->capacity)
+		return TRUE;
+
+	handles = (HANDLE*)realloc(set->handles, capacity * sizeof(HANDLE));
+
+	if (!handles)
+		return FALSE;
+
+	set->handles = handles;
+#ifndef _WIN32
+	{
+		WINPR_WAIT_SET_ENTRY* entries =
+		    (WINPR_WAIT_SET_ENTRY*)realloc(set->entries, capacity * sizeof(WINPR_WAIT_SET_ENTRY));
+
+		if (!entries)
+			return FALSE;
+
+		set->entries = entries;
+	}
+#ifdef HAVE_SYS_EPOLL_H
+	{
+		struct epoll_event* events =
+		    (struct epoll_event*)realloc(set->events, capacity * sizeof(struct epoll_event));
+
+		if (!events)
+			return FALSE;
+
+		set->events = events;
+	}
+#endif
+#endif
+	set->capacity = capacity;
+	return TRUE;
+}
+
+BOOL winpr_WaitSet_Add(WINPR_WAIT_SET* set, HANDLE hHandle)
+{
+#ifndef _WIN32
+	WINPR_WAIT_SET_ENTRY entry;
+#endif
+
+	if (!set)
+		return FALSE;
+
+#ifdef _WIN32
+	if (set->count >= MAXIMUM_WAIT_OBJECTS)
+	{
+		WLog_ERR(TAG, "wait set limited to %d handles", MAXIMUM_WAIT_OBJECTS);
+		return FALSE;
+	}
+#else
+	if (!waitset_resolve(hHandle, &entry))
+		return FALSE;
+#endif
+
+	if (!waitset_grow(set))
+	{
+		SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+		return FALSE;
+	}
+
+#ifndef _WIN32
+#ifdef HAVE_SYS_EPOLL_H
+	{
+		const ULONG mode = waitset_fd_mode(set, entry.fd);
+
+		if (!waitset_register(set, entry.fd, mode, mode | entry.mode))
+			return FALSE;
+	}
+#else
+	waitset_invalidate(set);
+#endif
+	set->entries[set->count] = entry;
+#endif
+	set->handles[set->count++] = hHandle;
+	return TRUE;
+}
+
+BOOL winpr_WaitSet_Remove(WINPR_WAIT_SET* set, HANDLE hHandle)
+{
+	size_t index;
+
+	if (!set)
+		return FALSE;
+
+	for (index = 0; index < set->count; index++)
+	{
+		if (set->handles[index] == hHandle)
+			break;
+	}
+
+	if (index == set->count)
+		return FALSE;
+
+	set->count--;
+	MoveMemory(&set->handles[index], &set->handles[index + 1],
+	           (set->count - index) * sizeof(HANDLE));
+#ifndef _WIN32
+	{
+		const WINPR_WAIT_SET_ENTRY entry = set->entries[index];
+		MoveMemory(&set->entries[index], &set->entries[index + 1],
+		           (set->count - index) * sizeof(WINPR_WAIT_SET_ENTRY));
+#ifdef HAVE_SYS_EPOLL_H
+		{
+			const ULONG mode = waitset_fd_mode(set, entry.fd);
+			waitset_register(set, entry.fd, mode | entry.mode, mode);
+		}
+#else
+		WINPR_UNUSED(entry);
+		waitset_invalidate(set);
+#endif
+	}
+#endif
+	return TRUE;
+}
+
+static void waitset_clear(WINPR_WAIT_SET* set)
+{
+	while (set->count > 0)
+		winpr_WaitSet_Remove(set, set->handles[set->count - 1]);
+}
+
+BOOL winpr_WaitSet_Update(WINPR_WAIT_SET* set, const HANDLE* lpHandles, DWORD nCount)
+{
+	DWORD x;
+
+	if (!set || (!lpHandles && nCount))
+		return FALSE;
+
+	if (nCount == set->count)
+	{
+		for (x = 0; x < nCount; x++)
+		{
+#ifndef _WIN32
+			WINPR_WAIT_SET_ENTRY entry;
+
+			/* A socket event can be pointed to another socket with WSAEventSelect */
+			if (!waitset_resolve(lpHandles[x], &entry))
+				return FALSE;
+
+			if ((entry.fd != set->entries[x].fd) || (entry.mode != set->entries[x].mode))
+				break;
+#endif
+			if (lpHandles[x] != set->handles[x])
+				break;
+		}
+
+		if (x == nCount)
+			return TRUE;
+	}
+
+	waitset_clear(set);
+
+	for (x = 0; x < nCount; x++)
+	{
+		if (!winpr_WaitSet_Add(set, lpHandles[x]))
+		{
+			waitset_clear(set);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+DWORD winpr_WaitSet_Count(const WINPR_WAIT_SET* set)
+{
+	if (!set)
+		return 0;
+
+	return (DWORD)set->count;
+}
+
+DWORD winpr_WaitSet_Wait(WINPR_WAIT_SET* set, DWORD dwMilliseconds)
+{
+#ifndef _WIN32
+	UINT64 now, dueTime;
+#endif
+
+	if (!set || !set->count)
+	{
+		WLog_ERR(TAG, "empty wait set");
+		SetLastError(ERROR_INVALID_PARAMETER);
+		return WAIT_FAILED;
+	}
+
+#ifdef _WIN32
+	return WaitForMultipleObjects((DWORD)set->count, set->handles, FALSE, dwMilliseconds);
+#else
+	now = GetTickCount64();
+
+	if (dwMilliseconds != INFINITE)
+		dueTime = now + dwMilliseconds;
+	else
+		dueTime = 0xFFFFFFFFFFFFFFFF;
+
+#ifndef HAVE_SYS_EPOLL_H
+	if (!set->pollsetValid)
+	{
+		size_t x;
+
+		if (!pollset_init(&set->pollset, set->count))
+		{
+			SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+			return WAIT_FAILED;
+		}
+
+		for (x = 0; x < set->count; x++)
+			pollset_add(&set->pollset, set->entries[x].fd, set->entries[x].mode);
+
+		set->pollsetValid = TRUE;
+	}
+#endif
+
+	do
+	{
+		int status;
+		size_t index = set->count;
+#ifdef HAVE_SYS_EPOLL_H
+		int x;
+		const int timeout = (dwMilliseconds == INFINITE) ? -1 : (int)(dueTime - now);
+		status = epoll_wait(set->epfd, set->events, (int)set->count, timeout);
+
+		if ((status < 0) && (errno != EINTR))
+		{
+			WLog_ERR(TAG, "epoll_wait failure [%d] %s", errno, strerror(errno));
+			SetLastError(ERROR_INTERNAL_ERROR);
+			return WAIT_FAILED;
+		}
+
+		/* Report the lowest signaled index, as WaitForMultipleObjects does */
+		for (x = 0; x < status; x++)
+		{
+			size_t y;
+			const struct epoll_event* event = &set->events[x];
+
+			for (y = 0; y < index; y++)
+			{
+				const WINPR_WAIT_SET_ENTRY* entry = &set->entries[y];
+
+				if ((entry->fd == event->data.fd) &&
+				    (event->events & waitset_mode_to_epoll(entry->mode)))
+				{
+					index = y;
+					break;
+				}
+			}
+		}
+#else
+		const DWORD timeout =
+		    (dwMilliseconds == INFINITE) ? INFINITE : (DWORD)(dueTime - now);
+		status = pollset_poll(&set->pollset, timeout);
+
+		if (status < 0)
+		{
+			WLog_ERR(TAG, "pollset_poll failure [%d] %s", errno, strerror(errno));
+			SetLastError(ERROR_INTERNAL_ERROR);
+			return WAIT_FAILED;
+		}
+
+		if (status > 0)
+		{
+			for (index = 0; index < set->count; index++)
+			{
+				if (pollset_isSignaled(&set->pollset, index))
+					break;
+			}
+		}
+#endif
+
+		if (index < set->count)
+		{
+			const DWORD rc = winpr_Handle_cleanup(set->handles[index]);
+
+			if (rc != WAIT_OBJECT_0)
+			{
+				WLog_ERR(TAG, "error in cleanup function for handle at index=%" PRIuz, index);
+				return rc;
+			}
+
+			return WAIT_OBJECT_0 + (DWORD)index;
+		}
+
+		now = GetTickCount64();
+	} while (now < dueTime);
+
+	return WAIT_TIMEOUT;
+#endif
+}
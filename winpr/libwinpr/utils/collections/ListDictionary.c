@@ -29,9 +29,104 @@
  * C equivalent of the C# ListDictionary Class:
  * http://msdn.microsoft.com/en-us/library/system.collections.specialized.listdictionary.aspx
  *
- * Internal implementation uses a singly-linked list
+ * Internal implementation uses a doubly-linked list that keeps insertion order,
+ * and a hash index over the key pointers for lookups with the default key comparison.
  */
 
+#define LIST_DICTIONARY_MIN_BUCKETS 16
+
+static BOOL default_equal_function(const void* obj1, const void* obj2)
+{
+	return (obj1 == obj2);
+}
+
+static size_t ListDictionary_Bucket(const wListDictionary* listDictionary, const void* key)
+{
+	/* Fibonacci hashing, keys are frequently small integers or aligned pointers */
+	const UINT64 hash = (UINT64)(ULONG_PTR)key * 0x9E3779B97F4A7C15ull;
+	return (size_t)(hash >> 32) & (listDictionary->numOfBuckets - 1);
+}
+
+/**
+ * Rebuilds the hash index with numOfBuckets buckets (a power of two).
+ * Bucket chains keep insertion order, so lookups find the oldest of duplicated keys first.
+ */
+
+static BOOL ListDictionary_Rehash(wListDictionary* listDictionary, size_t numOfBuckets)
+{
+	wListDictionaryItem* item;
+	wListDictionaryItem** buckets = (wListDictionaryItem**)calloc(numOfBuckets,
+	                                                              sizeof(wListDictionaryItem*));
+
+	if (!buckets)
+		return FALSE;
+
+	free(listDictionary->buckets);
+	listDictionary->buckets = buckets;
+	listDictionary->numOfBuckets = numOfBuckets;
+
+	for (item = listDictionary->tail; item; item = item->prev)
+	{
+		const size_t bucket = ListDictionary_Bucket(listDictionary, item->key);
+		item->bucketNext = buckets[bucket];
+		buckets[bucket] = item;
+	}
+
+	return TRUE;
+}
+
+static wListDictionaryItem* ListDictionary_Find(wListDictionary* listDictionary, const void* key)
+{
+	wListDictionaryItem* item;
+	const OBJECT_EQUALS_FN keyEquals = listDictionary->objectKey.fnObjectEquals;
+
+	/* The index hashes key pointers and only matches pointer comparison */
+	if ((keyEquals == default_equal_function) && listDictionary->buckets)
+	{
+		item = listDictionary->buckets[ListDictionary_Bucket(listDictionary, key)];
+
+		while (item && (item->key != key))
+			item = item->bucketNext;
+
+		return item;
+	}
+
+	item = listDictionary->head;
+
+	while (item)
+	{
+		if (keyEquals(item->key, key))
+			break;
+
+		item = item->next;
+	}
+
+	return item;
+}
+
+static void ListDictionary_Unlink(wListDictionary* listDictionary, wListDictionaryItem* item)
+{
+	wListDictionaryItem** link;
+
+	if (item->prev)
+		item->prev->next = item->next;
+	else
+		listDictionary->head = item->next;
+
+	if (item->next)
+		item->next->prev = item->prev;
+	else
+		listDictionary->tail = item->prev;
+
+	link = &listDictionary->buckets[ListDictionary_Bucket(listDictionary, item->key)];
+
+	while (*link != item)
+		link = &(*link)->bucketNext;
+
+	*link = item->bucketNext;
+	listDictionary->count--;
+}
+
 /**
  * Properties
  */
@@ -42,8 +137,7 @@
 
 int ListDictionary_Count(wListDictionary* listDictionary)
 {
-	int count = 0;
-	wListDictionaryItem* item;
+	int count;
 
 	if (!listDictionary)
 		return -1;
@@ -51,16 +145,7 @@ int ListDictionary_Count(wListDictionary* listDictionary)
 	if (listDictionary->synchronized)
 		EnterCriticalSection(&listDictionary->lock);
 
-	if (listDictionary->head)
-	{
-		item = listDictionary->head;
-
-		while (item)
-		{
-			count++;
-			item = item->next;
-		}
-	}
+	count = (int)listDictionary->count;
 
 	if (listDictionary->synchronized)
 		LeaveCriticalSection(&listDictionary->lock);
@@ -113,18 +198,7 @@ int ListDictionary_GetKeys(wListDictionary* listDictionary, ULONG_PTR** ppKeys)
 	if (listDictionary->synchronized)
 		EnterCriticalSection(&listDictionary->lock);
 
-	count = 0;
-
-	if (listDictionary->head)
-	{
-		item = listDictionary->head;
-
-		while (item)
-		{
-			count++;
-			item = item->next;
-		}
-	}
+	count = (int)listDictionary->count;
 
 	if (count)
 	{
@@ -140,16 +214,12 @@ int ListDictionary_GetKeys(wListDictionary* listDictionary, ULONG_PTR** ppKeys)
 	}
 
 	index = 0;
+	item = listDictionary->head;
 
-	if (listDictionary->head)
+	while (item)
 	{
-		item = listDictionary->head;
-
-		while (item)
-		{
-			pKeys[index++] = (ULONG_PTR)item->key;
-			item = item->next;
-		}
+		pKeys[index++] = (ULONG_PTR)item->key;
+		item = item->next;
 	}
 
 	*ppKeys = pKeys;
@@ -167,7 +237,7 @@ int ListDictionary_GetKeys(wListDictionary* listDictionary, ULONG_PTR** ppKeys)
 BOOL ListDictionary_Add(wListDictionary* listDictionary, const void* key, void* value)
 {
 	wListDictionaryItem* item;
-	wListDictionaryItem* lastItem;
+	wListDictionaryItem** link;
 	BOOL ret = FALSE;
 
 	if (!listDictionary)
@@ -176,6 +246,16 @@ BOOL ListDictionary_Add(wListDictionary* listDictionary, const void* key, void*
 	if (listDictionary->synchronized)
 		EnterCriticalSection(&listDictionary->lock);
 
+	if (listDictionary->count >= listDictionary->numOfBuckets)
+	{
+		const size_t numOfBuckets = listDictionary->numOfBuckets
+		                                ? listDictionary->numOfBuckets * 2
+		                                : LIST_DICTIONARY_MIN_BUCKETS;
+
+		if (!ListDictionary_Rehash(listDictionary, numOfBuckets))
+			goto out_error;
+	}
+
 	item = (wListDictionaryItem*)malloc(sizeof(wListDictionaryItem));
 
 	if (!item)
@@ -184,21 +264,22 @@ BOOL ListDictionary_Add(wListDictionary* listDictionary, const void* key, void*
 	item->key = (void*)key;
 	item->value = value;
 	item->next = NULL;
+	item->prev = listDictionary->tail;
+	item->bucketNext = NULL;
 
-	if (!listDictionary->head)
-	{
-		listDictionary->head = item;
-	}
+	if (listDictionary->tail)
+		listDictionary->tail->next = item;
 	else
-	{
-		lastItem = listDictionary->head;
+		listDictionary->head = item;
 
-		while (lastItem->next)
-			lastItem = lastItem->next;
+	listDictionary->tail = item;
+	link = &listDictionary->buckets[ListDictionary_Bucket(listDictionary, key)];
 
-		lastItem->next = item;
-	}
+	while (*link)
+		link = &(*link)->bucketNext;
 
+	*link = item;
+	listDictionary->count++;
 	ret = TRUE;
 out_error:
 
@@ -242,6 +323,10 @@ void ListDictionary_Clear(wListDictionary* listDictionary)
 		}
 
 		listDictionary->head = NULL;
+		listDictionary->tail = NULL;
+		listDictionary->count = 0;
+		ZeroMemory(listDictionary->buckets,
+		           listDictionary->numOfBuckets * sizeof(wListDictionaryItem*));
 	}
 
 	if (listDictionary->synchronized)
@@ -255,7 +340,6 @@ void ListDictionary_Clear(wListDictionary* listDictionary)
 BOOL ListDictionary_Contains(wListDictionary* listDictionary, const void* key)
 {
 	wListDictionaryItem* item;
-	OBJECT_EQUALS_FN keyEquals;
 
 	if (!listDictionary)
 		return FALSE;
@@ -263,16 +347,7 @@ BOOL ListDictionary_Contains(wListDictionary* listDictionary, const void* key)
 	if (listDictionary->synchronized)
 		EnterCriticalSection(&(listDictionary->lock));
 
-	keyEquals = listDictionary->objectKey.fnObjectEquals;
-	item = listDictionary->head;
-
-	while (item)
-	{
-		if (keyEquals(item->key, key))
-			break;
-
-		item = item->next;
-	}
+	item = ListDictionary_Find(listDictionary, key);
 
 	if (listDictionary->synchronized)
 		LeaveCriticalSection(&(listDictionary->lock));
@@ -288,8 +363,6 @@ void* ListDictionary_Remove(wListDictionary* listDictionary, const void* key)
 {
 	void* value = NULL;
 	wListDictionaryItem* item;
-	wListDictionaryItem* prevItem;
-	OBJECT_EQUALS_FN keyEquals;
 
 	if (!listDictionary)
 		return NULL;
@@ -297,26 +370,13 @@ void* ListDictionary_Remove(wListDictionary* listDictionary, const void* key)
 	if (listDictionary->synchronized)
 		EnterCriticalSection(&listDictionary->lock);
 
-	keyEquals = listDictionary->objectKey.fnObjectEquals;
-	item = listDictionary->head;
-	prevItem = NULL;
+	item = ListDictionary_Find(listDictionary, key);
 
-	while (item)
+	if (item)
 	{
-		if (keyEquals(item->key, key))
-		{
-			if (!prevItem)
-				listDictionary->head = item->next;
-			else
-				prevItem->next = item->next;
-
-			value = item->value;
-			free(item);
-			break;
-		}
-
-		prevItem = item;
-		item = item->next;
+		ListDictionary_Unlink(listDictionary, item);
+		value = item->value;
+		free(item);
 	}
 
 	if (listDictionary->synchronized)
@@ -343,7 +403,7 @@ void* ListDictionary_Remove_Head(wListDictionary* listDictionary)
 	if (listDictionary->head)
 	{
 		item = listDictionary->head;
-		listDictionary->head = listDictionary->head->next;
+		ListDictionary_Unlink(listDictionary, item);
 		value = item->value;
 		free(item);
 	}
@@ -362,7 +422,6 @@ void* ListDictionary_GetItemValue(wListDictionary* listDictionary, const void* k
 {
 	void* value = NULL;
 	wListDictionaryItem* item = NULL;
-	OBJECT_EQUALS_FN keyEquals;
 
 	if (!listDictionary)
 		return NULL;
@@ -370,21 +429,7 @@ void* ListDictionary_GetItemValue(wListDictionary* listDictionary, const void* k
 	if (listDictionary->synchronized)
 		EnterCriticalSection(&listDictionary->lock);
 
-	keyEquals = listDictionary->objectKey.fnObjectEquals;
-
-	if (listDictionary->head)
-	{
-		item = listDictionary->head;
-
-		while (item)
-		{
-			if (keyEquals(item->key, key))
-				break;
-
-			item = item->next;
-		}
-	}
-
+	item = ListDictionary_Find(listDictionary, key);
 	value = (item) ? item->value : NULL;
 
 	if (listDictionary->synchronized)
@@ -401,7 +446,6 @@ BOOL ListDictionary_SetItemValue(wListDictionary* listDictionary, const void* ke
 {
 	BOOL status = FALSE;
 	wListDictionaryItem* item;
-	OBJECT_EQUALS_FN keyEquals;
 
 	if (!listDictionary)
 		return FALSE;
@@ -409,29 +453,15 @@ BOOL ListDictionary_SetItemValue(wListDictionary* listDictionary, const void* ke
 	if (listDictionary->synchronized)
 		EnterCriticalSection(&listDictionary->lock);
 
-	keyEquals = listDictionary->objectKey.fnObjectEquals;
+	item = ListDictionary_Find(listDictionary, key);
 
-	if (listDictionary->head)
+	if (item)
 	{
-		item = listDictionary->head;
-
-		while (item)
-		{
-			if (keyEquals(item->key, key))
-				break;
+		if (listDictionary->objectValue.fnObjectFree)
+			listDictionary->objectValue.fnObjectFree(item->value);
 
-			item = item->next;
-		}
-
-		if (item)
-		{
-			if (listDictionary->objectValue.fnObjectFree)
-				listDictionary->objectValue.fnObjectFree(item->value);
-
-			item->value = value;
-		}
-
-		status = (item) ? TRUE : FALSE;
+		item->value = value;
+		status = TRUE;
 	}
 
 	if (listDictionary->synchronized)
@@ -440,10 +470,6 @@ BOOL ListDictionary_SetItemValue(wListDictionary* listDictionary, const void* ke
 	return status;
 }
 
-static BOOL default_equal_function(const void* obj1, const void* obj2)
-{
-	return (obj1 == obj2);
-}
 /**
  * Construction, Destruction
  */
@@ -475,6 +501,7 @@ void ListDictionary_Free(wListDictionary* listDictionary)
 	{
 		ListDictionary_Clear(listDictionary);
 		DeleteCriticalSection(&listDictionary->lock);
+		free(listDictionary->buckets);
 		free(listDictionary);
 	}
 }
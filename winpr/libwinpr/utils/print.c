@@ -33,7 +33,7 @@
 
 #include "../log.h"
 
-#define MIN(a, b) (a) < (b) ? (a) : (b)
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
 
 void winpr_HexDump(const char* tag, UINT32 level, const BYTE* data, size_t length)
 {
@@ -160,15 +160,48 @@ void winpr_CArrayDump(const char* tag, UINT32 level, const BYTE* data, int lengt
 	free(buffer);
 }
 
+/* Two hex digits per byte value, a byte is converted with a single lookup */
+static const char bin2hex[] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+/* Values of the hex digits, 0 for anything else */
+static const BYTE hex2bin[256] = {
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  0,  0,  0,  0,  0,  0,
+	 0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0, 10, 11, 12, 13, 14, 15,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
 static BYTE value(char c)
 {
-	if ((c >= '0') && (c <= '9'))
-		return c - '0';
-	if ((c >= 'A') && (c <= 'F'))
-		return 10 + c - 'A';
-	if ((c >= 'a') && (c <= 'f'))
-		return 10 + c - 'a';
-	return 0;
+	return hex2bin[(BYTE)c];
 }
 
 size_t winpr_HexStringToBinBuffer(const char* str, size_t strLength, BYTE* data, size_t dataLength)
@@ -199,41 +232,45 @@ size_t winpr_HexStringToBinBuffer(const char* str, size_t strLength, BYTE* data,
 size_t winpr_BinToHexStringBuffer(const BYTE* data, size_t length, char* dstStr, size_t dstSize,
                                   BOOL space)
 {
-	const size_t n = space ? 3 : 2;
-	const char bin2hex[] = "0123456789ABCDEF";
-	const size_t maxLength = MIN(length, dstSize / n);
 	size_t i;
+	char* dst = dstStr;
+	/* The separator after the last byte is replaced by the terminating NUL */
+	const size_t maxLength = MIN(length, space ? dstSize / 3 : (dstSize - 1) / 2);
 
 	if (!data || !dstStr || (length == 0) || (dstSize == 0))
 		return 0;
 
-	for (i = 0; i < maxLength; i++)
+	if (space)
 	{
-		const int ln = data[i] & 0xF;
-		const int hn = (data[i] >> 4) & 0xF;
-		char* dst = &dstStr[i * n];
-
-		dst[0] = bin2hex[hn];
-		dst[1] = bin2hex[ln];
-
-		if (space)
+		for (i = 0; i < maxLength; i++, dst += 3)
+		{
+			const char* hex = &bin2hex[data[i] * 2];
+			dst[0] = hex[0];
+			dst[1] = hex[1];
 			dst[2] = ' ';
-	}
+		}
 
-	if (space && (maxLength > 0))
+		if (maxLength > 0)
+			dst--;
+	}
+	else
 	{
-		dstStr[maxLength * n - 1] = '\0';
-		return maxLength * n - 1;
+		for (i = 0; i < maxLength; i++, dst += 2)
+		{
+			const char* hex = &bin2hex[data[i] * 2];
+			dst[0] = hex[0];
+			dst[1] = hex[1];
+		}
 	}
-	dstStr[maxLength * n] = '\0';
-	return maxLength * n;
+
+	*dst = '\0';
+	return (size_t)(dst - dstStr);
 }
 
 char* winpr_BinToHexString(const BYTE* data, size_t length, BOOL space)
 {
 	size_t rc;
-	const size_t n = space ? 3 : 2;
-	const size_t size = (length + 1ULL) * n;
+	const size_t size = space ? (length + 1ULL) * 3 : length * 2ULL + 1;
 	char* p = (char*)malloc(size);
 
 	if (!p)
@@ -1,8 +1,11 @@
 
 #include <winpr/crt.h>
 #include <winpr/tchar.h>
+#include <winpr/sysinfo.h>
 #include <winpr/collections.h>
 
+#define TEST_HANDLE_COUNT 20000
+
 static char* key1 = "key1";
 static char* key2 = "key2";
 static char* key3 = "key3";
@@ -11,6 +14,100 @@ static char* val1 = "val1";
 static char* val2 = "val2";
 static char* val3 = "val3";
 
+static BOOL test_string_equals(const void* obj1, const void* obj2)
+{
+	return strcmp((const char*)obj1, (const char*)obj2) == 0;
+}
+
+/* Duplicated keys resolve to the oldest entry, custom comparisons still work */
+static BOOL test_list_dictionary_semantics(void)
+{
+	BOOL rc = FALSE;
+	char key[] = "key2";
+	wListDictionary* list = ListDictionary_New(FALSE);
+
+	if (!list)
+		return FALSE;
+
+	if (!ListDictionary_Add(list, key1, val1) || !ListDictionary_Add(list, key1, val2) ||
+	    !ListDictionary_Add(list, key2, val3))
+		goto fail;
+
+	if (ListDictionary_GetItemValue(list, key1) != val1)
+		goto fail;
+
+	if ((ListDictionary_Remove(list, key1) != val1) ||
+	    (ListDictionary_GetItemValue(list, key1) != val2))
+		goto fail;
+
+	/* A copy of key2 only matches with a string comparison */
+	if (ListDictionary_Contains(list, key))
+		goto fail;
+
+	ListDictionary_KeyObject(list)->fnObjectEquals = test_string_equals;
+
+	if (ListDictionary_GetItemValue(list, key) != val3)
+		goto fail;
+
+	if ((ListDictionary_Remove(list, key) != val3) || (ListDictionary_Count(list) != 1))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	ListDictionary_Free(list);
+	return rc;
+}
+
+/* Simulates a redirected drive with many open file handles keyed by id */
+static BOOL test_list_dictionary_handles(void)
+{
+	size_t x;
+	BOOL rc = FALSE;
+	UINT64 start;
+	wListDictionary* list = ListDictionary_New(TRUE);
+
+	if (!list)
+		return FALSE;
+
+	start = GetTickCount64();
+
+	for (x = 1; x <= TEST_HANDLE_COUNT; x++)
+	{
+		if (!ListDictionary_Add(list, (void*)x, (void*)(x * 2)))
+			goto fail;
+	}
+
+	for (x = 1; x <= TEST_HANDLE_COUNT; x++)
+	{
+		const size_t key = (x * 7919) % TEST_HANDLE_COUNT + 1;
+
+		if (ListDictionary_GetItemValue(list, (void*)key) != (void*)(key * 2))
+			goto fail;
+	}
+
+	for (x = 1; x <= TEST_HANDLE_COUNT; x += 2)
+	{
+		if (ListDictionary_Remove(list, (void*)x) != (void*)(x * 2))
+			goto fail;
+	}
+
+	if (ListDictionary_Count(list) != TEST_HANDLE_COUNT / 2)
+		goto fail;
+
+	for (x = 2; x <= TEST_HANDLE_COUNT; x += 2)
+	{
+		if (ListDictionary_Remove_Head(list) != (void*)(x * 2))
+			goto fail;
+	}
+
+	printf("ListDictionary: %d handles added, looked up and removed in %" PRIu64 " ms\n",
+	       TEST_HANDLE_COUNT, GetTickCount64() - start);
+	rc = (ListDictionary_Count(list) == 0);
+fail:
+	ListDictionary_Free(list);
+	return rc;
+}
+
 int TestListDictionary(int argc, char* argv[])
 {
 	int count;
@@ -174,5 +271,17 @@ int TestListDictionary(int argc, char* argv[])
 
 	ListDictionary_Free(list);
 
+	if (!test_list_dictionary_semantics())
+	{
+		printf("ListDictionary: key semantics changed\n");
+		return -1;
+	}
+
+	if (!test_list_dictionary_handles())
+	{
+		printf("ListDictionary: handle lookups failed\n");
+		return -1;
+	}
+
 	return 0;
 }
@@ -121,6 +121,27 @@ static BOOL test_bin_tohex_string(void)
 			goto fail;
 	}
 	{
+		/* Output is truncated to whole bytes, the terminating NUL always fits */
+		const BYTE binbuffer1[] = { 0xAB, 0xCD, 0xEF };
+		char buffer[8];
+		size_t len;
+
+		memset(buffer, 'x', sizeof(buffer));
+		len = winpr_BinToHexStringBuffer(binbuffer1, sizeof(binbuffer1), buffer, 6, FALSE);
+		if ((len != 4) || (memcmp(buffer, "ABCD\0x", 6) != 0))
+			goto fail;
+		memset(buffer, 'x', sizeof(buffer));
+		len = winpr_BinToHexStringBuffer(binbuffer1, sizeof(binbuffer1), buffer, 7, FALSE);
+		if ((len != 6) || (memcmp(buffer, "ABCDEF\0x", 8) != 0))
+			goto fail;
+		memset(buffer, 'x', sizeof(buffer));
+		len = winpr_BinToHexStringBuffer(binbuffer1, sizeof(binbuffer1), buffer, 1, FALSE);
+		if ((len != 0) || (buffer[0] != '\0') || (buffer[1] != 'x'))
+			goto fail;
+		memset(buffer, 'x', sizeof(buffer));
+		len = winpr_BinToHexStringBuffer(binbuffer1, sizeof(binbuffer1), buffer, 6, TRUE);
+		if ((len != 5) || (memcmp(buffer, "AB CD\0x", 7) != 0))
+			goto fail;
 	}
 	rc = TRUE;
 fail: